@@ -0,0 +1,160 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Minimal microbenchmark harness.
+ *
+ * Each benchmark is a function which does its setup and then loops on
+ * State::keepRunning(), reporting how many items (calls, lookups, ...) and
+ * bytes each iteration processed:
+ *
+ *   BENCHMARK(foo) {
+ *       setup();
+ *       while (state.keepRunning()) {
+ *           work();
+ *           state.addItems(n);
+ *       }
+ *   }
+ */
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <vector>
+
+
+namespace bench {
+
+
+/* Run each benchmark once, on reduced inputs (for smoke testing). */
+extern bool quick;
+
+
+class State
+{
+    double minTime;
+    int64_t start;
+    int64_t stop;
+    int64_t paused;
+    unsigned long long iterations;
+    unsigned long long items;
+    unsigned long long bytes;
+
+public:
+    State(double _minTime);
+
+    /* Returns false once the benchmark ran for long enough. */
+    bool
+    keepRunning(void);
+
+    /* Exclude setup work done inside the loop from the measurement. */
+    void
+    pauseTiming(void);
+
+    void
+    resumeTiming(void);
+
+    inline void
+    addItems(unsigned long long n) {
+        items += n;
+    }
+
+    inline void
+    addBytes(unsigned long long n) {
+        bytes += n;
+    }
+
+    inline unsigned long long
+    getIterations(void) const {
+        return iterations;
+    }
+
+    inline unsigned long long
+    getItems(void) const {
+        return items;
+    }
+
+    inline unsigned long long
+    getBytes(void) const {
+        return bytes;
+    }
+
+    double
+    getSeconds(void) const;
+};
+
+
+typedef void (*Function)(State &state);
+
+
+struct Benchmark
+{
+    const char *name;
+    Function function;
+};
+
+
+std::vector<Benchmark> &
+registry(void);
+
+
+struct Registration
+{
+    Registration(const char *name, Function function) {
+        Benchmark benchmark = {name, function};
+        registry().push_back(benchmark);
+    }
+};
+
+
+/* Scale an input size down when running in quick mode. */
+inline unsigned
+size(unsigned n) {
+    return quick ? (n + 99) / 100 : n;
+}
+
+
+/* Prevent the compiler from optimizing away a computed value. */
+template< class T >
+inline void
+doNotOptimize(const T &value) {
+#if defined(__GNUC__)
+    __asm__ __volatile__("" : : "g"(value) : "memory");
+#else
+    static volatile const T *sink;
+    sink = &value;
+#endif
+}
+
+
+} /* namespace bench */
+
+
+#define BENCHMARK(_name) \
+    static void _name(bench::State &state); \
+    static bench::Registration _name##_registration(#_name, _name); \
+    static void _name(bench::State &state)
@@ -0,0 +1,214 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "os_process.hpp"
+#include "benchmark.hpp"
+#include "benchmark_calls.hpp"
+
+
+namespace bench {
+
+
+enum {
+    SIG_BIND_TEXTURE,
+    SIG_UNIFORM,
+    SIG_DRAW_ELEMENTS,
+    SIG_BUFFER_SUB_DATA,
+    SIG_SWAP_BUFFERS,
+};
+
+
+const char *callNames[] = {
+    "glBindTexture",
+    "glUniform4f",
+    "glDrawElements",
+    "glBufferSubData",
+    "glXSwapBuffers",
+    nullptr
+};
+
+
+static const char *bindTextureArgs[] = {"target", "texture"};
+static const char *uniformArgs[] = {"location", "v0", "v1", "v2", "v3"};
+static const char *drawElementsArgs[] = {"mode", "count", "type", "indices"};
+static const char *bufferSubDataArgs[] = {"target", "offset", "size", "data"};
+static const char *swapBuffersArgs[] = {"dpy", "drawable"};
+
+static const trace::FunctionSig bindTextureSig = {SIG_BIND_TEXTURE, callNames[SIG_BIND_TEXTURE], 2, bindTextureArgs};
+static const trace::FunctionSig uniformSig = {SIG_UNIFORM, callNames[SIG_UNIFORM], 5, uniformArgs};
+static const trace::FunctionSig drawElementsSig = {SIG_DRAW_ELEMENTS, callNames[SIG_DRAW_ELEMENTS], 4, drawElementsArgs};
+static const trace::FunctionSig bufferSubDataSig = {SIG_BUFFER_SUB_DATA, callNames[SIG_BUFFER_SUB_DATA], 4, bufferSubDataArgs};
+static const trace::FunctionSig swapBuffersSig = {SIG_SWAP_BUFFERS, callNames[SIG_SWAP_BUFFERS], 2, swapBuffersArgs};
+
+static const trace::EnumValue enumValues[] = {
+    {"GL_TRIANGLES", 0x0004},
+    {"GL_UNSIGNED_SHORT", 0x1403},
+    {"GL_TEXTURE_2D", 0x0DE1},
+    {"GL_ARRAY_BUFFER", 0x8892},
+};
+static const trace::EnumSig enumSig = {0, sizeof enumValues / sizeof enumValues[0], enumValues};
+
+
+unsigned long long
+writeCalls(trace::Writer &writer, unsigned count)
+{
+    static char data[4096];
+    static bool initialized = false;
+    if (!initialized) {
+        // low entropy noise, so that blobs are only partially compressible
+        uint32_t x = 1;
+        for (size_t i = 0; i < sizeof data; ++i) {
+            x = x * 1103515245 + 12345;
+            data[i] = (x >> 16) & 0x3f;
+        }
+        initialized = true;
+    }
+
+    unsigned long long blobBytes = 0;
+
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned call;
+        switch (i % 16) {
+        case 0:
+        case 4:
+        case 8:
+            call = writer.beginEnter(&bindTextureSig, 0);
+            writer.beginArg(0);
+            writer.writeEnum(&enumSig, 0x0DE1);
+            writer.endArg();
+            writer.beginArg(1);
+            writer.writeUInt(1 + i % 64);
+            writer.endArg();
+            writer.endEnter();
+            break;
+        case 12: {
+            size_t size = 64 + (i % 256) * 8;
+            call = writer.beginEnter(&bufferSubDataSig, 0);
+            writer.beginArg(0);
+            writer.writeEnum(&enumSig, 0x8892);
+            writer.endArg();
+            writer.beginArg(1);
+            writer.writeSInt(0);
+            writer.endArg();
+            writer.beginArg(2);
+            writer.writeSInt(size);
+            writer.endArg();
+            writer.beginArg(3);
+            writer.writeBlob(data, size);
+            writer.endArg();
+            writer.endEnter();
+            blobBytes += size;
+            break;
+        }
+        case 15:
+            call = writer.beginEnter(&swapBuffersSig, 0);
+            writer.beginArg(0);
+            writer.writePointer(0x1000);
+            writer.endArg();
+            writer.beginArg(1);
+            writer.writeUInt(0x2000);
+            writer.endArg();
+            writer.endEnter();
+            break;
+        default:
+            if (i % 2) {
+                call = writer.beginEnter(&uniformSig, 0);
+                writer.beginArg(0);
+                writer.writeSInt(i % 32);
+                writer.endArg();
+                for (unsigned j = 1; j < 5; ++j) {
+                    writer.beginArg(j);
+                    writer.writeFloat(0.25f * j + i);
+                    writer.endArg();
+                }
+                writer.endEnter();
+            } else {
+                call = writer.beginEnter(&drawElementsSig, 0);
+                writer.beginArg(0);
+                writer.writeEnum(&enumSig, 0x0004);
+                writer.endArg();
+                writer.beginArg(1);
+                writer.writeSInt(3 * (i % 1000));
+                writer.endArg();
+                writer.beginArg(2);
+                writer.writeEnum(&enumSig, 0x1403);
+                writer.endArg();
+                writer.beginArg(3);
+                writer.writePointer(0);
+                writer.endArg();
+                writer.endEnter();
+            }
+            break;
+        }
+        writer.beginLeave(call);
+        writer.endLeave();
+    }
+
+    return blobBytes;
+}
+
+
+TempFile::TempFile(const char *suffix)
+{
+#ifdef _WIN32
+    path = os::getTemporaryDirectoryPath();
+#else
+    const char *tmpdir = getenv("TMPDIR");
+    path = tmpdir ? tmpdir : "/tmp";
+#endif
+    path.join(os::String::format("apitrace-benchmark-%u%s",
+                                 unsigned(os::getCurrentProcessId()), suffix));
+}
+
+
+TempFile::~TempFile()
+{
+    remove(path.str());
+}
+
+
+const char *
+getTraceFile(void)
+{
+    static TempFile file(".trace");
+    static bool written = false;
+    if (!written) {
+        trace::Writer writer;
+        if (writer.open(file.str())) {
+            writeCalls(writer, size(200000));
+        }
+        written = true;
+    }
+    return file.str();
+}
+
+
+} /* namespace bench */
@@ -0,0 +1,74 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Synthetic GL-like calls shared by the benchmarks.
+ */
+
+#pragma once
+
+
+#include "os_string.hpp"
+#include "trace_writer.hpp"
+
+
+namespace bench {
+
+
+/* Names of the functions written by writeCalls. */
+extern const char *callNames[];
+
+
+/*
+ * Write count calls with a typical mix of state changes, uniform updates,
+ * draws, buffer uploads and frame ends.  Returns the number of blob bytes
+ * written.
+ */
+unsigned long long
+writeCalls(trace::Writer &writer, unsigned count);
+
+
+/* Name of a temporary file, removed by the destructor. */
+class TempFile
+{
+    os::String path;
+
+public:
+    TempFile(const char *suffix);
+    ~TempFile();
+
+    inline const char *
+    str(void) const {
+        return path.str();
+    }
+};
+
+
+/* Snappy compressed trace of writeCalls, written on first use. */
+const char *
+getTraceFile(void);
+
+
+} /* namespace bench */
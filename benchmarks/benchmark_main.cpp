@@ -0,0 +1,241 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include "os_time.hpp"
+#include "state_writer.hpp"
+#include "benchmark.hpp"
+
+
+namespace bench {
+
+
+bool quick = false;
+
+
+State::State(double _minTime) :
+    minTime(_minTime),
+    start(0),
+    stop(0),
+    paused(0),
+    iterations(0),
+    items(0),
+    bytes(0)
+{
+}
+
+
+bool
+State::keepRunning(void) {
+    int64_t now = os::getTime();
+    if (iterations == 0) {
+        start = now;
+    }
+    stop = now;
+    if (iterations > 0 &&
+        (quick || getSeconds() >= minTime)) {
+        return false;
+    }
+    ++iterations;
+    return true;
+}
+
+
+void
+State::pauseTiming(void) {
+    paused = os::getTime();
+}
+
+
+void
+State::resumeTiming(void) {
+    start += os::getTime() - paused;
+}
+
+
+double
+State::getSeconds(void) const {
+    return double(stop - start) / os::timeFrequency;
+}
+
+
+std::vector<Benchmark> &
+registry(void) {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+
+} /* namespace bench */
+
+
+static void
+usage(const char *argv0)
+{
+    std::cout
+        << "usage: " << argv0 << " [OPTIONS]\n"
+        << "Run apitrace microbenchmarks.\n"
+        << "\n"
+        << "  -h, --help            show this help message and exit\n"
+        << "  -l, --list            list benchmarks and exit\n"
+        << "  -f, --filter=STRING   only run benchmarks whose name contains STRING\n"
+        << "  -o, --output=FILE     write results as JSON to FILE\n"
+        << "      --min-time=SECS   minimum time to run each benchmark (default 0.5)\n"
+        << "      --quick           run each benchmark once on small inputs\n"
+    ;
+}
+
+
+enum {
+    MIN_TIME_OPT = CHAR_MAX + 1,
+    QUICK_OPT,
+};
+
+const static char *
+shortOptions = "hlf:o:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"list", no_argument, 0, 'l'},
+    {"filter", required_argument, 0, 'f'},
+    {"output", required_argument, 0, 'o'},
+    {"min-time", required_argument, 0, MIN_TIME_OPT},
+    {"quick", no_argument, 0, QUICK_OPT},
+    {0, 0, 0, 0}
+};
+
+
+int
+main(int argc, char **argv)
+{
+    const char *filter = nullptr;
+    const char *output = nullptr;
+    double minTime = 0.5;
+    bool list = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        case 'l':
+            list = true;
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case MIN_TIME_OPT:
+            minTime = atof(optarg);
+            break;
+        case QUICK_OPT:
+            bench::quick = true;
+            break;
+        default:
+            std::cerr << "error: unknown option " << opt << "\n";
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::ofstream os;
+    std::unique_ptr<StateWriter> writer;
+    if (output) {
+        os.open(output);
+        if (!os) {
+            std::cerr << "error: failed to create " << output << "\n";
+            return 1;
+        }
+        // the top level object is implicit
+        writer.reset(createJSONStateWriter(os));
+        writer->writeBoolMember("quick", bench::quick);
+        writer->writeFloatMember("min_time", minTime);
+        writer->beginMember("benchmarks");
+        writer->beginArray();
+    }
+
+    for (auto &benchmark : bench::registry()) {
+        if (filter && !strstr(benchmark.name, filter)) {
+            continue;
+        }
+        if (list) {
+            std::cout << benchmark.name << "\n";
+            continue;
+        }
+
+        bench::State state(minTime);
+        benchmark.function(state);
+
+        double seconds = state.getSeconds();
+        double itemsPerSecond = seconds > 0 ? state.getItems() / seconds : 0;
+        double bytesPerSecond = seconds > 0 ? state.getBytes() / seconds : 0;
+
+        std::cout << std::left << std::setw(32) << benchmark.name << std::right
+                  << std::fixed << std::setprecision(3);
+        if (state.getItems()) {
+            std::cout << std::setw(12) << itemsPerSecond / 1e6 << " M items/s";
+        } else {
+            std::cout << std::setw(22) << "";
+        }
+        if (state.getBytes()) {
+            std::cout << std::setw(12) << bytesPerSecond / (1024 * 1024) << " MB/s";
+        }
+        std::cout << std::endl;
+
+        if (writer) {
+            writer->beginObject();
+            writer->writeStringMember("name", benchmark.name);
+            writer->writeIntMember("iterations", state.getIterations());
+            writer->writeFloatMember("seconds", seconds);
+            writer->writeIntMember("items", state.getItems());
+            writer->writeFloatMember("items_per_second", itemsPerSecond);
+            writer->writeIntMember("bytes", state.getBytes());
+            writer->writeFloatMember("bytes_per_second", bytesPerSecond);
+            writer->endObject();
+        }
+    }
+
+    if (writer) {
+        writer->endArray();
+        writer->endMember();
+        writer.reset();
+    }
+
+    return 0;
+}
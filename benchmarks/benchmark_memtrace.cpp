@@ -0,0 +1,86 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Benchmark of the hashing used to detect changes to mapped/user memory
+ * while tracing.
+ */
+
+
+#include <string.h>
+
+#include <vector>
+
+#include "memtrace.hpp"
+#include "benchmark.hpp"
+
+
+using namespace bench;
+
+
+static size_t changedBytes = 0;
+
+static void
+changed(const void *ptr, size_t size) {
+    changedBytes += size;
+}
+
+
+static void
+memoryShadowUpdate(State &state, size_t stride)
+{
+    const size_t length = size_t(size(64)) * 16 * 1024;
+
+    std::vector<unsigned char> buffer(length + 1024);
+    // Misalign the buffer, like user memory often is, and leave room for
+    // hashing whole blocks past its end.
+    unsigned char *ptr = &buffer[13];
+    memset(ptr, 0, length);
+
+    MemoryShadow shadow;
+    shadow.cover(ptr, length, false);
+
+    unsigned char value = 0;
+    while (state.keepRunning()) {
+        if (stride) {
+            ++value;
+            for (size_t i = 0; i < length; i += stride) {
+                ptr[i] = value;
+            }
+        }
+        shadow.update(changed);
+        state.addBytes(length);
+    }
+}
+
+
+BENCHMARK(memory_shadow_unchanged) {
+    memoryShadowUpdate(state, 0);
+}
+
+
+BENCHMARK(memory_shadow_sparse_changes) {
+    memoryShadowUpdate(state, 64 * 1024);
+}
@@ -0,0 +1,257 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Retrace infrastructure benchmarks.  No API is actually called: callbacks
+ * are stubs, so that only the dispatch and lookup overheads are measured.
+ */
+
+
+#include <vector>
+
+#include "trace_parser.hpp"
+#include "retrace.hpp"
+#include "retrace_swizzle.hpp"
+#include "benchmark.hpp"
+#include "benchmark_calls.hpp"
+
+
+using namespace bench;
+
+
+/*
+ * Globals normally defined by retrace_main.cpp.
+ */
+namespace retrace {
+    trace::AbstractParser *parser = nullptr;
+    trace::Profiler profiler;
+    int verbosity = -1;
+    unsigned debug = 0;
+    bool markers = false;
+    bool snapshotMRT = false;
+    bool forceWindowed = true;
+    unsigned curPass = 0;
+    unsigned numPasses = 1;
+    bool profilingWithBackends = false;
+    char *profilingCallsMetricsString = nullptr;
+    char *profilingFramesMetricsString = nullptr;
+    char *profilingDrawCallsMetricsString = nullptr;
+    bool profilingListMetrics = false;
+    bool profilingNumPasses = false;
+    bool profiling = false;
+    bool profilingCpuTimes = false;
+    bool profilingGpuTimes = false;
+    bool profilingPixelsDrawn = false;
+    bool profilingMemoryUsage = false;
+    bool dumpingState = false;
+    bool dumpingSnapshots = false;
+    Driver driver = DRIVER_DEFAULT;
+    const char *driverModule = nullptr;
+    bool doubleBuffer = true;
+    unsigned samples = 1;
+    unsigned frameNo = 0;
+    unsigned callNo = 0;
+    Dumper *dumper = nullptr;
+}
+
+
+static unsigned long long stubCount = 0;
+
+static void
+stub(trace::Call &call) {
+    ++stubCount;
+}
+
+
+BENCHMARK(retrace_dispatch) {
+    // The parser owns the signatures, so must outlive the calls
+    trace::Parser parser;
+    if (!parser.open(getTraceFile())) {
+        return;
+    }
+    std::vector<trace::Call *> calls;
+    trace::Call *call;
+    while ((call = parser.parse_call())) {
+        calls.push_back(call);
+    }
+
+    std::vector<retrace::Entry> entries;
+    for (const char **name = callNames; *name; ++name) {
+        retrace::Entry entry = {*name, &stub};
+        entries.push_back(entry);
+    }
+    retrace::Entry end = {nullptr, nullptr};
+    entries.push_back(end);
+
+    retrace::Retracer retracer;
+    retracer.addCallbacks(&entries[0]);
+
+    while (state.keepRunning()) {
+        for (auto call : calls) {
+            retracer.retrace(*call);
+        }
+        state.addItems(calls.size());
+    }
+
+    for (auto call : calls) {
+        delete call;
+    }
+}
+
+
+BENCHMARK(retrace_map) {
+    const unsigned count = 4096;
+
+    retrace::map<unsigned> names;
+    for (unsigned i = 0; i < count; ++i) {
+        names[i * 3 + 1] = i + 1;
+    }
+
+    unsigned key = 0;
+    while (state.keepRunning()) {
+        unsigned sum = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            sum += names[(key % count) * 3 + 1];
+            key += 7919;
+        }
+        doNotOptimize(sum);
+        state.addItems(1000);
+    }
+}
+
+
+BENCHMARK(retrace_region_lookup) {
+    const unsigned count = 1024;
+    const unsigned long long regionSize = 4096;
+    const unsigned long long base = 0x10000000;
+
+    static const char *args[] = {"buffer"};
+    static const trace::FunctionSig sig = {0, "glMapBuffer", 1, args};
+    trace::Call call(&sig, 0, 0);
+
+    std::vector<char> buffer(count * regionSize);
+    for (unsigned i = 0; i < count; ++i) {
+        // leave a gap between regions
+        retrace::addRegion(call, base + i * 2 * regionSize, &buffer[i * regionSize], regionSize);
+    }
+
+    unsigned long long index = 0;
+    while (state.keepRunning()) {
+        uintptr_t sum = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            unsigned long long region = index % count;
+            unsigned long long offset = (index * 61) % regionSize;
+            trace::Pointer pointer(base + region * 2 * regionSize + offset);
+            sum += reinterpret_cast<uintptr_t>(retrace::toPointer(pointer));
+            index += 7919;
+        }
+        doNotOptimize(sum);
+        state.addItems(1000);
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        retrace::delRegionByPointer(&buffer[i * regionSize]);
+    }
+}
+
+
+/*
+ * Decode a mat4 uniform array argument as the generated retracers do, from
+ * an array written element by element, and from a packed array.
+ */
+template< class ArrayValue >
+static void
+decodeArray(State &state, const ArrayValue &array)
+{
+    while (state.keepRunning()) {
+        float sum = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            retrace::ScopedAllocator _allocator;
+            const trace::Value &value = array;
+            float *values = retrace::asPackedArray<float>(value);
+            if (!values) {
+                values = _allocator.allocArray<float>(&value);
+                const trace::Array *_a = value.toArray();
+                if (_a) {
+                    for (size_t j = 0; j < _a->values.size(); ++j) {
+                        values[j] = _a->values[j]->toFloat();
+                    }
+                }
+            }
+            sum += values[i % 16];
+        }
+        doNotOptimize(sum);
+        state.addItems(1000);
+    }
+}
+
+
+/*
+ * Decode as many scalar float arguments, which the generated retracers do
+ * with one accessor call each, for comparison.
+ */
+BENCHMARK(retrace_decode_scalars) {
+    std::vector<trace::Value *> args(16);
+    for (unsigned i = 0; i < 16; ++i) {
+        args[i] = new trace::Float(i * 0.5f);
+    }
+
+    while (state.keepRunning()) {
+        float sum = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            float values[16];
+            for (unsigned j = 0; j < 16; ++j) {
+                values[j] = args[j]->toFloat();
+            }
+            sum += values[i % 16];
+        }
+        doNotOptimize(sum);
+        state.addItems(1000);
+    }
+
+    for (auto arg : args) {
+        delete arg;
+    }
+}
+
+
+BENCHMARK(retrace_decode_array) {
+    trace::Array array(16);
+    for (unsigned i = 0; i < 16; ++i) {
+        array.values[i] = new trace::Float(i * 0.5f);
+    }
+    decodeArray(state, array);
+}
+
+
+BENCHMARK(retrace_decode_packed_array) {
+    trace::PackedArray array(trace::PACKED_FLOAT, 16);
+    float *data = reinterpret_cast<float *>(array.data.data());
+    for (unsigned i = 0; i < 16; ++i) {
+        data[i] = i * 0.5f;
+        array.set<trace::Float>(i, data[i]);
+    }
+    decodeArray(state, array);
+}
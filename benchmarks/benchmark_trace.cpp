@@ -0,0 +1,224 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Trace writing, compression, decompression and parsing benchmarks.
+ */
+
+
+#include <string>
+#include <memory>
+
+#include "trace_callset.hpp"
+#include "trace_file.hpp"
+#include "trace_ostream.hpp"
+#include "trace_ostream_file.hpp"
+#include "trace_parser.hpp"
+#include "benchmark.hpp"
+#include "benchmark_calls.hpp"
+
+
+using namespace bench;
+
+
+/* Stream which keeps the bytes written in memory. */
+class MemoryOutStream : public trace::OutStream
+{
+public:
+    std::string data;
+
+    bool write(const void *buffer, size_t length) override {
+        data.append(static_cast<const char *>(buffer), length);
+        return true;
+    }
+
+    void flush(void) override {}
+};
+
+
+/* Stream which only counts the bytes written. */
+class NullOutStream : public trace::OutStream
+{
+public:
+    unsigned long long bytes = 0;
+
+    bool write(const void *buffer, size_t length) override {
+        bytes += length;
+        return true;
+    }
+
+    void flush(void) override {}
+};
+
+
+BENCHMARK(writer_encode) {
+    const unsigned count = size(10000);
+
+    NullOutStream *stream = new NullOutStream;
+    trace::Writer writer;
+    writer.open(stream);
+
+    while (state.keepRunning()) {
+        unsigned long long bytes = stream->bytes;
+        writeCalls(writer, count);
+        state.addItems(count);
+        state.addBytes(stream->bytes - bytes);
+    }
+}
+
+
+BENCHMARK(snappy_write) {
+    // compress actual trace data
+    std::string data;
+    {
+        MemoryOutStream *stream = new MemoryOutStream;
+        trace::Writer writer;
+        writer.open(stream);
+        writeCalls(writer, size(10000));
+        data.swap(stream->data);
+    }
+
+    TempFile file(".snappy");
+    std::unique_ptr<trace::OutStream> stream(trace::createSnappyStream(file.str()));
+    if (!stream) {
+        return;
+    }
+
+    while (state.keepRunning()) {
+        stream->write(data.data(), data.size());
+        state.addBytes(data.size());
+    }
+    stream->flush();
+}
+
+
+BENCHMARK(outfile_write) {
+    // time the writing thread spends handing compressed chunks to the file
+    const size_t chunkSize = 1024 * 1024;
+    const unsigned long long maxSize = 256 * chunkSize;
+    std::string chunk(chunkSize, 'x');
+
+    TempFile file(".out");
+    std::unique_ptr<trace::OutFile> out(trace::createOutFile(file.str()));
+    if (!out) {
+        return;
+    }
+
+    unsigned long long written = 0;
+    while (state.keepRunning()) {
+        if (written >= maxSize) {
+            // don't fill the disk
+            state.pauseTiming();
+            out.reset(trace::createOutFile(file.str()));
+            written = 0;
+            state.resumeTiming();
+        }
+        out->write(chunk.data(), chunk.size());
+        written += chunk.size();
+        state.addBytes(chunk.size());
+    }
+    out->flush();
+}
+
+
+BENCHMARK(snappy_read) {
+    const char *filename = getTraceFile();
+
+    std::unique_ptr<char[]> buffer(new char[64 * 1024]);
+
+    while (state.keepRunning()) {
+        std::unique_ptr<trace::File> file(trace::File::createForRead(filename));
+        if (!file) {
+            return;
+        }
+        size_t read;
+        while ((read = file->read(buffer.get(), 64 * 1024)) != 0) {
+            state.addBytes(read);
+        }
+    }
+}
+
+
+BENCHMARK(parser_parse_call) {
+    const char *filename = getTraceFile();
+
+    while (state.keepRunning()) {
+        trace::Parser parser;
+        if (!parser.open(filename)) {
+            return;
+        }
+        trace::Call *call;
+        while ((call = parser.parse_call())) {
+            delete call;
+            state.addItems(1);
+        }
+    }
+}
+
+
+BENCHMARK(parser_scan_call) {
+    const char *filename = getTraceFile();
+
+    while (state.keepRunning()) {
+        trace::Parser parser;
+        if (!parser.open(filename)) {
+            return;
+        }
+        trace::Call *call;
+        while ((call = parser.scan_call())) {
+            delete call;
+            state.addItems(1);
+        }
+    }
+}
+
+
+static void
+callSetContains(State &state, const char *spec)
+{
+    trace::CallSet callSet;
+    callSet.merge(spec);
+
+    trace::CallNo callNo = 0;
+    while (state.keepRunning()) {
+        unsigned hits = 0;
+        for (unsigned i = 0; i < 1000; ++i) {
+            hits += callSet.contains(callNo, trace::CALL_FLAG_RENDER);
+            callNo = (callNo + 7919) % 1000000;
+        }
+        doNotOptimize(hits);
+        state.addItems(1000);
+    }
+}
+
+
+BENCHMARK(callset_contains_ranges) {
+    callSetContains(state, "10-20,100-20000,50000-60000,70000-80000,999000-");
+}
+
+
+BENCHMARK(callset_contains_steps) {
+    callSetContains(state, "1-100000/3,200000-300000/7,500000-600000/draw");
+}
@@ -236,6 +236,9 @@ command(int argc, char *argv[])
             return 1;
         }
 
+        // Don't bother parsing the arguments of calls which won't be dumped
+        p.setCallFilter(&calls);
+
         trace::Call *call;
         while ((call = p.parse_call())) {
             if (calls.contains(*call)) {
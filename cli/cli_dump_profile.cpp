@@ -0,0 +1,144 @@
+/**************************************************************************
+ *
+ * Copyright 2012 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "cli.hpp"
+#include "os_binary.hpp"
+
+#include "trace_profiler.hpp"
+
+
+static const char *synopsis = "Convert a binary profile to text.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace dump-profile [OPTIONS] PROFILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Reads a profile written by `glretrace --profile-format=binary` (or `-` for\n"
+        "standard input) and writes it out in the text format understood by the\n"
+        "profiling scripts.\n"
+        "\n"
+        "    -h, --help               Show this help message and exit\n"
+        "    -o, --output=FILE        Output file (default is standard output)\n"
+    ;
+}
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {0, 0, 0, 0}
+};
+
+static int
+command(int argc, char *argv[])
+{
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        std::cerr << "error: apitrace dump-profile requires exactly one profile as an argument.\n";
+        usage();
+        return 1;
+    }
+
+    const char *filename = argv[optind];
+    FILE *fp;
+    if (strcmp(filename, "-") == 0) {
+        os::setBinaryMode(stdin);
+        fp = stdin;
+    } else {
+        fp = fopen(filename, "rb");
+        if (!fp) {
+            std::cerr << "error: failed to open " << filename << "\n";
+            return 1;
+        }
+    }
+
+    trace::Profile profile;
+    trace::ProfileParser parser(&profile);
+
+    char buffer[64 * 1024];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof buffer, fp)) != 0) {
+        parser.parse(buffer, size);
+    }
+
+    if (fp != stdin) {
+        fclose(fp);
+    }
+
+    if (!parser.isValid()) {
+        return 1;
+    }
+
+    if (output) {
+        std::ofstream os(output);
+        if (!os) {
+            std::cerr << "error: failed to create " << output << "\n";
+            return 1;
+        }
+        trace::writeProfileText(os, profile);
+    } else {
+        trace::writeProfileText(std::cout, profile);
+    }
+
+    return 0;
+}
+
+const Command dump_profile_command = {
+    "dump-profile",
+    synopsis,
+    usage,
+    command
+};
@@ -71,9 +71,13 @@ static const Command * commands[] = {
     &diff_images_command,
     &dump_command,
     &dump_images_command,
+    &dump_profile_command,
     &leaks_command,
+    &optimize_command,
     &pickle_command,
     &sed_command,
+    &stats_command,
+    &synth_command,
     &repack_command,
     &retrace_command,
     &trace_command,
@@ -0,0 +1,258 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <limits.h> // for CHAR_MAX
+#include <getopt.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "os_string.hpp"
+
+#include "trace_optimizer.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+
+static const char *synopsis = "Remove redundant state changes from a trace.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace optimize [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Drops GL calls which provably don't change the state, e.g. binding the\n"
+        "texture, buffer, or program that is already bound, enabling a capability\n"
+        "that is already enabled, or setting a uniform to its current value.\n"
+        "Draw calls are never removed, and the output is checked to contain the\n"
+        "same draw calls as the input, issued with the same bindings and state.\n"
+        "Note that calls get renumbered.\n"
+        "\n"
+        "    -h, --help               Show this help message and exit\n"
+        "    -o, --output=TRACE_FILE  Output trace file\n"
+        "        --no-verify          Don't compare the draw calls of both traces\n"
+    ;
+}
+
+enum {
+    NO_VERIFY_OPT = CHAR_MAX + 1,
+};
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"no-verify", no_argument, 0, NO_VERIFY_OPT},
+    {0, 0, 0, 0}
+};
+
+
+/**
+ * Check that both traces contain the same draw calls, in the same order, and
+ * that every draw is issued with the same tracked state.
+ */
+static bool
+verifyDraws(const char *inFileName, const char *outFileName)
+{
+    trace::Parser in;
+    trace::Parser out;
+    if (!in.open(inFileName)) {
+        std::cerr << "error: failed to open " << inFileName << "\n";
+        return false;
+    }
+    if (!out.open(outFileName)) {
+        std::cerr << "error: failed to open " << outFileName << "\n";
+        return false;
+    }
+
+    /* Track the state of each trace independently. */
+    TraceOptimizer inState;
+    TraceOptimizer outState;
+
+    unsigned long long count = 0;
+    while (true) {
+        trace::Call *a;
+        while ((a = in.parse_call()) && !(a->flags & trace::CALL_FLAG_RENDER)) {
+            inState.isRedundant(a);
+            delete a;
+        }
+        trace::Call *b;
+        while ((b = out.parse_call()) && !(b->flags & trace::CALL_FLAG_RENDER)) {
+            outState.isRedundant(b);
+            delete b;
+        }
+
+        if (!a || !b) {
+            if (a || b) {
+                std::cerr << "error: " << (a ? outFileName : inFileName)
+                          << " has fewer draw calls than the other trace\n";
+                delete a;
+                delete b;
+                return false;
+            }
+            break;
+        }
+
+        bool same = TraceOptimizer::fingerprint(a) == TraceOptimizer::fingerprint(b);
+        if (!same) {
+            std::cerr << "error: draw call " << a->no << " of " << inFileName
+                      << " differs from call " << b->no << " of " << outFileName << "\n";
+        } else if (!inState.sameState(a, outState, b)) {
+            std::cerr << "error: draw call " << a->no << " of " << inFileName
+                      << " is issued with different state than call " << b->no
+                      << " of " << outFileName << "\n";
+            same = false;
+        }
+        delete a;
+        delete b;
+        if (!same) {
+            return false;
+        }
+        ++count;
+    }
+
+    std::cerr << "Verified " << count << " draw calls\n";
+    return true;
+}
+
+
+static int
+optimize_trace(const char *inFileName, std::string &outFileName, bool verify)
+{
+    trace::Parser p;
+    if (!p.open(inFileName)) {
+        std::cerr << "error: failed to open " << inFileName << "\n";
+        return 1;
+    }
+
+    if (outFileName.empty()) {
+        os::String base(inFileName);
+        base.trimExtension();
+
+        outFileName = std::string(base.str()) + std::string("-optimized.trace");
+    }
+
+    trace::Writer writer;
+    if (!writer.open(outFileName.c_str())) {
+        std::cerr << "error: failed to create " << outFileName << "\n";
+        return 1;
+    }
+
+    TraceOptimizer optimizer;
+    std::map<std::string, unsigned long long> removed;
+    unsigned long long totalCalls = 0;
+    unsigned long long removedCalls = 0;
+
+    trace::Call *call;
+    while ((call = p.parse_call())) {
+        ++totalCalls;
+        if (!(call->flags & trace::CALL_FLAG_RENDER) &&
+            optimizer.isRedundant(call)) {
+            ++removed[call->sig->name];
+            ++removedCalls;
+        } else {
+            writer.writeCall(call);
+        }
+        delete call;
+    }
+
+    writer.close();
+    p.close();
+
+    std::vector<std::pair<unsigned long long, std::string>> sorted;
+    for (auto & item : removed) {
+        sorted.emplace_back(item.second, item.first);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<unsigned long long, std::string> &a,
+                 const std::pair<unsigned long long, std::string> &b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    });
+    for (auto & item : sorted) {
+        std::cout << "  " << item.second << ": " << item.first << "\n";
+    }
+    std::cout << "Removed " << removedCalls << " of " << totalCalls << " calls\n";
+
+    if (verify && !verifyDraws(inFileName, outFileName.c_str())) {
+        return 1;
+    }
+
+    std::cerr << "Optimized trace is available as " << outFileName << "\n";
+
+    return 0;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    std::string outFileName;
+    bool verify = true;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            outFileName = optarg;
+            break;
+        case NO_VERIFY_OPT:
+            verify = false;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        std::cerr << "error: apitrace optimize requires exactly one trace file as an argument.\n";
+        usage();
+        return 1;
+    }
+
+    return optimize_trace(argv[optind], outFileName, verify);
+}
+
+const Command optimize_command = {
+    "optimize",
+    synopsis,
+    usage,
+    command
+};
@@ -274,6 +274,9 @@ command(int argc, char *argv[])
             return 1;
         }
 
+        // Don't bother parsing the arguments of calls which won't be dumped
+        parser.setCallFilter(&calls);
+
         trace::Call *call;
         while ((call = parser.parse_call())) {
             if (calls.contains(*call)) {
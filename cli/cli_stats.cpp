@@ -0,0 +1,776 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Streaming report of what a trace is made of, without fully parsing it.
+ */
+
+
+#include <limits.h> // for CHAR_MAX
+#include <string.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "os_thread.hpp"
+
+#include "trace_file.hpp"
+#include "trace_format.hpp"
+#include "trace_parser.hpp"
+#include "trace_snappy.hpp"
+
+
+static const char *synopsis = "Report what a trace is made of.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace stats [OPTIONS] TRACE_FILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Scans the trace without decoding call arguments, and reports call counts\n"
+        "and serialized sizes per function, blob sizes, calls per frame, calls per\n"
+        "thread, the largest calls, and the compression of each chunk.  Memory use\n"
+        "doesn't depend on the trace size.\n"
+        "\n"
+        "    -h, --help               Show this help message and exit\n"
+        "        --json               Output JSON instead of text\n"
+        "        --top=N              Number of largest calls/chunks to list (default 10)\n"
+    ;
+}
+
+enum {
+    JSON_OPT = CHAR_MAX + 1,
+    TOP_OPT,
+};
+
+const static char *
+shortOptions = "h";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"json", no_argument, 0, JSON_OPT},
+    {"top", required_argument, 0, TOP_OPT},
+    {0, 0, 0, 0}
+};
+
+
+namespace {
+
+/**
+ * Parser which also measures the serialized size of every call.
+ */
+class StatsParser : public trace::Parser
+{
+    struct Size {
+        unsigned long long bytes = 0;
+        unsigned long long blobBytes = 0;
+    };
+
+    // Calls entered but not yet left
+    std::map<unsigned, Size> pending;
+
+    // Bytes consumed in the previous segments
+    unsigned long long positionBase = 0;
+
+public:
+    // Bytes not belonging to any returned call
+    unsigned long long strayBytes = 0;
+
+    unsigned long long
+    getPosition(void) const {
+        return positionBase + (file ? file->position() : 0);
+    }
+
+    std::vector<std::string>
+    getFilenames(const char *filename) const {
+        std::vector<std::string> filenames;
+        for (auto & seg : segments) {
+            filenames.push_back(seg.filename);
+        }
+        if (filenames.empty()) {
+            filenames.push_back(filename);
+        }
+        return filenames;
+    }
+
+    trace::Call *
+    scanCall(unsigned long long &bytes, unsigned long long &blobs) {
+        while (true) {
+            unsigned long long startBytes = file->position();
+            unsigned long long startBlobs = blobBytes;
+            trace::Call *call;
+            int c = file->getc();
+            switch (c) {
+            case trace::EVENT_ENTER:
+                parse_enter(SCAN);
+                if (!calls.empty() && calls.back()->no + 1 == next_call_no) {
+                    Size &size = pending[calls.back()->no];
+                    size.bytes += file->position() - startBytes;
+                    size.blobBytes += blobBytes - startBlobs;
+                } else {
+                    strayBytes += file->position() - startBytes;
+                }
+                break;
+            case trace::EVENT_LEAVE:
+                call = parse_leave(SCAN);
+                if (call) {
+                    auto it = pending.find(call->no);
+                    bytes = file->position() - startBytes;
+                    blobs = blobBytes - startBlobs;
+                    if (it != pending.end()) {
+                        bytes += it->second.bytes;
+                        blobs += it->second.blobBytes;
+                        pending.erase(it);
+                    }
+                    adjust_call_flags(call);
+                    return call;
+                }
+                strayBytes += file->position() - startBytes;
+                break;
+            default:
+                std::cerr << "error: unknown event " << c << "\n";
+                exit(1);
+            case -1:
+                if (!calls.empty()) {
+                    call = calls.front();
+                    call->flags |= trace::CALL_FLAG_INCOMPLETE;
+                    calls.pop_front();
+                    auto it = pending.find(call->no);
+                    bytes = 0;
+                    blobs = 0;
+                    if (it != pending.end()) {
+                        bytes = it->second.bytes;
+                        blobs = it->second.blobBytes;
+                        pending.erase(it);
+                    }
+                    adjust_call_flags(call);
+                    return call;
+                }
+                {
+                    unsigned long long consumed = file->position();
+                    if (nextSegment()) {
+                        positionBase += consumed;
+                        break;
+                    }
+                }
+                return NULL;
+            }
+        }
+    }
+};
+
+
+struct FunctionStats
+{
+    std::string name;
+    unsigned long long calls = 0;
+    unsigned long long bytes = 0;
+    unsigned long long blobBytes = 0;
+    unsigned long long maxBytes = 0;
+};
+
+
+struct ThreadStats
+{
+    unsigned long long calls = 0;
+    unsigned long long bytes = 0;
+};
+
+
+struct LargeCall
+{
+    unsigned long long bytes;
+    unsigned no;
+    std::string name;
+
+    bool
+    operator > (const LargeCall &other) const {
+        return bytes > other.bytes;
+    }
+};
+
+
+/**
+ * Minimum, average, maximum, and power-of-two histogram of a quantity.
+ */
+struct Distribution
+{
+    unsigned long long count = 0;
+    unsigned long long sum = 0;
+    unsigned long long min = ULLONG_MAX;
+    unsigned long long max = 0;
+    std::vector<unsigned long long> histogram;
+
+    void
+    add(unsigned long long value) {
+        ++count;
+        sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        unsigned bucket = 0;
+        while (value >> bucket) {
+            ++bucket;
+        }
+        if (bucket >= histogram.size()) {
+            histogram.resize(bucket + 1);
+        }
+        ++histogram[bucket];
+    }
+
+    double
+    average(void) const {
+        return count ? double(sum) / double(count) : 0.0;
+    }
+
+    // Bucket i holds the values in [2^(i-1), 2^i - 1], bucket 0 just zero.
+    static unsigned long long
+    bucketMin(unsigned i) {
+        return i ? 1ULL << (i - 1) : 0;
+    }
+
+    static unsigned long long
+    bucketMax(unsigned i) {
+        return i ? (1ULL << (i - 1)) * 2 - 1 : 0;
+    }
+};
+
+
+struct ChunkStats
+{
+    bool snappy = false;
+    unsigned long long count = 0;
+    unsigned long long compressedBytes = 0;
+    unsigned long long uncompressedBytes = 0;
+    double minRatio = 0.0;
+    double maxRatio = 0.0;
+    unsigned long long codecs[3] = {0, 0, 0};
+
+    // Least compressible chunks, as a max-heap on the ratio
+    typedef std::pair<double, trace::File::Chunk> Entry;
+    struct Less {
+        bool operator () (const Entry &a, const Entry &b) const {
+            return a.first < b.first;
+        }
+    };
+    std::priority_queue<Entry, std::vector<Entry>, Less> worst;
+};
+
+
+struct Stats
+{
+    std::string filename;
+    size_t segments = 0;
+    unsigned long long fileSize = 0;
+    unsigned long long uncompressedBytes = 0;
+    unsigned long long strayBytes = 0;
+    unsigned long long calls = 0;
+    unsigned long long bytes = 0;
+    unsigned long long blobBytes = 0;
+
+    std::vector<FunctionStats> functions;
+    std::map<unsigned, ThreadStats> threads;
+    std::priority_queue<LargeCall, std::vector<LargeCall>, std::greater<LargeCall>> largest;
+
+    Distribution frameCalls;
+    Distribution frameBytes;
+
+    ChunkStats chunks;
+};
+
+}
+
+
+template< class T >
+static std::vector<T>
+drain(std::priority_queue<T, std::vector<T>, std::greater<T>> queue)
+{
+    std::vector<T> items;
+    while (!queue.empty()) {
+        items.push_back(queue.top());
+        queue.pop();
+    }
+    std::reverse(items.begin(), items.end());
+    return items;
+}
+
+
+static std::vector<FunctionStats>
+sortedFunctions(const Stats &stats)
+{
+    std::vector<FunctionStats> functions;
+    for (auto & function : stats.functions) {
+        if (function.calls) {
+            functions.push_back(function);
+        }
+    }
+    std::sort(functions.begin(), functions.end(),
+              [](const FunctionStats &a, const FunctionStats &b) {
+        return a.bytes > b.bytes || (a.bytes == b.bytes && a.name < b.name);
+    });
+    return functions;
+}
+
+
+static std::vector<ChunkStats::Entry>
+worstChunks(const ChunkStats &chunks)
+{
+    std::vector<ChunkStats::Entry> entries;
+    auto queue = chunks.worst;
+    while (!queue.empty()) {
+        entries.push_back(queue.top());
+        queue.pop();
+    }
+    std::reverse(entries.begin(), entries.end());
+    return entries;
+}
+
+
+static double
+ratio(unsigned long long compressed, unsigned long long uncompressed)
+{
+    return compressed ? double(uncompressed) / double(compressed) : 0.0;
+}
+
+
+static void
+writeText(std::ostream &os, const Stats &stats)
+{
+    os << std::fixed << std::setprecision(1);
+
+    os << "File: " << stats.filename << "\n";
+    if (stats.segments > 1) {
+        os << "  " << stats.segments << " segments\n";
+    }
+    os << "  " << stats.fileSize << " bytes, " << stats.uncompressedBytes
+       << " uncompressed (" << std::setprecision(2)
+       << ratio(stats.fileSize, stats.uncompressedBytes) << "x)\n"
+       << std::setprecision(1);
+    os << "  " << stats.calls << " calls, " << stats.frameCalls.count << " frames, "
+       << stats.threads.size() << " threads\n";
+    os << "  " << stats.bytes << " bytes in calls, of which " << stats.blobBytes
+       << " in blobs\n";
+    if (stats.strayBytes) {
+        os << "  " << stats.strayBytes << " bytes in incomplete calls\n";
+    }
+
+    os << "\nFunctions:\n";
+    os << std::setw(12) << "calls"
+       << std::setw(16) << "bytes"
+       << std::setw(12) << "avg"
+       << std::setw(16) << "blob bytes"
+       << std::setw(12) << "max"
+       << "  name\n";
+    for (auto & function : sortedFunctions(stats)) {
+        os << std::setw(12) << function.calls
+           << std::setw(16) << function.bytes
+           << std::setw(12) << double(function.bytes) / double(function.calls)
+           << std::setw(16) << function.blobBytes
+           << std::setw(12) << function.maxBytes
+           << "  " << function.name << "\n";
+    }
+
+    os << "\nFrames:\n";
+    if (stats.frameCalls.count) {
+        os << "  calls per frame: min " << stats.frameCalls.min
+           << ", avg " << stats.frameCalls.average()
+           << ", max " << stats.frameCalls.max << "\n";
+        os << "  bytes per frame: min " << stats.frameBytes.min
+           << ", avg " << stats.frameBytes.average()
+           << ", max " << stats.frameBytes.max << "\n";
+        os << "  calls per frame histogram:\n";
+        const std::vector<unsigned long long> &histogram = stats.frameCalls.histogram;
+        for (unsigned i = 0; i < histogram.size(); ++i) {
+            if (histogram[i]) {
+                os << std::setw(14) << Distribution::bucketMin(i) << " - "
+                   << std::setw(10) << std::left << Distribution::bucketMax(i) << std::right
+                   << std::setw(10) << histogram[i] << " frames\n";
+            }
+        }
+    }
+
+    os << "\nThreads:\n";
+    os << std::setw(12) << "thread"
+       << std::setw(12) << "calls"
+       << std::setw(16) << "bytes"
+       << "\n";
+    for (auto & thread : stats.threads) {
+        os << std::setw(12) << thread.first
+           << std::setw(12) << thread.second.calls
+           << std::setw(16) << thread.second.bytes
+           << "\n";
+    }
+
+    os << "\nLargest calls:\n";
+    os << std::setw(12) << "call"
+       << std::setw(16) << "bytes"
+       << "  name\n";
+    for (auto & call : drain(stats.largest)) {
+        os << std::setw(12) << call.no
+           << std::setw(16) << call.bytes
+           << "  " << call.name << "\n";
+    }
+
+    os << "\nChunks:\n";
+    const ChunkStats &chunks = stats.chunks;
+    if (!chunks.snappy) {
+        os << "  not a snappy compressed trace\n";
+    } else if (chunks.count) {
+        os << std::setprecision(2);
+        os << "  " << chunks.count << " chunks, " << chunks.compressedBytes
+           << " bytes compressed, " << chunks.uncompressedBytes << " uncompressed\n";
+        os << "  compression ratio: min " << chunks.minRatio
+           << "x, avg " << ratio(chunks.compressedBytes, chunks.uncompressedBytes)
+           << "x, max " << chunks.maxRatio << "x\n";
+        os << "  codecs: " << chunks.codecs[SNAPPY_CODEC_SNAPPY] << " snappy, "
+           << chunks.codecs[SNAPPY_CODEC_STORED] << " stored, "
+           << chunks.codecs[SNAPPY_CODEC_ZLIB] << " zlib\n";
+        os << "  least compressible chunks:\n";
+        os << std::setw(16) << "offset"
+           << std::setw(12) << "compressed"
+           << std::setw(14) << "uncompressed"
+           << std::setw(8) << "ratio"
+           << "\n";
+        for (auto & entry : worstChunks(chunks)) {
+            os << std::setw(16) << entry.second.offset
+               << std::setw(12) << entry.second.compressedSize
+               << std::setw(14) << entry.second.uncompressedSize
+               << std::setw(7) << entry.first << "x"
+               << "\n";
+        }
+    }
+}
+
+
+static std::string
+quote(const std::string &s)
+{
+    std::ostringstream os;
+    os << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if ((unsigned char)c < 0x20) {
+            os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (unsigned)c;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+    return os.str();
+}
+
+
+static void
+writeDistribution(std::ostream &os, const Distribution &distribution)
+{
+    os << "{\"min\": " << (distribution.count ? distribution.min : 0)
+       << ", \"avg\": " << distribution.average()
+       << ", \"max\": " << distribution.max
+       << ", \"histogram\": [";
+    const char *sep = "";
+    for (unsigned i = 0; i < distribution.histogram.size(); ++i) {
+        if (distribution.histogram[i]) {
+            os << sep << "{\"min\": " << Distribution::bucketMin(i)
+               << ", \"max\": " << Distribution::bucketMax(i)
+               << ", \"frames\": " << distribution.histogram[i] << "}";
+            sep = ", ";
+        }
+    }
+    os << "]}";
+}
+
+
+static void
+writeJSON(std::ostream &os, const Stats &stats)
+{
+    const char *sep;
+
+    os << "{\n";
+    os << "  \"file\": " << quote(stats.filename) << ",\n";
+    os << "  \"segments\": " << stats.segments << ",\n";
+    os << "  \"file_size\": " << stats.fileSize << ",\n";
+    os << "  \"uncompressed_size\": " << stats.uncompressedBytes << ",\n";
+    os << "  \"calls\": " << stats.calls << ",\n";
+    os << "  \"call_bytes\": " << stats.bytes << ",\n";
+    os << "  \"blob_bytes\": " << stats.blobBytes << ",\n";
+    os << "  \"incomplete_bytes\": " << stats.strayBytes << ",\n";
+
+    os << "  \"functions\": [";
+    sep = "\n";
+    for (auto & function : sortedFunctions(stats)) {
+        os << sep << "    {\"name\": " << quote(function.name)
+           << ", \"calls\": " << function.calls
+           << ", \"bytes\": " << function.bytes
+           << ", \"avg_bytes\": " << double(function.bytes) / double(function.calls)
+           << ", \"blob_bytes\": " << function.blobBytes
+           << ", \"max_bytes\": " << function.maxBytes << "}";
+        sep = ",\n";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"frames\": {\n";
+    os << "    \"count\": " << stats.frameCalls.count << ",\n";
+    os << "    \"calls\": ";
+    writeDistribution(os, stats.frameCalls);
+    os << ",\n";
+    os << "    \"bytes\": ";
+    writeDistribution(os, stats.frameBytes);
+    os << "\n  },\n";
+
+    os << "  \"threads\": [";
+    sep = "\n";
+    for (auto & thread : stats.threads) {
+        os << sep << "    {\"id\": " << thread.first
+           << ", \"calls\": " << thread.second.calls
+           << ", \"bytes\": " << thread.second.bytes << "}";
+        sep = ",\n";
+    }
+    os << "\n  ],\n";
+
+    os << "  \"largest_calls\": [";
+    sep = "\n";
+    for (auto & call : drain(stats.largest)) {
+        os << sep << "    {\"no\": " << call.no
+           << ", \"name\": " << quote(call.name)
+           << ", \"bytes\": " << call.bytes << "}";
+        sep = ",\n";
+    }
+    os << "\n  ],\n";
+
+    const ChunkStats &chunks = stats.chunks;
+    os << "  \"chunks\": ";
+    if (!chunks.snappy) {
+        os << "null\n";
+    } else {
+        os << "{\n";
+        os << "    \"count\": " << chunks.count << ",\n";
+        os << "    \"compressed_bytes\": " << chunks.compressedBytes << ",\n";
+        os << "    \"uncompressed_bytes\": " << chunks.uncompressedBytes << ",\n";
+        os << "    \"min_ratio\": " << chunks.minRatio << ",\n";
+        os << "    \"max_ratio\": " << chunks.maxRatio << ",\n";
+        os << "    \"codecs\": {\"snappy\": " << chunks.codecs[SNAPPY_CODEC_SNAPPY]
+           << ", \"stored\": " << chunks.codecs[SNAPPY_CODEC_STORED]
+           << ", \"zlib\": " << chunks.codecs[SNAPPY_CODEC_ZLIB] << "},\n";
+        os << "    \"least_compressible\": [";
+        sep = "\n";
+        for (auto & entry : worstChunks(chunks)) {
+            os << sep << "      {\"offset\": " << entry.second.offset
+               << ", \"compressed_bytes\": " << entry.second.compressedSize
+               << ", \"uncompressed_bytes\": " << entry.second.uncompressedSize
+               << ", \"ratio\": " << entry.first << "}";
+            sep = ",\n";
+        }
+        os << "\n    ]\n";
+        os << "  }\n";
+    }
+    os << "}\n";
+}
+
+
+static void
+scanChunks(std::vector<std::string> filenames, ChunkStats *chunks, size_t top)
+{
+    for (auto & filename : filenames) {
+        chunks->snappy = trace::File::scanSnappyChunks(filename.c_str(),
+            [chunks, top](const trace::File::Chunk &chunk) {
+                double chunkRatio = ratio(chunk.compressedSize, chunk.uncompressedSize);
+                if (!chunks->count) {
+                    chunks->minRatio = chunks->maxRatio = chunkRatio;
+                } else {
+                    chunks->minRatio = std::min(chunks->minRatio, chunkRatio);
+                    chunks->maxRatio = std::max(chunks->maxRatio, chunkRatio);
+                }
+                ++chunks->count;
+                if (chunk.codec < sizeof chunks->codecs / sizeof chunks->codecs[0]) {
+                    ++chunks->codecs[chunk.codec];
+                }
+                chunks->compressedBytes += chunk.compressedSize;
+                chunks->uncompressedBytes += chunk.uncompressedSize;
+
+                // Keep the chunks with the lowest ratio
+                if (top) {
+                    chunks->worst.push(ChunkStats::Entry(chunkRatio, chunk));
+                    if (chunks->worst.size() > top) {
+                        chunks->worst.pop();
+                    }
+                }
+            });
+        if (!chunks->snappy) {
+            break;
+        }
+    }
+}
+
+
+static int
+stats_trace(const char *filename, bool json, size_t top)
+{
+    StatsParser p;
+    if (!p.open(filename)) {
+        std::cerr << "error: failed to open " << filename << "\n";
+        return 1;
+    }
+
+    Stats stats;
+    stats.filename = filename;
+
+    std::vector<std::string> filenames = p.getFilenames(filename);
+    stats.segments = filenames.size();
+    for (auto & name : filenames) {
+        std::ifstream stream(name.c_str(), std::ifstream::binary | std::ifstream::ate);
+        stats.fileSize += stream.tellg();
+    }
+
+    // Walk the chunk headers on another thread while we parse
+    os::thread chunkThread(scanChunks, filenames, &stats.chunks, top);
+
+    unsigned long long frameCalls = 0;
+    unsigned long long frameBytes = 0;
+
+    trace::Call *call;
+    unsigned long long bytes;
+    unsigned long long blobBytes;
+    while ((call = p.scanCall(bytes, blobBytes))) {
+        ++stats.calls;
+        stats.bytes += bytes;
+        stats.blobBytes += blobBytes;
+
+        unsigned id = call->sig->id;
+        if (id >= stats.functions.size()) {
+            stats.functions.resize(id + 1);
+        }
+        FunctionStats &function = stats.functions[id];
+        if (!function.calls) {
+            function.name = call->sig->name;
+        }
+        ++function.calls;
+        function.bytes += bytes;
+        function.blobBytes += blobBytes;
+        function.maxBytes = std::max(function.maxBytes, bytes);
+
+        ThreadStats &thread = stats.threads[call->thread_id];
+        ++thread.calls;
+        thread.bytes += bytes;
+
+        if (top &&
+            (stats.largest.size() < top || bytes > stats.largest.top().bytes)) {
+            LargeCall large;
+            large.bytes = bytes;
+            large.no = call->no;
+            large.name = call->sig->name;
+            stats.largest.push(large);
+            if (stats.largest.size() > top) {
+                stats.largest.pop();
+            }
+        }
+
+        ++frameCalls;
+        frameBytes += bytes;
+        if (call->flags & trace::CALL_FLAG_END_FRAME) {
+            stats.frameCalls.add(frameCalls);
+            stats.frameBytes.add(frameBytes);
+            frameCalls = 0;
+            frameBytes = 0;
+        }
+
+        delete call;
+    }
+
+    if (frameCalls) {
+        stats.frameCalls.add(frameCalls);
+        stats.frameBytes.add(frameBytes);
+    }
+
+    stats.uncompressedBytes = p.getPosition();
+    stats.strayBytes = p.strayBytes;
+    p.close();
+
+    chunkThread.join();
+
+    if (json) {
+        writeJSON(std::cout, stats);
+    } else {
+        writeText(std::cout, stats);
+    }
+
+    return 0;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    bool json = false;
+    size_t top = 10;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case JSON_OPT:
+            json = true;
+            break;
+        case TOP_OPT:
+            top = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        std::cerr << "error: apitrace stats requires exactly one trace file as an argument.\n";
+        usage();
+        return 1;
+    }
+
+    return stats_trace(argv[optind], json, top);
+}
+
+const Command stats_command = {
+    "stats",
+    synopsis,
+    usage,
+    command
+};
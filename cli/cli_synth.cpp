@@ -0,0 +1,787 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> // for CHAR_MAX
+#include <getopt.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "trace_writer.hpp"
+
+
+static const char *synopsis = "Generate a synthetic trace.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace synth [OPTIONS]\n"
+        << synopsis << "\n"
+        "\n"
+        "Writes a trace with GL-like calls for testing and benchmarking the tools\n"
+        "at scale.  The trace parses and dumps like a real one, but it is not meant\n"
+        "to be replayed.  The same options and seed always produce the same trace.\n"
+        "\n"
+        "    -h, --help               Show this help message and exit\n"
+        "    -o, --output=TRACE_FILE  Output trace file (default synth.trace)\n"
+        "    -s, --seed=N             Random seed (default 0)\n"
+        "        --calls=N            Number of calls (default 1000000)\n"
+        "        --frames=N           Number of frames (default 1000)\n"
+        "        --threads=N          Number of threads (default 1)\n"
+        "        --signatures=N       Number of distinct functions (default 16);\n"
+        "                             functions beyond the GL-like built-ins get\n"
+        "                             synthetic names\n"
+        "        --blob-size=MIN[-MAX]\n"
+        "                             Blob size range in bytes, log-uniformly\n"
+        "                             distributed (default 16-65536)\n"
+        "        --blob-ratio=RATIO   Fraction of calls uploading blobs (default 0.05)\n"
+        "        --map-ratio=RATIO    Fraction of calls mapping or unmapping buffers\n"
+        "                             (default 0.01)\n"
+        "        --gen-ratio=RATIO    Fraction of calls generating or deleting object\n"
+        "                             names (default 0.01)\n"
+    ;
+}
+
+enum {
+    CALLS_OPT = CHAR_MAX + 1,
+    FRAMES_OPT,
+    THREADS_OPT,
+    SIGNATURES_OPT,
+    BLOB_SIZE_OPT,
+    BLOB_RATIO_OPT,
+    MAP_RATIO_OPT,
+    GEN_RATIO_OPT,
+};
+
+const static char *
+shortOptions = "ho:s:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {"seed", required_argument, 0, 's'},
+    {"calls", required_argument, 0, CALLS_OPT},
+    {"frames", required_argument, 0, FRAMES_OPT},
+    {"threads", required_argument, 0, THREADS_OPT},
+    {"signatures", required_argument, 0, SIGNATURES_OPT},
+    {"blob-size", required_argument, 0, BLOB_SIZE_OPT},
+    {"blob-ratio", required_argument, 0, BLOB_RATIO_OPT},
+    {"map-ratio", required_argument, 0, MAP_RATIO_OPT},
+    {"gen-ratio", required_argument, 0, GEN_RATIO_OPT},
+    {0, 0, 0, 0}
+};
+
+
+struct synth_options {
+    const char *output = "synth.trace";
+    unsigned long long seed = 0;
+    unsigned long long calls = 1000000;
+    unsigned long long frames = 1000;
+    unsigned threads = 1;
+    unsigned signatures = 16;
+    size_t blobMin = 16;
+    size_t blobMax = 65536;
+    double blobRatio = 0.05;
+    double mapRatio = 0.01;
+    double genRatio = 0.01;
+};
+
+
+/*
+ * SplitMix64, so that traces are identical across platforms and standard
+ * libraries for the same seed.
+ */
+class Random
+{
+    uint64_t state;
+
+public:
+    Random(uint64_t seed) : state(seed) {}
+
+    uint64_t
+    next(void) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // [0, n)
+    uint64_t
+    uniform(uint64_t n) {
+        return n ? next() % n : 0;
+    }
+
+    // [0, 1)
+    double
+    real(void) {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+};
+
+
+enum {
+    GL_TRIANGLES = 0x0004,
+    GL_ONE = 0x0001,
+    GL_SRC_ALPHA = 0x0302,
+    GL_ONE_MINUS_SRC_ALPHA = 0x0303,
+    GL_BLEND = 0x0BE2,
+    GL_DEPTH_TEST = 0x0B71,
+    GL_TEXTURE_2D = 0x0DE1,
+    GL_UNSIGNED_BYTE = 0x1401,
+    GL_UNSIGNED_SHORT = 0x1403,
+    GL_FLOAT = 0x1406,
+    GL_RGBA = 0x1908,
+    GL_ARRAY_BUFFER = 0x8892,
+    GL_STREAM_DRAW = 0x88E0,
+};
+
+static const trace::EnumValue enumValues[] = {
+    {"GL_TRIANGLES", GL_TRIANGLES},
+    {"GL_ONE", GL_ONE},
+    {"GL_SRC_ALPHA", GL_SRC_ALPHA},
+    {"GL_ONE_MINUS_SRC_ALPHA", GL_ONE_MINUS_SRC_ALPHA},
+    {"GL_BLEND", GL_BLEND},
+    {"GL_DEPTH_TEST", GL_DEPTH_TEST},
+    {"GL_TEXTURE_2D", GL_TEXTURE_2D},
+    {"GL_UNSIGNED_BYTE", GL_UNSIGNED_BYTE},
+    {"GL_UNSIGNED_SHORT", GL_UNSIGNED_SHORT},
+    {"GL_FLOAT", GL_FLOAT},
+    {"GL_RGBA", GL_RGBA},
+    {"GL_ARRAY_BUFFER", GL_ARRAY_BUFFER},
+    {"GL_STREAM_DRAW", GL_STREAM_DRAW},
+};
+
+static const trace::EnumSig enumSig = {0, sizeof enumValues / sizeof enumValues[0], enumValues};
+
+static const trace::BitmaskFlag accessFlags[] = {
+    {"GL_MAP_READ_BIT", 0x0001},
+    {"GL_MAP_WRITE_BIT", 0x0002},
+    {"GL_MAP_INVALIDATE_RANGE_BIT", 0x0004},
+    {"GL_MAP_INVALIDATE_BUFFER_BIT", 0x0008},
+    {"GL_MAP_FLUSH_EXPLICIT_BIT", 0x0010},
+    {"GL_MAP_UNSYNCHRONIZED_BIT", 0x0020},
+};
+
+static const trace::BitmaskSig accessSig = {0, sizeof accessFlags / sizeof accessFlags[0], accessFlags};
+
+
+/*
+ * Built-in functions, with the same signatures as the real ones so that
+ * trace flags (frame ends, draws, etc.) apply.
+ */
+enum {
+    SIG_MEMCPY = 0,
+    SIG_MAKE_CURRENT,
+    SIG_SWAP_BUFFERS,
+    SIG_GEN_BUFFERS,
+    SIG_DELETE_BUFFERS,
+    SIG_MAP_BUFFER_RANGE,
+    SIG_UNMAP_BUFFER,
+    SIG_BUFFER_DATA,
+    SIG_TEX_SUB_IMAGE_2D,
+    SIG_BIND_BUFFER,
+    SIG_BIND_TEXTURE,
+    SIG_ENABLE,
+    SIG_BLEND_FUNC,
+    SIG_USE_PROGRAM,
+    SIG_UNIFORM_4F,
+    SIG_DRAW_ELEMENTS,
+    SIG_BUILTIN_COUNT
+};
+
+static const char *memcpyArgs[] = {"dest", "src", "n"};
+static const char *makeCurrentArgs[] = {"dpy", "drawable", "ctx"};
+static const char *swapBuffersArgs[] = {"dpy", "drawable"};
+static const char *genBuffersArgs[] = {"n", "buffer"};
+static const char *mapBufferRangeArgs[] = {"target", "offset", "length", "access"};
+static const char *unmapBufferArgs[] = {"target"};
+static const char *bufferDataArgs[] = {"target", "size", "data", "usage"};
+static const char *texSubImage2DArgs[] = {"target", "level", "xoffset", "yoffset", "width", "height", "format", "type", "pixels"};
+static const char *bindArgs[] = {"target", "buffer"};
+static const char *bindTextureArgs[] = {"target", "texture"};
+static const char *enableArgs[] = {"cap"};
+static const char *blendFuncArgs[] = {"sfactor", "dfactor"};
+static const char *useProgramArgs[] = {"program"};
+static const char *uniform4fArgs[] = {"location", "v0", "v1", "v2", "v3"};
+static const char *drawElementsArgs[] = {"mode", "count", "type", "indices"};
+
+static const trace::FunctionSig builtinSigs[SIG_BUILTIN_COUNT] = {
+    {SIG_MEMCPY, "memcpy", 3, memcpyArgs},
+    {SIG_MAKE_CURRENT, "glXMakeCurrent", 3, makeCurrentArgs},
+    {SIG_SWAP_BUFFERS, "glXSwapBuffers", 2, swapBuffersArgs},
+    {SIG_GEN_BUFFERS, "glGenBuffers", 2, genBuffersArgs},
+    {SIG_DELETE_BUFFERS, "glDeleteBuffers", 2, genBuffersArgs},
+    {SIG_MAP_BUFFER_RANGE, "glMapBufferRange", 4, mapBufferRangeArgs},
+    {SIG_UNMAP_BUFFER, "glUnmapBuffer", 1, unmapBufferArgs},
+    {SIG_BUFFER_DATA, "glBufferData", 4, bufferDataArgs},
+    {SIG_TEX_SUB_IMAGE_2D, "glTexSubImage2D", 9, texSubImage2DArgs},
+    {SIG_BIND_BUFFER, "glBindBuffer", 2, bindArgs},
+    {SIG_BIND_TEXTURE, "glBindTexture", 2, bindTextureArgs},
+    {SIG_ENABLE, "glEnable", 1, enableArgs},
+    {SIG_BLEND_FUNC, "glBlendFunc", 2, blendFuncArgs},
+    {SIG_USE_PROGRAM, "glUseProgram", 1, useProgramArgs},
+    {SIG_UNIFORM_4F, "glUniform4f", 5, uniform4fArgs},
+    {SIG_DRAW_ELEMENTS, "glDrawElements", 4, drawElementsArgs},
+};
+
+static const char *synthArgs[] = {"a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7"};
+
+static const unsigned long long dpy = 0x1000;
+static const unsigned long long drawable = 0x4000001;
+
+
+class Synthesizer
+{
+    const synth_options &options;
+    Random random;
+    trace::Writer writer;
+
+    // synthetic functions beyond the built-ins
+    std::vector<std::string> synthNames;
+    std::vector<trace::FunctionSig> synthSigs;
+
+    // blob contents are slices of this pool
+    std::vector<char> pool;
+
+    unsigned long long calls;
+    unsigned mappings;
+    unsigned thread;
+    unsigned burst;
+
+    struct Thread {
+        bool current = false;
+        unsigned long long mapping = 0;
+        size_t mappingSize = 0;
+    };
+    std::vector<Thread> threads;
+
+    std::vector<unsigned> buffers;
+    unsigned nextBuffer;
+    unsigned long long nextAddress;
+
+public:
+    Synthesizer(const synth_options &_options) :
+        options(_options),
+        random(_options.seed),
+        calls(0),
+        mappings(0),
+        thread(0),
+        burst(0),
+        threads(_options.threads),
+        nextBuffer(1),
+        nextAddress(0x7f0000000000ULL)
+    {
+        for (unsigned i = SIG_BUILTIN_COUNT; i < options.signatures; ++i) {
+            synthNames.push_back("glSynth" + std::to_string(i - SIG_BUILTIN_COUNT));
+        }
+        for (unsigned i = SIG_BUILTIN_COUNT; i < options.signatures; ++i) {
+            trace::FunctionSig sig;
+            sig.id = i;
+            sig.name = synthNames[i - SIG_BUILTIN_COUNT].c_str();
+            sig.num_args = i % (sizeof synthArgs / sizeof synthArgs[0]);
+            sig.arg_names = synthArgs;
+            synthSigs.push_back(sig);
+        }
+
+        // spans of flat runs, smooth gradients and noise, around a limited
+        // range of values, so that blobs are only partially compressible,
+        // like most textures and vertex data
+        pool.resize(std::max(options.blobMax, size_t(1024 * 1024)));
+        size_t offset = 0;
+        while (offset < pool.size()) {
+            size_t length = std::min<size_t>(16 + random.uniform(1024), pool.size() - offset);
+            unsigned kind = random.uniform(3);
+            unsigned base = 64 + random.uniform(128);
+            for (size_t i = 0; i < length; ++i) {
+                unsigned value = base;
+                if (kind == 1) {
+                    value += i * 32 / length;
+                } else if (kind == 2) {
+                    value += random.uniform(32);
+                }
+                pool[offset + i] = value;
+            }
+            offset += length;
+        }
+    }
+
+    bool
+    open(void) {
+        return writer.open(options.output);
+    }
+
+    void
+    run(void) {
+        unsigned long long callsPerFrame = options.calls / std::max(options.frames, 1ULL);
+        callsPerFrame = std::max(callsPerFrame, 1ULL);
+        unsigned long long frameCalls = 0;
+
+        while (remaining() > 0) {
+            switchThread();
+            if (!threads[thread].current) {
+                makeCurrent();
+                threads[thread].current = true;
+                continue;
+            }
+            if (++frameCalls >= callsPerFrame) {
+                swapBuffers();
+                frameCalls = 0;
+                continue;
+            }
+
+            double p = random.real();
+            if ((p -= options.mapRatio) < 0) {
+                if (threads[thread].mapping) {
+                    unmapBuffer();
+                } else if (remaining() >= 3) {
+                    mapBuffer();
+                } else {
+                    stateOrDraw();
+                }
+            } else if ((p -= options.genRatio) < 0) {
+                if (buffers.size() > 16 && random.uniform(2)) {
+                    deleteBuffers();
+                } else {
+                    genBuffers();
+                }
+            } else if ((p -= options.blobRatio) < 0) {
+                if (random.uniform(2)) {
+                    bufferData();
+                } else {
+                    texSubImage2D();
+                }
+            } else {
+                stateOrDraw();
+            }
+        }
+
+        // leave no buffer mapped
+        for (thread = 0; thread < threads.size(); ++thread) {
+            if (threads[thread].mapping) {
+                unmapBuffer();
+            }
+        }
+    }
+
+private:
+    // calls left, once the mappings still open are closed with a memcpy and
+    // an unmap each
+    unsigned long long
+    remaining(void) const {
+        return options.calls - calls - 2 * mappings;
+    }
+
+    void
+    switchThread(void) {
+        if (threads.size() > 1 && burst-- == 0) {
+            thread = random.uniform(threads.size());
+            burst = random.uniform(64);
+        }
+    }
+
+    unsigned
+    enter(unsigned sig) {
+        ++calls;
+        const trace::FunctionSig *functionSig = sig < SIG_BUILTIN_COUNT ?
+            &builtinSigs[sig] : &synthSigs[sig - SIG_BUILTIN_COUNT];
+        return writer.beginEnter(functionSig, thread);
+    }
+
+    void
+    writeEnumArg(unsigned index, signed long long value) {
+        writer.beginArg(index);
+        writer.writeEnum(&enumSig, value);
+        writer.endArg();
+    }
+
+    void
+    writeSIntArg(unsigned index, signed long long value) {
+        writer.beginArg(index);
+        writer.writeSInt(value);
+        writer.endArg();
+    }
+
+    void
+    writeUIntArg(unsigned index, unsigned long long value) {
+        writer.beginArg(index);
+        writer.writeUInt(value);
+        writer.endArg();
+    }
+
+    void
+    writePointerArg(unsigned index, unsigned long long value) {
+        writer.beginArg(index);
+        writer.writePointer(value);
+        writer.endArg();
+    }
+
+    void
+    writeBlobArg(unsigned index, size_t size) {
+        writer.beginArg(index);
+        size_t offset = random.uniform(pool.size() - size + 1);
+        writer.writeBlob(&pool[offset], size);
+        writer.endArg();
+    }
+
+    void
+    leave(unsigned call) {
+        writer.beginLeave(call);
+        writer.endLeave();
+    }
+
+    size_t
+    blobSize(void) {
+        double logMin = log(double(options.blobMin));
+        double logMax = log(double(options.blobMax));
+        size_t size = size_t(exp(logMin + (logMax - logMin) * random.real()));
+        return std::min(std::max(size, options.blobMin), options.blobMax);
+    }
+
+    unsigned
+    randomBuffer(void) {
+        return buffers.empty() ? 0 : buffers[random.uniform(buffers.size())];
+    }
+
+    void
+    makeCurrent(void) {
+        unsigned call = enter(SIG_MAKE_CURRENT);
+        writePointerArg(0, dpy);
+        writeUIntArg(1, drawable);
+        writePointerArg(2, 0x2000 + 0x100 * thread);
+        writer.endEnter();
+        writer.beginLeave(call);
+        writer.beginReturn();
+        writer.writeSInt(1);
+        writer.endReturn();
+        writer.endLeave();
+    }
+
+    void
+    swapBuffers(void) {
+        unsigned call = enter(SIG_SWAP_BUFFERS);
+        writePointerArg(0, dpy);
+        writeUIntArg(1, drawable);
+        writer.endEnter();
+        leave(call);
+    }
+
+    void
+    genBuffers(void) {
+        unsigned n = 1 + random.uniform(4);
+        unsigned call = enter(SIG_GEN_BUFFERS);
+        writeSIntArg(0, n);
+        writer.endEnter();
+        writer.beginLeave(call);
+        writer.beginArg(1);
+        writer.beginArray(n);
+        for (unsigned i = 0; i < n; ++i) {
+            writer.beginElement();
+            writer.writeUInt(nextBuffer);
+            writer.endElement();
+            buffers.push_back(nextBuffer++);
+        }
+        writer.endArray();
+        writer.endArg();
+        writer.endLeave();
+    }
+
+    void
+    deleteBuffers(void) {
+        unsigned n = 1 + random.uniform(std::min<size_t>(buffers.size(), 4));
+        unsigned call = enter(SIG_DELETE_BUFFERS);
+        writeSIntArg(0, n);
+        writer.beginArg(1);
+        writer.beginArray(n);
+        for (unsigned i = 0; i < n; ++i) {
+            size_t index = random.uniform(buffers.size());
+            writer.beginElement();
+            writer.writeUInt(buffers[index]);
+            writer.endElement();
+            buffers[index] = buffers.back();
+            buffers.pop_back();
+        }
+        writer.endArray();
+        writer.endArg();
+        writer.endEnter();
+        leave(call);
+    }
+
+    void
+    mapBuffer(void) {
+        Thread &t = threads[thread];
+        t.mappingSize = blobSize();
+        t.mapping = nextAddress;
+        nextAddress += (t.mappingSize + 0xfff) & ~0xfffULL;
+        ++mappings;
+
+        unsigned call = enter(SIG_MAP_BUFFER_RANGE);
+        writeEnumArg(0, GL_ARRAY_BUFFER);
+        writeSIntArg(1, 0);
+        writeSIntArg(2, t.mappingSize);
+        writer.beginArg(3);
+        writer.writeBitmask(&accessSig, 0x0002 | 0x0008);
+        writer.endArg();
+        writer.endEnter();
+        writer.beginLeave(call);
+        writer.beginReturn();
+        writer.writePointer(t.mapping);
+        writer.endReturn();
+        writer.endLeave();
+    }
+
+    void
+    unmapBuffer(void) {
+        Thread &t = threads[thread];
+
+        // flush the mapped contents, as the tracer does
+        unsigned call = enter(SIG_MEMCPY);
+        writePointerArg(0, t.mapping);
+        writeBlobArg(1, t.mappingSize);
+        writeUIntArg(2, t.mappingSize);
+        writer.endEnter();
+        leave(call);
+
+        call = enter(SIG_UNMAP_BUFFER);
+        writeEnumArg(0, GL_ARRAY_BUFFER);
+        writer.endEnter();
+        writer.beginLeave(call);
+        writer.beginReturn();
+        writer.writeBool(true);
+        writer.endReturn();
+        writer.endLeave();
+
+        t.mapping = 0;
+        t.mappingSize = 0;
+        --mappings;
+    }
+
+    void
+    bufferData(void) {
+        size_t size = blobSize();
+        unsigned call = enter(SIG_BUFFER_DATA);
+        writeEnumArg(0, GL_ARRAY_BUFFER);
+        writeSIntArg(1, size);
+        writeBlobArg(2, size);
+        writeEnumArg(3, GL_STREAM_DRAW);
+        writer.endEnter();
+        leave(call);
+    }
+
+    void
+    texSubImage2D(void) {
+        size_t size = blobSize() & ~size_t(3);
+        size = std::max(size, size_t(4));
+        unsigned width = 1;
+        while (width * width * 4 < size) {
+            width *= 2;
+        }
+        unsigned height = size / (width * 4);
+        height = std::max(height, 1U);
+        size = width * height * 4;
+        if (size > pool.size()) {
+            height = pool.size() / (width * 4);
+            size = width * height * 4;
+        }
+
+        unsigned call = enter(SIG_TEX_SUB_IMAGE_2D);
+        writeEnumArg(0, GL_TEXTURE_2D);
+        writeSIntArg(1, 0);
+        writeSIntArg(2, 0);
+        writeSIntArg(3, 0);
+        writeSIntArg(4, width);
+        writeSIntArg(5, height);
+        writeEnumArg(6, GL_RGBA);
+        writeEnumArg(7, GL_UNSIGNED_BYTE);
+        writeBlobArg(8, size);
+        writer.endEnter();
+        leave(call);
+    }
+
+    void
+    stateOrDraw(void) {
+        unsigned sig = SIG_BIND_BUFFER + random.uniform(options.signatures - SIG_BIND_BUFFER);
+        unsigned call = enter(sig);
+        switch (sig) {
+        case SIG_BIND_BUFFER:
+            writeEnumArg(0, GL_ARRAY_BUFFER);
+            writeUIntArg(1, randomBuffer());
+            break;
+        case SIG_BIND_TEXTURE:
+            writeEnumArg(0, GL_TEXTURE_2D);
+            writeUIntArg(1, 1 + random.uniform(256));
+            break;
+        case SIG_ENABLE:
+            writeEnumArg(0, random.uniform(2) ? GL_BLEND : GL_DEPTH_TEST);
+            break;
+        case SIG_BLEND_FUNC:
+            writeEnumArg(0, GL_SRC_ALPHA);
+            writeEnumArg(1, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        case SIG_USE_PROGRAM:
+            writeUIntArg(0, 1 + random.uniform(32));
+            break;
+        case SIG_UNIFORM_4F:
+            writeSIntArg(0, random.uniform(64));
+            for (unsigned i = 1; i < 5; ++i) {
+                writer.beginArg(i);
+                writer.writeFloat(float(random.real()));
+                writer.endArg();
+            }
+            break;
+        case SIG_DRAW_ELEMENTS:
+            writeEnumArg(0, GL_TRIANGLES);
+            writeSIntArg(1, 3 * (1 + random.uniform(10000)));
+            writeEnumArg(2, GL_UNSIGNED_SHORT);
+            writePointerArg(3, 0);
+            break;
+        default:
+            assert(sig >= SIG_BUILTIN_COUNT);
+            for (unsigned i = 0; i < synthSigs[sig - SIG_BUILTIN_COUNT].num_args; ++i) {
+                writer.beginArg(i);
+                switch (random.uniform(4)) {
+                case 0:
+                    writer.writeEnum(&enumSig, enumValues[random.uniform(enumSig.num_values)].value);
+                    break;
+                case 1:
+                    writer.writeFloat(float(random.real()));
+                    break;
+                case 2:
+                    writer.writeSInt(signed(random.uniform(2000)) - 1000);
+                    break;
+                default:
+                    writer.writeUInt(random.uniform(1 << 20));
+                    break;
+                }
+                writer.endArg();
+            }
+            break;
+        }
+        writer.endEnter();
+        leave(call);
+    }
+};
+
+
+static bool
+parseBlobSize(const char *str, synth_options &options)
+{
+    char *end;
+    options.blobMin = strtoull(str, &end, 0);
+    if (*end == '-') {
+        options.blobMax = strtoull(end + 1, &end, 0);
+    } else {
+        options.blobMax = options.blobMin;
+    }
+    return *end == 0 && options.blobMin > 0 && options.blobMin <= options.blobMax;
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    synth_options options;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            options.output = optarg;
+            break;
+        case 's':
+            options.seed = strtoull(optarg, NULL, 0);
+            break;
+        case CALLS_OPT:
+            options.calls = strtoull(optarg, NULL, 0);
+            break;
+        case FRAMES_OPT:
+            options.frames = strtoull(optarg, NULL, 0);
+            break;
+        case THREADS_OPT:
+            options.threads = std::max(atoi(optarg), 1);
+            break;
+        case SIGNATURES_OPT:
+            options.signatures = std::max(atoi(optarg), int(SIG_BUILTIN_COUNT));
+            break;
+        case BLOB_SIZE_OPT:
+            if (!parseBlobSize(optarg, options)) {
+                std::cerr << "error: invalid blob size range " << optarg << "\n";
+                return 1;
+            }
+            break;
+        case BLOB_RATIO_OPT:
+            options.blobRatio = atof(optarg);
+            break;
+        case MAP_RATIO_OPT:
+            options.mapRatio = atof(optarg);
+            break;
+        case GEN_RATIO_OPT:
+            options.genRatio = atof(optarg);
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (optind < argc) {
+        std::cerr << "error: unexpected argument `" << argv[optind] << "`\n";
+        usage();
+        return 1;
+    }
+
+    Synthesizer synthesizer(options);
+    if (!synthesizer.open()) {
+        std::cerr << "error: failed to create " << options.output << "\n";
+        return 1;
+    }
+
+    synthesizer.run();
+
+    return 0;
+}
+
+const Command synth_command = {
+    "synth",
+    synopsis,
+    usage,
+    command
+};
@@ -37,6 +37,8 @@
 #include "trace_parser.hpp"
 #include "trace_writer.hpp"
 
+#include "trace_analyzer.hpp"
+
 static const char *synopsis = "Create a new trace by trimming an existing trace.";
 
 static void
@@ -47,6 +49,8 @@ usage(void)
         << synopsis << "\n"
         "\n"
         "    -h, --help               Show detailed help for trim options and exit\n"
+        "    -a, --auto               Also include all the calls the selected calls\n"
+        "                             depend on (GL and EGL traces only).\n"
         "        --calls=CALLSET      Include specified calls in the trimmed output.\n"
         "        --frames=FRAMESET    Include specified frames in the trimmed output.\n"
         "        --thread=THREAD_ID   Only retain calls from specified thread\n"
@@ -66,6 +70,7 @@ shortOptions = "aho:x";
 const static struct option
 longOptions[] = {
     {"help", no_argument, 0, 'h'},
+    {"auto", no_argument, 0, 'a'},
     {"calls", required_argument, 0, CALLS_OPT},
     {"frames", required_argument, 0, FRAMES_OPT},
     {"thread", required_argument, 0, THREAD_OPT},
@@ -91,6 +96,9 @@ struct trim_options {
 
     /* Emit only calls from this thread (-1 == all threads) */
     int thread;
+
+    /* Also emit the calls the selected calls depend on */
+    bool autoTrim;
 };
 
 static int
@@ -118,9 +126,48 @@ trim_trace(const char *filename, struct trim_options *options)
         return 1;
     }
 
+    TraceAnalyzer analyzer;
+    trace::Call *call;
+
+    if (options->autoTrim) {
+        /* First pass: work out which calls the selected ones depend on. */
+        frame = 0;
+        while ((call = p.parse_call())) {
+            if ((options->calls.empty() || call->no > options->calls.getLast()) &&
+                (options->frames.empty() || frame > options->frames.getLast())) {
+
+                delete call;
+                break;
+            }
+
+            analyzer.analyze(call);
+
+            if ((options->thread == -1 || call->thread_id == options->thread) &&
+                (options->calls.contains(*call) ||
+                 options->frames.contains(frame, call->flags))) {
+                analyzer.require(call);
+            }
+
+            if (call->flags & trace::CALL_FLAG_END_FRAME) {
+                frame++;
+            }
+
+            delete call;
+        }
+
+        if (p.api != trace::API_GL && p.api != trace::API_EGL) {
+            std::cerr << "warning: --auto is only supported for GL and EGL traces; ignoring\n";
+            options->autoTrim = false;
+        }
+
+        p.close();
+        if (!p.open(filename)) {
+            std::cerr << "error: failed to reopen " << filename << "\n";
+            return 1;
+        }
+    }
 
     frame = 0;
-    trace::Call *call;
     while ((call = p.parse_call())) {
 
         /* There's no use doing any work past the last call and frame
@@ -132,11 +179,19 @@ trim_trace(const char *filename, struct trim_options *options)
             break;
         }
 
-        /* If requested, ignore all calls not belonging to the specified thread. */
+        /* If requested, ignore all calls not belonging to the specified
+         * thread, including any dependencies --auto found on other threads. */
         if (options->thread != -1 && call->thread_id != options->thread) {
             goto NEXT;
         }
 
+        if (options->autoTrim) {
+            if (analyzer.getRequired().contains(call->no)) {
+                writer.writeCall(call);
+            }
+            goto NEXT;
+        }
+
         /* If this call is included in the user-specified call set,
          * then require it (and all dependencies) in the trimmed
          * output. */
@@ -168,6 +223,7 @@ command(int argc, char *argv[])
     options.frames = trace::CallSet(trace::FREQUENCY_NONE);
     options.output = "";
     options.thread = -1;
+    options.autoTrim = false;
 
     int opt;
     while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
@@ -175,6 +231,9 @@ command(int argc, char *argv[])
         case 'h':
             usage();
             return 0;
+        case 'a':
+            options.autoTrim = true;
+            break;
         case CALLS_OPT:
             options.calls.merge(optarg);
             break;
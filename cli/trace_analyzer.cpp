@@ -0,0 +1,2190 @@
+/*********************************************************************
+ *
+ * Copyright 2012 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *********************************************************************/
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "trace_analyzer.hpp"
+
+
+/*
+ * Helpers for fishing values out of calls.
+ */
+
+namespace {
+
+class ScalarVisitor : public trace::Visitor
+{
+public:
+    bool ok;
+    bool isEnum;
+    unsigned long long value;
+
+    ScalarVisitor() : ok(false), isEnum(false), value(0) {}
+
+    void visit(trace::Null *) override { ok = true; value = 0; }
+    void visit(trace::Bool *node) override { ok = true; value = node->value; }
+    void visit(trace::SInt *node) override { ok = true; value = node->value; }
+    void visit(trace::UInt *node) override { ok = true; value = node->value; }
+    void visit(trace::Float *) override {}
+    void visit(trace::Double *) override {}
+    void visit(trace::String *) override {}
+    void visit(trace::WString *) override {}
+    void visit(trace::Enum *node) override { ok = true; isEnum = true; value = node->value; }
+    void visit(trace::Bitmask *node) override { ok = true; value = node->value; }
+    void visit(trace::Struct *) override {}
+    void visit(trace::Array *) override {}
+    void visit(trace::Blob *) override {}
+    void visit(trace::Pointer *node) override { ok = true; value = node->value; }
+    void visit(trace::Repr *node) override { _visit(node->machineValue); }
+};
+
+}
+
+
+static bool
+getScalar(trace::Value *value, unsigned long long &result, bool *isEnum = NULL)
+{
+    if (!value) {
+        return false;
+    }
+    ScalarVisitor visitor;
+    value->visit(visitor);
+    result = visitor.value;
+    if (isEnum) {
+        *isEnum = visitor.isEnum;
+    }
+    return visitor.ok;
+}
+
+
+static trace::Value *
+findArg(trace::Call *call, const char *name)
+{
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        if (strcmp(call->sig->arg_names[i], name) == 0) {
+            return call->args[i].value;
+        }
+    }
+    return NULL;
+}
+
+
+static bool
+getArg(trace::Call *call, const char *name, unsigned long long &result)
+{
+    return getScalar(findArg(call, name), result);
+}
+
+
+static unsigned long long
+getArg(trace::Call *call, const char *name)
+{
+    unsigned long long result = 0;
+    getArg(call, name, result);
+    return result;
+}
+
+
+static void
+getNames(trace::Value *value, std::vector<unsigned long long> &names)
+{
+    if (!value) {
+        return;
+    }
+    trace::Array *array = value->toArray();
+    if (array) {
+        for (size_t i = 0; i < array->size(); ++i) {
+            unsigned long long name;
+            if (getScalar(array->values[i], name)) {
+                names.push_back(name);
+            }
+        }
+    } else {
+        unsigned long long name;
+        if (getScalar(value, name)) {
+            names.push_back(name);
+        }
+    }
+}
+
+
+static inline bool
+startsWith(const char *s, const char *prefix)
+{
+    return strncmp(s, prefix, strlen(prefix)) == 0;
+}
+
+
+/*
+ * Kinds of resources.
+ */
+enum {
+    KIND_NONE = 0,
+
+    /* Objects, keyed by name */
+    KIND_TEXTURE,
+    KIND_BUFFER,
+    KIND_PROGRAM,
+    KIND_SHADER,
+    KIND_FRAMEBUFFER,
+    KIND_RENDERBUFFER,
+    KIND_SAMPLER,
+    KIND_VERTEX_ARRAY,
+    KIND_PIPELINE,
+    KIND_SYNC,
+    KIND_QUERY,
+    KIND_TRANSFORM_FEEDBACK,
+    KIND_LIST,
+    KIND_CONTEXT,
+    KIND_EGL_IMAGE,
+
+    /* Contents of the buffer or framebuffer in scope */
+    KIND_DATA,
+
+    /* Context current on a thread, keyed by thread ID */
+    KIND_CURRENT,
+
+    /* Window system calls, keyed by signature ID and arguments */
+    KIND_WINDOW_SYSTEM,
+
+    /* State of the context or object in scope */
+    KIND_ACTIVE_TEXTURE,
+    KIND_CLIENT_ACTIVE_TEXTURE,
+    KIND_TEXTURE_BINDING,
+    KIND_TEXTURE_UNIT_BINDING,
+    KIND_IMAGE_BINDING,
+    KIND_SAMPLER_BINDING,
+    KIND_BUFFER_BINDING,
+    KIND_VERTEX_ARRAY_BINDING,
+    KIND_DRAW_FRAMEBUFFER_BINDING,
+    KIND_READ_FRAMEBUFFER_BINDING,
+    KIND_RENDERBUFFER_BINDING,
+    KIND_PROGRAM_BINDING,
+    KIND_PIPELINE_BINDING,
+    KIND_TRANSFORM_FEEDBACK_BINDING,
+    KIND_TRANSFORM_FEEDBACK_STATE,
+    KIND_QUERY_STATE,
+    KIND_CONDITIONAL_RENDER,
+    KIND_UNIFORM,
+    KIND_VERTEX_ATTRIB_ARRAY,
+    KIND_CLIENT_STATE,
+    KIND_MATRIX_MODE,
+    KIND_MATRIX,
+    KIND_ATTRIB_STACK,
+    KIND_ENABLE,
+    KIND_SIDE_EFFECT_WRITES,
+
+    /* State set by any other call, keyed by signature ID and selectors */
+    KIND_CALL,
+};
+
+
+/*
+ * Arguments which name GL objects.
+ */
+
+struct ObjectArg {
+    const char *arg;
+    unsigned kind;
+};
+
+static const ObjectArg
+objectArgs[] = {
+    {"texture",         KIND_TEXTURE},
+    {"textures",        KIND_TEXTURE},
+    {"origtexture",     KIND_TEXTURE},
+    {"srcName",         KIND_TEXTURE},
+    {"dstName",         KIND_TEXTURE},
+    {"buffer",          KIND_BUFFER},
+    {"buffers",         KIND_BUFFER},
+    {"readBuffer",      KIND_BUFFER},
+    {"writeBuffer",     KIND_BUFFER},
+    {"program",         KIND_PROGRAM},
+    {"programObj",      KIND_PROGRAM},
+    {"containerObj",    KIND_PROGRAM},
+    {"shader",          KIND_SHADER},
+    {"shaders",         KIND_SHADER},
+    {"shaderObj",       KIND_SHADER},
+    {"framebuffer",     KIND_FRAMEBUFFER},
+    {"framebuffers",    KIND_FRAMEBUFFER},
+    {"renderbuffer",    KIND_RENDERBUFFER},
+    {"renderbuffers",   KIND_RENDERBUFFER},
+    {"sampler",         KIND_SAMPLER},
+    {"samplers",        KIND_SAMPLER},
+    {"array",           KIND_VERTEX_ARRAY},
+    {"arrays",          KIND_VERTEX_ARRAY},
+    {"vaobj",           KIND_VERTEX_ARRAY},
+    {"pipeline",        KIND_PIPELINE},
+    {"pipelines",       KIND_PIPELINE},
+    {"sync",            KIND_SYNC},
+};
+
+/* Functions which use the argument names above for something else, such as
+ * enums or client memory. */
+static const char *
+nonObjectFunctions[] = {
+    "glActiveTexture",
+    "glClientActiveTexture",
+    "glMultiTexCoord",
+    "glEnableClientState",
+    "glDisableClientState",
+    "glEnableVertexArrayEXT",
+    "glDisableVertexArrayEXT",
+    "glClearBuffer",
+    "glClearNamedFramebuffer",
+    "glFeedbackBuffer",
+    "glSelectBuffer",
+    "glInstrumentsBufferSGIX",
+    "glBindVideoCaptureStreamTextureNV",
+};
+
+
+static unsigned
+objectKind(trace::Call *call, const char *argName)
+{
+    const char *name = call->name();
+
+    if (strcmp(argName, "ids") == 0 || strcmp(argName, "id") == 0) {
+        if (strstr(name, "Quer") || strstr(name, "ConditionalRender")) {
+            return KIND_QUERY;
+        }
+        if (strstr(name, "TransformFeedback")) {
+            return KIND_TRANSFORM_FEEDBACK;
+        }
+        return KIND_NONE;
+    }
+
+    if (strcmp(argName, "list") == 0 || strcmp(argName, "lists") == 0) {
+        return KIND_NONE;
+    }
+
+    for (unsigned i = 0; i < sizeof nonObjectFunctions / sizeof nonObjectFunctions[0]; ++i) {
+        if (startsWith(name, nonObjectFunctions[i])) {
+            return KIND_NONE;
+        }
+    }
+
+    for (unsigned i = 0; i < sizeof objectArgs / sizeof objectArgs[0]; ++i) {
+        if (strcmp(argName, objectArgs[i].arg) == 0) {
+            return objectArgs[i].kind;
+        }
+    }
+
+    return KIND_NONE;
+}
+
+
+/* Argument names which select which piece of state a call sets, as opposed
+ * to the value it sets it to.  Enums are always treated as selectors. */
+static const char *
+selectorArgs[] = {
+    "index",
+    "buf",
+    "unit",
+    "light",
+    "face",
+    "plane",
+    "coord",
+    "texunit",
+    "maskNumber",
+    "drawbuffer",
+    "bindingindex",
+    "attribindex",
+    "first",
+};
+
+
+/*
+ * Key identifying the state set by a generic state call.
+ *
+ * Using more arguments than strictly necessary is harmless (it merely keeps
+ * a few redundant calls), whereas using fewer would drop calls that are
+ * still needed.  Hence false is returned when the selectors do not all fit
+ * in the key, and the state must then be accumulated rather than replaced.
+ */
+bool
+TraceAnalyzer::stateKey(trace::Call *call, Key &key)
+{
+    key = Key(KIND_CALL);
+    key << call->sig->id;
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        unsigned long long value;
+        bool isEnum = false;
+        if (!getScalar(call->args[i].value, value, &isEnum)) {
+            continue;
+        }
+        bool selector = isEnum;
+        for (unsigned j = 0; !selector && j < sizeof selectorArgs / sizeof selectorArgs[0]; ++j) {
+            selector = strcmp(call->sig->arg_names[i], selectorArgs[j]) == 0;
+        }
+        if (selector && !key.add(value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/*
+ * Key identifying a window system call by all its scalar arguments.  Returns
+ * false when they do not all fit in the key.
+ */
+bool
+TraceAnalyzer::windowSystemKey(trace::Call *call, Key &key)
+{
+    key = Key(KIND_WINDOW_SYSTEM);
+    key << call->sig->id;
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        unsigned long long value;
+        if (getScalar(call->args[i].value, value) && !key.add(value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static unsigned long long
+textureTarget(unsigned long long target)
+{
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+        target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+        return GL_TEXTURE_CUBE_MAP;
+    }
+    return target;
+}
+
+
+static bool
+isFramebufferTarget(unsigned long long target, bool read)
+{
+    if (target == GL_FRAMEBUFFER) {
+        return true;
+    }
+    return target == (read ? GL_READ_FRAMEBUFFER : GL_DRAW_FRAMEBUFFER);
+}
+
+
+/*
+ * Resource bookkeeping.
+ */
+
+size_t
+TraceAnalyzer::KeyHash::operator () (const Key &key) const
+{
+    size_t hash = key.kind;
+    hash = hash * 31 + reinterpret_cast<uintptr_t>(key.scope);
+    for (unsigned i = 0; i < key.count; ++i) {
+        hash = hash * 31 + static_cast<size_t>(key.values[i] ^ (key.values[i] >> 32));
+    }
+    return hash;
+}
+
+
+TraceAnalyzer::Context::Context(unsigned long long _id) :
+    id(_id),
+    lastDrawTarget(NULL),
+    activeTexture(0),
+    clientActiveTexture(0),
+    matrixMode(GL_MODELVIEW),
+    attribDepth(0),
+    scissorTest(false),
+    insideBeginEnd(false),
+    sideEffects(false),
+    currentList(0),
+    program(0),
+    vertexArray(0),
+    drawFramebuffer(0),
+    readFramebuffer(0),
+    renderbuffer(0)
+{
+}
+
+
+TraceAnalyzer::TraceAnalyzer() :
+    generation(0),
+    stale(true),
+    analyzedSinceRequire(false)
+{
+}
+
+
+TraceAnalyzer::~TraceAnalyzer()
+{
+    std::unordered_map<Key, Resource *, KeyHash>::iterator it;
+    for (it = resources.begin(); it != resources.end(); ++it) {
+        delete it->second;
+    }
+
+    std::map<unsigned long long, Context *>::iterator ctx;
+    for (ctx = contexts.begin(); ctx != contexts.end(); ++ctx) {
+        delete ctx->second;
+    }
+
+    global.clear();
+    required.clear();
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::lookup(const Key &key)
+{
+    Resource *&resource = resources[key];
+    if (!resource) {
+        resource = new Resource(key);
+    }
+    return resource;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::find(const Key &key)
+{
+    std::unordered_map<Key, Resource *, KeyHash>::iterator it = resources.find(key);
+    if (it == resources.end()) {
+        return NULL;
+    }
+    return it->second;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::object(unsigned kind, unsigned long long name)
+{
+    return lookup(Key(kind) << name);
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::findObject(unsigned kind, unsigned long long name)
+{
+    return find(Key(kind) << name);
+}
+
+
+void
+TraceAnalyzer::provide(Resource *resource, trace::CallNo call_no)
+{
+    resource->calls.add(call_no);
+    touched.push_back(resource);
+}
+
+
+void
+TraceAnalyzer::provide(Resource *resource, Resource *source)
+{
+    if (resource == source) {
+        return;
+    }
+    trace::FastCallRange *range = source->calls.head.next[0]();
+    while (range) {
+        resource->calls.add(range->first, range->last);
+        range = range->next[0]();
+    }
+}
+
+
+void
+TraceAnalyzer::link(Resource *resource, Resource *dependency)
+{
+    if (resource == dependency) {
+        return;
+    }
+    resource->dependencies.insert(dependency);
+    dependency->dependents.insert(resource);
+}
+
+
+void
+TraceAnalyzer::own(Resource *resource, Resource *child)
+{
+    if (resource == child) {
+        return;
+    }
+    resource->children.insert(child);
+    child->parents.insert(resource);
+}
+
+
+/*
+ * Hand the current contents of a resource over to everything that depends
+ * on them, prior to the resource being reset or discarded.
+ */
+void
+TraceAnalyzer::fold(Resource *resource)
+{
+    std::set<Resource *>::iterator it;
+    for (it = resource->dependents.begin(); it != resource->dependents.end(); ++it) {
+        Resource *dependent = *it;
+        provide(dependent, resource);
+        dependent->dependencies.erase(resource);
+        std::set<Resource *>::iterator dep;
+        for (dep = resource->dependencies.begin(); dep != resource->dependencies.end(); ++dep) {
+            link(dependent, *dep);
+        }
+    }
+    resource->dependents.clear();
+}
+
+
+void
+TraceAnalyzer::reset(Resource *resource)
+{
+    fold(resource);
+
+    std::set<Resource *>::iterator it;
+    for (it = resource->dependencies.begin(); it != resource->dependencies.end(); ++it) {
+        (*it)->dependents.erase(resource);
+    }
+    resource->dependencies.clear();
+    resource->calls.clear();
+}
+
+
+void
+TraceAnalyzer::discard(Resource *resource)
+{
+    fold(resource);
+
+    std::set<Resource *>::iterator it;
+
+    /* Whoever owned this keeps its last contents. */
+    for (it = resource->parents.begin(); it != resource->parents.end(); ++it) {
+        Resource *parent = *it;
+        provide(parent, resource);
+        std::set<Resource *>::iterator dep;
+        for (dep = resource->dependencies.begin(); dep != resource->dependencies.end(); ++dep) {
+            link(parent, *dep);
+        }
+        parent->children.erase(resource);
+    }
+
+    for (it = resource->dependencies.begin(); it != resource->dependencies.end(); ++it) {
+        (*it)->dependents.erase(resource);
+    }
+
+    /* Owned resources go away together with their owner. */
+    std::set<Resource *> children;
+    children.swap(resource->children);
+    for (it = children.begin(); it != children.end(); ++it) {
+        (*it)->parents.erase(resource);
+        if ((*it)->parents.empty()) {
+            discard(*it);
+        }
+    }
+
+    std::map<unsigned long long, Context *>::iterator ctx;
+    for (ctx = contexts.begin(); ctx != contexts.end(); ++ctx) {
+        ctx->second->state.erase(resource);
+        ctx->second->pixelStore.erase(resource);
+        ctx->second->changed.erase(resource);
+        if (ctx->second->lastDrawTarget == resource) {
+            ctx->second->lastDrawTarget = NULL;
+        }
+    }
+
+    std::map<unsigned long long, Mapping>::iterator mapping = mappings.begin();
+    while (mapping != mappings.end()) {
+        if (mapping->second.buffer == resource) {
+            mappings.erase(mapping++);
+        } else {
+            ++mapping;
+        }
+    }
+
+    std::map<Resource *, Attachments>::iterator fb;
+    for (fb = attachments.begin(); fb != attachments.end(); ++fb) {
+        Attachments::iterator attachment = fb->second.begin();
+        while (attachment != fb->second.end()) {
+            if (attachment->second == resource) {
+                fb->second.erase(attachment++);
+            } else {
+                ++attachment;
+            }
+        }
+    }
+    attachments.erase(resource);
+    lists.erase(resource);
+    currentBindings.erase(resource);
+
+    for (size_t i = 0; i < touched.size(); ++i) {
+        if (touched[i] == resource) {
+            touched[i] = NULL;
+        }
+    }
+
+    resources.erase(resource->key);
+    delete resource;
+}
+
+
+/*
+ * State.
+ */
+
+TraceAnalyzer::Context *
+TraceAnalyzer::getContext(trace::Call *call)
+{
+    unsigned long long id = 0;
+    std::map<unsigned, unsigned long long>::iterator current = currentContext.find(call->thread_id);
+    if (current != currentContext.end()) {
+        id = current->second;
+    }
+
+    Context *&ctx = contexts[id];
+    if (!ctx) {
+        ctx = new Context(id);
+    }
+    return ctx;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::stateResource(Context *ctx, Key key)
+{
+    key.scope = ctx;
+    Resource *resource = lookup(key);
+    ctx->state.insert(resource);
+    return resource;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::findState(Context *ctx, Key key)
+{
+    key.scope = ctx;
+    return find(key);
+}
+
+
+/*
+ * State which belongs to an object (e.g., uniforms of a program, attribute
+ * bindings of a vertex array object), or to the context when no object is
+ * given.
+ */
+TraceAnalyzer::Resource *
+TraceAnalyzer::scopedResource(Context *ctx, Resource *scope, Key key)
+{
+    if (!scope) {
+        return stateResource(ctx, key);
+    }
+    key.scope = scope;
+    Resource *resource = lookup(key);
+    own(scope, resource);
+    return resource;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::setState(Context *ctx, const Key &key, trace::Call *call, bool replace)
+{
+    Resource *resource = stateResource(ctx, key);
+    /* Inside glPushAttrib/glPopAttrib earlier values may get restored, so
+     * they must be kept. */
+    if (replace && ctx->attribDepth == 0) {
+        reset(resource);
+    }
+    provide(resource, call->no);
+    ctx->changed.insert(resource);
+    return resource;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::setScopedState(Context *ctx, Resource *scope, const Key &key, trace::Call *call, bool replace)
+{
+    if (!scope) {
+        return setState(ctx, key, call, replace);
+    }
+    Resource *resource = scopedResource(ctx, scope, key);
+    if (replace) {
+        reset(resource);
+    }
+    provide(resource, call->no);
+    ctx->changed.insert(resource);
+    return resource;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::bufferData(Resource *buffer)
+{
+    Resource *data = lookup(Key(KIND_DATA, buffer));
+    own(buffer, data);
+    return data;
+}
+
+
+TraceAnalyzer::Resource *
+TraceAnalyzer::framebufferData(unsigned long long framebuffer)
+{
+    Resource *fb = object(KIND_FRAMEBUFFER, framebuffer);
+    Resource *data = lookup(Key(KIND_DATA, fb));
+    own(fb, data);
+    return data;
+}
+
+
+/*
+ * Pseudo-resource standing for whatever draws and dispatches write through
+ * images, storage buffers, atomic counters and transform feedback.
+ */
+TraceAnalyzer::Resource *
+TraceAnalyzer::sideEffectWrites(Context *ctx)
+{
+    return lookup(Key(KIND_SIDE_EFFECT_WRITES, ctx));
+}
+
+
+/*
+ * Texture uploads depend on the pixel unpack state at the time.
+ */
+void
+TraceAnalyzer::carryUnpackState(Context *ctx, Resource *resource)
+{
+    std::set<Resource *>::iterator it;
+    for (it = ctx->pixelStore.begin(); it != ctx->pixelStore.end(); ++it) {
+        provide(resource, *it);
+    }
+
+    Resource *unpack = findState(ctx, Key(KIND_BUFFER_BINDING) << GL_PIXEL_UNPACK_BUFFER);
+    if (unpack) {
+        provide(resource, unpack);
+        std::set<Resource *>::iterator dep;
+        for (dep = unpack->dependencies.begin(); dep != unpack->dependencies.end(); ++dep) {
+            link(resource, *dep);
+        }
+    }
+}
+
+
+void
+TraceAnalyzer::attach(Resource *framebuffer, unsigned long long attachment, Resource *image)
+{
+    Resource *data = lookup(Key(KIND_DATA, framebuffer));
+    own(framebuffer, data);
+
+    Attachments &fbAttachments = attachments[framebuffer];
+    Resource *&previous = fbAttachments[attachment];
+    if (previous && previous != image) {
+        /* The detached image keeps what was rendered into it so far. */
+        provide(previous, data);
+        std::set<Resource *>::iterator dep;
+        for (dep = data->dependencies.begin(); dep != data->dependencies.end(); ++dep) {
+            link(previous, *dep);
+        }
+        previous->children.erase(data);
+        data->parents.erase(previous);
+    }
+    previous = image;
+
+    if (image) {
+        link(framebuffer, image);
+        own(image, data);
+    } else {
+        fbAttachments.erase(attachment);
+    }
+}
+
+
+void
+TraceAnalyzer::bindFramebuffer(Context *ctx, unsigned long long target, unsigned long long framebuffer, trace::Call *call)
+{
+    Resource *fb = NULL;
+    if (framebuffer) {
+        fb = object(KIND_FRAMEBUFFER, framebuffer);
+        framebufferData(framebuffer);
+    }
+
+    if (isFramebufferTarget(target, false)) {
+        Resource *binding = setState(ctx, Key(KIND_DRAW_FRAMEBUFFER_BINDING), call);
+        if (fb) {
+            link(binding, fb);
+        }
+        ctx->drawFramebuffer = framebuffer;
+    }
+    if (isFramebufferTarget(target, true)) {
+        Resource *binding = setState(ctx, Key(KIND_READ_FRAMEBUFFER_BINDING), call);
+        if (fb) {
+            link(binding, fb);
+        }
+        ctx->readFramebuffer = framebuffer;
+    }
+}
+
+
+/*
+ * Record a change to the data store of a buffer.
+ */
+void
+TraceAnalyzer::updateBufferData(Context *ctx, Resource *buffer, Resource *binding, trace::Call *call)
+{
+    const char *name = call->name();
+    Resource *data = bufferData(buffer);
+
+    /* Respecifying the whole data store makes earlier uploads irrelevant. */
+    if (startsWith(name, "glBufferData") ||
+        startsWith(name, "glNamedBufferData")) {
+        reset(data);
+    }
+
+    provide(data, call->no);
+    if (binding) {
+        provide(data, binding);
+    }
+
+    if (strstr(name, "Map") && !strstr(name, "Unmap") && !strstr(name, "Flush")) {
+        unsigned long long address = 0;
+        if (getScalar(call->ret, address) && address) {
+            unsigned long long size = 0;
+            if (!getArg(call, "length", size) || !size) {
+                size = ~0ULL - address;
+            }
+            Mapping mapping;
+            mapping.size = size;
+            mapping.buffer = buffer;
+            mappings[address] = mapping;
+        }
+    } else if (strstr(name, "Unmap")) {
+        std::map<unsigned long long, Mapping>::iterator mapping = mappings.begin();
+        while (mapping != mappings.end()) {
+            if (mapping->second.buffer == buffer) {
+                mappings.erase(mapping++);
+            } else {
+                ++mapping;
+            }
+        }
+    } else if (strstr(name, "CopyBufferSubData") || strstr(name, "CopyNamedBufferSubData")) {
+        unsigned long long source = 0;
+        if (startsWith(name, "glCopyNamed")) {
+            source = getArg(call, "readBuffer");
+        } else {
+            std::map<unsigned long long, unsigned long long>::iterator it =
+                ctx->buffers.find(getArg(call, "readTarget"));
+            if (it != ctx->buffers.end()) {
+                source = it->second;
+                Resource *readBinding = findState(ctx, Key(KIND_BUFFER_BINDING) << it->first);
+                if (readBinding) {
+                    provide(data, readBinding);
+                }
+            }
+        }
+        if (source) {
+            link(data, bufferData(object(KIND_BUFFER, source)));
+        }
+    }
+}
+
+
+/*
+ * Calls on objects which are not tied to any context state.
+ */
+
+void
+TraceAnalyzer::analyzeWindowSystem(trace::Call *call)
+{
+    const char *name = call->name();
+
+    if (call->flags & (trace::CALL_FLAG_END_FRAME | trace::CALL_FLAG_SWAP_RENDERTARGET)) {
+        /* Presentation is only needed for the selected frames. */
+        return;
+    }
+
+    if (strcmp(name, "memcpy") == 0) {
+        unsigned long long dest = 0;
+        if (getArg(call, "dest", dest) && !mappings.empty()) {
+            std::map<unsigned long long, Mapping>::iterator it = mappings.upper_bound(dest);
+            if (it != mappings.begin()) {
+                --it;
+                if (dest - it->first < it->second.size) {
+                    Resource *data = bufferData(it->second.buffer);
+                    provide(data, call->no);
+                    return;
+                }
+            }
+        }
+        global.add(call->no);
+        return;
+    }
+
+    if (strstr(name, "DestroyContext") || strstr(name, "DeleteContext")) {
+        return;
+    }
+
+    if (strstr(name, "MakeCurrent") ||
+        strstr(name, "MakeContextCurrent") ||
+        strcmp(name, "CGLSetCurrentContext") == 0) {
+        unsigned long long ctx = 0;
+        if (!getArg(call, "ctx", ctx)) {
+            getArg(call, "hglrc", ctx);
+        }
+        currentContext[call->thread_id] = ctx;
+
+        Resource *current = lookup(Key(KIND_CURRENT) << call->thread_id);
+        currentBindings.insert(current);
+        reset(current);
+        provide(current, call->no);
+
+        if (ctx) {
+            Resource *context = object(KIND_CONTEXT, ctx);
+            link(current, context);
+
+            /* The first time a context is made current with a given drawable
+             * is when the retracer creates the latter. */
+            Key key(KIND_WINDOW_SYSTEM);
+            bool complete = windowSystemKey(call, key);
+            if (madeCurrent.insert(key).second || !complete) {
+                provide(context, call->no);
+            }
+        }
+        return;
+    }
+
+    if (strstr(name, "CreateContext") ||
+        strstr(name, "CreateNewContext")) {
+        unsigned long long ctx = 0;
+        if (getScalar(call->ret, ctx) && ctx) {
+            Resource *context = object(KIND_CONTEXT, ctx);
+            provide(context, call->no);
+
+            static const char *shareArgs[] = {
+                "shareList", "share_list", "share_context", "hShareContext", "share"
+            };
+            for (unsigned i = 0; i < sizeof shareArgs / sizeof shareArgs[0]; ++i) {
+                unsigned long long share = 0;
+                if (getArg(call, shareArgs[i], share) && share) {
+                    link(context, object(KIND_CONTEXT, share));
+                }
+            }
+            return;
+        }
+    }
+
+    /* Everything else (displays, configs, surfaces, ...) is kept once per
+     * distinct set of arguments. */
+    Key key(KIND_WINDOW_SYSTEM);
+    bool complete = windowSystemKey(call, key);
+    if (globalKeys.insert(key).second || !complete) {
+        global.add(call->no);
+    }
+}
+
+
+void
+TraceAnalyzer::analyzeGenerate(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+
+    if (strcmp(name, "glCreateProgram") == 0 ||
+        strcmp(name, "glCreateProgramObjectARB") == 0 ||
+        startsWith(name, "glCreateShaderProgram")) {
+        unsigned long long program = 0;
+        if (getScalar(call->ret, program)) {
+            provide(object(KIND_PROGRAM, program), call->no);
+        }
+        return;
+    }
+
+    if (strcmp(name, "glCreateShader") == 0 ||
+        strcmp(name, "glCreateShaderObjectARB") == 0) {
+        unsigned long long shader = 0;
+        if (getScalar(call->ret, shader)) {
+            provide(object(KIND_SHADER, shader), call->no);
+        }
+        return;
+    }
+
+    if (strcmp(name, "glGenLists") == 0) {
+        unsigned long long first = 0;
+        if (getScalar(call->ret, first) && first) {
+            unsigned long long range = getArg(call, "range");
+            for (unsigned long long list = first; list < first + range; ++list) {
+                Resource *resource = object(KIND_LIST, list);
+                provide(resource, call->no);
+                lists.insert(resource);
+            }
+        }
+        return;
+    }
+
+    if (strcmp(name, "glFenceSync") == 0) {
+        unsigned long long sync = 0;
+        if (getScalar(call->ret, sync)) {
+            provide(object(KIND_SYNC, sync), call->no);
+        }
+        return;
+    }
+
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        unsigned kind = objectKind(call, call->sig->arg_names[i]);
+        if (!kind) {
+            continue;
+        }
+        std::vector<unsigned long long> names;
+        getNames(call->args[i].value, names);
+        for (size_t j = 0; j < names.size(); ++j) {
+            provide(object(kind, names[j]), call->no);
+        }
+    }
+}
+
+
+bool
+TraceAnalyzer::analyzeBinding(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+
+    if (startsWith(name, "glActiveTexture")) {
+        ctx->activeTexture = getArg(call, "texture") - GL_TEXTURE0;
+        setState(ctx, Key(KIND_ACTIVE_TEXTURE), call);
+        return true;
+    }
+
+    if (startsWith(name, "glClientActiveTexture")) {
+        ctx->clientActiveTexture = getArg(call, "texture") - GL_TEXTURE0;
+        setState(ctx, Key(KIND_CLIENT_ACTIVE_TEXTURE), call);
+        return true;
+    }
+
+    if (strcmp(name, "glBindTexture") == 0 ||
+        strcmp(name, "glBindTextureEXT") == 0 ||
+        strcmp(name, "glBindMultiTextureEXT") == 0) {
+        unsigned long long target = textureTarget(getArg(call, "target"));
+        unsigned long long texture = getArg(call, "texture");
+        unsigned unit = ctx->activeTexture;
+        if (strcmp(name, "glBindMultiTextureEXT") == 0) {
+            unit = getArg(call, "texunit") - GL_TEXTURE0;
+        }
+
+        /* Binding a name which was never generated creates the object. */
+        bool created = !findObject(KIND_TEXTURE, texture);
+        Resource *object = this->object(KIND_TEXTURE, texture);
+
+        Resource *binding = setState(ctx, Key(KIND_TEXTURE_BINDING) << unit << target, call);
+        Resource *activeTexture = findState(ctx, Key(KIND_ACTIVE_TEXTURE));
+        if (activeTexture && unit == ctx->activeTexture) {
+            provide(binding, activeTexture);
+        }
+        link(binding, object);
+        if (created) {
+            provide(object, binding);
+        }
+
+        ctx->textures[std::make_pair(unit, target)] = texture;
+        return true;
+    }
+
+    if (strcmp(name, "glBindTextureUnit") == 0) {
+        unsigned long long unit = getArg(call, "unit");
+        Resource *binding = setState(ctx, Key(KIND_TEXTURE_UNIT_BINDING) << unit, call);
+        unsigned long long texture = getArg(call, "texture");
+        if (texture) {
+            link(binding, object(KIND_TEXTURE, texture));
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glBindTextures") ||
+        startsWith(name, "glBindSamplers") ||
+        startsWith(name, "glBindImageTextures") ||
+        startsWith(name, "glBindBuffersBase") ||
+        startsWith(name, "glBindBuffersRange") ||
+        startsWith(name, "glBindVertexBuffers")) {
+        Key key(KIND_CALL);
+        bool complete = stateKey(call, key);
+        Resource *binding = setState(ctx, key, call, complete);
+        for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+            unsigned kind = objectKind(call, call->sig->arg_names[i]);
+            if (!kind) {
+                continue;
+            }
+            std::vector<unsigned long long> names;
+            getNames(call->args[i].value, names);
+            for (size_t j = 0; j < names.size(); ++j) {
+                if (names[j]) {
+                    Resource *resource = object(kind, names[j]);
+                    link(binding, resource);
+                    if (startsWith(name, "glBindImageTextures") ||
+                        (startsWith(name, "glBindBuffers") &&
+                         getArg(call, "target") != GL_UNIFORM_BUFFER)) {
+                        own(resource, sideEffectWrites(ctx));
+                        ctx->sideEffects = true;
+                    }
+                }
+            }
+        }
+        if (startsWith(name, "glBindVertexBuffers") && ctx->vertexArray) {
+            Resource *vao = object(KIND_VERTEX_ARRAY, ctx->vertexArray);
+            link(vao, binding);
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glBindImageTexture")) {
+        Resource *binding = setState(ctx, Key(KIND_IMAGE_BINDING) << getArg(call, "unit"), call);
+        unsigned long long texture = getArg(call, "texture");
+        if (texture) {
+            Resource *object = this->object(KIND_TEXTURE, texture);
+            link(binding, object);
+            own(object, sideEffectWrites(ctx));
+            ctx->sideEffects = true;
+        }
+        return true;
+    }
+
+    if (strcmp(name, "glBindSampler") == 0) {
+        Resource *binding = setState(ctx, Key(KIND_SAMPLER_BINDING) << getArg(call, "unit"), call);
+        unsigned long long sampler = getArg(call, "sampler");
+        if (sampler) {
+            link(binding, object(KIND_SAMPLER, sampler));
+        }
+        return true;
+    }
+
+    if (strcmp(name, "glBindBuffer") == 0 ||
+        strcmp(name, "glBindBufferARB") == 0) {
+        unsigned long long target = getArg(call, "target");
+        unsigned long long buffer = getArg(call, "buffer");
+
+        bool created = buffer && !findObject(KIND_BUFFER, buffer);
+        Resource *object = buffer ? this->object(KIND_BUFFER, buffer) : NULL;
+
+        Resource *binding;
+        if (target == GL_ELEMENT_ARRAY_BUFFER && ctx->vertexArray) {
+            /* Element array bindings are vertex array object state. */
+            Resource *vao = this->object(KIND_VERTEX_ARRAY, ctx->vertexArray);
+            binding = setScopedState(ctx, vao, Key(KIND_BUFFER_BINDING) << target, call);
+            Resource *vaoBinding = findState(ctx, Key(KIND_VERTEX_ARRAY_BINDING));
+            if (vaoBinding) {
+                provide(binding, vaoBinding);
+            }
+        } else {
+            binding = setState(ctx, Key(KIND_BUFFER_BINDING) << target, call);
+        }
+        if (object) {
+            link(binding, object);
+            if (created) {
+                provide(object, call->no);
+            }
+        }
+
+        ctx->buffers[target] = buffer;
+        return true;
+    }
+
+    if (startsWith(name, "glBindBufferBase") ||
+        startsWith(name, "glBindBufferRange") ||
+        startsWith(name, "glBindBufferOffset")) {
+        unsigned long long target = getArg(call, "target");
+        unsigned long long index = getArg(call, "index");
+        unsigned long long buffer = getArg(call, "buffer");
+
+        /* These also bind the generic binding point. */
+        Resource *indexed = setState(ctx, Key(KIND_BUFFER_BINDING) << target << index, call);
+        Resource *generic = setState(ctx, Key(KIND_BUFFER_BINDING) << target, call);
+        if (buffer) {
+            Resource *object = this->object(KIND_BUFFER, buffer);
+            link(indexed, object);
+            link(generic, object);
+            if (target != GL_UNIFORM_BUFFER) {
+                own(object, sideEffectWrites(ctx));
+                ctx->sideEffects = true;
+            }
+        }
+
+        ctx->buffers[target] = buffer;
+        return true;
+    }
+
+    if (strcmp(name, "glBindVertexArray") == 0 ||
+        strcmp(name, "glBindVertexArrayAPPLE") == 0 ||
+        strcmp(name, "glBindVertexArrayOES") == 0) {
+        unsigned long long array = getArg(call, "array");
+        Resource *binding = setState(ctx, Key(KIND_VERTEX_ARRAY_BINDING), call);
+        if (array) {
+            Resource *vao = object(KIND_VERTEX_ARRAY, array);
+            link(binding, vao);
+
+            /* Vertex array state will now be pinned through the object. */
+            std::set<Resource *>::iterator it;
+            for (it = vao->children.begin(); it != vao->children.end(); ++it) {
+                ctx->changed.insert(*it);
+            }
+        }
+        ctx->vertexArray = array;
+        return true;
+    }
+
+    if (strcmp(name, "glBindFramebuffer") == 0 ||
+        strcmp(name, "glBindFramebufferEXT") == 0 ||
+        strcmp(name, "glBindFramebufferOES") == 0) {
+        bindFramebuffer(ctx, getArg(call, "target"), getArg(call, "framebuffer"), call);
+        return true;
+    }
+
+    if (strcmp(name, "glBindRenderbuffer") == 0 ||
+        strcmp(name, "glBindRenderbufferEXT") == 0 ||
+        strcmp(name, "glBindRenderbufferOES") == 0) {
+        unsigned long long renderbuffer = getArg(call, "renderbuffer");
+        Resource *binding = setState(ctx, Key(KIND_RENDERBUFFER_BINDING), call);
+        if (renderbuffer) {
+            link(binding, object(KIND_RENDERBUFFER, renderbuffer));
+        }
+        ctx->renderbuffer = renderbuffer;
+        return true;
+    }
+
+    if (strcmp(name, "glUseProgram") == 0 ||
+        strcmp(name, "glUseProgramObjectARB") == 0) {
+        unsigned long long program = 0;
+        if (!getArg(call, "program", program)) {
+            getArg(call, "programObj", program);
+        }
+        Resource *binding = setState(ctx, Key(KIND_PROGRAM_BINDING), call);
+        if (program) {
+            Resource *object = this->object(KIND_PROGRAM, program);
+            link(binding, object);
+
+            std::set<Resource *>::iterator it;
+            for (it = object->children.begin(); it != object->children.end(); ++it) {
+                ctx->changed.insert(*it);
+            }
+        }
+        ctx->program = program;
+        return true;
+    }
+
+    if (strcmp(name, "glBindProgramPipeline") == 0) {
+        Resource *binding = setState(ctx, Key(KIND_PIPELINE_BINDING), call);
+        unsigned long long pipeline = getArg(call, "pipeline");
+        if (pipeline) {
+            link(binding, object(KIND_PIPELINE, pipeline));
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glBindTransformFeedback")) {
+        Resource *binding = setState(ctx, Key(KIND_TRANSFORM_FEEDBACK_BINDING), call);
+        unsigned long long id = getArg(call, "id");
+        if (id) {
+            link(binding, object(KIND_TRANSFORM_FEEDBACK, id));
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glBeginTransformFeedback")) {
+        setState(ctx, Key(KIND_TRANSFORM_FEEDBACK_STATE), call);
+        ctx->sideEffects = true;
+        return true;
+    }
+
+    if (startsWith(name, "glEndTransformFeedback") ||
+        startsWith(name, "glPauseTransformFeedback") ||
+        startsWith(name, "glResumeTransformFeedback")) {
+        setState(ctx, Key(KIND_TRANSFORM_FEEDBACK_STATE), call, false);
+        return true;
+    }
+
+    if (startsWith(name, "glBeginQuery") ||
+        startsWith(name, "glEndQuery")) {
+        Key key = Key(KIND_QUERY_STATE) << getArg(call, "target") << getArg(call, "index");
+        Resource *state = setState(ctx, key, call, startsWith(name, "glBeginQuery"));
+        unsigned long long id = getArg(call, "id");
+        if (id) {
+            link(state, object(KIND_QUERY, id));
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glBeginConditionalRender") ||
+        startsWith(name, "glEndConditionalRender")) {
+        Resource *state = setState(ctx, Key(KIND_CONDITIONAL_RENDER), call, startsWith(name, "glBegin"));
+        unsigned long long id = getArg(call, "id");
+        if (id) {
+            link(state, object(KIND_QUERY, id));
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+bool
+TraceAnalyzer::analyzeUniform(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+    Resource *program;
+
+    if (startsWith(name, "glProgramUniform")) {
+        unsigned long long object = 0;
+        if (!getArg(call, "program", object)) {
+            return false;
+        }
+        program = this->object(KIND_PROGRAM, object);
+    } else if (startsWith(name, "glUniform") &&
+               (isdigit(name[9]) ||
+                startsWith(name + 9, "Matrix") ||
+                startsWith(name + 9, "Handle"))) {
+        if (!ctx->program) {
+            return true;
+        }
+        program = object(KIND_PROGRAM, ctx->program);
+    } else {
+        return false;
+    }
+
+    unsigned long long location;
+    if (!getArg(call, "location", location)) {
+        return false;
+    }
+    if (static_cast<long long>(location) < 0) {
+        return true;
+    }
+
+    Resource *uniform = setScopedState(ctx, program, Key(KIND_UNIFORM) << location, call);
+    if (!startsWith(name, "glProgramUniform")) {
+        Resource *binding = findState(ctx, Key(KIND_PROGRAM_BINDING));
+        if (binding) {
+            provide(uniform, binding);
+        }
+    }
+    return true;
+}
+
+
+/*
+ * Non-DSA calls operating on whatever object is bound to a target.
+ */
+bool
+TraceAnalyzer::analyzeBoundObject(Context *ctx, trace::Call *call, const std::vector<Resource *> &objects)
+{
+    const char *name = call->name();
+
+    static const char *textureFunctions[] = {
+        "glTexImage",
+        "glTexSubImage",
+        "glTexStorage",
+        "glTexParameter",
+        "glTexBuffer",
+        "glTexPageCommitment",
+        "glCompressedTexImage",
+        "glCompressedTexSubImage",
+        "glCopyTexImage",
+        "glCopyTexSubImage",
+        "glGenerateMipmap",
+        "glEGLImageTargetTexture",
+    };
+    for (unsigned i = 0; i < sizeof textureFunctions / sizeof textureFunctions[0]; ++i) {
+        if (!startsWith(name, textureFunctions[i])) {
+            continue;
+        }
+
+        unsigned long long target = textureTarget(getArg(call, "target"));
+        unsigned long long texture = 0;
+        std::map<std::pair<unsigned, unsigned long long>, unsigned long long>::iterator bound =
+            ctx->textures.find(std::make_pair(ctx->activeTexture, target));
+        if (bound != ctx->textures.end()) {
+            texture = bound->second;
+        }
+
+        Resource *object = this->object(KIND_TEXTURE, texture);
+        provide(object, call->no);
+
+        Resource *binding = findState(ctx, Key(KIND_TEXTURE_BINDING) << ctx->activeTexture << target);
+        if (binding) {
+            provide(object, binding);
+        }
+        Resource *activeTexture = findState(ctx, Key(KIND_ACTIVE_TEXTURE));
+        if (activeTexture) {
+            provide(object, activeTexture);
+        }
+
+        if (strstr(name, "Image") && !strstr(name, "Copy")) {
+            carryUnpackState(ctx, object);
+        }
+
+        if (startsWith(name, "glCopyTex") && ctx->readFramebuffer) {
+            link(object, framebufferData(ctx->readFramebuffer));
+            Resource *readBinding = findState(ctx, Key(KIND_READ_FRAMEBUFFER_BINDING));
+            if (readBinding) {
+                provide(object, readBinding);
+            }
+        }
+
+        if (startsWith(name, "glEGLImageTargetTexture")) {
+            unsigned long long image = getArg(call, "image");
+            if (image) {
+                link(object, this->object(KIND_EGL_IMAGE, image));
+            }
+        }
+
+        for (size_t j = 0; j < objects.size(); ++j) {
+            link(object, objects[j]);
+        }
+        return true;
+    }
+
+    static const char *bufferFunctions[] = {
+        "glBufferData",
+        "glBufferSubData",
+        "glBufferStorage",
+        "glBufferParameteri",
+        "glBufferPageCommitment",
+        "glMapBuffer",
+        "glUnmapBuffer",
+        "glFlushMappedBufferRange",
+        "glCopyBufferSubData",
+        "glClearBufferData",
+        "glClearBufferSubData",
+    };
+    for (unsigned i = 0; i < sizeof bufferFunctions / sizeof bufferFunctions[0]; ++i) {
+        if (!startsWith(name, bufferFunctions[i])) {
+            continue;
+        }
+
+        unsigned long long target = 0;
+        if (!getArg(call, "target", target)) {
+            getArg(call, "writeTarget", target);
+        }
+
+        std::map<unsigned long long, unsigned long long>::iterator bound = ctx->buffers.find(target);
+        if (bound == ctx->buffers.end() || !bound->second) {
+            /* Error, or client-side buffer emulation. */
+            Key key(KIND_CALL);
+            stateKey(call, key);
+            setState(ctx, key, call, false);
+            return true;
+        }
+
+        Resource *binding = NULL;
+        if (target == GL_ELEMENT_ARRAY_BUFFER && ctx->vertexArray) {
+            Resource *vao = findObject(KIND_VERTEX_ARRAY, ctx->vertexArray);
+            if (vao) {
+                binding = find(Key(KIND_BUFFER_BINDING, vao) << target);
+            }
+        } else {
+            binding = findState(ctx, Key(KIND_BUFFER_BINDING) << target);
+        }
+
+        updateBufferData(ctx, object(KIND_BUFFER, bound->second), binding, call);
+        return true;
+    }
+
+    if (startsWith(name, "glFramebufferTexture") ||
+        startsWith(name, "glFramebufferRenderbuffer") ||
+        startsWith(name, "glFramebufferParameteri") ||
+        (startsWith(name, "glDrawBuffer") && ctx->drawFramebuffer) ||
+        (startsWith(name, "glReadBuffer") && ctx->readFramebuffer) ||
+        startsWith(name, "glInvalidateFramebuffer") ||
+        startsWith(name, "glInvalidateSubFramebuffer") ||
+        startsWith(name, "glDiscardFramebuffer")) {
+        bool read = startsWith(name, "glReadBuffer");
+        if (!read && !startsWith(name, "glDrawBuffer")) {
+            read = getArg(call, "target") == GL_READ_FRAMEBUFFER;
+        }
+
+        unsigned long long framebuffer = read ? ctx->readFramebuffer : ctx->drawFramebuffer;
+        if (!framebuffer) {
+            Key key(KIND_CALL);
+            bool complete = stateKey(call, key);
+            setState(ctx, key, call, complete);
+            return true;
+        }
+
+        Resource *fb = object(KIND_FRAMEBUFFER, framebuffer);
+        if (startsWith(name, "glInvalidate") || startsWith(name, "glDiscard")) {
+            provide(framebufferData(framebuffer), call->no);
+            return true;
+        }
+
+        provide(fb, call->no);
+        Resource *binding = findState(ctx, Key(read ? KIND_READ_FRAMEBUFFER_BINDING : KIND_DRAW_FRAMEBUFFER_BINDING));
+        if (binding) {
+            provide(fb, binding);
+        }
+
+        unsigned long long attachment;
+        if (getArg(call, "attachment", attachment)) {
+            Resource *image = NULL;
+            for (size_t j = 0; j < objects.size(); ++j) {
+                image = objects[j];
+            }
+            attach(fb, attachment, image);
+        }
+        return true;
+    }
+
+    if (startsWith(name, "glRenderbufferStorage")) {
+        if (!ctx->renderbuffer) {
+            return true;
+        }
+        Resource *object = this->object(KIND_RENDERBUFFER, ctx->renderbuffer);
+        provide(object, call->no);
+        Resource *binding = findState(ctx, Key(KIND_RENDERBUFFER_BINDING));
+        if (binding) {
+            provide(object, binding);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * Calls that explicitly name the objects they operate on.  The first object
+ * is the one modified; any other object is a dependency.
+ */
+bool
+TraceAnalyzer::analyzeNamedObject(Context *ctx, trace::Call *call, const std::vector<Resource *> &objects)
+{
+    if (objects.empty()) {
+        return false;
+    }
+
+    const char *name = call->name();
+    Resource *object = objects[0];
+
+    if (strstr(name, "NamedBuffer") &&
+        !strstr(name, "Framebuffer") &&
+        !strstr(name, "Renderbuffer")) {
+        updateBufferData(ctx, object, NULL, call);
+        for (size_t i = 1; i < objects.size(); ++i) {
+            link(bufferData(object), objects[i]);
+        }
+        return true;
+    }
+
+    provide(object, call->no);
+
+    if (startsWith(name, "glTexture") ||
+        startsWith(name, "glCompressedTexture") ||
+        startsWith(name, "glCopyTexture") ||
+        startsWith(name, "glMultiTex") ||
+        startsWith(name, "glCompressedMultiTex")) {
+        if (strstr(name, "Image") && !strstr(name, "Copy")) {
+            carryUnpackState(ctx, object);
+        }
+        if (strstr(name, "Copy") && ctx->readFramebuffer) {
+            link(object, framebufferData(ctx->readFramebuffer));
+        }
+    }
+
+    if (startsWith(name, "glNamedFramebuffer")) {
+        unsigned long long attachment;
+        if (getArg(call, "attachment", attachment)) {
+            attach(object, attachment, objects.size() > 1 ? objects[1] : NULL);
+            return true;
+        }
+    }
+
+    if (startsWith(name, "glCopyImageSubData") && objects.size() > 1) {
+        /* Destination is the second object. */
+        Resource *dst = objects[1];
+        provide(dst, call->no);
+        link(dst, object);
+        return true;
+    }
+
+    for (size_t i = 1; i < objects.size(); ++i) {
+        link(object, objects[i]);
+    }
+
+    return true;
+}
+
+
+bool
+TraceAnalyzer::analyzeVertexArray(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+
+    static const char *pointerFunctions[] = {
+        "glVertexAttribPointer",
+        "glVertexAttribIPointer",
+        "glVertexAttribLPointer",
+        "glVertexPointer",
+        "glNormalPointer",
+        "glColorPointer",
+        "glSecondaryColorPointer",
+        "glFogCoordPointer",
+        "glEdgeFlagPointer",
+        "glIndexPointer",
+        "glTexCoordPointer",
+        "glInterleavedArrays",
+    };
+    static const char *stateFunctions[] = {
+        "glEnableVertexAttribArray",
+        "glDisableVertexAttribArray",
+        "glVertexAttribDivisor",
+        "glVertexAttribBinding",
+        "glVertexAttribFormat",
+        "glVertexAttribIFormat",
+        "glVertexAttribLFormat",
+        "glVertexBindingDivisor",
+        "glBindVertexBuffer",
+        "glEnableClientState",
+        "glDisableClientState",
+    };
+
+    bool pointer = false;
+    bool state = false;
+    for (unsigned i = 0; !pointer && i < sizeof pointerFunctions / sizeof pointerFunctions[0]; ++i) {
+        pointer = startsWith(name, pointerFunctions[i]);
+    }
+    for (unsigned i = 0; !pointer && !state && i < sizeof stateFunctions / sizeof stateFunctions[0]; ++i) {
+        state = startsWith(name, stateFunctions[i]);
+    }
+    if (!pointer && !state) {
+        return false;
+    }
+
+    Key key(KIND_CALL);
+    bool complete = true;
+    if (startsWith(name, "glEnableVertexAttribArray") ||
+        startsWith(name, "glDisableVertexAttribArray")) {
+        key = Key(KIND_VERTEX_ATTRIB_ARRAY) << getArg(call, "index");
+    } else if (startsWith(name, "glEnableClientState") ||
+               startsWith(name, "glDisableClientState")) {
+        key = Key(KIND_CLIENT_STATE) << getArg(call, "array");
+    } else {
+        complete = stateKey(call, key);
+    }
+    bool texCoord = startsWith(name, "glTexCoordPointer") ||
+                    getArg(call, "array") == GL_TEXTURE_COORD_ARRAY;
+    if (texCoord) {
+        complete = complete && key.add(ctx->clientActiveTexture);
+    }
+
+    Resource *vao = ctx->vertexArray ? object(KIND_VERTEX_ARRAY, ctx->vertexArray) : NULL;
+    Resource *resource = setScopedState(ctx, vao, key, call, complete);
+
+    if (vao) {
+        Resource *binding = findState(ctx, Key(KIND_VERTEX_ARRAY_BINDING));
+        if (binding) {
+            provide(resource, binding);
+        }
+    }
+
+    Resource *clientActiveTexture = findState(ctx, Key(KIND_CLIENT_ACTIVE_TEXTURE));
+    if (clientActiveTexture && texCoord) {
+        provide(resource, clientActiveTexture);
+    }
+
+    if (pointer) {
+        Resource *binding = findState(ctx, Key(KIND_BUFFER_BINDING) << GL_ARRAY_BUFFER);
+        if (binding) {
+            provide(resource, binding);
+            std::set<Resource *>::iterator dep;
+            for (dep = binding->dependencies.begin(); dep != binding->dependencies.end(); ++dep) {
+                link(resource, *dep);
+            }
+        }
+    }
+
+    unsigned long long buffer;
+    if (getArg(call, "buffer", buffer) && buffer) {
+        link(resource, object(KIND_BUFFER, buffer));
+    }
+
+    return true;
+}
+
+
+bool
+TraceAnalyzer::analyzeMatrix(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+
+    if (strcmp(name, "glMatrixMode") == 0) {
+        ctx->matrixMode = getArg(call, "mode");
+        setState(ctx, Key(KIND_MATRIX_MODE), call);
+        return true;
+    }
+
+    static const char *matrixFunctions[] = {
+        "glLoadIdentity",
+        "glLoadMatrix",
+        "glLoadTransposeMatrix",
+        "glMultMatrix",
+        "glMultTransposeMatrix",
+        "glRotate",
+        "glScale",
+        "glTranslate",
+        "glOrtho",
+        "glFrustum",
+        "glPushMatrix",
+        "glPopMatrix",
+    };
+    bool matrix = false;
+    for (unsigned i = 0; !matrix && i < sizeof matrixFunctions / sizeof matrixFunctions[0]; ++i) {
+        matrix = startsWith(name, matrixFunctions[i]);
+    }
+
+    Key key(KIND_MATRIX);
+    bool load;
+    bool push;
+    bool pop;
+    if (matrix) {
+        key << ctx->matrixMode;
+        if (ctx->matrixMode == GL_TEXTURE) {
+            key << ctx->activeTexture;
+        }
+        load = startsWith(name, "glLoad");
+        push = startsWith(name, "glPushMatrix");
+        pop = startsWith(name, "glPopMatrix");
+    } else if (startsWith(name, "glMatrix") && strstr(name, "EXT")) {
+        key << getArg(call, "mode");
+        load = startsWith(name, "glMatrixLoad");
+        push = startsWith(name, "glMatrixPush");
+        pop = startsWith(name, "glMatrixPop");
+    } else {
+        return false;
+    }
+
+    unsigned &depth = ctx->matrixDepth[key];
+
+    /* Matrix operations are cumulative, but loads discard everything that
+     * came before, provided no earlier matrix may be popped back. */
+    Resource *resource = setState(ctx, key, call, load && depth == 0);
+
+    if (matrix) {
+        Resource *matrixMode = findState(ctx, Key(KIND_MATRIX_MODE));
+        if (matrixMode) {
+            provide(resource, matrixMode);
+        }
+        if (ctx->matrixMode == GL_TEXTURE) {
+            Resource *activeTexture = findState(ctx, Key(KIND_ACTIVE_TEXTURE));
+            if (activeTexture) {
+                provide(resource, activeTexture);
+            }
+        }
+    }
+
+    if (push) {
+        ++depth;
+    } else if (pop && depth) {
+        --depth;
+    }
+
+    return true;
+}
+
+
+/*
+ * Draws, clears, blits and dispatches.
+ */
+
+void
+TraceAnalyzer::recordDraw(Context *ctx, Resource *target, trace::CallNo call_no)
+{
+    provide(target, call_no);
+
+    /* Pin the state the draw was done with.  Only the state that changed
+     * needs to be pinned when drawing repeatedly into the same target. */
+    std::set<Resource *>::iterator it;
+    if (ctx->lastDrawTarget != target) {
+        for (it = ctx->state.begin(); it != ctx->state.end(); ++it) {
+            link(target, *it);
+        }
+        if (ctx->program) {
+            Resource *program = object(KIND_PROGRAM, ctx->program);
+            for (it = program->children.begin(); it != program->children.end(); ++it) {
+                link(target, *it);
+            }
+        }
+        if (ctx->vertexArray) {
+            Resource *vao = object(KIND_VERTEX_ARRAY, ctx->vertexArray);
+            for (it = vao->children.begin(); it != vao->children.end(); ++it) {
+                link(target, *it);
+            }
+        }
+        ctx->lastDrawTarget = target;
+    } else {
+        for (it = ctx->changed.begin(); it != ctx->changed.end(); ++it) {
+            link(target, *it);
+        }
+    }
+    ctx->changed.clear();
+}
+
+
+void
+TraceAnalyzer::analyzeRender(Context *ctx, trace::Call *call)
+{
+    const char *name = call->name();
+
+    bool compute = startsWith(name, "glDispatchCompute");
+
+    Resource *target = NULL;
+    if (ctx->drawFramebuffer && !compute) {
+        target = framebufferData(ctx->drawFramebuffer);
+
+        if (strcmp(name, "glClear") == 0 && !ctx->scissorTest) {
+            /* A full clear makes whatever was rendered before irrelevant. */
+            unsigned long long mask = getArg(call, "mask");
+            unsigned long long needed = 0;
+            Attachments &fbAttachments = attachments[object(KIND_FRAMEBUFFER, ctx->drawFramebuffer)];
+            Attachments::iterator it;
+            for (it = fbAttachments.begin(); it != fbAttachments.end(); ++it) {
+                switch (it->first) {
+                case GL_DEPTH_ATTACHMENT:
+                    needed |= GL_DEPTH_BUFFER_BIT;
+                    break;
+                case GL_STENCIL_ATTACHMENT:
+                    needed |= GL_STENCIL_BUFFER_BIT;
+                    break;
+                case GL_DEPTH_STENCIL_ATTACHMENT:
+                    needed |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+                    break;
+                default:
+                    needed |= GL_COLOR_BUFFER_BIT;
+                    break;
+                }
+            }
+            if (needed && (mask & needed) == needed) {
+                reset(target);
+                ctx->lastDrawTarget = NULL;
+            }
+        }
+    }
+
+    if (target) {
+        recordDraw(ctx, target, call->no);
+
+        if (startsWith(name, "glBlitFramebuffer") && ctx->readFramebuffer) {
+            link(target, framebufferData(ctx->readFramebuffer));
+        }
+    }
+
+    if (ctx->sideEffects) {
+        Resource *writes = sideEffectWrites(ctx);
+        if (target) {
+            link(writes, target);
+        } else {
+            recordDraw(ctx, writes, call->no);
+        }
+    }
+
+    if (startsWith(name, "glCallList")) {
+        /* Display lists may change state too. */
+        Key key(KIND_CALL);
+        bool complete = stateKey(call, key) && key.add(getArg(call, "list"));
+        Resource *state = setState(ctx, key, call, complete);
+        if (strcmp(name, "glCallList") == 0) {
+            Resource *list = findObject(KIND_LIST, getArg(call, "list"));
+            if (list) {
+                link(state, list);
+                if (target) {
+                    link(target, list);
+                }
+            }
+        } else {
+            std::set<Resource *>::iterator it;
+            for (it = lists.begin(); it != lists.end(); ++it) {
+                link(state, *it);
+                if (target) {
+                    link(target, *it);
+                }
+            }
+        }
+    }
+}
+
+
+/*
+ * Entry points.
+ */
+
+void
+TraceAnalyzer::analyze(trace::Call *call)
+{
+    const char *name = call->name();
+
+    touched.clear();
+
+    if (analyzedSinceRequire) {
+        stale = true;
+    }
+    analyzedSinceRequire = true;
+
+    if (call->flags & trace::CALL_FLAG_NO_SIDE_EFFECTS) {
+        /* The retracer relies on location queries to remap locations. */
+        if (!(startsWith(name, "glGet") &&
+              (strstr(name, "Location") || strstr(name, "Index")))) {
+            return;
+        }
+    }
+
+    if (!(name[0] == 'g' && name[1] == 'l' && isupper(name[2])) ||
+        startsWith(name, "glX")) {
+        analyzeWindowSystem(call);
+        return;
+    }
+
+    Context *ctx = getContext(call);
+
+    if (ctx->currentList) {
+        provide(object(KIND_LIST, ctx->currentList), call->no);
+        if (strcmp(name, "glEndList") == 0) {
+            ctx->currentList = 0;
+        }
+        return;
+    }
+
+    if (strcmp(name, "glNewList") == 0) {
+        ctx->currentList = getArg(call, "list");
+        Resource *list = object(KIND_LIST, ctx->currentList);
+        lists.insert(list);
+        /* Compiling a list replaces its previous contents. */
+        reset(list);
+        provide(list, call->no);
+        return;
+    }
+
+    if (ctx->insideBeginEnd || strcmp(name, "glBegin") == 0) {
+        ctx->insideBeginEnd = strcmp(name, "glEnd") != 0;
+        analyzeRender(ctx, call);
+        return;
+    }
+
+    if (startsWith(name, "glDelete")) {
+        if (strcmp(name, "glDeleteLists") == 0) {
+            unsigned long long first = getArg(call, "list");
+            unsigned long long range = getArg(call, "range");
+            for (unsigned long long list = first; list < first + range; ++list) {
+                Resource *resource = findObject(KIND_LIST, list);
+                if (resource) {
+                    discard(resource);
+                }
+            }
+            return;
+        }
+        for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+            unsigned kind = objectKind(call, call->sig->arg_names[i]);
+            if (!kind) {
+                continue;
+            }
+            std::vector<unsigned long long> names;
+            getNames(call->args[i].value, names);
+            for (size_t j = 0; j < names.size(); ++j) {
+                Resource *resource = findObject(kind, names[j]);
+                if (resource) {
+                    discard(resource);
+                }
+            }
+        }
+        return;
+    }
+
+    if ((startsWith(name, "glGen") && !startsWith(name, "glGenerate")) ||
+        startsWith(name, "glCreate") ||
+        strcmp(name, "glFenceSync") == 0) {
+        analyzeGenerate(ctx, call);
+        return;
+    }
+
+    if (analyzeBinding(ctx, call) ||
+        analyzeUniform(ctx, call)) {
+        return;
+    }
+
+    if ((call->flags & trace::CALL_FLAG_RENDER) ||
+        startsWith(name, "glDispatchCompute")) {
+        analyzeRender(ctx, call);
+        return;
+    }
+
+    std::vector<Resource *> objects;
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        unsigned kind = objectKind(call, call->sig->arg_names[i]);
+        if (!kind) {
+            continue;
+        }
+        std::vector<unsigned long long> names;
+        getNames(call->args[i].value, names);
+        for (size_t j = 0; j < names.size(); ++j) {
+            if (names[j]) {
+                objects.push_back(object(kind, names[j]));
+            }
+        }
+    }
+
+    if (analyzeBoundObject(ctx, call, objects) ||
+        analyzeVertexArray(ctx, call) ||
+        analyzeNamedObject(ctx, call, objects) ||
+        analyzeMatrix(ctx, call)) {
+        return;
+    }
+
+    if (startsWith(name, "glPushAttrib") ||
+        startsWith(name, "glPushClientAttrib")) {
+        setState(ctx, Key(KIND_ATTRIB_STACK), call, false);
+        ++ctx->attribDepth;
+        return;
+    }
+
+    if (startsWith(name, "glPopAttrib") ||
+        startsWith(name, "glPopClientAttrib")) {
+        setState(ctx, Key(KIND_ATTRIB_STACK), call, false);
+        if (ctx->attribDepth) {
+            --ctx->attribDepth;
+        }
+        return;
+    }
+
+    if (strcmp(name, "glEnable") == 0 ||
+        strcmp(name, "glDisable") == 0) {
+        unsigned long long cap = getArg(call, "cap");
+        if (cap == GL_SCISSOR_TEST) {
+            ctx->scissorTest = name[2] == 'E';
+        }
+        setState(ctx, Key(KIND_ENABLE) << cap, call);
+        return;
+    }
+
+    if (startsWith(name, "glEnablei") ||
+        startsWith(name, "glDisablei") ||
+        startsWith(name, "glEnableIndexed") ||
+        startsWith(name, "glDisableIndexed")) {
+        setState(ctx, Key(KIND_ENABLE) << getArg(call, "target") << getArg(call, "index"), call);
+        return;
+    }
+
+    if (strcmp(name, "glFlush") == 0 ||
+        strcmp(name, "glFinish") == 0) {
+        return;
+    }
+
+    Key key(KIND_CALL);
+    bool complete = stateKey(call, key);
+    Resource *resource = setState(ctx, key, call, complete);
+    if (startsWith(name, "glPixelStore")) {
+        ctx->pixelStore.insert(resource);
+    }
+}
+
+
+void
+TraceAnalyzer::requireResource(Resource *resource)
+{
+    std::vector<Resource *> pending;
+    pending.push_back(resource);
+
+    while (!pending.empty()) {
+        Resource *current = pending.back();
+        pending.pop_back();
+
+        if (current->generation == generation) {
+            continue;
+        }
+        current->generation = generation;
+
+        /* Once required, the calls need not be tracked any further. */
+        trace::FastCallRange *range = current->calls.head.next[0]();
+        while (range) {
+            required.add(range->first, range->last);
+            range = range->next[0]();
+        }
+        current->calls.clear();
+
+        std::set<Resource *>::iterator it;
+        for (it = current->dependencies.begin(); it != current->dependencies.end(); ++it) {
+            pending.push_back(*it);
+        }
+        for (it = current->children.begin(); it != current->children.end(); ++it) {
+            pending.push_back(*it);
+        }
+    }
+}
+
+
+/*
+ * Require everything needed to reproduce the current state of every context.
+ */
+void
+TraceAnalyzer::requireAll(void)
+{
+    std::map<unsigned long long, Context *>::iterator ctx;
+    for (ctx = contexts.begin(); ctx != contexts.end(); ++ctx) {
+        std::set<Resource *>::iterator it;
+        for (it = ctx->second->state.begin(); it != ctx->second->state.end(); ++it) {
+            requireResource(*it);
+        }
+
+        /* As well as the calls creating the context, and first making it
+         * current, for that state to be replayed at all. */
+        Resource *context = findObject(KIND_CONTEXT, ctx->first);
+        if (context && !ctx->second->state.empty()) {
+            requireResource(context);
+        }
+    }
+
+    std::set<Resource *>::iterator it;
+    for (it = currentBindings.begin(); it != currentBindings.end(); ++it) {
+        requireResource(*it);
+    }
+
+    trace::FastCallRange *range = global.head.next[0]();
+    while (range) {
+        required.add(range->first, range->last);
+        range = range->next[0]();
+    }
+}
+
+
+void
+TraceAnalyzer::require(trace::Call *call)
+{
+    required.add(call->no);
+    analyzedSinceRequire = false;
+    ++generation;
+
+    /* The state is only needed once, before the first of a run of
+     * consecutive required calls. */
+    if (stale) {
+        requireAll();
+        stale = false;
+    }
+
+    for (size_t i = 0; i < touched.size(); ++i) {
+        if (touched[i]) {
+            requireResource(touched[i]);
+        }
+    }
+}
@@ -0,0 +1,281 @@
+/*********************************************************************
+ *
+ * Copyright 2012 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *********************************************************************/
+
+#pragma once
+
+#include <assert.h>
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "trace_fast_callset.hpp"
+#include "trace_model.hpp"
+
+
+/*
+ * Dependency analysis used by `apitrace trim --auto`.
+ *
+ * Every call is attributed to one or more resources: GL objects (texture 5,
+ * program 3), per-context state (GL_BLEND enable of context 1), bindings, the
+ * contents rendered into framebuffers, and so on.  Requiring a call requires
+ * every resource it depends on, recursively, so that the emitted subset
+ * reproduces the same GL state when replayed.
+ *
+ * Traces which repeat the same work frame after frame are analyzed with a
+ * constant number of resources, by:
+ *
+ *  - replacing, rather than accumulating, the calls of state which is fully
+ *    overwritten by each new call (bindings, enables, uniform values, ...);
+ *
+ *  - discarding objects when the application deletes them;
+ *
+ *  - resetting framebuffer contents on full clears;
+ *
+ *  - storing call numbers in FastCallSet ranges.
+ */
+class TraceAnalyzer {
+public:
+    TraceAnalyzer();
+    ~TraceAnalyzer();
+
+    /* Record the side effects of a call.  Must be invoked for every call,
+     * in order. */
+    void analyze(trace::Call *call);
+
+    /* Require a call (previously passed to analyze) and all the calls it
+     * depends on. */
+    void require(trace::Call *call);
+
+    const trace::FastCallSet &
+    getRequired(void) const {
+        return required;
+    }
+
+    size_t
+    getNumResources(void) const {
+        return resources.size();
+    }
+
+private:
+    /* Resources are identified by their kind, by the context or resource
+     * they belong to (if any), and by a few numbers such as object names,
+     * targets or binding indices. */
+    struct Key {
+        enum { MAX_VALUES = 8 };
+
+        unsigned kind;
+        const void *scope;
+        unsigned count;
+        unsigned long long values[MAX_VALUES];
+
+        Key(unsigned _kind, const void *_scope = NULL) :
+            kind(_kind),
+            scope(_scope),
+            count(0)
+        {}
+
+        /* Returns false when the key is full. */
+        bool
+        add(unsigned long long value) {
+            if (count >= MAX_VALUES) {
+                return false;
+            }
+            values[count++] = value;
+            return true;
+        }
+
+        Key &
+        operator << (unsigned long long value) {
+            bool added = add(value);
+            assert(added);
+            (void)added;
+            return *this;
+        }
+
+        bool
+        operator == (const Key &other) const {
+            if (kind != other.kind || scope != other.scope || count != other.count) {
+                return false;
+            }
+            for (unsigned i = 0; i < count; ++i) {
+                if (values[i] != other.values[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator () (const Key &key) const;
+    };
+
+    typedef std::unordered_set<Key, KeyHash> KeySet;
+
+    struct Resource {
+        Key key;
+
+        /* Calls that provide this resource. */
+        trace::FastCallSet calls;
+
+        /* Resources whose contents, as of when the link was made, this one
+         * depends on.  When a dependency is reset or discarded, its calls
+         * are folded into its dependents. */
+        std::set<Resource *> dependencies;
+        std::set<Resource *> dependents;
+
+        /* Resources that must be required alongside this one, but whose
+         * stale contents are not worth preserving once reset (e.g., the
+         * uniform values of a program, or the data store of a buffer). */
+        std::set<Resource *> children;
+        std::set<Resource *> parents;
+
+        unsigned generation;
+
+        Resource(const Key &_key) :
+            key(_key),
+            generation(0)
+        {}
+
+        ~Resource() {
+            calls.clear();
+        }
+    };
+
+    /* Per-context GL state tracking. */
+    struct Context {
+        unsigned long long id;
+
+        /* All state resources of this context. */
+        std::set<Resource *> state;
+
+        /* Pixel store state, which texture uploads depend on. */
+        std::set<Resource *> pixelStore;
+
+        /* State changed since the last draw, and where that draw went. */
+        std::set<Resource *> changed;
+        Resource *lastDrawTarget;
+
+        unsigned activeTexture;
+        unsigned clientActiveTexture;
+        unsigned matrixMode;
+        std::unordered_map<Key, unsigned, KeyHash> matrixDepth;
+        unsigned attribDepth;
+        bool scissorTest;
+        bool insideBeginEnd;
+        bool sideEffects;
+        unsigned long long currentList;
+
+        unsigned long long program;
+        unsigned long long vertexArray;
+        unsigned long long drawFramebuffer;
+        unsigned long long readFramebuffer;
+        unsigned long long renderbuffer;
+        std::map<unsigned long long, unsigned long long> buffers;
+        std::map<std::pair<unsigned, unsigned long long>, unsigned long long> textures;
+
+        Context(unsigned long long id);
+    };
+
+    struct Mapping {
+        unsigned long long size;
+        Resource *buffer;
+    };
+
+    typedef std::map<unsigned long long, Resource *> Attachments;
+
+    std::unordered_map<Key, Resource *, KeyHash> resources;
+    std::map<unsigned long long, Context *> contexts;
+    std::map<unsigned, unsigned long long> currentContext;
+    std::set<Resource *> currentBindings;
+    KeySet madeCurrent;
+    std::map<unsigned long long, Mapping> mappings;
+    std::map<Resource *, Attachments> attachments;
+    std::set<Resource *> lists;
+
+    /* Window system calls which are always kept. */
+    trace::FastCallSet global;
+    KeySet globalKeys;
+
+    trace::FastCallSet required;
+
+    /* Resources provided by the call being analyzed. */
+    std::vector<Resource *> touched;
+
+    unsigned generation;
+    bool stale;
+    bool analyzedSinceRequire;
+
+    Resource *lookup(const Key &key);
+    Resource *find(const Key &key);
+    Resource *object(unsigned kind, unsigned long long name);
+    Resource *findObject(unsigned kind, unsigned long long name);
+
+    void provide(Resource *resource, trace::CallNo call_no);
+    void provide(Resource *resource, Resource *source);
+    void link(Resource *resource, Resource *dependency);
+    void own(Resource *resource, Resource *child);
+    void fold(Resource *resource);
+    void reset(Resource *resource);
+    void discard(Resource *resource);
+
+    static bool stateKey(trace::Call *call, Key &key);
+    static bool windowSystemKey(trace::Call *call, Key &key);
+
+    Context *getContext(trace::Call *call);
+    Resource *stateResource(Context *ctx, Key key);
+    Resource *findState(Context *ctx, Key key);
+    Resource *scopedResource(Context *ctx, Resource *scope, Key key);
+    Resource *setState(Context *ctx, const Key &key, trace::Call *call, bool replace = true);
+    Resource *setScopedState(Context *ctx, Resource *scope, const Key &key, trace::Call *call, bool replace = true);
+
+    Resource *bufferData(Resource *buffer);
+    Resource *framebufferData(unsigned long long framebuffer);
+    Resource *sideEffectWrites(Context *ctx);
+
+    void attach(Resource *framebuffer, unsigned long long attachment, Resource *image);
+    void bindFramebuffer(Context *ctx, unsigned long long target, unsigned long long framebuffer, trace::Call *call);
+    void updateBufferData(Context *ctx, Resource *buffer, Resource *binding, trace::Call *call);
+    void carryUnpackState(Context *ctx, Resource *resource);
+
+    void analyzeWindowSystem(trace::Call *call);
+    void analyzeGenerate(Context *ctx, trace::Call *call);
+    bool analyzeBinding(Context *ctx, trace::Call *call);
+    bool analyzeUniform(Context *ctx, trace::Call *call);
+    bool analyzeBoundObject(Context *ctx, trace::Call *call, const std::vector<Resource *> &objects);
+    bool analyzeNamedObject(Context *ctx, trace::Call *call, const std::vector<Resource *> &objects);
+    bool analyzeVertexArray(Context *ctx, trace::Call *call);
+    bool analyzeMatrix(Context *ctx, trace::Call *call);
+    void analyzeRender(Context *ctx, trace::Call *call);
+    void recordDraw(Context *ctx, Resource *target, trace::CallNo call_no);
+
+    void requireResource(Resource *resource);
+    void requireAll(void);
+};
@@ -0,0 +1,330 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include <initializer_list>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "gtest/gtest.h"
+
+#include "trace_analyzer.hpp"
+
+using trace::Value;
+
+
+/*
+ * Just enough of the GL and GLX signatures for the analyzer to go by.
+ */
+
+#define SIG(name, ...) \
+    static const char *name##_args[] = { __VA_ARGS__ }; \
+    static const trace::FunctionSig name##_sig = { \
+        __LINE__, #name, sizeof name##_args / sizeof name##_args[0], name##_args \
+    }
+
+SIG(glXCreateContext, "dpy", "vis", "shareList", "direct");
+SIG(glXMakeCurrent, "dpy", "drawable", "ctx");
+SIG(glXSwapBuffers, "dpy", "drawable");
+SIG(glEnable, "cap");
+SIG(glDisable, "cap");
+SIG(glViewport, "x", "y", "width", "height");
+SIG(glPixelStorei, "pname", "param");
+SIG(glBindTexture, "target", "texture");
+SIG(glDeleteTextures, "n", "textures");
+SIG(glTexImage2D, "target", "level", "internalformat", "width", "height", "border", "format", "type", "pixels");
+SIG(glTexParameteri, "target", "pname", "param");
+SIG(glBindBuffer, "target", "buffer");
+SIG(glBufferData, "target", "size", "data", "usage");
+SIG(glVertexAttribPointer, "index", "size", "type", "normalized", "stride", "pointer");
+SIG(glCreateShader, "type");
+SIG(glCompileShader, "shader");
+SIG(glDeleteShader, "shader");
+SIG(glAttachShader, "program", "shader");
+SIG(glLinkProgram, "program");
+SIG(glUseProgram, "program");
+SIG(glUniform1f, "location", "v0");
+SIG(glClear, "mask");
+SIG(glDrawArrays, "mode", "first", "count");
+
+static const trace::FunctionSig glCreateProgram_sig = {
+    __LINE__, "glCreateProgram", 0, NULL
+};
+
+static const trace::EnumSig enumSig = { 0, 0, NULL };
+
+
+static Value *
+e(unsigned long long value)
+{
+    return new trace::Enum(&enumSig, value);
+}
+
+static Value *
+u(unsigned long long value)
+{
+    return new trace::UInt(value);
+}
+
+static Value *
+names(unsigned long long name)
+{
+    trace::Array *array = new trace::Array(1);
+    array->values[0] = u(name);
+    return array;
+}
+
+
+class AutoTrim : public ::testing::Test
+{
+protected:
+    TraceAnalyzer analyzer;
+    trace::CallNo no = 0;
+    unsigned thread = 0;
+
+    trace::CallNo
+    call(const trace::FunctionSig &sig, std::initializer_list<Value *> args,
+         Value *ret = nullptr, bool require = false)
+    {
+        trace::CallFlags flags = 0;
+        if (strcmp(sig.name, "glXSwapBuffers") == 0) {
+            flags = trace::CALL_FLAG_END_FRAME | trace::CALL_FLAG_SWAP_RENDERTARGET;
+        } else if (strcmp(sig.name, "glClear") == 0 ||
+                   strcmp(sig.name, "glDrawArrays") == 0) {
+            flags = trace::CALL_FLAG_RENDER;
+        }
+
+        trace::Call call(&sig, flags, thread);
+        call.no = no++;
+        EXPECT_EQ(sig.num_args, args.size());
+        unsigned i = 0;
+        for (Value *arg : args) {
+            call.args[i++].value = arg;
+        }
+        call.ret = ret;
+
+        analyzer.analyze(&call);
+        if (require) {
+            analyzer.require(&call);
+        }
+        return call.no;
+    }
+
+    trace::CallNo
+    draw(void) {
+        return call(glDrawArrays_sig, {e(GL_TRIANGLES), u(0), u(3)}, nullptr, true);
+    }
+
+    bool
+    required(trace::CallNo callNo) const {
+        return analyzer.getRequired().contains(callNo);
+    }
+};
+
+
+TEST_F(AutoTrim, state)
+{
+    trace::CallNo blendOn = call(glEnable_sig, {e(GL_BLEND)});
+    trace::CallNo depthOn = call(glEnable_sig, {e(GL_DEPTH_TEST)});
+    trace::CallNo blendOff = call(glDisable_sig, {e(GL_BLEND)});
+    trace::CallNo viewport = call(glViewport_sig, {u(0), u(0), u(640), u(480)});
+    trace::CallNo newViewport = call(glViewport_sig, {u(0), u(0), u(320), u(240)});
+    trace::CallNo drawCall = draw();
+
+    EXPECT_TRUE(required(drawCall));
+    EXPECT_TRUE(required(depthOn));
+    EXPECT_TRUE(required(blendOff));
+    EXPECT_TRUE(required(newViewport));
+
+    // Overwritten by later calls
+    EXPECT_FALSE(required(blendOn));
+    EXPECT_FALSE(required(viewport));
+}
+
+
+TEST_F(AutoTrim, buffer)
+{
+    trace::CallNo bind1 = call(glBindBuffer_sig, {e(GL_ARRAY_BUFFER), u(1)});
+    trace::CallNo data1 = call(glBufferData_sig, {e(GL_ARRAY_BUFFER), u(16), u(0), e(GL_STATIC_DRAW)});
+    trace::CallNo bind2 = call(glBindBuffer_sig, {e(GL_ARRAY_BUFFER), u(2)});
+    trace::CallNo data2 = call(glBufferData_sig, {e(GL_ARRAY_BUFFER), u(16), u(0), e(GL_STATIC_DRAW)});
+    trace::CallNo respecify2 = call(glBufferData_sig, {e(GL_ARRAY_BUFFER), u(32), u(0), e(GL_STATIC_DRAW)});
+    trace::CallNo pointer = call(glVertexAttribPointer_sig, {u(0), u(4), e(GL_FLOAT), u(0), u(0), u(0)});
+    trace::CallNo unbind = call(glBindBuffer_sig, {e(GL_ARRAY_BUFFER), u(0)});
+    trace::CallNo drawCall = draw();
+
+    EXPECT_TRUE(required(drawCall));
+    EXPECT_TRUE(required(unbind));
+
+    // The attribute still sources buffer 2
+    EXPECT_TRUE(required(pointer));
+    EXPECT_TRUE(required(bind2));
+    EXPECT_TRUE(required(respecify2));
+    EXPECT_FALSE(required(data2));
+
+    // Buffer 1 is no longer referenced
+    EXPECT_FALSE(required(bind1));
+    EXPECT_FALSE(required(data1));
+}
+
+
+TEST_F(AutoTrim, texture)
+{
+    trace::CallNo alignment = call(glPixelStorei_sig, {e(GL_UNPACK_ALIGNMENT), u(1)});
+    trace::CallNo bind5 = call(glBindTexture_sig, {e(GL_TEXTURE_2D), u(5)});
+    trace::CallNo image5 = call(glTexImage2D_sig, {e(GL_TEXTURE_2D), u(0), e(GL_RGBA), u(4), u(4), u(0), e(GL_RGBA), e(GL_UNSIGNED_BYTE), u(0)});
+    trace::CallNo filter5 = call(glTexParameteri_sig, {e(GL_TEXTURE_2D), e(GL_TEXTURE_MIN_FILTER), e(GL_NEAREST)});
+    call(glPixelStorei_sig, {e(GL_UNPACK_ALIGNMENT), u(4)});
+    trace::CallNo bind6 = call(glBindTexture_sig, {e(GL_TEXTURE_2D), u(6)});
+    trace::CallNo image6 = call(glTexImage2D_sig, {e(GL_TEXTURE_2D), u(0), e(GL_RGBA), u(4), u(4), u(0), e(GL_RGBA), e(GL_UNSIGNED_BYTE), u(0)});
+    trace::CallNo rebind5 = call(glBindTexture_sig, {e(GL_TEXTURE_2D), u(5)});
+    trace::CallNo drawCall = draw();
+
+    EXPECT_TRUE(required(drawCall));
+    EXPECT_TRUE(required(rebind5));
+    EXPECT_TRUE(required(bind5));
+    EXPECT_TRUE(required(image5));
+    EXPECT_TRUE(required(filter5));
+
+    // Texture 5 was uploaded with the pixel store state of the time
+    EXPECT_TRUE(required(alignment));
+
+    // Texture 6 is not bound
+    EXPECT_FALSE(required(bind6));
+    EXPECT_FALSE(required(image6));
+}
+
+
+TEST_F(AutoTrim, program)
+{
+    trace::CallNo createShader = call(glCreateShader_sig, {e(GL_VERTEX_SHADER)}, u(3));
+    trace::CallNo compile = call(glCompileShader_sig, {u(3)});
+    trace::CallNo createProgram = call(glCreateProgram_sig, {}, u(4));
+    trace::CallNo attach = call(glAttachShader_sig, {u(4), u(3)});
+    trace::CallNo linkProgram = call(glLinkProgram_sig, {u(4)});
+    call(glDeleteShader_sig, {u(3)});
+    trace::CallNo use = call(glUseProgram_sig, {u(4)});
+    trace::CallNo uniform0 = call(glUniform1f_sig, {u(0), u(0)});
+    trace::CallNo newUniform0 = call(glUniform1f_sig, {u(0), u(1)});
+    trace::CallNo uniform1 = call(glUniform1f_sig, {u(1), u(0)});
+    call(glUseProgram_sig, {u(0)});
+    trace::CallNo reuse = call(glUseProgram_sig, {u(4)});
+    trace::CallNo drawCall = draw();
+
+    EXPECT_TRUE(required(drawCall));
+    EXPECT_TRUE(required(reuse));
+    EXPECT_TRUE(required(createProgram));
+    EXPECT_TRUE(required(attach));
+    EXPECT_TRUE(required(linkProgram));
+
+    // The shader outlives its deletion through the program
+    EXPECT_TRUE(required(createShader));
+    EXPECT_TRUE(required(compile));
+
+    // Uniforms belong to the program, not to the binding
+    EXPECT_TRUE(required(use));
+    EXPECT_TRUE(required(newUniform0));
+    EXPECT_TRUE(required(uniform1));
+    EXPECT_FALSE(required(uniform0));
+}
+
+
+TEST_F(AutoTrim, context)
+{
+    const unsigned long long ctx1 = 0x100;
+    const unsigned long long ctx2 = 0x200;
+
+    thread = 1;
+    trace::CallNo create1 = call(glXCreateContext_sig, {u(1), u(2), u(0), u(1)}, u(ctx1));
+    trace::CallNo create2 = call(glXCreateContext_sig, {u(1), u(2), u(ctx1), u(1)}, u(ctx2));
+    trace::CallNo current1 = call(glXMakeCurrent_sig, {u(1), u(3), u(ctx1)});
+    trace::CallNo blendOn = call(glEnable_sig, {e(GL_BLEND)});
+
+    thread = 2;
+    trace::CallNo current2 = call(glXMakeCurrent_sig, {u(1), u(4), u(ctx2)});
+    trace::CallNo blendOff = call(glDisable_sig, {e(GL_BLEND)});
+    call(glXMakeCurrent_sig, {u(1), u(0), u(0)});
+
+    thread = 1;
+    trace::CallNo drawCall = draw();
+
+    EXPECT_TRUE(required(drawCall));
+    EXPECT_TRUE(required(create1));
+    EXPECT_TRUE(required(current1));
+
+    // Each context has its own state
+    EXPECT_TRUE(required(blendOn));
+    EXPECT_TRUE(required(blendOff));
+
+    // The state of the second context needs it created and made current
+    EXPECT_TRUE(required(create2));
+    EXPECT_TRUE(required(current2));
+}
+
+
+/*
+ * Analyzing the same frame over and over must not grow the analyzer state.
+ */
+TEST_F(AutoTrim, bounded)
+{
+    call(glCreateProgram_sig, {}, u(1));
+    call(glLinkProgram_sig, {u(1)});
+    call(glBindBuffer_sig, {e(GL_ARRAY_BUFFER), u(1)});
+    call(glVertexAttribPointer_sig, {u(0), u(4), e(GL_FLOAT), u(0), u(0), u(0)});
+
+    size_t numResources = 0;
+    for (unsigned frame = 0; frame < 1000; ++frame) {
+        unsigned long long texture = 100 + frame;
+        call(glBindTexture_sig, {e(GL_TEXTURE_2D), u(texture)});
+        call(glTexImage2D_sig, {e(GL_TEXTURE_2D), u(0), e(GL_RGBA), u(4), u(4), u(0), e(GL_RGBA), e(GL_UNSIGNED_BYTE), u(0)});
+        call(glBufferData_sig, {e(GL_ARRAY_BUFFER), u(16), u(0), e(GL_STREAM_DRAW)});
+        call(glUseProgram_sig, {u(1)});
+        call(glUniform1f_sig, {u(0), u(frame)});
+        call(glClear_sig, {u(GL_COLOR_BUFFER_BIT)});
+        draw();
+        call(glDeleteTextures_sig, {u(1), names(texture)});
+        call(glXSwapBuffers_sig, {u(1), u(2)});
+
+        if (frame == 1) {
+            numResources = analyzer.getNumResources();
+        }
+    }
+
+    EXPECT_EQ(numResources, analyzer.getNumResources());
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
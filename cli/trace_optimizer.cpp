@@ -0,0 +1,874 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <ctype.h>
+#include <string.h>
+#include <wchar.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "trace_optimizer.hpp"
+
+
+namespace {
+
+/**
+ * Serializes values into a byte string, so that calls can be compared for
+ * identity.
+ */
+class Fingerprinter : public trace::Visitor
+{
+    std::string &s;
+
+    template< typename T >
+    void
+    append(char tag, const T &value) {
+        s.push_back(tag);
+        s.append(reinterpret_cast<const char *>(&value), sizeof value);
+    }
+
+    void
+    append(char tag, const void *data, size_t size) {
+        append(tag, size);
+        s.append(static_cast<const char *>(data), size);
+    }
+
+public:
+    Fingerprinter(std::string &_s) : s(_s) {}
+
+    void visit(trace::Null *) override { s.push_back('0'); }
+    void visit(trace::Bool *node) override { append('b', node->value); }
+    void visit(trace::SInt *node) override { append('i', node->value); }
+    void visit(trace::UInt *node) override { append('u', node->value); }
+    void visit(trace::Float *node) override { append('f', node->value); }
+    void visit(trace::Double *node) override { append('d', node->value); }
+    void visit(trace::Enum *node) override { append('i', node->value); }
+    void visit(trace::Bitmask *node) override { append('u', node->value); }
+    void visit(trace::Pointer *node) override { append('p', node->value); }
+    void visit(trace::Repr *node) override { _visit(node->machineValue); }
+
+    void visit(trace::String *node) override {
+        if (node->value) {
+            append('s', node->value, strlen(node->value));
+        } else {
+            s.push_back('0');
+        }
+    }
+
+    void visit(trace::WString *node) override {
+        if (node->value) {
+            append('w', node->value, wcslen(node->value) * sizeof(wchar_t));
+        } else {
+            s.push_back('0');
+        }
+    }
+
+    void visit(trace::Struct *node) override {
+        append('S', node->members.size());
+        for (auto member : node->members) {
+            _visit(member);
+            s.push_back(';');
+        }
+    }
+
+    void visit(trace::Array *node) override {
+        append('A', node->values.size());
+        for (auto value : node->values) {
+            _visit(value);
+            s.push_back(';');
+        }
+    }
+
+    void visit(trace::Blob *node) override {
+        append('B', node->buf, node->size);
+    }
+
+    void
+    add(trace::Value *value) {
+        _visit(value);
+        s.push_back(';');
+    }
+
+    void
+    visit(const trace::Call *call) {
+        append('c', call->sig->name, strlen(call->sig->name));
+        append('t', call->thread_id);
+        for (auto & arg : call->args) {
+            add(arg.value);
+        }
+    }
+};
+
+
+class ScalarVisitor : public trace::Visitor
+{
+public:
+    bool ok = false;
+    unsigned long long value = 0;
+
+    void visit(trace::Null *) override { ok = true; value = 0; }
+    void visit(trace::Bool *node) override { ok = true; value = node->value; }
+    void visit(trace::SInt *node) override { ok = true; value = node->value; }
+    void visit(trace::UInt *node) override { ok = true; value = node->value; }
+    void visit(trace::Float *) override {}
+    void visit(trace::Double *) override {}
+    void visit(trace::String *) override {}
+    void visit(trace::WString *) override {}
+    void visit(trace::Enum *node) override { ok = true; value = node->value; }
+    void visit(trace::Bitmask *node) override { ok = true; value = node->value; }
+    void visit(trace::Struct *) override {}
+    void visit(trace::Array *) override {}
+    void visit(trace::Blob *) override {}
+    void visit(trace::Pointer *node) override { ok = true; value = node->value; }
+    void visit(trace::Repr *node) override { _visit(node->machineValue); }
+};
+
+}
+
+
+std::string
+TraceOptimizer::fingerprint(const trace::Call *call)
+{
+    std::string s;
+    Fingerprinter(s).visit(call);
+    return s;
+}
+
+
+static bool
+getArg(const trace::Call *call, const char *name, unsigned long long &result)
+{
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        if (strcmp(call->sig->arg_names[i], name) == 0) {
+            trace::Value *value = call->args[i].value;
+            if (!value) {
+                return false;
+            }
+            ScalarVisitor visitor;
+            value->visit(visitor);
+            result = visitor.value;
+            return visitor.ok;
+        }
+    }
+    return false;
+}
+
+
+/*
+ * How each function interacts with the tracked state.
+ */
+enum Kind {
+    KIND_UNKNOWN = -1,
+    KIND_OTHER = 0,
+    KIND_MAKE_CURRENT,
+    KIND_CREATE_CONTEXT,
+    KIND_DESTROY_CONTEXT,
+    KIND_RESET,
+    KIND_NEW_LIST,
+    KIND_END_LIST,
+    KIND_ACTIVE_TEXTURE,
+    KIND_BIND_TEXTURE,
+    KIND_BIND_BUFFER,
+    KIND_BIND_BUFFER_INDEXED,
+    KIND_BIND_VERTEX_ARRAY,
+    KIND_VERTEX_ARRAY_ELEMENT_BUFFER,
+    KIND_BIND_FRAMEBUFFER,
+    KIND_BIND_RENDERBUFFER,
+    KIND_BIND_SAMPLER,
+    KIND_BIND_TRANSFORM_FEEDBACK,
+    KIND_USE_PROGRAM,
+    KIND_LINK_PROGRAM,
+    KIND_ENABLE,
+    KIND_DISABLE,
+    KIND_ENABLE_INDEXED,
+    KIND_UNIFORM,
+    KIND_PROGRAM_UNIFORM,
+    KIND_SETTER,
+    KIND_FORGET_TEXTURES,
+    KIND_FORGET_SAMPLERS,
+    KIND_DELETE_TEXTURES,
+    KIND_DELETE_BUFFERS,
+    KIND_DELETE_VERTEX_ARRAYS,
+    KIND_DELETE_FRAMEBUFFERS,
+    KIND_DELETE_RENDERBUFFERS,
+    KIND_DELETE_SAMPLERS,
+    KIND_DELETE_PROGRAM,
+};
+
+
+/*
+ * Functions which set a piece of state wholly determined by their arguments.
+ * Functions in the same group set overlapping state, so a call is only
+ * redundant when it is identical to the last call of its group.
+ */
+static const char *
+setterGroups[][5] = {
+    {"glBlendFunc", "glBlendFuncSeparate", "glBlendFunci", "glBlendFuncSeparatei", NULL},
+    {"glBlendEquation", "glBlendEquationSeparate", "glBlendEquationi", "glBlendEquationSeparatei", NULL},
+    {"glBlendColor", NULL},
+    {"glColorMask", "glColorMaski", NULL},
+    {"glDepthFunc", NULL},
+    {"glDepthMask", NULL},
+    {"glDepthRange", "glDepthRangef", "glDepthRangeArrayv", "glDepthRangeIndexed", NULL},
+    {"glViewport", "glViewportArrayv", "glViewportIndexedf", "glViewportIndexedfv", NULL},
+    {"glScissor", "glScissorArrayv", "glScissorIndexed", "glScissorIndexedv", NULL},
+    {"glCullFace", NULL},
+    {"glFrontFace", NULL},
+    {"glPolygonOffset", NULL},
+    {"glLineWidth", NULL},
+    {"glClearColor", NULL},
+    {"glClearDepth", "glClearDepthf", NULL},
+    {"glClearStencil", NULL},
+    {"glStencilFunc", "glStencilFuncSeparate", NULL},
+    {"glStencilOp", "glStencilOpSeparate", NULL},
+    {"glStencilMask", "glStencilMaskSeparate", NULL},
+};
+
+
+static bool
+startsWith(const std::string &s, const char *prefix)
+{
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+
+static Kind
+classify(const char *functionName, unsigned &group)
+{
+    std::string name = functionName;
+
+    if (name.find("MakeCurrent") != std::string::npos ||
+        name.find("MakeContextCurrent") != std::string::npos ||
+        name == "CGLSetCurrentContext") {
+        return KIND_MAKE_CURRENT;
+    }
+    if (name.find("CreateContext") != std::string::npos ||
+        name.find("CreateNewContext") != std::string::npos) {
+        return KIND_CREATE_CONTEXT;
+    }
+    if (name.find("DestroyContext") != std::string::npos ||
+        name.find("DeleteContext") != std::string::npos) {
+        return KIND_DESTROY_CONTEXT;
+    }
+
+    if (!startsWith(name, "gl") || name.size() < 3 || !isupper(name[2])) {
+        return KIND_OTHER;
+    }
+
+    if (name == "glUseProgramObjectARB") {
+        return KIND_USE_PROGRAM;
+    }
+    if (name == "glDeleteObjectARB") {
+        return KIND_DELETE_PROGRAM;
+    }
+    if (name == "glBindMultiTextureEXT") {
+        return KIND_FORGET_TEXTURES;
+    }
+    if (name == "glPushClientAttribDefaultEXT" ||
+        name == "glClientAttribDefaultEXT") {
+        return KIND_RESET;
+    }
+
+    static const char *suffixes[] = {"ARB", "EXT", "OES", "APPLE"};
+    for (auto suffix : suffixes) {
+        size_t len = strlen(suffix);
+        if (name.size() > len &&
+            name.compare(name.size() - len, len, suffix) == 0) {
+            name.resize(name.size() - len);
+            break;
+        }
+    }
+
+    if (name == "glPopAttrib" ||
+        name == "glPopClientAttrib" ||
+        name == "glCallList" ||
+        name == "glCallLists") {
+        return KIND_RESET;
+    }
+    if (name == "glNewList") {
+        return KIND_NEW_LIST;
+    }
+    if (name == "glEndList") {
+        return KIND_END_LIST;
+    }
+
+    if (name == "glActiveTexture") {
+        return KIND_ACTIVE_TEXTURE;
+    }
+    if (name == "glBindTexture") {
+        return KIND_BIND_TEXTURE;
+    }
+    if (name == "glBindTextures" ||
+        name == "glBindTextureUnit" ||
+        name == "glBindImageTexture" ||
+        name == "glBindImageTextures") {
+        /* Image units are distinct from texture units, but the latter are
+         * cheap to forget. */
+        return KIND_FORGET_TEXTURES;
+    }
+    if (name == "glBindBuffer") {
+        return KIND_BIND_BUFFER;
+    }
+    if (startsWith(name, "glBindBuffer") ||
+        startsWith(name, "glBindBuffers")) {
+        /* glBindBufferBase, glBindBufferRange, glBindBufferOffset, and
+         * their multi-bind variants also set the generic binding. */
+        return KIND_BIND_BUFFER_INDEXED;
+    }
+    if (name == "glBindVertexArray") {
+        return KIND_BIND_VERTEX_ARRAY;
+    }
+    if (name == "glVertexArrayElementBuffer") {
+        return KIND_VERTEX_ARRAY_ELEMENT_BUFFER;
+    }
+    if (name == "glBindFramebuffer") {
+        return KIND_BIND_FRAMEBUFFER;
+    }
+    if (name == "glBindRenderbuffer") {
+        return KIND_BIND_RENDERBUFFER;
+    }
+    if (name == "glBindSampler") {
+        return KIND_BIND_SAMPLER;
+    }
+    if (name == "glBindSamplers") {
+        return KIND_FORGET_SAMPLERS;
+    }
+    if (name == "glBindTransformFeedback") {
+        return KIND_BIND_TRANSFORM_FEEDBACK;
+    }
+    if (name == "glUseProgram") {
+        return KIND_USE_PROGRAM;
+    }
+    if (name == "glLinkProgram" ||
+        name == "glProgramBinary") {
+        return KIND_LINK_PROGRAM;
+    }
+    if (name == "glEnable") {
+        return KIND_ENABLE;
+    }
+    if (name == "glDisable") {
+        return KIND_DISABLE;
+    }
+    if (name == "glEnablei" ||
+        name == "glDisablei" ||
+        name == "glEnableIndexed" ||
+        name == "glDisableIndexed") {
+        return KIND_ENABLE_INDEXED;
+    }
+    if (startsWith(name, "glUniform") &&
+        !startsWith(name, "glUniformBlock") &&
+        !startsWith(name, "glUniformSubroutines") &&
+        !startsWith(name, "glUniformHandle")) {
+        return KIND_UNIFORM;
+    }
+    if (startsWith(name, "glProgramUniform") &&
+        !startsWith(name, "glProgramUniformHandle")) {
+        return KIND_PROGRAM_UNIFORM;
+    }
+
+    if (name == "glDeleteTextures") {
+        return KIND_DELETE_TEXTURES;
+    }
+    if (name == "glDeleteBuffers") {
+        return KIND_DELETE_BUFFERS;
+    }
+    if (name == "glDeleteVertexArrays") {
+        return KIND_DELETE_VERTEX_ARRAYS;
+    }
+    if (name == "glDeleteFramebuffers") {
+        return KIND_DELETE_FRAMEBUFFERS;
+    }
+    if (name == "glDeleteRenderbuffers") {
+        return KIND_DELETE_RENDERBUFFERS;
+    }
+    if (name == "glDeleteSamplers") {
+        return KIND_DELETE_SAMPLERS;
+    }
+    if (name == "glDeleteProgram") {
+        return KIND_DELETE_PROGRAM;
+    }
+
+    for (unsigned i = 0; i < sizeof setterGroups / sizeof setterGroups[0]; ++i) {
+        for (const char **member = setterGroups[i]; *member; ++member) {
+            if (name == *member) {
+                group = i;
+                return KIND_SETTER;
+            }
+        }
+    }
+
+    return KIND_OTHER;
+}
+
+
+enum {
+    OBJECT_ACTIVE_TEXTURE,
+    OBJECT_PROGRAM,
+    OBJECT_VERTEX_ARRAY,
+    OBJECT_DRAW_FRAMEBUFFER,
+    OBJECT_READ_FRAMEBUFFER,
+    OBJECT_RENDERBUFFER,
+};
+
+
+int
+TraceOptimizer::getKind(const trace::Call *call, unsigned &group)
+{
+    unsigned id = call->sig->id;
+    if (id >= kinds.size()) {
+        kinds.resize(id + 1, KIND_UNKNOWN);
+        groups.resize(id + 1, 0);
+    }
+    if (kinds[id] == KIND_UNKNOWN) {
+        kinds[id] = classify(call->sig->name, groups[id]);
+    }
+    group = groups[id];
+    return kinds[id];
+}
+
+
+void
+TraceOptimizer::forgetProgram(unsigned long long program)
+{
+    for (auto & context : contexts) {
+        auto it = context.second.objects.find(OBJECT_PROGRAM);
+        if (it != context.second.objects.end() && it->second == program) {
+            context.second.objects.erase(it);
+        }
+    }
+    eraseIf(uniforms, [program](const std::pair<const std::pair<unsigned long long, long long>, Uniform> &item) {
+        return item.first.first == program;
+    });
+}
+
+
+
+static bool
+isTextureUnitCap(unsigned long long cap)
+{
+    switch (cap) {
+    case GL_TEXTURE_1D:
+    case GL_TEXTURE_2D:
+    case GL_TEXTURE_3D:
+    case GL_TEXTURE_CUBE_MAP:
+    case GL_TEXTURE_RECTANGLE:
+    case GL_TEXTURE_GEN_S:
+    case GL_TEXTURE_GEN_T:
+    case GL_TEXTURE_GEN_R:
+    case GL_TEXTURE_GEN_Q:
+    case 0x8D65: // GL_TEXTURE_EXTERNAL_OES
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+bool
+TraceOptimizer::uniform(unsigned long long context, unsigned long long program, const trace::Call *call)
+{
+    unsigned long long location = 0;
+    if (!getArg(call, "location", location)) {
+        forgetProgram(program);
+        return false;
+    }
+
+    /* Array updates may overlap the locations of other elements. */
+    unsigned long long count = 1;
+    if (getArg(call, "count", count) && count != 1) {
+        eraseIf(uniforms, [program](const std::pair<const std::pair<unsigned long long, long long>, Uniform> &item) {
+            return item.first.first == program;
+        });
+        return false;
+    }
+
+    /* Leave out the program argument of glProgramUniform*, which is already
+     * in the key, so that it matches the equivalent glUniform* call. */
+    std::string value = call->sig->name;
+    if (startsWith(value, "glProgramUniform")) {
+        value.erase(2, strlen("Program"));
+    }
+    Fingerprinter fingerprinter(value);
+    for (unsigned i = 0; i < call->sig->num_args && i < call->args.size(); ++i) {
+        if (strcmp(call->sig->arg_names[i], "program") != 0) {
+            fingerprinter.add(call->args[i].value);
+        }
+    }
+
+    std::pair<unsigned long long, long long> key(program, static_cast<long long>(location));
+    auto it = uniforms.find(key);
+    if (it != uniforms.end() &&
+        it->second.context == context &&
+        it->second.value == value) {
+        return true;
+    }
+    Uniform &entry = uniforms[key];
+    entry.context = context;
+    entry.value = value;
+    return false;
+}
+
+
+static std::string
+argsFingerprint(const trace::Call *call)
+{
+    std::string value = call->sig->name;
+    Fingerprinter fingerprinter(value);
+    for (auto & arg : call->args) {
+        fingerprinter.add(arg.value);
+    }
+    return value;
+}
+
+
+bool
+TraceOptimizer::isRedundant(const trace::Call *call)
+{
+    unsigned group = 0;
+    Kind kind = static_cast<Kind>(getKind(call, group));
+    if (kind == KIND_OTHER) {
+        return false;
+    }
+
+    unsigned long long name = 0;
+    unsigned long long target = 0;
+
+    /*
+     * Calls affecting objects shared between contexts.
+     */
+
+    switch (kind) {
+    case KIND_MAKE_CURRENT:
+        if (!getArg(call, "ctx", name)) {
+            getArg(call, "hglrc", name);
+        }
+        currentContext[call->thread_id] = name;
+        return false;
+    case KIND_CREATE_CONTEXT:
+        if (call->ret) {
+            ScalarVisitor visitor;
+            call->ret->visit(visitor);
+            if (visitor.ok) {
+                /* New contexts start with the first texture unit active. */
+                Context &context = contexts[visitor.value] = Context();
+                context.objects[OBJECT_ACTIVE_TEXTURE] = GL_TEXTURE0;
+            }
+        }
+        return false;
+    case KIND_DESTROY_CONTEXT:
+        if (getArg(call, "ctx", name) || getArg(call, "hglrc", name)) {
+            contexts.erase(name);
+        }
+        return false;
+    case KIND_DELETE_TEXTURES:
+        /* Deleting bound objects reverts the bindings to zero, and the names
+         * may be reused, so forget every binding of the kind. */
+        for (auto & context : contexts) {
+            context.second.textures.clear();
+        }
+        return false;
+    case KIND_DELETE_BUFFERS:
+        for (auto & context : contexts) {
+            context.second.buffers.clear();
+        }
+        return false;
+    case KIND_VERTEX_ARRAY_ELEMENT_BUFFER:
+        /* Changes the element array buffer binding if the vertex array
+         * object happens to be bound. */
+        for (auto & context : contexts) {
+            context.second.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        return false;
+    case KIND_DELETE_VERTEX_ARRAYS:
+        for (auto & context : contexts) {
+            context.second.objects.erase(OBJECT_VERTEX_ARRAY);
+            context.second.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        }
+        return false;
+    case KIND_DELETE_FRAMEBUFFERS:
+        for (auto & context : contexts) {
+            context.second.objects.erase(OBJECT_DRAW_FRAMEBUFFER);
+            context.second.objects.erase(OBJECT_READ_FRAMEBUFFER);
+        }
+        return false;
+    case KIND_DELETE_RENDERBUFFERS:
+        for (auto & context : contexts) {
+            context.second.objects.erase(OBJECT_RENDERBUFFER);
+        }
+        return false;
+    case KIND_DELETE_SAMPLERS:
+        for (auto & context : contexts) {
+            context.second.samplers.clear();
+        }
+        return false;
+    case KIND_DELETE_PROGRAM:
+    case KIND_LINK_PROGRAM:
+        /* Linking resets the uniforms to their defaults. */
+        if (getArg(call, "program", name) || getArg(call, "obj", name)) {
+            forgetProgram(name);
+        } else {
+            for (auto & context : contexts) {
+                context.second.objects.erase(OBJECT_PROGRAM);
+            }
+            uniforms.clear();
+        }
+        return false;
+    default:
+        break;
+    }
+
+    /*
+     * Calls affecting the current context.
+     */
+
+    unsigned long long contextKey = getContextKey(call);
+    Context &context = contexts[contextKey];
+
+    if (kind == KIND_RESET || kind == KIND_END_LIST) {
+        /* Display lists may contain any state change, uniforms included. */
+        context = Context();
+        uniforms.clear();
+        return false;
+    }
+
+    if (kind == KIND_NEW_LIST) {
+        context.inList = true;
+        return false;
+    }
+
+    if (context.inList) {
+        /* Most calls are compiled rather than executed, and we reset the
+         * context on glEndList anyway. */
+        return false;
+    }
+
+    switch (kind) {
+    case KIND_ACTIVE_TEXTURE:
+        if (!getArg(call, "texture", name)) {
+            context.objects.erase(OBJECT_ACTIVE_TEXTURE);
+            return false;
+        }
+        return bind(context.objects, OBJECT_ACTIVE_TEXTURE, name);
+
+    case KIND_BIND_TEXTURE:
+        {
+            auto unit = context.objects.find(OBJECT_ACTIVE_TEXTURE);
+            if (unit == context.objects.end() ||
+                !getArg(call, "target", target) ||
+                !getArg(call, "texture", name)) {
+                context.textures.clear();
+                return false;
+            }
+            std::pair<unsigned long long, unsigned long long> key(unit->second, target);
+            auto it = context.textures.find(key);
+            if (it != context.textures.end() && it->second == name) {
+                return true;
+            }
+            context.textures[key] = name;
+            return false;
+        }
+
+    case KIND_FORGET_TEXTURES:
+        context.textures.clear();
+        return false;
+
+    case KIND_BIND_BUFFER:
+        if (!getArg(call, "target", target) ||
+            !getArg(call, "buffer", name)) {
+            context.buffers.clear();
+            return false;
+        }
+        return bind(context.buffers, target, name);
+
+    case KIND_BIND_BUFFER_INDEXED:
+        if (getArg(call, "target", target)) {
+            context.buffers.erase(target);
+        } else {
+            context.buffers.clear();
+        }
+        return false;
+
+    case KIND_BIND_VERTEX_ARRAY:
+        /* The element array buffer binding is vertex array state. */
+        if (!getArg(call, "array", name)) {
+            context.objects.erase(OBJECT_VERTEX_ARRAY);
+            context.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+            return false;
+        }
+        if (bind(context.objects, OBJECT_VERTEX_ARRAY, name)) {
+            return true;
+        }
+        context.buffers.erase(GL_ELEMENT_ARRAY_BUFFER);
+        return false;
+
+    case KIND_BIND_TRANSFORM_FEEDBACK:
+        /* The transform feedback buffer bindings are object state. */
+        context.buffers.erase(GL_TRANSFORM_FEEDBACK_BUFFER);
+        return false;
+
+    case KIND_BIND_FRAMEBUFFER:
+        if (!getArg(call, "target", target) ||
+            !getArg(call, "framebuffer", name)) {
+            context.objects.erase(OBJECT_DRAW_FRAMEBUFFER);
+            context.objects.erase(OBJECT_READ_FRAMEBUFFER);
+            return false;
+        }
+        switch (target) {
+        case GL_DRAW_FRAMEBUFFER:
+            return bind(context.objects, OBJECT_DRAW_FRAMEBUFFER, name);
+        case GL_READ_FRAMEBUFFER:
+            return bind(context.objects, OBJECT_READ_FRAMEBUFFER, name);
+        case GL_FRAMEBUFFER:
+            {
+                bool draw = bind(context.objects, OBJECT_DRAW_FRAMEBUFFER, name);
+                bool read = bind(context.objects, OBJECT_READ_FRAMEBUFFER, name);
+                return draw && read;
+            }
+        default:
+            context.objects.erase(OBJECT_DRAW_FRAMEBUFFER);
+            context.objects.erase(OBJECT_READ_FRAMEBUFFER);
+            return false;
+        }
+
+    case KIND_BIND_RENDERBUFFER:
+        if (!getArg(call, "renderbuffer", name)) {
+            context.objects.erase(OBJECT_RENDERBUFFER);
+            return false;
+        }
+        return bind(context.objects, OBJECT_RENDERBUFFER, name);
+
+    case KIND_BIND_SAMPLER:
+        if (!getArg(call, "unit", target) ||
+            !getArg(call, "sampler", name)) {
+            context.samplers.clear();
+            return false;
+        }
+        return bind(context.samplers, target, name);
+
+    case KIND_FORGET_SAMPLERS:
+        context.samplers.clear();
+        return false;
+
+    case KIND_USE_PROGRAM:
+        if (!getArg(call, "program", name) &&
+            !getArg(call, "programObj", name)) {
+            context.objects.erase(OBJECT_PROGRAM);
+            return false;
+        }
+        return bind(context.objects, OBJECT_PROGRAM, name);
+
+    case KIND_ENABLE:
+    case KIND_DISABLE:
+        {
+            if (!getArg(call, "cap", target)) {
+                context.caps.clear();
+                return false;
+            }
+            unsigned long long unit = ~0ULL;
+            if (isTextureUnitCap(target)) {
+                auto it = context.objects.find(OBJECT_ACTIVE_TEXTURE);
+                if (it == context.objects.end()) {
+                    eraseIf(context.caps, [target](const std::pair<const std::pair<unsigned long long, unsigned long long>, bool> &item) {
+                        return item.first.second == target;
+                    });
+                    return false;
+                }
+                unit = it->second;
+            }
+            bool enabled = kind == KIND_ENABLE;
+            std::pair<unsigned long long, unsigned long long> key(unit, target);
+            auto it = context.caps.find(key);
+            if (it != context.caps.end() && it->second == enabled) {
+                return true;
+            }
+            context.caps[key] = enabled;
+            return false;
+        }
+
+    case KIND_ENABLE_INDEXED:
+        if (!getArg(call, "target", target) &&
+            !getArg(call, "cap", target)) {
+            context.caps.clear();
+            return false;
+        }
+        eraseIf(context.caps, [target](const std::pair<const std::pair<unsigned long long, unsigned long long>, bool> &item) {
+            return item.first.second == target;
+        });
+        return false;
+
+    case KIND_UNIFORM:
+        {
+            /* With no program current the uniforms go to the active program
+             * of the bound pipeline, which we don't track. */
+            auto it = context.objects.find(OBJECT_PROGRAM);
+            if (it == context.objects.end() || it->second == 0) {
+                uniforms.clear();
+                return false;
+            }
+            return uniform(contextKey, it->second, call);
+        }
+
+    case KIND_PROGRAM_UNIFORM:
+        if (!getArg(call, "program", name)) {
+            uniforms.clear();
+            return false;
+        }
+        return uniform(contextKey, name, call);
+
+    case KIND_SETTER:
+        {
+            std::string value = argsFingerprint(call);
+            auto it = context.setters.find(group);
+            if (it != context.setters.end() && it->second == value) {
+                return true;
+            }
+            context.setters[group] = value;
+            return false;
+        }
+
+    default:
+        return false;
+    }
+}
+
+
+bool
+TraceOptimizer::sameState(const trace::Call *call, const TraceOptimizer &other, const trace::Call *otherCall) const
+{
+    static const Context unknown;
+
+    auto it = contexts.find(getContextKey(call));
+    auto otherIt = other.contexts.find(other.getContextKey(otherCall));
+    const Context &context = it != contexts.end() ? it->second : unknown;
+    const Context &otherContext = otherIt != other.contexts.end() ? otherIt->second : unknown;
+
+    return context == otherContext && uniforms == other.uniforms;
+}
@@ -0,0 +1,162 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace_model.hpp"
+
+
+/*
+ * Redundant state change detection used by `apitrace optimize`.
+ *
+ * Finds calls which provably leave the GL state unchanged, such as binding
+ * the object that is already bound, or enabling a capability that is already
+ * enabled.
+ *
+ * The tracking is deliberately conservative: any state we are not certain
+ * about is forgotten, and calls touching forgotten state are always kept.
+ */
+class TraceOptimizer
+{
+public:
+    /* Whether a call leaves the tracked state unchanged.  Must be invoked
+     * for every call but draws, in order. */
+    bool
+    isRedundant(const trace::Call *call);
+
+    /* Whether the state tracked for the context of a call matches the state
+     * another optimizer tracked for the context of its call. */
+    bool
+    sameState(const trace::Call *call, const TraceOptimizer &other, const trace::Call *otherCall) const;
+
+    /* Serialize a call, so that calls can be compared for identity. */
+    static std::string
+    fingerprint(const trace::Call *call);
+
+private:
+    /*
+     * Per-context state.  Absence from a map means unknown.
+     */
+    struct Context
+    {
+        bool inList = false;
+
+        std::map<unsigned, unsigned long long> objects;  // activeTexture, program, etc
+        std::map<std::pair<unsigned long long, unsigned long long>, unsigned long long> textures;  // (unit, target)
+        std::map<unsigned long long, unsigned long long> buffers;  // target
+        std::map<unsigned long long, unsigned long long> samplers;  // unit
+        std::map<std::pair<unsigned long long, unsigned long long>, bool> caps;  // (unit or ~0, cap)
+        std::map<unsigned, std::string> setters;  // group
+
+        bool
+        operator == (const Context &other) const {
+            return inList == other.inList &&
+                   objects == other.objects &&
+                   textures == other.textures &&
+                   buffers == other.buffers &&
+                   samplers == other.samplers &&
+                   caps == other.caps &&
+                   setters == other.setters;
+        }
+    };
+
+    struct Uniform
+    {
+        unsigned long long context;
+        std::string value;
+
+        bool
+        operator == (const Uniform &other) const {
+            return context == other.context && value == other.value;
+        }
+    };
+
+    std::vector<signed char> kinds;
+    std::vector<unsigned> groups;
+
+    std::map<unsigned, unsigned long long> currentContext;  // thread
+    std::map<unsigned long long, Context> contexts;
+
+    /* Uniforms are program state, and programs may be shared between
+     * contexts, but so may their names be reused by unrelated contexts, so
+     * remember which context set the value. */
+    std::map<std::pair<unsigned long long, long long>, Uniform> uniforms;  // (program, location)
+
+    int
+    getKind(const trace::Call *call, unsigned &group);
+
+    unsigned long long
+    getContextKey(const trace::Call *call) const {
+        auto it = currentContext.find(call->thread_id);
+        if (it != currentContext.end()) {
+            return it->second;
+        }
+        /* No MakeCurrent seen on this thread -- use a per-thread key which
+         * can't collide with a real context handle. */
+        return (1ULL << 63) | call->thread_id;
+    }
+
+    template< class Map, class Predicate >
+    static void
+    eraseIf(Map &map, Predicate predicate) {
+        for (auto it = map.begin(); it != map.end(); ) {
+            if (predicate(*it)) {
+                it = map.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void
+    forgetProgram(unsigned long long program);
+
+    bool
+    uniform(unsigned long long context, unsigned long long program, const trace::Call *call);
+
+    static bool
+    bind(std::map<unsigned long long, unsigned long long> &bindings, unsigned long long key, unsigned long long name) {
+        auto it = bindings.find(key);
+        if (it != bindings.end() && it->second == name) {
+            return true;
+        }
+        bindings[key] = name;
+        return false;
+    }
+
+    static bool
+    bind(std::map<unsigned, unsigned long long> &bindings, unsigned key, unsigned long long name) {
+        auto it = bindings.find(key);
+        if (it != bindings.end() && it->second == name) {
+            return true;
+        }
+        bindings[key] = name;
+        return false;
+    }
+};
@@ -0,0 +1,179 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include "gtest/gtest.h"
+
+#include "trace_optimizer.hpp"
+#include "trace_test_calls.hpp"
+
+using trace::Value;
+using namespace testcalls;
+
+
+TEST_SIG(0, glXCreateContext, "dpy", "vis", "shareList", "direct");
+TEST_SIG(1, glXMakeCurrent, "dpy", "drawable", "ctx");
+TEST_SIG(2, glEnable, "cap");
+TEST_SIG(3, glBindTexture, "target", "texture");
+TEST_SIG(4, glBindBuffer, "target", "buffer");
+TEST_SIG(5, glBindVertexArray, "array");
+TEST_SIG(6, glVertexArrayElementBuffer, "vaobj", "buffer");
+TEST_SIG(7, glPushClientAttrib, "mask");
+TEST_SIG(8, glUseProgram, "program");
+TEST_SIG(9, glLinkProgram, "program");
+TEST_SIG(10, glUniform1f, "location", "v0");
+TEST_SIG(11, glDrawArrays, "mode", "first", "count");
+
+static const trace::FunctionSig glPopClientAttrib_sig = {
+    12, "glPopClientAttrib", 0, NULL
+};
+
+
+/*
+ * Feeds calls to an optimizer, on a context created and made current
+ * beforehand.
+ */
+class Stream
+{
+public:
+    TraceOptimizer optimizer;
+
+    Stream() {
+        isRedundant(glXCreateContext_sig,
+                    {uintValue(1), uintValue(2), uintValue(0), uintValue(1)},
+                    uintValue(0x100));
+        isRedundant(glXMakeCurrent_sig, {uintValue(1), uintValue(3), uintValue(0x100)});
+    }
+
+    bool
+    isRedundant(const trace::FunctionSig &sig, std::initializer_list<Value *> args,
+                Value *ret = nullptr)
+    {
+        trace::Call call(&sig, 0, 0);
+        setArgs(call, args);
+        call.ret = ret;
+        return optimizer.isRedundant(&call);
+    }
+
+    bool
+    sameState(const Stream &other) const {
+        trace::Call draw(&glDrawArrays_sig, trace::CALL_FLAG_RENDER, 0);
+        setArgs(draw, {enumValue(GL_TRIANGLES), uintValue(0), uintValue(3)});
+        return optimizer.sameState(&draw, other.optimizer, &draw);
+    }
+};
+
+
+TEST(Optimize, bindings)
+{
+    Stream s;
+    EXPECT_FALSE(s.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(1)}));
+    EXPECT_TRUE(s.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(1)}));
+    EXPECT_FALSE(s.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(2)}));
+
+    EXPECT_FALSE(s.isRedundant(glEnable_sig, {enumValue(GL_BLEND)}));
+    EXPECT_TRUE(s.isRedundant(glEnable_sig, {enumValue(GL_BLEND)}));
+}
+
+
+TEST(Optimize, popClientAttrib)
+{
+    Stream s;
+    EXPECT_FALSE(s.isRedundant(glBindBuffer_sig, {enumValue(GL_ARRAY_BUFFER), uintValue(1)}));
+    s.isRedundant(glPushClientAttrib_sig, {uintValue(GL_CLIENT_VERTEX_ARRAY_BIT)});
+    EXPECT_FALSE(s.isRedundant(glBindBuffer_sig, {enumValue(GL_ARRAY_BUFFER), uintValue(2)}));
+    s.isRedundant(glPopClientAttrib_sig, {});
+
+    // Buffer 1 is bound again
+    EXPECT_FALSE(s.isRedundant(glBindBuffer_sig, {enumValue(GL_ARRAY_BUFFER), uintValue(2)}));
+}
+
+
+TEST(Optimize, vertexArrayElementBuffer)
+{
+    Stream s;
+    EXPECT_FALSE(s.isRedundant(glBindVertexArray_sig, {uintValue(1)}));
+    EXPECT_FALSE(s.isRedundant(glBindBuffer_sig,
+                               {enumValue(GL_ELEMENT_ARRAY_BUFFER), uintValue(5)}));
+    s.isRedundant(glVertexArrayElementBuffer_sig, {uintValue(1), uintValue(6)});
+
+    // Buffer 6 is bound now
+    EXPECT_FALSE(s.isRedundant(glBindBuffer_sig,
+                               {enumValue(GL_ELEMENT_ARRAY_BUFFER), uintValue(5)}));
+}
+
+
+TEST(Optimize, uniforms)
+{
+    Stream s;
+    EXPECT_FALSE(s.isRedundant(glUseProgram_sig, {uintValue(3)}));
+    EXPECT_FALSE(s.isRedundant(glUniform1f_sig, {uintValue(0), floatValue(1.0f)}));
+    EXPECT_TRUE(s.isRedundant(glUniform1f_sig, {uintValue(0), floatValue(1.0f)}));
+    EXPECT_FALSE(s.isRedundant(glUniform1f_sig, {uintValue(0), floatValue(2.0f)}));
+
+    // Linking resets uniforms to their defaults
+    s.isRedundant(glLinkProgram_sig, {uintValue(3)});
+    EXPECT_FALSE(s.isRedundant(glUniform1f_sig, {uintValue(0), floatValue(2.0f)}));
+}
+
+
+TEST(Optimize, sameState)
+{
+    Stream in;
+    Stream out;
+    EXPECT_TRUE(in.sameState(out));
+
+    // Dropping redundant calls leaves the state the same
+    in.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(1)});
+    in.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(1)});
+    out.isRedundant(glBindTexture_sig, {enumValue(GL_TEXTURE_2D), uintValue(1)});
+    EXPECT_TRUE(in.sameState(out));
+
+    // Dropping anything else doesn't
+    in.isRedundant(glEnable_sig, {enumValue(GL_DEPTH_TEST)});
+    EXPECT_FALSE(in.sameState(out));
+    out.isRedundant(glEnable_sig, {enumValue(GL_DEPTH_TEST)});
+    EXPECT_TRUE(in.sameState(out));
+
+    in.isRedundant(glUseProgram_sig, {uintValue(3)});
+    in.isRedundant(glUniform1f_sig, {uintValue(0), floatValue(1.0f)});
+    out.isRedundant(glUseProgram_sig, {uintValue(3)});
+    EXPECT_FALSE(in.sameState(out));
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
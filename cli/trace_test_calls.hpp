@@ -0,0 +1,87 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Helpers for building synthetic calls in tests.
+ */
+
+#pragma once
+
+#include <initializer_list>
+
+#include "gtest/gtest.h"
+
+#include "trace_model.hpp"
+
+
+/*
+ * Declare the signature NAME_sig, with the given ID, of a function taking
+ * the given arguments.
+ */
+#define TEST_SIG(id, name, ...) \
+    static const char *name##_args[] = { __VA_ARGS__ }; \
+    static const trace::FunctionSig name##_sig = { \
+        id, #name, sizeof name##_args / sizeof name##_args[0], name##_args \
+    }
+
+
+namespace testcalls {
+
+
+static const trace::EnumSig enumSig = { 0, 0, NULL };
+
+
+static inline trace::Value *
+enumValue(unsigned long long value)
+{
+    return new trace::Enum(&enumSig, value);
+}
+
+static inline trace::Value *
+uintValue(unsigned long long value)
+{
+    return new trace::UInt(value);
+}
+
+static inline trace::Value *
+floatValue(float value)
+{
+    return new trace::Float(value);
+}
+
+
+static inline void
+setArgs(trace::Call &call, std::initializer_list<trace::Value *> args)
+{
+    EXPECT_EQ(call.sig->num_args, args.size());
+    unsigned i = 0;
+    for (trace::Value *arg : args) {
+        call.args[i++].value = arg;
+    }
+}
+
+
+} /* namespace testcalls */
@@ -10,7 +10,6 @@
 #include <QHostAddress>
 #include <QSettings>
 #include <QTime>
-#include <QBuffer>
 
 #include "qubjson.h"
 
@@ -117,6 +116,7 @@ void AndroidRetracer::run()
 
     QVariantMap parsedJson;
     trace::Profile* profile = isProfiling() ? new trace::Profile() : NULL;
+    trace::ProfileParser profileParser(profile);
 
     QList<ApiTraceError> errors;
     QRegExp regexp("(^\\d+): +(\\b\\w+\\b): ([^\\r\\n]+)[\\r\\n]*$");
@@ -233,13 +233,8 @@ void AndroidRetracer::run()
                 QImage thumb = thumbnail(snapshot);
                 thumbnails.insert(info.commentNumber, thumb);
             } else if (isProfiling()) {
-                QByteArray line = readLine(stdoutSocket);
-                if (line.isEmpty()) {
-                    keepGoing = false;
-                    break;
-                }
-                line.append('\0');
-                trace::Profiler::parseLine(line.constData(), profile);
+                QByteArray data = stdoutSocket.readAll();
+                profileParser.parse(data.constData(), data.size());
             } else {
                 outputBuffer.append(stdoutSocket.readAll());
             }
@@ -270,10 +265,7 @@ void AndroidRetracer::run()
         msg = outputBuffer;
 
     if (captureState()) {
-        QBuffer io(&ubjsonBuffer);
-        io.open(QIODevice::ReadOnly);
-
-        parsedJson = decodeUBJSONObject(&io).toMap();
+        parsedJson = decodeUBJSONObject(ubjsonBuffer).toMap();
         ApiTraceState *state = new ApiTraceState(parsedJson);
         emit foundState(state);
     }
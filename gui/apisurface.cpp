@@ -34,7 +34,7 @@ struct ByteArrayBuf : public std::streambuf
 
 QImage ApiSurface::calculateThumbnail(bool opaque, bool alpha) const
 {
-    return m_data.isEmpty() ? QImage{} : calculateThumbnail(m_data, opaque, alpha);
+    return m_data.isEmpty() ? QImage{} : calculateThumbnail(m_data.data(), opaque, alpha);
 }
 
 QImage ApiSurface::calculateThumbnail(const QByteArray &data, bool opaque,
@@ -50,11 +50,21 @@ QImage ApiSurface::calculateThumbnail(const QByteArray &data, bool opaque,
 }
 
 void ApiSurface::setData(const QByteArray &data)
+{
+    m_data = UBJSONBinary(data);
+}
+
+void ApiSurface::setData(const UBJSONBinary &data)
 {
     m_data = data;
 }
 
 QByteArray ApiSurface::data() const
+{
+    return m_data.data();
+}
+
+UBJSONBinary ApiSurface::dataReference() const
 {
     return m_data;
 }
@@ -4,6 +4,8 @@
 #include <QSize>
 #include <QString>
 
+#include "qubjson.h"
+
 namespace image {
     class Image;
 }
@@ -23,9 +25,12 @@ public:
     void setFormatName(const QString &str);
 
     void setData(const QByteArray &data);
+    void setData(const UBJSONBinary &data);
     QImage calculateThumbnail(bool opaque, bool alpha) const;
 
     QByteArray data() const;
+    /* The encoded image, without copying it out of the state document */
+    UBJSONBinary dataReference() const;
 
     static image::Image *imageFromData(const QByteArray &data);
     static QImage qimageFromRawImage(const image::Image *img,
@@ -37,7 +42,7 @@ public:
 private:
 
     QSize  m_size;
-    QByteArray m_data;
+    UBJSONBinary m_data;
     int m_depth;
     QString m_formatName;
 
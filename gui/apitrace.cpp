@@ -6,10 +6,27 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QDir>
+#include <QMap>
 #include <QThread>
 
+// Rough estimate of the memory held by each ApiTraceCall besides its blobs:
+// the object itself, its QVariant arguments, and the cached rich text.
+#define CALL_SIZE_ESTIMATE 1024
+
+#define DEFAULT_FRAME_CACHE_BUDGET (quint64(1024) * 1024 * 1024)
+
+static quint64
+frameSizeEstimate(const ApiTraceFrame *frame)
+{
+    return quint64(frame->binaryDataSize()) +
+           quint64(frame->numTotalCalls()) * CALL_SIZE_ESTIMATE;
+}
+
 ApiTrace::ApiTrace()
-    : m_needsSaving(false)
+    : m_needsSaving(false),
+      m_frameUseClock(0),
+      m_frameCacheSize(0),
+      m_frameCacheBudget(DEFAULT_FRAME_CACHE_BUDGET)
 {
     m_loader = new TraceLoader();
 
@@ -28,9 +45,11 @@ ApiTrace::ApiTrace()
     connect(this, SIGNAL(loaderSearch(ApiTrace::SearchRequest)),
             m_loader, SLOT(search(ApiTrace::SearchRequest)));
     connect(m_loader,
-            SIGNAL(searchResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceCall*)),
+            SIGNAL(searchResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceFrame*,int)),
             this,
-            SLOT(loaderSearchResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceCall*)));
+            SLOT(loaderSearchResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceFrame*,int)));
+    connect(m_loader, SIGNAL(searchProgress(int)),
+            this, SIGNAL(findProgress(int)));
     connect(this, SIGNAL(loaderFindFrameStart(ApiTraceFrame*)),
             m_loader, SLOT(findFrameStart(ApiTraceFrame*)));
     connect(this, SIGNAL(loaderFindFrameEnd(ApiTraceFrame*)),
@@ -41,8 +60,8 @@ ApiTrace::ApiTrace()
             this, SIGNAL(foundFrameEnd(ApiTraceFrame*)));
     connect(this, SIGNAL(loaderFindCallIndex(int)),
             m_loader, SLOT(findCallIndex(int)));
-    connect(m_loader, SIGNAL(foundCallIndex(ApiTraceCall*)),
-            this, SIGNAL(foundCallIndex(ApiTraceCall*)));
+    connect(m_loader, SIGNAL(foundCallIndex(ApiTraceFrame*,int)),
+            this, SLOT(loaderFoundCallIndex(ApiTraceFrame*,int)));
 
 
     connect(m_loader, SIGNAL(parseProblem(const QString&)),
@@ -68,6 +87,7 @@ ApiTrace::ApiTrace()
 
 ApiTrace::~ApiTrace()
 {
+    m_loader->cancelSearch();
     m_loaderThread->quit();
     m_loaderThread->deleteLater();
     qDeleteAll(m_frames);
@@ -96,7 +116,9 @@ const QList<ApiTraceFrame*> & ApiTrace::frames() const
 
 ApiTraceFrame * ApiTrace::frameAt(int idx) const
 {
-    return m_frames.value(idx);
+    ApiTraceFrame *frame = m_frames.value(idx);
+    touchFrame(frame);
+    return frame;
 }
 
 int ApiTrace::numFrames() const
@@ -106,7 +128,7 @@ int ApiTrace::numFrames() const
 
 int ApiTrace::numCallsInFrame(int idx) const
 {
-    const ApiTraceFrame *frame = frameAt(idx);
+    const ApiTraceFrame *frame = m_frames.value(idx);
     if (frame) {
         return frame->numTotalCalls();
     } else {
@@ -124,8 +146,12 @@ void ApiTrace::setFileName(const QString &name)
         m_errors.clear();
         m_editedCalls.clear();
         m_queuedErrors.clear();
+        m_cachedFrames.clear();
+        m_pinnedFrames.clear();
+        m_frameCacheSize = 0;
         m_needsSaving = false;
         emit invalidated();
+        emit frameCacheChanged(m_frameCacheSize, m_frameCacheBudget);
 
         emit loadTrace(m_fileName);
     }
@@ -152,6 +178,7 @@ ApiTraceCall * ApiTrace::callWithIndex(int idx) const
     for (int i = 0; i < m_frames.count(); ++i) {
         ApiTraceCall *call = m_frames[i]->callWithIndex(idx);
         if (call) {
+            touchFrame(m_frames[i]);
             return call;
         }
     }
@@ -274,6 +301,26 @@ void ApiTrace::loaderFrameLoaded(ApiTraceFrame *frame,
         frame->setCalls(topLevelItems, calls, binaryDataSize);
         emit endLoadingFrame(frame);
         m_loadingFrames.remove(frame);
+
+        // The frame might have been unloaded before, so restore the
+        // thumbnails already bound to its calls
+        if (!m_thumbnails.isEmpty()) {
+            foreach (ApiTraceCall *call, calls) {
+                ImageHash::const_iterator itr = m_thumbnails.find(call->index());
+                if (itr != m_thumbnails.constEnd()) {
+                    call->setThumbnail(itr.value());
+                }
+            }
+        }
+
+        if (!frame->isEmpty()) {
+            m_cachedFrames.insert(frame, ++m_frameUseClock);
+            m_frameCacheSize += frameSizeEstimate(frame);
+        }
+    } else {
+        // The loader always parses a copy of the frame, as it can't safely
+        // look at the calls we own, so drop it when we have them already
+        qDeleteAll(calls);
     }
 
     if (!m_queuedErrors.isEmpty()) {
@@ -303,6 +350,8 @@ void ApiTrace::loaderFrameLoaded(ApiTraceFrame *frame,
             }
         }
     }
+
+    unloadFrames(frame);
 }
 
 void ApiTrace::findNext(ApiTraceFrame *frame,
@@ -314,10 +363,13 @@ void ApiTrace::findNext(ApiTraceFrame *frame,
     int frameIdx = m_frames.indexOf(frame);
     SearchRequest request(SearchRequest::Next,
                           frame, from, str, sensitivity);
+    // Supersede any search still running in the loader
+    request.serial = m_loader->cancelSearch();
 
     if (frame->isLoaded()) {
         foundCall = frame->findNextCall(from, str, sensitivity);
         if (foundCall) {
+            touchFrame(frame);
             emit findResult(request, SearchResult_Found, foundCall);
             return;
         }
@@ -338,6 +390,7 @@ void ApiTrace::findNext(ApiTraceFrame *frame,
         } else {
             ApiTraceCall *call = frame->findNextCall(0, str, sensitivity);
             if (call) {
+                touchFrame(frame);
                 emit findResult(request, SearchResult_Found, call);
                 return;
             }
@@ -355,10 +408,13 @@ void ApiTrace::findPrev(ApiTraceFrame *frame,
     int frameIdx = m_frames.indexOf(frame);
     SearchRequest request(SearchRequest::Prev,
                           frame, from, str, sensitivity);
+    // Supersede any search still running in the loader
+    request.serial = m_loader->cancelSearch();
 
     if (frame->isLoaded()) {
         foundCall = frame->findPrevCall(from, str, sensitivity);
         if (foundCall) {
+            touchFrame(frame);
             emit findResult(request, SearchResult_Found, foundCall);
             return;
         }
@@ -378,6 +434,7 @@ void ApiTrace::findPrev(ApiTraceFrame *frame,
         } else {
             ApiTraceCall *call = frame->findPrevCall(0, str, sensitivity);
             if (call) {
+                touchFrame(frame);
                 emit findResult(request, SearchResult_Found, call);
                 return;
             }
@@ -386,21 +443,44 @@ void ApiTrace::findPrev(ApiTraceFrame *frame,
     emit findResult(request, SearchResult_Wrapped, 0);
 }
 
+void ApiTrace::cancelSearch()
+{
+    m_loader->cancelSearch();
+}
+
 void ApiTrace::loaderSearchResult(const ApiTrace::SearchRequest &request,
                                   ApiTrace::SearchResult result,
-                                  ApiTraceCall *call)
-{
-    //qDebug()<<"Search result = "<<result
-    //       <<", call is = "<<call;
+                                  ApiTraceFrame *frame,
+                                  int callIndex)
+{
+    // The frame contents were delivered just before, so the call is
+    // resolved here rather than by the loader
+    ApiTraceCall *call = 0;
+    if (result == SearchResult_Found) {
+        Q_ASSERT(frame);
+        call = frame->callWithIndex(callIndex);
+        if (!call) {
+            result = SearchResult_NotFound;
+        }
+        touchFrame(frame);
+    }
     emit findResult(request, result, call);
 }
 
+void ApiTrace::loaderFoundCallIndex(ApiTraceFrame *frame, int callIndex)
+{
+    ApiTraceCall *call = frame->callWithIndex(callIndex);
+    touchFrame(frame);
+    emit foundCallIndex(call);
+}
+
 void ApiTrace::findFrameStart(ApiTraceFrame *frame)
 {
     if (!frame)
         return;
 
     if (frame->isLoaded()) {
+        touchFrame(frame);
         emit foundFrameStart(frame);
     } else {
         emit loaderFindFrameStart(frame);
@@ -413,6 +493,7 @@ void ApiTrace::findFrameEnd(ApiTraceFrame *frame)
         return;
 
     if (frame->isLoaded()) {
+        touchFrame(frame);
         emit foundFrameEnd(frame);
     } else {
         emit loaderFindFrameEnd(frame);
@@ -434,6 +515,7 @@ void ApiTrace::findCallIndex(int index)
     if (frame) {
         if (frame->isLoaded()) {
             ApiTraceCall *call = frame->callWithIndex(index);
+            touchFrame(frame);
             emit foundCallIndex(call);
         } else {
             emit loaderFindCallIndex(index);
@@ -493,6 +575,94 @@ bool ApiTrace::isFrameLoading(ApiTraceFrame *frame) const
     return m_loadingFrames.contains(frame);
 }
 
+quint64 ApiTrace::frameCacheBudget() const
+{
+    return m_frameCacheBudget;
+}
+
+void ApiTrace::setFrameCacheBudget(quint64 bytes)
+{
+    m_frameCacheBudget = bytes;
+    unloadFrames();
+}
+
+quint64 ApiTrace::frameCacheSize() const
+{
+    return m_frameCacheSize;
+}
+
+void ApiTrace::setPinnedFrames(const QSet<ApiTraceFrame*> &frames)
+{
+    m_pinnedFrames = frames;
+
+    // Pinned frames are the ones being looked at, so they are also the most
+    // recently used ones
+    foreach (ApiTraceFrame *frame, frames) {
+        touchFrame(frame);
+    }
+}
+
+void ApiTrace::touchFrame(ApiTraceFrame *frame) const
+{
+    QHash<ApiTraceFrame*, quint64>::iterator itr = m_cachedFrames.find(frame);
+    if (itr != m_cachedFrames.end()) {
+        *itr = ++m_frameUseClock;
+    }
+}
+
+bool ApiTrace::canUnloadFrame(ApiTraceFrame *frame) const
+{
+    if (m_pinnedFrames.contains(frame)) {
+        return false;
+    }
+
+    // Edits and errors live in the calls themselves
+    foreach (ApiTraceCall *call, m_editedCalls) {
+        if (call->parentFrame() == frame) {
+            return false;
+        }
+    }
+    foreach (ApiTraceCall *call, m_errors) {
+        if (call->parentFrame() == frame) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ApiTrace::unloadFrames(ApiTraceFrame *current)
+{
+    if (m_frameCacheBudget && m_frameCacheSize > m_frameCacheBudget) {
+        // Least recently used first
+        QMap<quint64, ApiTraceFrame*> byUse;
+        QHash<ApiTraceFrame*, quint64>::const_iterator itr;
+        for (itr = m_cachedFrames.constBegin(); itr != m_cachedFrames.constEnd(); ++itr) {
+            byUse.insert(itr.value(), itr.key());
+        }
+
+        foreach (ApiTraceFrame *frame, byUse) {
+            if (m_frameCacheSize <= m_frameCacheBudget) {
+                break;
+            }
+            if (frame == current || !canUnloadFrame(frame)) {
+                continue;
+            }
+
+            m_cachedFrames.remove(frame);
+            m_frameCacheSize -= frameSizeEstimate(frame);
+
+            // The frame will be transparently loaded again from its bookmark
+            // the next time it's expanded
+            emit beginUnloadingFrame(frame);
+            frame->unload();
+            emit endUnloadingFrame(frame);
+        }
+    }
+
+    emit frameCacheChanged(m_frameCacheSize, m_frameCacheBudget);
+}
+
 void ApiTrace::bindThumbnails(const ImageHash &thumbnails)
 {
     QHashIterator<int, QImage> i(thumbnails);
@@ -508,11 +678,11 @@ void ApiTrace::bindThumbnails(const ImageHash &thumbnails)
 
             // find the frame associated with the call index
             int frameIndex = 0;
-            while (frameAt(frameIndex)->lastCallIndex() < callIndex) {
+            while (m_frames[frameIndex]->lastCallIndex() < callIndex) {
                 ++frameIndex;
             }
 
-            ApiTraceFrame *frame = frameAt(frameIndex);
+            ApiTraceFrame *frame = m_frames[frameIndex];
 
             // if the call was actually for a frame, ...
             if (callIndex == frame->lastCallIndex()) {
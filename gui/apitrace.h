@@ -4,6 +4,7 @@
 
 #include "trace_api.hpp"
 
+#include <QHash>
 #include <QObject>
 #include <QSet>
 
@@ -29,7 +30,8 @@ public:
             Prev
         };
         SearchRequest()
-            : direction(Next)
+            : direction(Next),
+              serial(0)
         {}
         SearchRequest(Direction dir,
                       ApiTraceFrame *f,
@@ -40,13 +42,17 @@ public:
               frame(f),
               from(call),
               text(str),
-              cs(caseSens)
+              cs(caseSens),
+              serial(0)
         {}
         Direction direction;
         ApiTraceFrame *frame;
         ApiTraceCall *from;
         QString text;
         Qt::CaseSensitivity cs;
+        // Searches in the loader are abandoned once superseded, see
+        // TraceLoader::cancelSearch
+        int serial;
     };
 
 public:
@@ -87,6 +93,18 @@ public:
 
     void iterateMissingThumbnails(void *object, ThumbnailCallback cb);
 
+    // Loaded frames are kept in a LRU cache, and unloaded once the estimated
+    // memory they take exceeds the budget (0 means unlimited)
+    quint64 frameCacheBudget() const;
+    void setFrameCacheBudget(quint64 bytes);
+    quint64 frameCacheSize() const;
+
+    // Frames whose calls are referenced elsewhere and must stay loaded
+    void setPinnedFrames(const QSet<ApiTraceFrame*> &frames);
+
+    // Mark a loaded frame as the most recently used one
+    void touchFrame(ApiTraceFrame *frame) const;
+
 public slots:
     void setFileName(const QString &name);
     void save();
@@ -100,6 +118,7 @@ public slots:
                   ApiTraceCall *call,
                   const QString &str,
                   Qt::CaseSensitivity sensitivity);
+    void cancelSearch();
     void findFrameStart(ApiTraceFrame *frame);
     void findFrameEnd(ApiTraceFrame *frame);
     void findCallIndex(int index);
@@ -122,11 +141,15 @@ signals:
     void findResult(const ApiTrace::SearchRequest &request,
                     ApiTrace::SearchResult result,
                     ApiTraceCall *call);
+    void findProgress(int percent);
 
     void beginAddingFrames(int oldCount, int numAdded);
     void endAddingFrames();
     void beginLoadingFrame(ApiTraceFrame *frame, int numAdded);
     void endLoadingFrame(ApiTraceFrame *frame);
+    void beginUnloadingFrame(ApiTraceFrame *frame);
+    void endUnloadingFrame(ApiTraceFrame *frame);
+    void frameCacheChanged(quint64 size, quint64 budget);
     void foundFrameStart(ApiTraceFrame *frame);
     void foundFrameEnd(ApiTraceFrame *frame);
     void foundCallIndex(ApiTraceCall *call);
@@ -147,11 +170,15 @@ private slots:
                            quint64 binaryDataSize);
     void loaderSearchResult(const ApiTrace::SearchRequest &request,
                             ApiTrace::SearchResult result,
-                            ApiTraceCall *call);
+                            ApiTraceFrame *frame,
+                            int callIndex);
+    void loaderFoundCallIndex(ApiTraceFrame *frame, int callIndex);
 
 private:
     int callInFrame(int callIdx) const;
     bool isFrameLoading(ApiTraceFrame *frame) const;
+    bool canUnloadFrame(ApiTraceFrame *frame) const;
+    void unloadFrames(ApiTraceFrame *current = 0);
 
     void missingThumbnail(int callIdx);
 private:
@@ -173,6 +200,13 @@ private:
     QList< QPair<ApiTraceFrame*, ApiTraceError> > m_queuedErrors;
     QSet<ApiTraceFrame*> m_loadingFrames;
 
+    // Loaded frames, along with when they were last used
+    mutable QHash<ApiTraceFrame*, quint64> m_cachedFrames;
+    mutable quint64 m_frameUseClock;
+    QSet<ApiTraceFrame*> m_pinnedFrames;
+    quint64 m_frameCacheSize;
+    quint64 m_frameCacheBudget;
+
     QSet<int> m_missingThumbnails;
 
     ImageHash m_thumbnails;
@@ -102,6 +102,17 @@ plainTextToHTML(const QString & plain, bool multiLine, bool forceNoQuote = false
     return rich;
 }
 
+static QString
+binaryDataToString(int bytes)
+{
+    if (bytes < 1024) {
+        return QObject::tr("[binary data, size = %1 bytes]").arg(bytes);
+    } else {
+        float kb = bytes/1024.;
+        return QObject::tr("[binary data, size = %1 kb]").arg(kb);
+    }
+}
+
 QString
 apiVariantToString(const QVariant &variant, bool multiLine)
 {
@@ -116,13 +127,7 @@ apiVariantToString(const QVariant &variant, bool multiLine)
         return QString::number(variant.toDouble());
     }
     if (variant.userType() == QVariant::ByteArray) {
-        if (variant.toByteArray().size() < 1024) {
-            int bytes = variant.toByteArray().size();
-            return QObject::tr("[binary data, size = %1 bytes]").arg(bytes);
-        } else {
-            float kb = variant.toByteArray().size()/1024.;
-            return QObject::tr("[binary data, size = %1 kb]").arg(kb);
-        }
+        return binaryDataToString(variant.toByteArray().size());
     }
 
     if (variant.userType() == QVariant::String) {
@@ -230,6 +235,139 @@ void VariantVisitor::visit(trace::Repr *repr)
     repr->humanValue->visit(*this);
 }
 
+/*
+ * Formats trace values as apiVariantToString formats the QVariants that
+ * VariantVisitor would make of them.
+ */
+class SearchTextVisitor : public trace::Visitor
+{
+public:
+    SearchTextVisitor(QString &text)
+        : m_text(text)
+    {}
+
+    virtual void visit(trace::Null *) override
+    {
+        m_text += QLatin1String("NULL");
+    }
+
+    virtual void visit(trace::Bool *node) override
+    {
+        m_text += node->value ? QLatin1String("true") : QLatin1String("false");
+    }
+
+    virtual void visit(trace::SInt *node) override
+    {
+        m_text += QString::number(node->value);
+    }
+
+    virtual void visit(trace::UInt *node) override
+    {
+        m_text += QString::number(node->value);
+    }
+
+    virtual void visit(trace::Float *node) override
+    {
+        m_text += QString::number(node->value);
+    }
+
+    virtual void visit(trace::Double *node) override
+    {
+        m_text += QString::number(node->value);
+    }
+
+    virtual void visit(trace::String *node) override
+    {
+        m_text += plainTextToHTML(QString::fromLatin1(node->value), false);
+    }
+
+    virtual void visit(trace::WString *node) override
+    {
+        m_text += plainTextToHTML(QString::fromWCharArray(node->value), false);
+    }
+
+    virtual void visit(trace::Enum *e) override
+    {
+        m_text += ApiEnum(e->sig, e->value).toString();
+    }
+
+    virtual void visit(trace::Bitmask *bitmask) override
+    {
+        m_text += ApiBitmask(bitmask).toString();
+    }
+
+    virtual void visit(trace::Struct *str) override
+    {
+        m_text += QLatin1Char('{');
+        for (unsigned i = 0; i < str->sig->num_members; ++i) {
+            if (i) {
+                m_text += QLatin1String(", ");
+            }
+            m_text += QLatin1String(str->sig->member_names[i]);
+            m_text += QLatin1String(" = ");
+            _visit(str->members[i]);
+        }
+        m_text += QLatin1Char('}');
+    }
+
+    virtual void visit(trace::Array *array) override
+    {
+        m_text += QLatin1Char('[');
+        for (size_t i = 0; i < array->values.size(); ++i) {
+            if (i) {
+                m_text += QLatin1String(", ");
+            }
+            _visit(array->values[i]);
+        }
+        m_text += QLatin1Char(']');
+    }
+
+    virtual void visit(trace::Blob *blob) override
+    {
+        m_text += binaryDataToString(blob->size);
+    }
+
+    virtual void visit(trace::Pointer *ptr) override
+    {
+        m_text += ApiPointer(ptr->value).toString();
+    }
+
+    virtual void visit(trace::Repr *repr) override
+    {
+        _visit(repr->humanValue);
+    }
+
+private:
+    QString &m_text;
+};
+
+void
+appendCallSearchText(QString &text, trace::Call *call)
+{
+    SearchTextVisitor visitor(text);
+
+    text += QLatin1String(call->sig->name);
+    text += QLatin1Char('(');
+    for (unsigned i = 0; i < call->sig->num_args; ++i) {
+        if (i) {
+            text += QLatin1String(", ");
+        }
+        text += QLatin1String(call->sig->arg_names[i]);
+        text += QLatin1String(" = ");
+        if (i < call->args.size() && call->args[i].value) {
+            call->args[i].value->visit(visitor);
+        } else {
+            text += QLatin1Char('?');
+        }
+    }
+    text += QLatin1Char(')');
+
+    if (call->ret) {
+        text += QLatin1String(" = ");
+        call->ret->visit(visitor);
+    }
+}
+
 ApiEnum::ApiEnum(const trace::EnumSig *sig, signed long long value)
     : m_sig(sig), m_value(value)
 {
@@ -436,6 +574,14 @@ ApiTraceState::ApiTraceState()
 {
 }
 
+static UBJSONBinary getSurfaceData(const QVariant &data)
+{
+    if (data.userType() == qMetaTypeId<UBJSONBinary>()) {
+        return data.value<UBJSONBinary>();
+    }
+    return UBJSONBinary(data.toByteArray());
+}
+
 static ApiTexture getTextureFrom(QVariantMap const &image, QString label)
 {
     QSize size(image[QLatin1String("__width__")].toInt(),
@@ -446,8 +592,8 @@ static ApiTexture getTextureFrom(QVariantMap const &image, QString label)
     QString formatName =
         image[QLatin1String("__format__")].toString();
 
-    QByteArray dataArray =
-        image[QLatin1String("__data__")].toByteArray();
+    UBJSONBinary dataArray =
+        getSurfaceData(image[QLatin1String("__data__")]);
 
     QString userLabel =
         image[QLatin1String("__label__")].toString();
@@ -504,8 +650,8 @@ ApiTraceState::ApiTraceState(const QVariantMap &parsedJson)
         int depth = buffer[QLatin1String("__depth__")].toInt();
         QString formatName = buffer[QLatin1String("__format__")].toString();
 
-        QByteArray dataArray =
-            buffer[QLatin1String("__data__")].toByteArray();
+        UBJSONBinary dataArray =
+            getSurfaceData(buffer[QLatin1String("__data__")]);
 
         QString label = itr.key();
         QString userLabel =
@@ -1242,6 +1388,17 @@ void ApiTraceFrame::setCalls(const QVector<ApiTraceCall*> &children,
     m_staticText = 0;
 }
 
+void ApiTraceFrame::unload()
+{
+    // Drop the calls, but keep everything needed to load them again
+    qDeleteAll(m_calls);
+    m_children.clear();
+    m_calls.clear();
+    m_loaded = false;
+    delete m_staticText;
+    m_staticText = 0;
+}
+
 bool ApiTraceFrame::isLoaded() const
 {
     return m_loaded;
@@ -137,6 +137,12 @@ Q_DECLARE_METATYPE(ApiArray);
 
 QString apiVariantToString(const QVariant &variant, bool multiLine = false);
 
+/*
+ * Append the text ApiTraceCall::searchText() would have for a call, without
+ * converting it into an ApiTraceCall first.
+ */
+void appendCallSearchText(QString &text, trace::Call *call);
+
 class ApiTraceFrame;
 
 class ApiTraceState {
@@ -342,6 +348,7 @@ public:
     void setCalls(const QVector<ApiTraceCall*> &topLevelCalls,
                   const QVector<ApiTraceCall*> &allCalls,
                   quint64 binaryDataSize);
+    void unload();
 
     ApiTraceCall *findNextCall(ApiTraceCall *from,
                                const QString &str,
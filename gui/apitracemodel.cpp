@@ -261,6 +261,10 @@ void ApiTraceModel::setApiTrace(ApiTrace *trace)
             this, SLOT(beginLoadingFrame(ApiTraceFrame*,int)));
     connect(m_trace, SIGNAL(endLoadingFrame(ApiTraceFrame*)),
             this, SLOT(endLoadingFrame(ApiTraceFrame*)));
+    connect(m_trace, SIGNAL(beginUnloadingFrame(ApiTraceFrame*)),
+            this, SLOT(beginUnloadingFrame(ApiTraceFrame*)));
+    connect(m_trace, SIGNAL(endUnloadingFrame(ApiTraceFrame*)),
+            this, SLOT(endUnloadingFrame(ApiTraceFrame*)));
 
 }
 
@@ -417,4 +421,22 @@ void ApiTraceModel::endLoadingFrame(ApiTraceFrame *frame)
     m_loadingFrames.remove(frame);
 }
 
+void ApiTraceModel::beginUnloadingFrame(ApiTraceFrame *frame)
+{
+    Q_ASSERT(frame->numChildren() > 0);
+    QModelIndex index = createIndex(frame->number, 0, frame);
+    beginRemoveRows(index, 0, frame->numChildren() - 1);
+}
+
+void ApiTraceModel::endUnloadingFrame(ApiTraceFrame *frame)
+{
+    QModelIndex index = createIndex(frame->number, 0, frame);
+
+    endRemoveRows();
+
+    // canFetchMore() holds again, so the view will fetch the rows back
+    // when it needs them
+    emit dataChanged(index, index);
+}
+
 #include "apitracemodel.moc"
@@ -3,6 +3,7 @@
 #include "graphing/graphwidget.h"
 #include "trace_profiler.hpp"
 #include "profiling.h"
+#include "profiletimeline.h"
 
 /**
  * Wrapper for call duration graphs.
@@ -82,9 +83,10 @@ private:
 /* Data provider for call duration graphs */
 class CallDurationDataProvider : public GraphDataProvider {
 public:
-    CallDurationDataProvider(const trace::Profile* profile, bool gpu) :
+    CallDurationDataProvider(const trace::Profile* profile, const ProfileTimelines* timelines, bool gpu) :
         m_gpu(gpu),
         m_profile(profile),
+        m_timelines(timelines),
         m_selectionState(NULL)
     {
     }
@@ -123,6 +125,43 @@ public:
         }
     }
 
+    virtual qint64 maxValue(qint64 begin, qint64 end, qint64* index = NULL) const override
+    {
+        GraphPyramid::Aggregate durations = m_timelines->calls(m_gpu).durations(begin, end);
+
+        if (index) {
+            *index = durations.maxIndex;
+        }
+
+        return durations.isEmpty() ? 0 : durations.max;
+    }
+
+    virtual qint64 maxSelectedValue(qint64 begin, qint64 end) const override
+    {
+        if (!m_selectionState) {
+            return 0;
+        }
+
+        if (m_selectionState->type == SelectionState::Horizontal) {
+            return maxValue(qMax(begin, m_selectionState->start),
+                            qMin(end, m_selectionState->end));
+        } else if (m_selectionState->type == SelectionState::Vertical) {
+            if (m_selectionState->start < 0 ||
+                m_selectionState->start >= m_timelines->programs()) {
+                return 0;
+            }
+
+            /* Only calls with GPU timings are tracked per program */
+            const ProfileTimeline& program = m_timelines->program(m_selectionState->start, m_gpu);
+            GraphPyramid::Aggregate durations =
+                program.durations(program.lowerBoundCall(begin), program.lowerBoundCall(end));
+
+            return durations.isEmpty() ? 0 : durations.max;
+        }
+
+        return 0;
+    }
+
     virtual void itemDoubleClicked(qint64 index) const override
     {
         if (!m_profile) {
@@ -166,6 +205,7 @@ public:
 private:
     bool m_gpu;
     const trace::Profile* m_profile;
+    const ProfileTimelines* m_timelines;
     SelectionState* m_selectionState;
 };
 
@@ -31,6 +31,14 @@ public:
     /* Returns value for index */
     virtual qint64 value(qint64 index) const = 0;
 
+    /* Largest value in [begin, end), or 0 if none, and optionally its index.
+     * Used when there are many items per pixel, so this should not need to
+     * visit them all. */
+    virtual qint64 maxValue(qint64 begin, qint64 end, qint64* index = NULL) const = 0;
+
+    /* Largest value of the selected items in [begin, end), or 0 if none */
+    virtual qint64 maxSelectedValue(qint64 begin, qint64 end) const = 0;
+
     /* Is the item at index selected */
     virtual bool selected(qint64 index) const = 0;
 
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <QtGlobal>
+
+#include <vector>
+
+/**
+ * Multi-resolution min/max/sum aggregate of a sequence of values.
+ *
+ * The first level summarizes groups of FANOUT consecutive values, the next
+ * groups of FANOUT nodes of the first, and so on up to a single node.  Any
+ * range of values is then summarized by combining at most 2 * FANOUT items
+ * per level, so graphs can draw each pixel in logarithmic time regardless of
+ * how many values it covers.
+ *
+ * The values themselves are not kept, but accessed through a functor
+ * returning the value for an index, both when building and querying.
+ */
+class GraphPyramid {
+public:
+    enum {
+        FANOUT = 8
+    };
+
+    struct Aggregate {
+        Aggregate() :
+            min(0),
+            max(0),
+            sum(0),
+            maxIndex(-1)
+        {
+        }
+
+        bool isEmpty() const
+        {
+            return maxIndex < 0;
+        }
+
+        void add(qint64 value, qint64 index)
+        {
+            if (isEmpty()) {
+                min = max = value;
+                maxIndex = index;
+            } else {
+                if (value < min) {
+                    min = value;
+                }
+                if (value > max) {
+                    max = value;
+                    maxIndex = index;
+                }
+            }
+            sum += value;
+        }
+
+        void add(const Aggregate& other)
+        {
+            if (other.isEmpty()) {
+                return;
+            }
+
+            if (isEmpty()) {
+                *this = other;
+                return;
+            }
+
+            if (other.min < min) {
+                min = other.min;
+            }
+            if (other.max > max) {
+                max = other.max;
+                maxIndex = other.maxIndex;
+            }
+            sum += other.sum;
+        }
+
+        qint64 min;
+        qint64 max;
+        qint64 sum;
+
+        /* Index of the (first) largest value, or -1 when empty */
+        qint64 maxIndex;
+    };
+
+public:
+    GraphPyramid() :
+        m_size(0)
+    {
+    }
+
+    qint64 size() const
+    {
+        return m_size;
+    }
+
+    template<typename Values>
+    void build(const Values& values, qint64 size)
+    {
+        m_size = size;
+        m_levels.clear();
+
+        if (size == 0) {
+            return;
+        }
+
+        m_levels.push_back(std::vector<Aggregate>());
+        m_levels.back().reserve((size + FANOUT - 1) / FANOUT);
+
+        for (qint64 i = 0; i < size; i += FANOUT) {
+            Aggregate node;
+            qint64 end = qMin<qint64>(i + FANOUT, size);
+
+            for (qint64 j = i; j < end; ++j) {
+                node.add(values(j), j);
+            }
+
+            m_levels.back().push_back(node);
+        }
+
+        while (m_levels.back().size() > 1) {
+            const std::vector<Aggregate>& below = m_levels.back();
+            std::vector<Aggregate> level;
+            level.reserve((below.size() + FANOUT - 1) / FANOUT);
+
+            for (size_t i = 0; i < below.size(); i += FANOUT) {
+                Aggregate node;
+                size_t end = qMin<size_t>(i + FANOUT, below.size());
+
+                for (size_t j = i; j < end; ++j) {
+                    node.add(below[j]);
+                }
+
+                level.push_back(node);
+            }
+
+            m_levels.push_back(level);
+        }
+    }
+
+    /* Summarize the values in [begin, end) */
+    template<typename Values>
+    Aggregate query(const Values& values, qint64 begin, qint64 end) const
+    {
+        Aggregate result;
+
+        begin = qMax<qint64>(begin, 0);
+        end = qMin<qint64>(end, m_size);
+
+        /* Values at the edges, up to the boundaries of the first level */
+        while (begin < end && begin % FANOUT) {
+            result.add(values(begin), begin);
+            ++begin;
+        }
+
+        while (begin < end && end % FANOUT) {
+            --end;
+            result.add(values(end), end);
+        }
+
+        /* Then nodes, moving one level up each time */
+        begin /= FANOUT;
+        end /= FANOUT;
+
+        for (size_t level = 0; begin < end; ++level) {
+            const std::vector<Aggregate>& nodes = m_levels[level];
+
+            while (begin < end && begin % FANOUT) {
+                result.add(nodes[begin]);
+                ++begin;
+            }
+
+            while (begin < end && end % FANOUT) {
+                --end;
+                result.add(nodes[end]);
+            }
+
+            begin /= FANOUT;
+            end /= FANOUT;
+        }
+
+        return result;
+    }
+
+private:
+    qint64 m_size;
+    std::vector< std::vector<Aggregate> > m_levels;
+};
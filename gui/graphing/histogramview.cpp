@@ -100,13 +100,7 @@ void HistogramView::update()
     m_graphTop = 0;
 
     if (m_data) {
-        for (qint64 i = m_viewLeft; i < m_viewRight; ++i) {
-            qint64 value = m_data->value(i);
-
-            if (value > m_graphTop) {
-                m_graphTop = value;
-            }
-        }
+        m_graphTop = qMax<qint64>(m_graphTop, m_data->maxValue(m_viewLeft, m_viewRight));
     }
 
     GraphView::update();
@@ -123,7 +117,8 @@ void HistogramView::resizeEvent(QResizeEvent *)
 /* Draw the histogram
  *
  * When the view is zoomed such that there is more than one item occupying a single pixel
- * the one with the highest value will be displayed.
+ * the one with the highest value will be displayed, as given by the data provider
+ * for the whole range of the pixel.
  */
 void HistogramView::paintEvent(QPaintEvent *)
 {
@@ -145,11 +140,8 @@ void HistogramView::paintEvent(QPaintEvent *)
     bool selection = m_selectionState && m_selectionState->type != SelectionState::None;
 
     if (dxdv < 1.0) {
-        /* Less than one pixel per item */
-        qint64 longestValue = m_graphBottom;
-        qint64 longestSelected = m_graphBottom;
-        int lastX = 0;
-        double x = 0;
+        /* Less than one pixel per item, draw the largest of each pixel */
+        double dvdx = 1.0 / dxdv;
 
         if (selection) {
             painter.setPen(unselectedPen);
@@ -157,33 +149,28 @@ void HistogramView::paintEvent(QPaintEvent *)
             painter.setPen(selectedPen);
         }
 
-        for (qint64 i = m_viewLeft; i < m_viewRight; ++i) {
-            qint64 value = m_data->value(i);
-            int ix;
+        for (int x = 0; x < width(); ++x) {
+            qint64 begin = m_viewLeft + (qint64)(x * dvdx);
+            qint64 end = qMin<qint64>(m_viewLeft + (qint64)((x + 1) * dvdx), m_viewRight);
 
-            if (value > longestValue) {
-                longestValue = value;
+            if (begin >= end) {
+                continue;
             }
 
-            if (selection && m_data->selected(i) && value > longestSelected) {
-                longestSelected = value;
-            }
+            qint64 longestValue = m_data->maxValue(begin, end);
 
-            x += dxdv;
-            ix = (int)x;
+            if (longestValue > m_graphBottom) {
+                painter.drawLine(x, height(), x, height() - (longestValue * dydv));
+            }
 
-            if (lastX != ix) {
-                painter.drawLine(lastX, height(), lastX, height() - (longestValue * dydv));
+            if (selection) {
+                qint64 longestSelected = m_data->maxSelectedValue(begin, end);
 
-                if (selection && longestSelected > m_graphBottom) {
+                if (longestSelected > m_graphBottom) {
                     painter.setPen(selectedPen);
-                    painter.drawLine(lastX, height(), lastX, height() - (longestSelected * dydv));
+                    painter.drawLine(x, height(), x, height() - (longestSelected * dydv));
                     painter.setPen(unselectedPen);
-                    longestSelected = m_graphBottom;
                 }
-
-                longestValue = m_graphBottom;
-                lastX = ix;
             }
         }
     } else {
@@ -232,16 +219,12 @@ qint64 HistogramView::itemAtPosition(QPoint pos) {
     qint64 right = qCeil(dvdx * (pos.x() + 1)) + m_viewLeft;
 
     qint64 longestIndex = 0;
-    qint64 longestValue = 0;
 
     left = qBound<qint64>(0, left, m_data->size() - 1);
     right = qBound<qint64>(0, right, m_data->size() - 1);
 
-    for (qint64 i = left; i <= right; ++i) {
-        if (m_data->value(i) > longestValue) {
-            longestValue = m_data->value(i);
-            longestIndex = i;
-        }
+    if (m_data->maxValue(left, right + 1, &longestIndex) <= 0) {
+        longestIndex = 0;
     }
 
     return longestIndex;
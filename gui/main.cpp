@@ -25,7 +25,9 @@ static void usage(void)
     qWarning("usage: qapitrace [options] [TRACE] [CALLNO]\n"
              "Valid options include:\n"
              "    -h, --help            Print this help message\n"
-             "    --remote-target HOST  Replay trace on remote target HOST\n");
+             "    --remote-target HOST  Replay trace on remote target HOST\n"
+             "    --frame-cache-size MB Memory budget for loaded frames (default 1024,\n"
+             "                          0 for unlimited)\n");
 }
 
 int main(int argc, char **argv)
@@ -50,6 +52,7 @@ int main(int argc, char **argv)
 
     QStringList args = app.arguments();
     QString remoteTarget;
+    int frameCacheSize = -1;
 
     int i = 1;
     while (i < args.count()) {
@@ -67,6 +70,16 @@ int main(int argc, char **argv)
             }
             remoteTarget = args[i];
             ++i;
+        } else if (arg == QLatin1String("--frame-cache-size")) {
+            bool ok = false;
+            if (i < args.count()) {
+                frameCacheSize = args[i].toInt(&ok);
+            }
+            if (!ok || frameCacheSize < 0) {
+                qWarning("Option --frame-cache-size requires a size in MB.\n");
+                exit(1);
+            }
+            ++i;
         } else if (arg == QLatin1String("-h") ||
                    arg == QLatin1String("--help")) {
             usage();
@@ -80,6 +93,10 @@ int main(int argc, char **argv)
     MainWindow window;
     window.show();
 
+    if (frameCacheSize >= 0) {
+        window.setFrameCacheBudget(quint64(frameCacheSize) * 1024 * 1024);
+    }
+
     if (i < args.count()) {
         QString fileName = args[i++];
 
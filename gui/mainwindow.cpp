@@ -33,9 +33,11 @@
 #include <QDesktopWidget>
 #include <QDir>
 #include <QFileDialog>
+#include <QLabel>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QProgressBar>
+#include <QScrollBar>
 #include <QSettings>
 #include <QToolBar>
 #include <QUrl>
@@ -50,6 +52,7 @@ MainWindow::MainWindow()
       m_initalCallNum(-1),
       m_selectedEvent(0),
       m_stateEvent(0),
+      m_trimEvent(0),
       m_nonDefaultsLookupEvent(0)
 {
     m_ui.setupUi(this);
@@ -216,6 +219,22 @@ void MainWindow::setRemoteTarget(const QString &host)
     m_retracer->setRemoteTarget(host);
 }
 
+void MainWindow::setFrameCacheBudget(quint64 bytes)
+{
+    m_trace->setFrameCacheBudget(bytes);
+}
+
+void MainWindow::callItemExpanded(const QModelIndex &index)
+{
+    ApiTraceEvent *event =
+        index.data(ApiTraceModel::EventRole).value<ApiTraceEvent*>();
+
+    // Keep the frames being browsed from being unloaded first
+    if (event && event->type() == ApiTraceEvent::Frame) {
+        m_trace->touchFrame(static_cast<ApiTraceFrame*>(event));
+    }
+}
+
 void MainWindow::callItemSelected(const QModelIndex &index)
 {
     ApiTraceEvent *event =
@@ -267,6 +286,7 @@ void MainWindow::callItemSelected(const QModelIndex &index)
         m_ui.backtraceDock->hide();
         m_ui.vertexDataDock->hide();
     }
+    updatePinnedFrames();
     if (m_selectedEvent && m_selectedEvent->hasState()) {
         fillStateForFrame();
     } else {
@@ -585,6 +605,7 @@ void MainWindow::lookupState()
         return;
     }
     m_stateEvent = m_selectedEvent;
+    updatePinnedFrames();
     replayTrace(true, false);
 }
 
@@ -602,6 +623,7 @@ void MainWindow::trim()
         return;
     }
     m_trimEvent = m_selectedEvent;
+    updatePinnedFrames();
     trimEvent();
 }
 
@@ -753,12 +775,12 @@ variantToItem(const QString &key, const QVariant &var,
 static void addSurfaceItem(const ApiSurface &surface,
                            const QString &label,
                            QTreeWidgetItem *parent,
-                           QTreeWidget *tree,
-                           bool opaque, bool alpha)
+                           QTreeWidget *tree)
 {
-    QIcon icon(QPixmap::fromImage(surface.calculateThumbnail(opaque, alpha)));
+    // The thumbnail is only decoded once the item is scrolled into view, see
+    // updateSurfaceThumbnails(), so reserve room for it meanwhile
     QTreeWidgetItem *item = new QTreeWidgetItem(parent);
-    item->setIcon(0, icon);
+    item->setSizeHint(0, QSize(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
 
     int width = surface.size().width();
     int height = surface.size().height();
@@ -782,7 +804,7 @@ static void addSurfaceItem(const ApiSurface &surface,
     l->setWordWrap(true);
     tree->setItemWidget(item, 1, l);
 
-    item->setData(0, Qt::UserRole, surface.data());
+    item->setData(0, Qt::UserRole, QVariant::fromValue(surface.dataReference()));
 }
 
 void MainWindow::addSurface(const ApiTexture &image, QTreeWidgetItem *parent) {
@@ -796,9 +818,7 @@ void MainWindow::addSurface(const ApiFramebuffer &fbo, QTreeWidgetItem *parent)
 void MainWindow::addSurface(const ApiSurface &surface, const QString &label,
                             QTreeWidgetItem *parent)
 {
-    addSurfaceItem(surface, label, parent,
-                   m_ui.surfacesTreeWidget, m_ui.surfacesOpaqueCB->isChecked(),
-                   m_ui.surfacesAlphaCB->isChecked());
+    addSurfaceItem(surface, label, parent, m_ui.surfacesTreeWidget);
 }
 
 template <typename Surface>
@@ -924,6 +944,35 @@ void MainWindow::updateSurfacesView(const ApiTraceState &state)
         addSurfaces(textures, "Textures");
         addSurfaces(fbos, "Framebuffers");
         m_ui.surfacesTab->setEnabled(true);
+        updateSurfaceThumbnails();
+    }
+}
+
+void MainWindow::updateSurfaceThumbnails()
+{
+    QTreeWidget *tree = m_ui.surfacesTreeWidget;
+    if (!tree->isVisible()) {
+        return;
+    }
+
+    bool opaque = m_ui.surfacesOpaqueCB->isChecked();
+    bool alpha = m_ui.surfacesAlphaCB->isChecked();
+
+    // Decoding every image up front makes states with hundreds of textures
+    // take ages to show, so only do it for the rows currently on screen
+    QRect viewport = tree->viewport()->rect();
+    QTreeWidgetItem *item = tree->itemAt(viewport.topLeft());
+    while (item && tree->visualItemRect(item).top() < viewport.bottom()) {
+        QVariant var = item->data(0, Qt::UserRole);
+        if (var.isValid() && item->icon(0).isNull()) {
+            ApiSurface surface;
+            surface.setData(var.value<UBJSONBinary>());
+            QImage thumbnail = surface.calculateThumbnail(opaque, alpha);
+            if (!thumbnail.isNull()) {
+                item->setIcon(0, QIcon(QPixmap::fromImage(thumbnail)));
+            }
+        }
+        item = tree->itemBelow(item);
     }
 }
 
@@ -1067,7 +1116,7 @@ void MainWindow::showSelectedSurface()
 
     viewer->setAttribute(Qt::WA_DeleteOnClose, true);
 
-    QByteArray data = var.value<QByteArray>();
+    QByteArray data = var.value<UBJSONBinary>().data();
     viewer->setData(data);
 
     viewer->show();
@@ -1116,6 +1165,11 @@ void MainWindow::initObjects()
     statusBar()->addPermanentWidget(m_progressBar);
     m_progressBar->hide();
 
+    m_frameCacheLabel = new QLabel();
+    m_frameCacheLabel->setToolTip(
+        tr("Estimated memory used by the calls of loaded frames"));
+    statusBar()->addPermanentWidget(m_frameCacheLabel);
+
     m_argsEditor = new ArgumentsEditor(this);
 
     m_ui.detailsDock->hide();
@@ -1163,6 +1217,10 @@ void MainWindow::initConnections()
             this, SLOT(slotTraceChanged(ApiTraceEvent*)));
     connect(m_trace, SIGNAL(findResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceCall*)),
             this, SLOT(slotSearchResult(ApiTrace::SearchRequest,ApiTrace::SearchResult,ApiTraceCall*)));
+    connect(m_trace, SIGNAL(findProgress(int)),
+            this, SLOT(slotSearchProgress(int)));
+    connect(m_trace, SIGNAL(frameCacheChanged(quint64,quint64)),
+            this, SLOT(slotFrameCacheChanged(quint64,quint64)));
     connect(m_trace, SIGNAL(foundFrameStart(ApiTraceFrame*)),
             this, SLOT(slotFoundFrameStart(ApiTraceFrame*)));
     connect(m_trace, SIGNAL(foundFrameEnd(ApiTraceFrame*)),
@@ -1234,6 +1292,8 @@ void MainWindow::initConnections()
             this, SLOT(callItemSelected(const QModelIndex &)));
     connect(m_ui.callView, SIGNAL(doubleClicked(const QModelIndex &)),
             this, SLOT(callItemActivated(const QModelIndex &)));
+    connect(m_ui.callView, SIGNAL(expanded(const QModelIndex &)),
+            this, SLOT(callItemExpanded(const QModelIndex &)));
     connect(m_ui.callView, SIGNAL(customContextMenuRequested(QPoint)),
             this, SLOT(customContextMenuRequested(QPoint)));
 
@@ -1243,6 +1303,12 @@ void MainWindow::initConnections()
     connect(m_ui.surfacesTreeWidget,
             SIGNAL(itemDoubleClicked(QTreeWidgetItem *, int)),
             SLOT(showSelectedSurface()));
+    connect(m_ui.surfacesTreeWidget, SIGNAL(itemExpanded(QTreeWidgetItem *)),
+            this, SLOT(updateSurfaceThumbnails()));
+    connect(m_ui.surfacesTreeWidget->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(updateSurfaceThumbnails()));
+    connect(m_ui.stateTabWidget, SIGNAL(currentChanged(int)),
+            this, SLOT(updateSurfaceThumbnails()));
 
     connect(m_ui.nonDefaultsCB, SIGNAL(toggled(bool)),
             this, SLOT(fillState(bool)));
@@ -1256,6 +1322,8 @@ void MainWindow::initConnections()
     connect(m_searchWidget,
             SIGNAL(searchPrev(const QString&, Qt::CaseSensitivity)),
             SLOT(slotSearchPrev(const QString&, Qt::CaseSensitivity)));
+    connect(m_searchWidget, SIGNAL(cancelled()),
+            m_trace, SLOT(cancelSearch()));
 
     connect(m_traceProcess, SIGNAL(tracedFile(const QString&)),
             SLOT(createdTrace(const QString&)));
@@ -1526,6 +1594,7 @@ void MainWindow::editCall()
     if (m_selectedEvent && m_selectedEvent->type() == ApiTraceEvent::Call) {
         ApiTraceCall *call = static_cast<ApiTraceCall*>(m_selectedEvent);
         m_argsEditor->setCall(call);
+        updatePinnedFrames();
         m_argsEditor->show();
     }
 }
@@ -1645,7 +1714,7 @@ void MainWindow::saveSelectedSurface()
 
     QImage img = var.value<QImage>();
     if (img.isNull()) {
-        image::Image *traceImage = ApiSurface::imageFromData(var.value<QByteArray>());
+        image::Image *traceImage = ApiSurface::imageFromData(var.value<UBJSONBinary>().data());
         img = ApiSurface::qimageFromRawImage(traceImage);
         delete traceImage;
     }
@@ -1744,6 +1813,8 @@ void MainWindow::slotSearchResult(const ApiTrace::SearchRequest &request,
                                   ApiTrace::SearchResult result,
                                   ApiTraceCall *call)
 {
+    statusBar()->clearMessage();
+
     switch (result) {
     case ApiTrace::SearchResult_NotFound:
         m_searchWidget->setFound(false);
@@ -1780,6 +1851,49 @@ void MainWindow::slotSearchResult(const ApiTrace::SearchRequest &request,
     }
 }
 
+void MainWindow::slotSearchProgress(int percent)
+{
+    statusBar()->showMessage(tr("Searching... %1%").arg(percent));
+}
+
+void MainWindow::slotFrameCacheChanged(quint64 size, quint64 budget)
+{
+    const quint64 mb = 1024 * 1024;
+    if (budget) {
+        m_frameCacheLabel->setText(
+            tr("Frame cache: %1 / %2 MB").arg(size / mb).arg(budget / mb));
+    } else {
+        m_frameCacheLabel->setText(
+            tr("Frame cache: %1 MB").arg(size / mb));
+    }
+}
+
+static ApiTraceFrame *
+eventFrame(ApiTraceEvent *event)
+{
+    if (!event) {
+        return 0;
+    }
+    if (event->type() == ApiTraceEvent::Call) {
+        return static_cast<ApiTraceCall*>(event)->parentFrame();
+    }
+    Q_ASSERT(event->type() == ApiTraceEvent::Frame);
+    return static_cast<ApiTraceFrame*>(event);
+}
+
+void MainWindow::updatePinnedFrames()
+{
+    // Keep the frames of the events we hold on to from being unloaded
+    QSet<ApiTraceFrame*> frames;
+    frames << eventFrame(m_selectedEvent)
+           << eventFrame(m_stateEvent)
+           << eventFrame(m_trimEvent)
+           << eventFrame(m_nonDefaultsLookupEvent)
+           << eventFrame(m_argsEditor->call());
+    frames.remove(0);
+    m_trace->setPinnedFrames(frames);
+}
+
 ApiTraceFrame * MainWindow::currentFrame() const
 {
     QModelIndex index = m_ui.callView->currentIndex();
@@ -20,6 +20,7 @@ class ApiTraceState;
 class ArgumentsEditor;
 class JumpWidget;
 class QModelIndex;
+class QLabel;
 class QProgressBar;
 class QTreeWidgetItem;
 class QUrl;
@@ -46,8 +47,11 @@ public slots:
 
     void setRemoteTarget(const QString &host);
 
+    void setFrameCacheBudget(quint64 bytes);
+
 private slots:
     void callItemSelected(const QModelIndex &index);
+    void callItemExpanded(const QModelIndex &index);
     void callItemActivated(const QModelIndex &index);
     void createTrace();
     void openTrace();
@@ -100,11 +104,14 @@ private slots:
     void slotSearchResult(const ApiTrace::SearchRequest &request,
                           ApiTrace::SearchResult result,
                           ApiTraceCall *call);
+    void slotSearchProgress(int percent);
+    void slotFrameCacheChanged(quint64 size, quint64 budget);
     void slotFoundFrameStart(ApiTraceFrame *frame);
     void slotFoundFrameEnd(ApiTraceFrame *frame);
     void slotJumpToResult(ApiTraceCall *call);
     void replayTrace(bool dumpState, bool dumpThumbnails);
     void updateSurfacesView();
+    void updateSurfaceThumbnails();
 
 private:
     void initObjects();
@@ -116,6 +123,7 @@ private:
     void trimEvent();
     void updateSurfacesView(const ApiTraceState &state);
     void fillStateForFrame();
+    void updatePinnedFrames();
 
     /* there's a difference between selected frame/call and
      * current call/frame. the former implies actual selection
@@ -151,6 +159,7 @@ private:
     int m_initalCallNum;
 
     QProgressBar *m_progressBar;
+    QLabel *m_frameCacheLabel;
 
     ApiTraceEvent *m_selectedEvent;
 
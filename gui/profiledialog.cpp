@@ -7,6 +7,7 @@
 #include "graphing/frameaxiswidget.h"
 #include "graphing/heatmapverticalaxiswidget.h"
 #include "profileheatmap.h"
+#include "profiletimeline.h"
 
 /* Handy function to allow selection of a call in main window */
 ProfileDialog* g_profileDialog = 0;
@@ -68,7 +69,8 @@ private:
 
 ProfileDialog::ProfileDialog(QWidget *parent)
     : QDialog(parent),
-      m_profile(0)
+      m_profile(0),
+      m_timelines(0)
 {
     setupUi(this);
     g_profileDialog = this;
@@ -144,6 +146,7 @@ ProfileDialog::ProfileDialog(QWidget *parent)
 
 ProfileDialog::~ProfileDialog()
 {
+    delete m_timelines;
     delete m_profile;
 }
 
@@ -182,6 +185,7 @@ void ProfileDialog::tableDoubleClicked(const QModelIndex& index)
 
 void ProfileDialog::setProfile(trace::Profile* profile)
 {
+    ProfileTimelines* timelines = NULL;
 
     if (profile && profile->frames.size()) {
         HeatmapVerticalAxisWidget* programAxis;
@@ -189,13 +193,16 @@ void ProfileDialog::setProfile(trace::Profile* profile)
         HistogramView* histogram;
         HeatmapView* heatmap;
 
+        /* Summarize the calls once for all graphs */
+        timelines = new ProfileTimelines(profile);
+
 
         /* Setup data providers for Cpu graph */
         m_cpuGraph->setProfile(profile);
         histogram = (HistogramView*)m_cpuGraph->view();
         frameAxis = (FrameAxisWidget*)m_cpuGraph->axis(GraphWidget::AxisTop);
 
-        histogram->setDataProvider(new CallDurationDataProvider(profile, false));
+        histogram->setDataProvider(new CallDurationDataProvider(profile, timelines, false));
         frameAxis->setDataProvider(new FrameCallDataProvider(profile));
 
         /* Setup data provider for Gpu graph */
@@ -203,7 +210,7 @@ void ProfileDialog::setProfile(trace::Profile* profile)
         histogram = (HistogramView*)m_gpuGraph->view();
         frameAxis = (FrameAxisWidget*)m_gpuGraph->axis(GraphWidget::AxisTop);
 
-        histogram->setDataProvider(new CallDurationDataProvider(profile, true));
+        histogram->setDataProvider(new CallDurationDataProvider(profile, timelines, true));
         frameAxis->setDataProvider(new FrameCallDataProvider(profile));
 
         /* Setup data provider for heatmap timeline */
@@ -211,9 +218,9 @@ void ProfileDialog::setProfile(trace::Profile* profile)
         frameAxis = (FrameAxisWidget*)m_timeline->axis(GraphWidget::AxisTop);
         programAxis = (HeatmapVerticalAxisWidget*)m_timeline->axis(GraphWidget::AxisLeft);
 
-        heatmap->setDataProvider(new ProfileHeatmapDataProvider(profile));
+        heatmap->setDataProvider(new ProfileHeatmapDataProvider(profile, timelines));
         frameAxis->setDataProvider(new FrameTimeDataProvider(profile));
-        programAxis->setDataProvider(new ProfileHeatmapDataProvider(profile));
+        programAxis->setDataProvider(new ProfileHeatmapDataProvider(profile, timelines));
 
         /* Setup data model for table view */
         ProfileTableModel* model = new ProfileTableModel(m_table);
@@ -234,6 +241,9 @@ void ProfileDialog::setProfile(trace::Profile* profile)
         m_timeline->setSelection(emptySelection);
     }
 
+    delete m_timelines;
+    m_timelines = timelines;
+
     delete m_profile;
     m_profile = profile;
 }
@@ -4,6 +4,7 @@
 #include <QDialog>
 
 namespace trace { struct Profile; }
+class ProfileTimelines;
 
 class ProfileDialog : public QDialog, public Ui_ProfileDialog
 {
@@ -25,4 +26,5 @@ signals:
 
 private:
     trace::Profile *m_profile;
+    ProfileTimelines *m_timelines;
 };
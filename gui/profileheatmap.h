@@ -2,6 +2,7 @@
 
 #include "graphing/heatmapview.h"
 #include "profiling.h"
+#include "profiletimeline.h"
 
 /**
  * Data providers for a heatmap based off the trace::Profile call data
@@ -9,128 +10,90 @@
 
 class ProfileHeatmapRowIterator : public HeatmapRowIterator {
 public:
-    ProfileHeatmapRowIterator(const trace::Profile* profile, qint64 start, qint64 end, int steps, bool gpu, int program = -1) :
-        m_profile(profile),
+    ProfileHeatmapRowIterator(const ProfileTimeline* timeline, qint64 start, qint64 end, int steps, bool gpu, int program = -1) :
+        m_timeline(timeline),
         m_step(-1),
         m_stepWidth(1),
         m_stepCount(steps),
-        m_index(0),
         m_timeStart(start),
         m_timeEnd(end),
         m_useGpu(gpu),
         m_program(program),
-        m_selected(false),
         m_timeSelection(false),
-        m_programSelection(false)
+        m_programSelection(false),
+        m_programTimeline(NULL)
     {
         m_timeWidth = m_timeEnd - m_timeStart;
     }
 
+    /* Each step costs a few lookups in the timeline, however many calls
+     * it covers, and empty steps are skipped altogether. */
     virtual bool next() override
     {
-        unsigned maxIndex = m_program == -1 ? m_profile->calls.size() : m_profile->programs[m_program].calls.size();
-
-        if (m_index >= maxIndex) {
-            return false;
-        }
-
-        double dtds = m_timeWidth / (double)m_stepCount;
-
-        qint64 heatDuration = 0;
-        qint64 programHeatDuration = 0;
-        m_heat = 0.0f;
         m_step += m_stepWidth;
         m_stepWidth = 1;
 
-        m_selected = false;
-
-        /* Iterator through calls until step != lastStep */
-        for (; m_index < maxIndex; ++m_index)
-        {
-            const trace::Profile::Call* call;
-
-            if (m_program == -1) {
-                call = &m_profile->calls[m_index];
-            } else {
-                call = &m_profile->calls[ m_profile->programs[m_program].calls[m_index] ];
-            }
-
-            qint64 start, duration, end;
-
-            if (m_useGpu) {
-                start = call->gpuStart;
-                duration = call->gpuDuration;
+        if (m_step >= m_stepCount) {
+            return false;
+        }
 
-                if (call->pixels < 0) {
-                    continue;
-                }
-            } else {
-                start = call->cpuStart;
-                duration = call->cpuDuration;
-            }
+        qint64 stepStart = stepToTime(m_step);
 
-            end = start + duration;
+        /* First call reaching into this step */
+        unsigned index = m_timeline->lowerBound(stepStart);
 
-            if (end < m_timeStart) {
-                continue;
-            }
+        if (index > 0 && m_timeline->end(index - 1) > stepStart) {
+            --index;
+        }
 
-            if (start > m_timeEnd) {
-                m_index = m_profile->calls.size();
-                break;
-            }
+        if (index >= m_timeline->size()) {
+            return false;
+        }
 
-            double left  = timeToStep(start);
-            double right = timeToStep(end);
+        qint64 start = m_timeline->start(index);
 
-            int leftStep = left;
-            int rightStep = right;
+        if (start > m_timeEnd) {
+            return false;
+        }
 
-            if (leftStep > m_step) {
-                break;
-            }
+        /* Jump to the step of the next call */
+        if (start >= stepToTime(m_step + 1)) {
+            m_step = qMax<int>(m_step, (int)timeToStep(start));
 
-            if (m_programSelection && call->program == m_programSel) {
-                m_selected = true;
+            while (stepToTime(m_step + 1) <= start) {
+                ++m_step;
             }
 
-            if (rightStep - leftStep > 1) {
-                m_label = QString::fromStdString(call->name);
-                m_step = left;
-                m_stepWidth = rightStep - leftStep;
-                heatDuration = dtds;
-                ++m_index;
-                break;
+            if (m_step >= m_stepCount) {
+                return false;
             }
+        }
 
-            if (leftStep < m_step) {
-                qint64 rightTime = stepToTime(rightStep);
-                heatDuration += end - rightTime;
+        const trace::Profile::Call& call = m_timeline->call(index);
+        bool selected = m_programSelection && (int)call.program == m_programSel;
+        int rightStep = timeToStep(m_timeline->end(index));
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += end - rightTime;
-                }
-            } else if (leftStep == rightStep) {
-                heatDuration += duration;
+        if (rightStep - m_step > 1) {
+            /* A single call over several steps */
+            m_label = QString::fromStdString(call.name);
+            m_stepWidth = rightStep - m_step;
+            m_heat = 1.0f;
+            m_programHeat = selected ? 1.0f : 0.0f;
+        } else {
+            qint64 stepEnd = stepToTime(m_step + 1);
+            double dtds = m_timeWidth / (double)m_stepCount;
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += duration;
-                }
-            } else if (rightStep - leftStep == 1) {
-                qint64 rightTime = stepToTime(rightStep);
-                heatDuration += rightTime - start;
+            stepStart = stepToTime(m_step);
 
-                if (m_programSelection && call->program == m_programSel) {
-                    programHeatDuration += rightTime - start;
-                }
+            m_heat = m_timeline->busyTime(stepStart, stepEnd) / dtds;
 
-                break;
+            if (m_programTimeline) {
+                m_programHeat = m_programTimeline->busyTime(stepStart, stepEnd) / dtds;
+            } else {
+                m_programHeat = 0.0f;
             }
         }
 
-        m_heat = heatDuration / dtds;
-        m_programHeat = programHeatDuration / dtds;
-
         if (m_timeSelection) {
             qint64 time = stepToTime(m_step);
 
@@ -139,14 +102,10 @@ public:
             }
         }
 
-        if (m_programSelection && (m_program == m_programSel || (m_selected && m_stepWidth > 1))) {
+        if (m_programSelection && m_program == m_programSel) {
             m_programHeat = 1.0;
         }
 
-        if (m_programHeat > 0) {
-            m_selected = true;
-        }
-
         return true;
     }
 
@@ -180,10 +139,13 @@ public:
         return m_label;
     }
 
-    void setProgramSelection(int program)
+    /* The timeline of the program, if any, is used to highlight its share of
+     * each step */
+    void setProgramSelection(int program, const ProfileTimeline* timeline = NULL)
     {
         m_programSelection = true;
         m_programSel = program;
+        m_programTimeline = timeline;
     }
 
     void setTimeSelection(qint64 start, qint64 end)
@@ -213,14 +175,12 @@ private:
     }
 
 private:
-    const trace::Profile* m_profile;
+    const ProfileTimeline* m_timeline;
 
     int m_step;
     int m_stepWidth;
     int m_stepCount;
 
-    unsigned m_index;
-
     float m_heat;
 
     qint64 m_timeStart;
@@ -232,14 +192,13 @@ private:
 
     QString m_label;
 
-    bool m_selected;
-
     bool m_timeSelection;
     qint64 m_timeSelStart;
     qint64 m_timeSelEnd;
 
     bool m_programSelection;
     int m_programSel;
+    const ProfileTimeline* m_programTimeline;
 
     float m_programHeat;
 };
@@ -253,8 +212,9 @@ protected:
     };
 
 public:
-    ProfileHeatmapDataProvider(trace::Profile* profile) :
+    ProfileHeatmapDataProvider(trace::Profile* profile, const ProfileTimelines* timelines) :
         m_profile(profile),
+        m_timelines(timelines),
         m_selectionState(NULL)
     {
         sortRows();
@@ -295,7 +255,8 @@ public:
 
     virtual HeatmapRowIterator* dataRowIterator(int row, qint64 start, qint64 end, int steps) const override
     {
-        ProfileHeatmapRowIterator* itr = new ProfileHeatmapRowIterator(m_profile, start, end, steps, true, m_rowPrograms[row]);
+        const ProfileTimeline* timeline = &m_timelines->program(m_rowPrograms[row], true);
+        ProfileHeatmapRowIterator* itr = new ProfileHeatmapRowIterator(timeline, start, end, steps, true, m_rowPrograms[row]);
 
         if (m_selectionState) {
             if (m_selectionState->type == SelectionState::Horizontal) {
@@ -331,13 +292,21 @@ public:
 
     virtual HeatmapRowIterator* headerRowIterator(int row, qint64 start, qint64 end, int steps) const override
     {
-        ProfileHeatmapRowIterator* itr = new ProfileHeatmapRowIterator(m_profile, start, end, steps, row != 0);
+        bool gpu = row != 0;
+        const ProfileTimeline* timeline = gpu ? &m_timelines->gpuDrawCalls() : &m_timelines->calls(false);
+        ProfileHeatmapRowIterator* itr = new ProfileHeatmapRowIterator(timeline, start, end, steps, gpu);
 
         if (m_selectionState) {
             if (m_selectionState->type == SelectionState::Horizontal) {
                 itr->setTimeSelection(m_selectionState->start, m_selectionState->end);
             } else if (m_selectionState->type == SelectionState::Vertical) {
-                itr->setProgramSelection(m_selectionState->start);
+                unsigned program = m_selectionState->start;
+
+                if (program < m_timelines->programs()) {
+                    itr->setProgramSelection(program, &m_timelines->program(program, gpu));
+                } else {
+                    itr->setProgramSelection(program);
+                }
             }
         }
 
@@ -462,6 +431,7 @@ private:
 
 protected:
     trace::Profile* m_profile;
+    const ProfileTimelines* m_timelines;
     std::vector<int> m_rowPrograms;
     SelectionState* m_selectionState;
 };
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "graphing/graphpyramid.h"
+#include "trace_profiler.hpp"
+
+#include <algorithm>
+
+/**
+ * A time ordered sequence of profiled calls (all of them, or a subset such as
+ * the calls of one program), along with a pyramid of their CPU or GPU
+ * durations.
+ */
+class ProfileTimeline {
+public:
+    ProfileTimeline() :
+        m_profile(NULL),
+        m_calls(NULL),
+        m_gpu(false)
+    {
+    }
+
+    /* A NULL calls vector means all calls of the profile */
+    void build(const trace::Profile* profile, const std::vector<unsigned>* calls, bool gpu)
+    {
+        m_profile = profile;
+        m_calls = calls;
+        m_gpu = gpu;
+        m_durations.build(*this, size());
+    }
+
+    unsigned size() const
+    {
+        if (!m_profile) {
+            return 0;
+        }
+        return m_calls ? m_calls->size() : m_profile->calls.size();
+    }
+
+    /* Index of the i-th call in profile->calls */
+    unsigned callIndex(unsigned i) const
+    {
+        return m_calls ? (*m_calls)[i] : i;
+    }
+
+    const trace::Profile::Call& call(unsigned i) const
+    {
+        return m_profile->calls[callIndex(i)];
+    }
+
+    qint64 start(unsigned i) const
+    {
+        const trace::Profile::Call& c = call(i);
+        return m_gpu ? c.gpuStart : c.cpuStart;
+    }
+
+    qint64 duration(unsigned i) const
+    {
+        const trace::Profile::Call& c = call(i);
+        return m_gpu ? c.gpuDuration : c.cpuDuration;
+    }
+
+    qint64 end(unsigned i) const
+    {
+        return start(i) + duration(i);
+    }
+
+    /* Value accessor for the pyramid */
+    qint64 operator()(qint64 i) const
+    {
+        return duration(i);
+    }
+
+    /* First call starting at or after time */
+    unsigned lowerBound(qint64 time) const
+    {
+        unsigned lower = 0;
+        unsigned upper = size();
+
+        while (lower < upper) {
+            unsigned pos = lower + (upper - lower) / 2;
+
+            if (start(pos) < time) {
+                lower = pos + 1;
+            } else {
+                upper = pos;
+            }
+        }
+
+        return lower;
+    }
+
+    /* First call with an index in profile->calls at or after index */
+    unsigned lowerBoundCall(qint64 index) const
+    {
+        if (!m_calls) {
+            return qBound<qint64>(0, index, size());
+        }
+
+        return std::lower_bound(m_calls->begin(), m_calls->end(), index) - m_calls->begin();
+    }
+
+    /* Summary of the durations of calls [begin, end) */
+    GraphPyramid::Aggregate durations(qint64 begin, qint64 end) const
+    {
+        return m_durations.query(*this, begin, end);
+    }
+
+    /* Time within [timeStart, timeEnd) covered by calls */
+    qint64 busyTime(qint64 timeStart, qint64 timeEnd) const
+    {
+        unsigned begin = lowerBound(timeStart);
+        unsigned last = lowerBound(timeEnd);
+
+        /* Calls don't overlap, so only the previous one can reach in */
+        if (begin > 0 && end(begin - 1) > timeStart) {
+            --begin;
+        }
+
+        if (begin >= last) {
+            return 0;
+        }
+
+        qint64 busy = durations(begin, last).sum;
+
+        if (start(begin) < timeStart) {
+            busy -= timeStart - start(begin);
+        }
+
+        if (end(last - 1) > timeEnd) {
+            busy -= end(last - 1) - timeEnd;
+        }
+
+        return qMax<qint64>(busy, 0);
+    }
+
+private:
+    const trace::Profile* m_profile;
+    const std::vector<unsigned>* m_calls;
+    bool m_gpu;
+
+    GraphPyramid m_durations;
+};
+
+
+/**
+ * All the timelines the profile graphs draw from.
+ *
+ * They are built once when the profile is loaded, and then shared by the
+ * data providers of the heatmap and the call duration graphs.
+ */
+class ProfileTimelines {
+public:
+    ProfileTimelines(const trace::Profile* profile)
+    {
+        m_cpuCalls.build(profile, NULL, false);
+        m_gpuCalls.build(profile, NULL, true);
+
+        for (unsigned i = 0; i < profile->calls.size(); ++i) {
+            if (profile->calls[i].pixels >= 0) {
+                m_drawCalls.push_back(i);
+            }
+        }
+
+        m_gpuDrawCalls.build(profile, &m_drawCalls, true);
+
+        m_cpuPrograms.resize(profile->programs.size());
+        m_gpuPrograms.resize(profile->programs.size());
+
+        for (unsigned i = 0; i < profile->programs.size(); ++i) {
+            m_cpuPrograms[i].build(profile, &profile->programs[i].calls, false);
+            m_gpuPrograms[i].build(profile, &profile->programs[i].calls, true);
+        }
+    }
+
+    /* Every call, indexed as profile->calls */
+    const ProfileTimeline& calls(bool gpu) const
+    {
+        return gpu ? m_gpuCalls : m_cpuCalls;
+    }
+
+    /* Calls with GPU timings */
+    const ProfileTimeline& gpuDrawCalls() const
+    {
+        return m_gpuDrawCalls;
+    }
+
+    /* Calls of a program, indexed as its calls vector */
+    const ProfileTimeline& program(unsigned program, bool gpu) const
+    {
+        return gpu ? m_gpuPrograms[program] : m_cpuPrograms[program];
+    }
+
+    unsigned programs() const
+    {
+        return m_gpuPrograms.size();
+    }
+
+private:
+    ProfileTimelines(const ProfileTimelines&);
+    ProfileTimelines& operator=(const ProfileTimelines&);
+
+    std::vector<unsigned> m_drawCalls;
+
+    ProfileTimeline m_cpuCalls;
+    ProfileTimeline m_gpuCalls;
+    ProfileTimeline m_gpuDrawCalls;
+
+    std::vector<ProfileTimeline> m_cpuPrograms;
+    std::vector<ProfileTimeline> m_gpuPrograms;
+};
@@ -28,6 +28,7 @@
 
 #include <QDebug>
 #include <QVariant>
+#include <QBuffer>
 #include <QDataStream>
 
 #include "ubjson.hpp"
@@ -36,6 +37,37 @@
 using namespace ubjson;
 
 
+UBJSONBinary::UBJSONBinary() :
+    m_offset(0),
+    m_size(0)
+{
+}
+
+UBJSONBinary::UBJSONBinary(const QByteArray &data) :
+    m_document(data),
+    m_offset(0),
+    m_size(data.size())
+{
+}
+
+UBJSONBinary::UBJSONBinary(const QByteArray &document, int offset, int size) :
+    m_document(document),
+    m_offset(offset),
+    m_size(size)
+{
+    Q_ASSERT(offset >= 0 && size >= 0);
+    Q_ASSERT(offset + size <= document.size());
+}
+
+QByteArray UBJSONBinary::data() const
+{
+    if (m_offset == 0 && m_size == m_document.size()) {
+        return m_document;
+    }
+    return m_document.mid(m_offset, m_size);
+}
+
+
 static Marker
 readMarker(QDataStream &stream)
 {
@@ -180,11 +212,11 @@ readString(QDataStream &stream)
 
 
 static QVariant
-readVariant(QDataStream &stream, Marker type);
+readVariant(QDataStream &stream, Marker type, const QByteArray *document);
 
 
 static QVariant
-readArray(QDataStream &stream)
+readArray(QDataStream &stream, const QByteArray *document)
 {
     Marker marker = readMarker(stream);
     if (marker == MARKER_TYPE) {
@@ -194,6 +226,17 @@ readArray(QDataStream &stream)
         marker = readMarker(stream);
         Q_ASSERT(marker == MARKER_COUNT);
         int count = readSize(stream);
+        if (document) {
+            /*
+             * Just note where the data is, leaving it in the document until
+             * somebody asks for it.
+             */
+            int offset = stream.device()->pos();
+            int skipped = stream.skipRawData(count);
+            Q_ASSERT(skipped == count);
+            Q_UNUSED(skipped);
+            return QVariant::fromValue(UBJSONBinary(*document, offset, count));
+        }
         QByteArray array(count, Qt::Uninitialized);
         int read = stream.readRawData(array.data(), count);
         Q_ASSERT(read == count);
@@ -204,7 +247,7 @@ readArray(QDataStream &stream)
         QVariantList array;
         for (int i = 0; i < count; ++i) {
             marker = readMarker(stream);
-            QVariant value = readVariant(stream, marker);
+            QVariant value = readVariant(stream, marker, document);
             array.append(value);
         }
         return array;
@@ -212,7 +255,7 @@ readArray(QDataStream &stream)
         QVariantList array;
         while (marker != MARKER_ARRAY_END &&
                marker != MARKER_EOF) {
-            QVariant value = readVariant(stream, marker);
+            QVariant value = readVariant(stream, marker, document);
             array.append(value);
             marker = readMarker(stream);
         }
@@ -222,7 +265,7 @@ readArray(QDataStream &stream)
 
 
 static QVariantMap
-readObject(QDataStream &stream)
+readObject(QDataStream &stream, const QByteArray *document)
 {
     QVariantMap object;
     Marker marker = readMarker(stream);
@@ -231,7 +274,7 @@ readObject(QDataStream &stream)
         int nameSize = readSize(stream, marker);
         QString name = readString(stream, nameSize);
         marker = readMarker(stream);
-        QVariant value = readVariant(stream, marker);
+        QVariant value = readVariant(stream, marker, document);
         object[name] = value;
         marker = readMarker(stream);
     }
@@ -240,7 +283,7 @@ readObject(QDataStream &stream)
 
 
 static QVariant
-readVariant(QDataStream &stream, Marker type)
+readVariant(QDataStream &stream, Marker type, const QByteArray *document)
 {
     switch (type) {
     case MARKER_NULL:
@@ -273,9 +316,9 @@ readVariant(QDataStream &stream, Marker type)
     case MARKER_STRING:
         return readString(stream);
     case MARKER_ARRAY_BEGIN:
-        return readArray(stream);
+        return readArray(stream, document);
     case MARKER_OBJECT_BEGIN:
-        return readObject(stream);
+        return readObject(stream, document);
     case MARKER_ARRAY_END:
     case MARKER_OBJECT_END:
     case MARKER_TYPE:
@@ -293,6 +336,23 @@ QVariant decodeUBJSONObject(QIODevice *io)
     QDataStream stream(io);
     stream.setByteOrder(QDataStream::BigEndian);
     Marker marker = readMarker(stream);
-    return readVariant(stream, marker);
+    return readVariant(stream, marker, NULL);
+}
+
+
+QVariant decodeUBJSONObject(const QByteArray &document)
+{
+    static bool registered =
+        QMetaType::registerConverter<UBJSONBinary, QByteArray>(&UBJSONBinary::data);
+    Q_UNUSED(registered);
+
+    QBuffer io;
+    io.setData(document);
+    io.open(QIODevice::ReadOnly);
+
+    QDataStream stream(&io);
+    stream.setByteOrder(QDataStream::BigEndian);
+    Marker marker = readMarker(stream);
+    return readVariant(stream, marker, &document);
 }
 
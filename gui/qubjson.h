@@ -27,8 +27,46 @@
 #pragma once
 
 
+#include <QByteArray>
+#include <QMetaType>
 #include <QVariantMap>
 
 class QIODevice;
 
+
+/**
+ * Binary array within a UBJSON document kept in memory.
+ *
+ * Only the position of the array is recorded while decoding, so large
+ * payloads such as images stay in the document until they're actually used.
+ */
+class UBJSONBinary
+{
+public:
+    UBJSONBinary();
+    explicit UBJSONBinary(const QByteArray &data);
+    UBJSONBinary(const QByteArray &document, int offset, int size);
+
+    bool isEmpty() const { return m_size == 0; }
+    int size() const { return m_size; }
+
+    /* Copy of the array's bytes */
+    QByteArray data() const;
+
+private:
+    QByteArray m_document;
+    int m_offset;
+    int m_size;
+};
+
+Q_DECLARE_METATYPE(UBJSONBinary);
+
+
 QVariant decodeUBJSONObject(QIODevice *io);
+
+/*
+ * Same as above, but binary arrays are returned as UBJSONBinary references
+ * into the document rather than copied out.  They still convert to
+ * QByteArray on demand.
+ */
+QVariant decodeUBJSONObject(const QByteArray &document);
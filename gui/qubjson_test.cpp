@@ -149,6 +149,34 @@ TEST(qubjson, binary_data) {
 }
 
 
+TEST(qubjson, binary_reference) {
+    static const unsigned char X[] = {
+        '{',
+            'U', 1, 'A', '[', '$', 'U', '#', 'U', 3, 'A', 'B', 'C',
+            'U', 1, 'B', '[', '$', 'U', '#', 'U', 0,
+            'U', 1, 'C', 'i', 1,
+        '}'
+    };
+    QByteArray document((const char *)X, sizeof X);
+
+    QVariantMap object = decodeUBJSONObject(document).toMap();
+    ASSERT_EQ(3, object.size());
+
+    QVariant a = object["A"];
+    ASSERT_EQ(qMetaTypeId<UBJSONBinary>(), a.userType());
+    EXPECT_EQ(3, a.value<UBJSONBinary>().size());
+    EXPECT_EQ(QByteArray("ABC"), a.value<UBJSONBinary>().data());
+    EXPECT_EQ(QByteArray("ABC"), a.toByteArray());
+
+    QVariant b = object["B"];
+    ASSERT_EQ(qMetaTypeId<UBJSONBinary>(), b.userType());
+    EXPECT_TRUE(b.value<UBJSONBinary>().isEmpty());
+    EXPECT_EQ(QByteArray(), b.value<UBJSONBinary>().data());
+
+    EXPECT_EQ(QVariant(1), object["C"]);
+}
+
+
 int
 main(int argc, char **argv)
 {
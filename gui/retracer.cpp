@@ -346,6 +346,8 @@ QStringList Retracer::retraceArguments() const
         if (m_profileMemory) {
             arguments << QLatin1String("--pmem");
         }
+
+        arguments << QLatin1String("--profile-format=binary");
     } else {
         if (!m_doubleBuffered) {
             arguments << QLatin1String("--sb");
@@ -446,8 +448,13 @@ void Retracer::run()
         BlockingIODevice io(&process);
 
         if (m_captureState) {
-            parsedJson = decodeUBJSONObject(&io).toMap();
+            /*
+             * Keep the whole output around, so that images are only
+             * referenced rather than copied while decoding.
+             */
+            QByteArray ubjsonBuffer = io.readAll();
             process.waitForFinished(-1);
+            parsedJson = decodeUBJSONObject(ubjsonBuffer).toMap();
         } else if (m_captureThumbnails) {
             /*
              * Parse concatenated PNM images from output.
@@ -503,17 +510,18 @@ void Retracer::run()
             Q_ASSERT(process.state() != QProcess::Running);
         } else if (isProfiling()) {
             profile = new trace::Profile();
+            trace::ProfileParser parser(profile);
 
             while (!io.atEnd()) {
-                char line[256];
-                qint64 lineLength;
+                char buffer[64 * 1024];
+                qint64 size;
 
-                lineLength = io.readLine(line, 256);
+                size = io.read(buffer, sizeof buffer);
 
-                if (lineLength == -1)
+                if (size <= 0)
                     break;
 
-                trace::Profiler::parseLine(line, profile);
+                parser.parse(buffer, size);
             }
         } else {
             QByteArray output;
@@ -46,6 +46,7 @@ void SearchWidget::slotSearchPrev()
 void SearchWidget::slotCancel()
 {
     hide();
+    emit cancelled();
 }
 
 void SearchWidget::showEvent(QShowEvent *event)
@@ -3,6 +3,8 @@
 #include "apitrace.h"
 #include <QDebug>
 #include <QFile>
+#include <QMutexLocker>
+#include <QRunnable>
 
 #define FRAMES_TO_CACHE 100
 
@@ -26,12 +28,16 @@ apiCallFromTraceCall(const trace::Call *call,
 }
 
 TraceLoader::TraceLoader(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      m_canShareParser(true)
 {
 }
 
 TraceLoader::~TraceLoader()
 {
+    cancelSearch();
+    m_searchPool.waitForDone();
+    closeSearchParsers();
     m_parser.close();
     qDeleteAll(m_signatures);
 }
@@ -47,10 +53,13 @@ void TraceLoader::loadTrace(const QString &filename)
         m_signatures.clear();
         m_frameBookmarks.clear();
         m_createdFrames.clear();
+        closeSearchParsers();
         m_parser.close();
     }
 
-    if (!m_parser.open(filename.toLatin1())) {
+    m_fileName = filename.toLatin1();
+    m_canShareParser = true;
+    if (!m_parser.open(m_fileName)) {
         qDebug() << "error: failed to open " << filename;
         return;
     }
@@ -187,101 +196,6 @@ void TraceLoader::addSignature(unsigned id, ApiTraceCallSignature *signature)
     m_signatures[id] = signature;
 }
 
-void TraceLoader::searchNext(const ApiTrace::SearchRequest &request)
-{
-    Q_ASSERT(m_parser.supportsOffsets());
-    int startFrame = m_createdFrames.indexOf(request.frame);
-    const FrameBookmark &frameBookmark = m_frameBookmarks[startFrame];
-    m_parser.setBookmark(frameBookmark.start);
-    trace::Call *call = 0;
-    while ((call = m_parser.parse_call())) {
-
-        if (callContains(call, request.text, request.cs)) {
-            unsigned frameIdx = callInFrame(call->no);
-            ApiTraceFrame *frame = m_createdFrames[frameIdx];
-            const QVector<ApiTraceCall*> calls =
-                    fetchFrameContents(frame);
-            for (int i = 0; i < calls.count(); ++i) {
-                if (calls[i]->index() == call->no) {
-                    emit searchResult(request, ApiTrace::SearchResult_Found,
-                                      calls[i]);
-                    break;
-                }
-            }
-            delete call;
-            return;
-        }
-
-        delete call;
-    }
-    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
-}
-
-void TraceLoader::searchPrev(const ApiTrace::SearchRequest &request)
-{
-    Q_ASSERT(m_parser.supportsOffsets());
-    int startFrame = m_createdFrames.indexOf(request.frame);
-    trace::Call *call = 0;
-    QList<trace::Call*> frameCalls;
-    int frameIdx = startFrame;
-
-    const FrameBookmark &frameBookmark = m_frameBookmarks[frameIdx];
-    int numCallsToParse = frameBookmark.numberOfCalls;
-    m_parser.setBookmark(frameBookmark.start);
-
-    while ((call = m_parser.parse_call())) {
-
-        frameCalls.append(call);
-        --numCallsToParse;
-
-        if (numCallsToParse == 0) {
-            bool foundCall = searchCallsBackwards(frameCalls,
-                                                  frameIdx,
-                                                  request);
-
-            qDeleteAll(frameCalls);
-            frameCalls.clear();
-            if (foundCall) {
-                return;
-            }
-
-            --frameIdx;
-
-            if (frameIdx >= 0) {
-                const FrameBookmark &frameBookmark =
-                        m_frameBookmarks[frameIdx];
-                m_parser.setBookmark(frameBookmark.start);
-                numCallsToParse = frameBookmark.numberOfCalls;
-            }
-        }
-    }
-    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0);
-}
-
-bool TraceLoader::searchCallsBackwards(const QList<trace::Call*> &calls,
-                                       int frameIdx,
-                                       const ApiTrace::SearchRequest &request)
-{
-    for (int i = calls.count() - 1; i >= 0; --i) {
-        trace::Call *call = calls[i];
-        if (callContains(call, request.text, request.cs)) {
-            ApiTraceFrame *frame = m_createdFrames[frameIdx];
-            const QVector<ApiTraceCall*> apiCalls =
-                    fetchFrameContents(frame);
-            for (int i = 0; i < apiCalls.count(); ++i) {
-                if (apiCalls[i]->index() == call->no) {
-                    emit searchResult(request,
-                                      ApiTrace::SearchResult_Found,
-                                      apiCalls[i]);
-                    break;
-                }
-            }
-            return true;
-        }
-    }
-    return false;
-}
-
 int TraceLoader::callInFrame(int callIdx) const
 {
     unsigned numCalls = 0;
@@ -299,29 +213,14 @@ int TraceLoader::callInFrame(int callIdx) const
     return 0;
 }
 
-bool TraceLoader::callContains(trace::Call *call,
-                               const QString &str,
-                               Qt::CaseSensitivity sensitivity)
-{
-    /*
-     * FIXME: do string comparison directly on trace::Call
-     */
-    ApiTraceCall *apiCall = apiCallFromTraceCall(call, m_helpHash,
-                                                 0, 0, this);
-    bool result = apiCall->contains(str, sensitivity);
-    delete apiCall;
-    return result;
-}
-
-QVector<ApiTraceCall*>
+QVector<int>
 TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
 {
     Q_ASSERT(currentFrame);
 
-    if (currentFrame->isLoaded()) {
-        return currentFrame->calls();
-    }
-
+    // Never look at the frame's own calls here: they belong to the GUI
+    // thread, which may unload them meanwhile.  The parsed copy is handed
+    // over, and dropped there if the frame turns out to be loaded already.
     unsigned frameIdx = currentFrame->number;
     int numOfCalls = numberOfCallsInFrame(frameIdx);
 
@@ -332,6 +231,14 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
 
         FrameContents frameCalls(numOfCalls);
         frameCalls.load(this, currentFrame, m_helpHash, m_parser);
+
+        // The calls can't be looked at once handed over
+        QVector<int> callIndices;
+        callIndices.reserve(frameCalls.allCallsCount());
+        foreach (ApiTraceCall *call, frameCalls.allCalls()) {
+            callIndices.append(call->index());
+        }
+
         if (frameCalls.topLevelCount() == frameCalls.allCallsCount()) {
             emit frameContentsLoaded(currentFrame,
                                      frameCalls.allCalls(),
@@ -343,24 +250,20 @@ TraceLoader::fetchFrameContents(ApiTraceFrame *currentFrame)
                                      frameCalls.allCalls(),
                                      frameCalls.binaryDataSize());
         }
-        return frameCalls.allCalls();
+        return callIndices;
     }
-    return QVector<ApiTraceCall*>();
+    return QVector<int>();
 }
 
 void TraceLoader::findFrameStart(ApiTraceFrame *frame)
 {
-    if (!frame->isLoaded()) {
-        loadFrame(frame);
-    }
+    loadFrame(frame);
     emit foundFrameStart(frame);
 }
 
 void TraceLoader::findFrameEnd(ApiTraceFrame *frame)
 {
-    if (!frame->isLoaded()) {
-        loadFrame(frame);
-    }
+    loadFrame(frame);
     emit foundFrameEnd(frame);
 }
 
@@ -368,27 +271,203 @@ void TraceLoader::findCallIndex(int index)
 {
     int frameIdx = callInFrame(index);
     ApiTraceFrame *frame = m_createdFrames[frameIdx];
-    QVector<ApiTraceCall*> calls = fetchFrameContents(frame);
-    QVector<ApiTraceCall*>::const_iterator itr;
-    ApiTraceCall *call = 0;
-    for (itr = calls.constBegin(); itr != calls.constEnd(); ++itr) {
-        if ((*itr)->index() == index) {
-            call = *itr;
+    QVector<int> callIndices = fetchFrameContents(frame);
+    if (callIndices.contains(index)) {
+        emit foundCallIndex(frame, index);
+    }
+}
+
+int TraceLoader::cancelSearch()
+{
+    return m_searchSerial.fetchAndAddOrdered(1) + 1;
+}
+
+TraceLoader::SearchParser *
+TraceLoader::acquireSearchParser()
+{
+    QMutexLocker locker(&m_searchParsersMutex);
+    if (!m_searchParsers.isEmpty()) {
+        return m_searchParsers.takeLast();
+    }
+    if (!m_canShareParser) {
+        return NULL;
+    }
+    SearchParser *searchParser = new SearchParser;
+    if (!searchParser->parser.openShared(m_fileName, m_parser)) {
+        m_canShareParser = false;
+        delete searchParser;
+        return NULL;
+    }
+    return searchParser;
+}
+
+void TraceLoader::releaseSearchParser(SearchParser *searchParser)
+{
+    QMutexLocker locker(&m_searchParsersMutex);
+    m_searchParsers.append(searchParser);
+}
+
+void TraceLoader::closeSearchParsers()
+{
+    QMutexLocker locker(&m_searchParsersMutex);
+    qDeleteAll(m_searchParsers);
+    m_searchParsers.clear();
+}
+
+/*
+ * Search the calls of a frame, returning the number of the first matching
+ * one (or the last one when searching backwards), or -1.
+ *
+ * position is the order in which the frame would be searched sequentially,
+ * and nearest the position of the nearest frame known to have a match, so
+ * that frames past it aren't searched needlessly.
+ */
+int TraceLoader::searchFrame(trace::Parser &parser, QString &text,
+                             const ApiTrace::SearchRequest &request,
+                             int frameIdx, int position, QAtomicInt &nearest)
+{
+    bool forward = request.direction == ApiTrace::SearchRequest::Next;
+    const FrameBookmark frameBookmark = m_frameBookmarks.value(frameIdx);
+    parser.setBookmark(frameBookmark.start);
+
+    int found = -1;
+    for (int i = 0; i < frameBookmark.numberOfCalls; ++i) {
+        if (position > nearest.loadAcquire() ||
+            request.serial != m_searchSerial.loadAcquire()) {
+            return -1;
+        }
+
+        trace::Call *call = parser.parse_call();
+        if (!call) {
+            break;
+        }
+        text.clear();
+        appendCallSearchText(text, call);
+        if (text.contains(request.text, request.cs)) {
+            found = call->no;
+        }
+        delete call;
+
+        if (found >= 0 && forward) {
             break;
         }
     }
-    if (call) {
-        emit foundCallIndex(call);
+
+    if (found >= 0) {
+        int current = nearest.loadAcquire();
+        while (position < current &&
+               !nearest.testAndSetOrdered(current, position)) {
+            current = nearest.loadAcquire();
+        }
     }
+    return found;
 }
 
+class TraceLoader::FrameSearch : public QRunnable
+{
+public:
+    FrameSearch(TraceLoader *loader,
+                const ApiTrace::SearchRequest &request,
+                int frameIdx, int position,
+                QAtomicInt &nearest, int &found)
+        : m_loader(loader),
+          m_request(request),
+          m_frameIdx(frameIdx),
+          m_position(position),
+          m_nearest(nearest),
+          m_found(found)
+    {}
+
+    void run() override
+    {
+        SearchParser *searchParser = m_loader->acquireSearchParser();
+        if (!searchParser) {
+            return;
+        }
+        m_found = m_loader->searchFrame(searchParser->parser,
+                                        searchParser->text,
+                                        m_request, m_frameIdx,
+                                        m_position, m_nearest);
+        m_loader->releaseSearchParser(searchParser);
+    }
+
+private:
+    TraceLoader *m_loader;
+    const ApiTrace::SearchRequest &m_request;
+    int m_frameIdx;
+    int m_position;
+    QAtomicInt &m_nearest;
+    int &m_found;
+};
+
+/*
+ * Search the frames in batches, each frame of a batch in parallel with its
+ * own parser, until the nearest match is found.  Segmented traces, whose
+ * parsers can't be shared, are searched sequentially instead.
+ */
 void TraceLoader::search(const ApiTrace::SearchRequest &request)
 {
-    if (request.direction == ApiTrace::SearchRequest::Next) {
-        searchNext(request);
-    } else {
-        searchPrev(request);
+    if (request.serial != m_searchSerial.loadAcquire()) {
+        return;
+    }
+
+    Q_ASSERT(m_parser.supportsOffsets());
+    bool forward = request.direction == ApiTrace::SearchRequest::Next;
+    int startFrame = m_createdFrames.indexOf(request.frame);
+    int numFrames = forward ? m_createdFrames.count() - startFrame
+                            : startFrame + 1;
+
+    SearchParser *searchParser = acquireSearchParser();
+    bool parallel = searchParser != NULL;
+    if (parallel) {
+        releaseSearchParser(searchParser);
+    }
+
+    int batchSize = parallel ? qMax(m_searchPool.maxThreadCount(), 1) * 4 : 16;
+    int lastPercentReport = 0;
+    for (int first = 0; first < numFrames; first += batchSize) {
+        int count = qMin(batchSize, numFrames - first);
+        QAtomicInt nearest(count);
+        QVector<int> found(count, -1);
+        for (int i = 0; i < count; ++i) {
+            int position = first + i;
+            int frameIdx = forward ? startFrame + position
+                                   : startFrame - position;
+            if (parallel) {
+                m_searchPool.start(new FrameSearch(this, request, frameIdx, i,
+                                                   nearest, found[i]));
+            } else {
+                found[i] = searchFrame(m_parser, m_searchText, request,
+                                       frameIdx, i, nearest);
+            }
+        }
+        m_searchPool.waitForDone();
+
+        if (request.serial != m_searchSerial.loadAcquire()) {
+            return;
+        }
+
+        int i = nearest.loadAcquire();
+        if (i < count) {
+            // Calls of other threads may cross frame boundaries
+            int frameIdx = callInFrame(found[i]);
+            ApiTraceFrame *frame = m_createdFrames[frameIdx];
+            QVector<int> callIndices = fetchFrameContents(frame);
+            if (callIndices.contains(found[i])) {
+                emit searchResult(request, ApiTrace::SearchResult_Found,
+                                  frame, found[i]);
+                return;
+            }
+            break;
+        }
+
+        int percent = (first + count) * 100 / numFrames;
+        if (percent - lastPercentReport >= 5) {
+            emit searchProgress(percent);
+            lastPercentReport = percent;
+        }
     }
+    emit searchResult(request, ApiTrace::SearchResult_NotFound, 0, -1);
 }
 
 TraceLoader::FrameContents::FrameContents(int numOfCalls)
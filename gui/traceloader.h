@@ -5,10 +5,13 @@
 #include "trace_file.hpp"
 #include "trace_parser.hpp"
 
+#include <QAtomicInt>
 #include <QObject>
 #include <QList>
 #include <QMap>
+#include <QMutex>
 #include <QStack>
+#include <QThreadPool>
 
 class TraceLoader : public QObject
 {
@@ -23,6 +26,13 @@ public:
 
     trace::EnumSig *enumSignature(unsigned id);
 
+    /*
+     * Abandon the search in progress, if any, and return the serial number
+     * which the next search request must have.  Can be called from any
+     * thread.
+     */
+    int cancelSearch();
+
 private:
     class FrameContents
     {
@@ -68,12 +78,19 @@ signals:
                              const QVector<ApiTraceCall*> &calls,
                              quint64 binaryDataSize);
 
+    /*
+     * Calls are identified by their frame and index rather than by pointer,
+     * as the GUI thread owns the calls of loaded frames and may unload them
+     * at any time.
+     */
     void searchResult(const ApiTrace::SearchRequest &request,
                       ApiTrace::SearchResult result,
-                      ApiTraceCall *call);
+                      ApiTraceFrame *frame,
+                      int callIndex);
+    void searchProgress(int percent);
     void foundFrameStart(ApiTraceFrame *frame);
     void foundFrameEnd(ApiTraceFrame *frame);
-    void foundCallIndex(ApiTraceCall *call);
+    void foundCallIndex(ApiTraceFrame *frame, int callIndex);
 private:
     struct FrameBookmark {
         FrameBookmark()
@@ -94,20 +111,32 @@ private:
     void guessApi(const trace::Call *call);
     void scanTrace();
 
-    void searchNext(const ApiTrace::SearchRequest &request);
-    void searchPrev(const ApiTrace::SearchRequest &request);
+    class FrameSearch;
+
+    /*
+     * Parser sharing the signatures of m_parser, and a buffer for the text
+     * of the calls, for searching frames in parallel.
+     */
+    struct SearchParser {
+        trace::Parser parser;
+        QString text;
+    };
+
+    SearchParser *acquireSearchParser();
+    void releaseSearchParser(SearchParser *searchParser);
+    void closeSearchParsers();
+
+    int searchFrame(trace::Parser &parser, QString &text,
+                    const ApiTrace::SearchRequest &request,
+                    int frameIdx, int position, QAtomicInt &nearest);
 
     int callInFrame(int callIdx) const;
-    bool callContains(trace::Call *call,
-                      const QString &str,
-                      Qt::CaseSensitivity sensitivity);
-     QVector<ApiTraceCall*> fetchFrameContents(ApiTraceFrame *frame);
-     bool searchCallsBackwards(const QList<trace::Call*> &calls,
-                               int frameIdx,
-                               const ApiTrace::SearchRequest &request);
+    // Parse a frame for the GUI thread, returning the indices of its calls
+    QVector<int> fetchFrameContents(ApiTraceFrame *frame);
 
 private:
     trace::Parser m_parser;
+    QByteArray m_fileName;
 
     typedef QMap<int, FrameBookmark> FrameBookmarks;
     FrameBookmarks m_frameBookmarks;
@@ -116,4 +145,12 @@ private:
     QHash<QString, QUrl> m_helpHash;
 
     QVector<ApiTraceCallSignature*> m_signatures;
+
+    QAtomicInt m_searchSerial;
+    QThreadPool m_searchPool;
+    QMutex m_searchParsersMutex;
+    QList<SearchParser*> m_searchParsers;
+    // Whether search parsers can be opened, false for segmented traces
+    bool m_canShareParser;
+    QString m_searchText;
 };
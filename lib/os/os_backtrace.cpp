@@ -41,11 +41,16 @@
 #elif HAVE_BACKTRACE
 #  include <stdint.h>
 #  include <dlfcn.h>
+#  include <link.h>
+#  include <pthread.h>
 #  include <unistd.h>
+#  include <unwind.h>
+#  include <algorithm>
 #  include <map>
 #  include <vector>
 #  include <cxxabi.h>
 #  include <backtrace.h>
+#  include "os_thread.hpp"
 #endif
 
 
@@ -273,6 +278,14 @@ std::vector<RawStackFrame> get_backtrace() {
     return backtraceProvider.parseBacktrace(backtraceProvider.getBacktrace());
 }
 
+unsigned get_backtrace_addresses(uintptr_t *addresses, unsigned max_addresses) {
+    return 0;
+}
+
+std::vector<RawStackFrame> symbolize_backtrace(const uintptr_t *addresses, unsigned num_addresses) {
+    return std::vector<RawStackFrame>();
+}
+
 void dump_backtrace() {
     /* TODO */
 }
@@ -394,21 +407,27 @@ class libbacktraceProvider {
                                        : pc - (uintptr_t)info.dli_fbase;
     }
 
-    static int bt_callback(void *vdata, uintptr_t pc)
+    const std::vector<RawStackFrame> &symbolize(uintptr_t pc)
     {
-        libbacktraceProvider *this_ = (libbacktraceProvider*)vdata;
-        std::vector<RawStackFrame> &frames = this_->cache[pc];
+        std::vector<RawStackFrame> &frames = cache[pc];
         if (!frames.size()) {
             RawStackFrame frame;
             dl_fill(&frame, pc);
-            this_->current_frame = &frame;
-            this_->current_frames = &frames;
-            backtrace_pcinfo(this_->state, pc, bt_full_callback, bt_err_callback, vdata);
+            current_frame = &frame;
+            current_frames = &frames;
+            backtrace_pcinfo(state, pc, bt_full_callback, bt_err_callback, this);
             if (!frames.size()) {
-                frame.id = this_->nextFrameId++;
+                frame.id = nextFrameId++;
                 frames.push_back(frame);
             }
         }
+        return frames;
+    }
+
+    static int bt_callback(void *vdata, uintptr_t pc)
+    {
+        libbacktraceProvider *this_ = (libbacktraceProvider*)vdata;
+        const std::vector<RawStackFrame> &frames = this_->symbolize(pc);
         this_->current->insert(this_->current->end(), frames.begin(), frames.end());
         return this_->current->size() >= BT_DEPTH;
     }
@@ -454,15 +473,216 @@ public:
         return parsedBacktrace;
     }
 
+    std::vector<RawStackFrame> symbolizeBacktrace(const uintptr_t *addresses, unsigned num_addresses)
+    {
+        std::vector<RawStackFrame> parsedBacktrace;
+        for (unsigned i = 0; i < num_addresses; ++i) {
+            const std::vector<RawStackFrame> &frames = symbolize(addresses[i]);
+            parsedBacktrace.insert(parsedBacktrace.end(), frames.begin(), frames.end());
+        }
+        return parsedBacktrace;
+    }
+
     void dumpBacktrace()
     {
         backtrace_simple(state, 0, bt_dump_callback, bt_err_callback, this);
     }
 };
 
-std::vector<RawStackFrame> get_backtrace() {
+static libbacktraceProvider &
+getBacktraceProvider(void)
+{
     static libbacktraceProvider backtraceProvider;
-    return backtraceProvider.getParsedBacktrace();
+    return backtraceProvider;
+}
+
+std::vector<RawStackFrame> get_backtrace() {
+    return getBacktraceProvider().getParsedBacktrace();
+}
+
+
+/*
+ * Address range of the module containing apitrace, whose frames are left out
+ * of the backtraces.
+ */
+struct ModuleRange {
+    uintptr_t start;
+    uintptr_t end;
+
+    static int callback(struct dl_phdr_info *info, size_t size, void *data)
+    {
+        ModuleRange *range = (ModuleRange *)data;
+        uintptr_t self = (uintptr_t)&get_backtrace_addresses;
+        uintptr_t start = UINTPTR_MAX;
+        uintptr_t end = 0;
+        for (unsigned i = 0; i < info->dlpi_phnum; ++i) {
+            const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD) {
+                uintptr_t segmentStart = info->dlpi_addr + phdr.p_vaddr;
+                start = std::min(start, segmentStart);
+                end = std::max(end, (uintptr_t)(segmentStart + phdr.p_memsz));
+            }
+        }
+        if (self >= start && self < end) {
+            range->start = start;
+            range->end = end;
+            return 1;
+        }
+        return 0;
+    }
+
+    ModuleRange() :
+        start(0),
+        end(0)
+    {
+        dl_iterate_phdr(callback, this);
+    }
+};
+
+/*
+ * DWARF register number of the frame pointer, on architectures where the
+ * frame pointer points to the saved frame pointer and return address.
+ */
+#if defined(__linux__) && defined(__x86_64__)
+#  define FP_REGNUM 6
+#elif defined(__linux__) && defined(__aarch64__)
+#  define FP_REGNUM 29
+#endif
+
+#ifdef FP_REGNUM
+
+/*
+ * Walking the frame pointer chain is several times faster than unwinding with
+ * the DWARF call frame information, but it only works on code built with
+ * frame pointers, so it's opt-in via APITRACE_BACKTRACE_FP.  It is only used
+ * past apitrace's own frames, and every frame pointer is checked to lie in the
+ * thread's stack, so that bogus frame pointers can only cause bogus frames.
+ */
+static bool
+useFramePointers(void)
+{
+    static bool enabled = getenv("APITRACE_BACKTRACE_FP") != NULL &&
+                          strcmp(getenv("APITRACE_BACKTRACE_FP"), "0") != 0;
+    return enabled;
+}
+
+struct StackRange {
+    uintptr_t start;
+    uintptr_t end;
+};
+
+static OS_THREAD_LOCAL StackRange thread_stack;
+
+static const StackRange &
+getStackRange(void)
+{
+    StackRange &range = thread_stack;
+    if (!range.end) {
+        pthread_attr_t attr;
+        void *addr = NULL;
+        size_t size = 0;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            pthread_attr_getstack(&attr, &addr, &size);
+            pthread_attr_destroy(&attr);
+        }
+        range.start = (uintptr_t)addr;
+        range.end = (uintptr_t)addr + size;
+        if (!range.end) {
+            // Don't try again
+            range.start = range.end = 1;
+        }
+    }
+    return range;
+}
+
+static unsigned
+walkFramePointers(uintptr_t fp, uintptr_t sp,
+                  uintptr_t *addresses, unsigned max_addresses)
+{
+    const StackRange &stack = getStackRange();
+    unsigned num_addresses = 0;
+    while (num_addresses < max_addresses &&
+           fp >= sp &&
+           fp >= stack.start &&
+           fp + 2 * sizeof(uintptr_t) <= stack.end &&
+           fp % sizeof(uintptr_t) == 0) {
+        const uintptr_t *frame = (const uintptr_t *)fp;
+        uintptr_t pc = frame[1];
+        if (!pc) {
+            break;
+        }
+        addresses[num_addresses++] = pc - 1;
+        // Frames must go up the stack
+        sp = fp + 2 * sizeof(uintptr_t);
+        fp = frame[0];
+    }
+    return num_addresses;
+}
+
+#endif /* FP_REGNUM */
+
+struct UnwindState {
+    const ModuleRange *self;
+    uintptr_t *addresses;
+    unsigned num_addresses;
+    unsigned max_addresses;
+    bool inside;
+};
+
+static _Unwind_Reason_Code
+unwindCallback(struct _Unwind_Context *context, void *data)
+{
+    UnwindState *state = (UnwindState *)data;
+
+    int ipBeforeInsn = 0;
+    uintptr_t pc = _Unwind_GetIPInfo(context, &ipBeforeInsn);
+    if (!pc) {
+        return _URC_END_OF_STACK;
+    }
+    if (!ipBeforeInsn) {
+        // Point inside the call instruction, as libbacktrace expects
+        --pc;
+    }
+
+    // Skip the unwinder's frames, then ours
+    if (!state->num_addresses) {
+        if (pc >= state->self->start && pc < state->self->end) {
+            state->inside = true;
+            return _URC_NO_REASON;
+        }
+        if (!state->inside) {
+            return _URC_NO_REASON;
+        }
+    }
+
+    state->addresses[state->num_addresses++] = pc;
+
+#ifdef FP_REGNUM
+    if (useFramePointers()) {
+        // Continue from the first frame outside apitrace
+        uintptr_t fp = _Unwind_GetGR(context, FP_REGNUM);
+        uintptr_t sp = (uintptr_t)&ipBeforeInsn;
+        state->num_addresses += walkFramePointers(fp, sp,
+                                                  state->addresses + state->num_addresses,
+                                                  state->max_addresses - state->num_addresses);
+        return _URC_END_OF_STACK;
+    }
+#endif
+
+    return state->num_addresses < state->max_addresses ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+unsigned get_backtrace_addresses(uintptr_t *addresses, unsigned max_addresses) {
+    static ModuleRange self;
+    UnwindState state = {&self, addresses, 0, max_addresses, false};
+    if (max_addresses) {
+        _Unwind_Backtrace(unwindCallback, &state);
+    }
+    return state.num_addresses;
+}
+
+std::vector<RawStackFrame> symbolize_backtrace(const uintptr_t *addresses, unsigned num_addresses) {
+    return getBacktraceProvider().symbolizeBacktrace(addresses, num_addresses);
 }
 
 void dump_backtrace() {
@@ -477,6 +697,14 @@ std::vector<RawStackFrame> get_backtrace() {
     return std::vector<RawStackFrame>();
 }
 
+unsigned get_backtrace_addresses(uintptr_t *addresses, unsigned max_addresses) {
+    return 0;
+}
+
+std::vector<RawStackFrame> symbolize_backtrace(const uintptr_t *addresses, unsigned num_addresses) {
+    return std::vector<RawStackFrame>();
+}
+
 void dump_backtrace() {
 }
 
@@ -26,6 +26,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "trace_model.hpp"
@@ -38,6 +40,15 @@ using trace::RawStackFrame;
 std::vector<RawStackFrame> get_backtrace();
 bool backtrace_is_needed(const char* fname);
 
+/*
+ * Cheaper alternative to get_backtrace: only the return addresses of the
+ * caller's stack are captured, without apitrace's own frames, and symbols are
+ * looked up later with symbolize_backtrace.  Returns the number of addresses,
+ * or zero where unsupported.
+ */
+unsigned get_backtrace_addresses(uintptr_t *addresses, unsigned max_addresses);
+std::vector<RawStackFrame> symbolize_backtrace(const uintptr_t *addresses, unsigned num_addresses);
+
 void dump_backtrace();
 
 
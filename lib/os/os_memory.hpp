@@ -25,34 +25,22 @@
  **************************************************************************/
 
 /*
- * Simple OS time measurement abstraction.
+ * Process memory usage.
  */
 
 #pragma once
 
-#ifdef HAVE_READPROC_H
-#include <proc/readproc.h>
-#endif
-
 namespace os {
 
-#if defined(HAVE_READPROC_H)
+#if defined(__linux__)
 
-    inline long long
-    getVsize(void) {
-        proc_t proc;
-        look_up_our_self(&proc);
-        return proc.vsize;
-    }
-
-    inline long long
-    getRss(void) {
-        proc_t proc;
-        look_up_our_self(&proc);
-        return proc.rss;
-    }
-
-#elif defined(__ANDROID__)
+    /*
+     * Read both the virtual size and the resident set size with a single
+     * pread() of /proc/self/statm, which is kept open.  Safe to call from
+     * multiple threads.
+     */
+    bool
+    getMemoryUsage(long long &vsize, long long &rss);
 
     long long
     getVsize(void);
@@ -72,7 +60,13 @@ namespace os {
         return 0;
     }
 
+    inline bool
+    getMemoryUsage(long long &vsize, long long &rss) {
+        vsize = 0;
+        rss = 0;
+        return false;
+    }
+
 #endif
 
 } /* namespace os */
-
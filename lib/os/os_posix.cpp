@@ -426,40 +426,63 @@ resetExceptionCallback(void)
 #endif
 }
 
-#ifdef __ANDROID__
+#ifdef __linux__
 #include "os_memory.hpp"
-#include <cassert>
-#include <cstdio>
 
-#include <fcntl.h>
-#include <unistd.h>
-
-char statmBuff[256];
-static __uint64_t pageSize = sysconf(_SC_PAGESIZE);
+static int
+openStatm(void)
+{
+    return open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+}
 
-static long size, resident;
+static inline long long
+parseNumber(const char *&p)
+{
+    long long n = 0;
+    while (*p == ' ') {
+        ++p;
+    }
+    while (*p >= '0' && *p <= '9') {
+        n = n * 10 + (*p++ - '0');
+    }
+    return n;
+}
 
-static inline void parseStatm()
+bool
+getMemoryUsage(long long &vsize, long long &rss)
 {
-    int fd = open("/proc/self/statm", O_RDONLY, 0);
-    int sz = read(fd, statmBuff, 255);
-    close(fd);
-    statmBuff[sz] = 0;
-    sz = sscanf(statmBuff, "%ld %ld",
-               &size, &resident);
-    assert(sz == 2);
+    static const long long pageSize = sysconf(_SC_PAGESIZE);
+    static const int fd = openStatm();
+
+    char buf[128];
+    ssize_t size = fd < 0 ? -1 : pread(fd, buf, sizeof buf - 1, 0);
+    if (size <= 0) {
+        vsize = 0;
+        rss = 0;
+        return false;
+    }
+    buf[size] = 0;
+
+    const char *p = buf;
+    vsize = parseNumber(p) * pageSize;
+    rss = parseNumber(p) * pageSize;
+    return true;
 }
 
-long long getVsize()
+long long
+getVsize(void)
 {
-    parseStatm();
-    return pageSize * size;
+    long long vsize, rss;
+    getMemoryUsage(vsize, rss);
+    return vsize;
 }
 
-long long getRss()
+long long
+getRss(void)
 {
-    parseStatm();
-    return pageSize * resident;
+    long long vsize, rss;
+    getMemoryUsage(vsize, rss);
+    return rss;
 }
 #endif
 
@@ -27,6 +27,8 @@
 
 #pragma once
 
+#include <assert.h>
+
 #include <algorithm>
 #include <cstddef>
 #include <functional>
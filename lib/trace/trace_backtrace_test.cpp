@@ -0,0 +1,249 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+
+#include "gtest/gtest.h"
+
+#include "os.hpp"
+#include "os_process.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_file.hpp"
+#include "trace_writer_local.hpp"
+
+using namespace trace;
+
+
+static const char *filename = "trace_backtrace_test.trace";
+
+/*
+ * Stack of each call, -1 for a non-shared backtrace.
+ */
+static const int callStacks[] = {0, 1, 0, -1, 1, 0};
+static const unsigned numCalls = sizeof callStacks / sizeof callStacks[0];
+
+
+static void
+writeFrames(Writer &writer, int stack)
+{
+    // Stacks 0 and 1 share their outermost frame
+    RawStackFrame frames[2];
+    frames[0].id = stack == 1 ? 1 : 0;
+    frames[0].function = stack == 1 ? "bar" : "foo";
+    frames[0].offset = 16;
+    frames[1].id = 2;
+    frames[1].function = "main";
+    frames[1].offset = 32;
+    for (auto & frame : frames) {
+        writer.writeStackFrame(&frame);
+    }
+}
+
+
+class BacktraceTest : public TraceFileTest
+{
+protected:
+    BacktraceTest() :
+        TraceFileTest(::filename)
+    {}
+
+    void
+    write(Writer &writer) override {
+        for (unsigned no = 0; no < numCalls; ++no) {
+            int stack = callStacks[no];
+            unsigned call = beginCall(writer, &fooSig, no);
+            if (stack < 0) {
+                writer.beginBacktrace(2);
+                writeFrames(writer, 0);
+                writer.endBacktrace();
+            } else {
+                if (writer.beginStack(stack)) {
+                    writer.beginStackFrames(2);
+                    writeFrames(writer, stack);
+                }
+                writer.endStack();
+            }
+            endCall(writer, call);
+        }
+    }
+};
+
+
+static void
+expectBacktrace(Call *call, unsigned no)
+{
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(no, call->no);
+    EXPECT_EQ(no, call->args[0].value->toUInt());
+    ASSERT_TRUE(call->backtrace != NULL);
+    ASSERT_EQ(2u, call->backtrace->size());
+    const StackFrame *frame = (*call->backtrace)[0];
+    EXPECT_STREQ(callStacks[no] == 1 ? "bar" : "foo", frame->function);
+    EXPECT_EQ(16, frame->offset);
+    frame = (*call->backtrace)[1];
+    EXPECT_STREQ("main", frame->function);
+    EXPECT_EQ(32, frame->offset);
+}
+
+
+TEST_F(BacktraceTest, parse)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    Call *calls[numCalls];
+    for (unsigned no = 0; no < numCalls; ++no) {
+        calls[no] = parser.parse_call();
+        expectBacktrace(calls[no], no);
+    }
+    EXPECT_TRUE(parser.parse_call() == NULL);
+
+    // Shared stacks are parsed once
+    EXPECT_EQ(calls[0]->backtrace, calls[2]->backtrace);
+    EXPECT_EQ(calls[0]->backtrace, calls[5]->backtrace);
+    EXPECT_EQ(calls[1]->backtrace, calls[4]->backtrace);
+    EXPECT_NE(calls[0]->backtrace, calls[1]->backtrace);
+
+    for (auto call : calls) {
+        delete call;
+    }
+}
+
+
+TEST_F(BacktraceTest, bookmarks)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    ParseBookmark bookmarks[numCalls];
+    for (unsigned no = 0; no < numCalls; ++no) {
+        parser.getBookmark(bookmarks[no]);
+        delete parser.parse_call();
+    }
+
+    // Reparse the calls defining the stacks, and those referring to them
+    for (unsigned first = 0; first < numCalls; ++first) {
+        parser.setBookmark(bookmarks[first]);
+        for (unsigned no = first; no < numCalls; ++no) {
+            Call *call = parser.parse_call();
+            expectBacktrace(call, no);
+            delete call;
+        }
+        EXPECT_TRUE(parser.parse_call() == NULL);
+    }
+}
+
+
+/*
+ * LocalWriter sharing at most two stacks, fed with made up return addresses
+ * instead of unwinding.
+ */
+class BoundedWriter : public LocalWriter
+{
+public:
+    BoundedWriter() {
+        maxStacks = 2;
+    }
+
+    void
+    writeCall(unsigned no, const uintptr_t *addresses, unsigned num_addresses) {
+        unsigned call = beginEnter(&fooSig, true);
+        beginArg(0);
+        writeUInt(no);
+        endArg();
+        writeBacktrace(addresses, num_addresses);
+        endEnter();
+        beginLeave(call);
+        endLeave();
+    }
+
+    size_t
+    numStacks(void) const {
+        return stackAddresses.size();
+    }
+};
+
+
+TEST(BoundedStacks, parse)
+{
+    const uintptr_t stacks[3][2] = {
+        {(uintptr_t)&writeFrames, (uintptr_t)&expectBacktrace},
+        {(uintptr_t)&expectBacktrace, (uintptr_t)&writeFrames},
+        {(uintptr_t)&writeFrames, (uintptr_t)&writeFrames},
+    };
+    static const unsigned callStacks[] = {0, 1, 2, 0, 2, 1};
+    const unsigned numCalls = sizeof callStacks / sizeof callStacks[0];
+
+    // Each LocalWriter installs the exception handlers, which the singleton
+    // already did
+    os::resetExceptionCallback();
+
+    os::setEnvironment("TRACE_FILE", filename);
+    {
+        BoundedWriter writer;
+        for (unsigned no = 0; no < numCalls; ++no) {
+            writer.writeCall(no, stacks[callStacks[no]], 2);
+        }
+        // The third stack doesn't fit
+        EXPECT_EQ(2u, writer.numStacks());
+        writer.close();
+    }
+    os::unsetEnvironment("TRACE_FILE");
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    Call *calls[numCalls];
+    for (unsigned no = 0; no < numCalls; ++no) {
+        calls[no] = parser.parse_call();
+        ASSERT_TRUE(calls[no] != NULL);
+        EXPECT_EQ(no, calls[no]->args[0].value->toUInt());
+    }
+    EXPECT_TRUE(parser.parse_call() == NULL);
+
+    ASSERT_TRUE(calls[0]->backtrace != NULL);
+    EXPECT_EQ(calls[0]->backtrace, calls[3]->backtrace);
+    EXPECT_EQ(calls[1]->backtrace, calls[5]->backtrace);
+    EXPECT_NE(calls[0]->backtrace, calls[1]->backtrace);
+
+    // Written in full each time
+    ASSERT_TRUE(calls[2]->backtrace != NULL);
+    EXPECT_NE(calls[2]->backtrace, calls[4]->backtrace);
+
+    for (auto call : calls) {
+        delete call;
+    }
+
+    remove(filename);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
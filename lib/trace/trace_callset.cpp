@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -91,7 +92,7 @@ private:
                 }
             }
         }
-        set.addRange(CallRange(start, stop, step, freq));
+        set.add(CallRange(start, stop, step, freq));
     }
 
     // match and consume an operator
@@ -249,6 +250,8 @@ CallSet::merge(const char *string)
             parser.parse();
         }
     }
+
+    compile();
 }
 
 
@@ -262,3 +265,152 @@ CallSet::CallSet(CallFlags freq): limits(std::numeric_limits<CallNo>::min(), std
     }
 }
 
+
+const CallNo CallSet::NO_MEMBER;
+
+
+void
+CallSet::add(const CallRange & range)
+{
+    if (range.start <= range.stop &&
+        range.freq != FREQUENCY_NONE) {
+
+        if (empty()) {
+            limits.start = range.start;
+            limits.stop = range.stop;
+        } else {
+            if (range.start < limits.start)
+                limits.start = range.start;
+            if (range.stop > limits.stop)
+                limits.stop = range.stop;
+        }
+
+        ranges.push_back(range);
+        if (!ranges.back().step) {
+            ranges.back().step = 1;
+        }
+    }
+}
+
+
+void
+CallSet::compile(void)
+{
+    segments.clear();
+    segmentRanges.clear();
+
+    // Sweep over the points where ranges start or end, in 64 bits so that
+    // the end of a range stopping at the last call number doesn't wrap.
+    struct Event {
+        unsigned long long position;
+        unsigned index;
+        bool start;
+
+        bool operator < (const Event &other) const {
+            return position < other.position;
+        }
+    };
+
+    std::vector<Event> events;
+    events.reserve(ranges.size() * 2);
+    for (unsigned index = 0; index < ranges.size(); ++index) {
+        const CallRange &range = ranges[index];
+        Event start = {range.start, index, true};
+        Event stop = {(unsigned long long)range.stop + 1, index, false};
+        events.push_back(start);
+        events.push_back(stop);
+    }
+    std::sort(events.begin(), events.end());
+
+    unsigned plain = 0;
+    std::vector<unsigned> active;
+
+    size_t i = 0;
+    while (i < events.size()) {
+        unsigned long long position = events[i].position;
+        do {
+            const Event &event = events[i];
+            const CallRange &range = ranges[event.index];
+            bool isPlain = range.freq == FREQUENCY_ALL &&
+                           (range.step == 1 || range.start == range.stop);
+            if (isPlain) {
+                plain += event.start ? 1 : -1;
+            } else if (event.start) {
+                active.push_back(event.index);
+            } else {
+                active.erase(std::find(active.begin(), active.end(), event.index));
+            }
+            ++i;
+        } while (i < events.size() && events[i].position == position);
+
+        if (i == events.size() || (!plain && active.empty())) {
+            continue;
+        }
+
+        Segment segment;
+        segment.start = position;
+        segment.stop = events[i].position - 1;
+        segment.all = plain > 0;
+        segment.first = segmentRanges.size();
+        segment.count = 0;
+
+        if (segment.all) {
+            if (!segments.empty() &&
+                segments.back().all &&
+                segments.back().stop + 1 == segment.start) {
+                segments.back().stop = segment.stop;
+                continue;
+            }
+        } else {
+            for (unsigned index : active) {
+                segmentRanges.push_back(ranges[index]);
+            }
+            segment.count = active.size();
+        }
+        segments.push_back(segment);
+    }
+}
+
+
+size_t
+CallSet::lowerBound(CallNo callNo) const
+{
+    size_t lo = 0;
+    size_t hi = segments.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (segments[mid].stop < callNo) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+
+CallNo
+CallSet::nextMember(CallNo callNo) const
+{
+    for (size_t i = lowerBound(callNo); i < segments.size(); ++i) {
+        const Segment &segment = segments[i];
+        CallNo from = std::max(callNo, segment.start);
+        if (segment.all) {
+            return from;
+        }
+
+        // Earliest call matching the step of any covering range
+        unsigned long long next = (unsigned long long)segment.stop + 1;
+        for (unsigned j = 0; j < segment.count; ++j) {
+            const CallRange &range = segmentRanges[segment.first + j];
+            unsigned long long offset = from - range.start;
+            offset = (offset + range.step - 1) / range.step * range.step;
+            next = std::min(next, range.start + offset);
+        }
+        if (next <= segment.stop) {
+            return next;
+        }
+    }
+
+    return NO_MEMBER;
+}
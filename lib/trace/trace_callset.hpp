@@ -48,10 +48,12 @@
 
 
 #include <limits>
-#include <list>
+#include <vector>
 
 #include "trace_model.hpp"
-#include "trace_fast_callset.hpp"
+
+
+class CallSetParser;
 
 namespace trace {
 
@@ -91,7 +93,7 @@ namespace trace {
         contains(CallNo callNo, CallFlags callFlags) const {
             return callNo >= start &&
                    callNo <= stop &&
-                   ((callNo - start) % step) == 0 &&
+                   (step == 1 || ((callNo - start) % step) == 0) &&
                    ((callFlags & freq) ||
                     freq == FREQUENCY_ALL);
         }
@@ -99,21 +101,60 @@ namespace trace {
 
 
     // A collection of call ranges
+    //
+    // Ranges are compiled, whenever they are added, into a sorted array of
+    // disjoint segments, each either wholly inside the set, or covered by the
+    // same stepped or flag filtered ranges.  Queries only binary search the
+    // segments, so a set can be queried from several threads at once.
     class CallSet
     {
     private:
+        friend class ::CallSetParser;
+
         CallRange limits;
         bool firstmerge;
 
-    public:
-        FastCallSet fast_call_set;
-
-        // TODO: use binary tree to speed up lookups, (less important
-        // now that we are using FastCallSet for ranges without step
-        // or freq).
-        typedef std::list< CallRange > RangeList;
+        typedef std::vector< CallRange > RangeList;
         RangeList ranges;
 
+        struct Segment
+        {
+            CallNo start;
+            CallNo stop;
+            // Whether every call in the segment is a member, otherwise the
+            // ranges covering it
+            bool all;
+            unsigned first;
+            unsigned count;
+        };
+
+        std::vector< Segment > segments;
+        RangeList segmentRanges;
+
+        // Add a range without compiling, for adding many at once
+        void
+        add(const CallRange & range);
+
+        void
+        compile(void);
+
+        // Find the segment containing callNo, if any
+        inline const Segment *
+        findSegment(CallNo callNo) const {
+            size_t i = lowerBound(callNo);
+            if (i < segments.size() && callNo >= segments[i].start) {
+                return &segments[i];
+            }
+            return nullptr;
+        }
+
+        size_t
+        lowerBound(CallNo callNo) const;
+
+    public:
+        // Returned by nextMember when there are no more members
+        static const CallNo NO_MEMBER = std::numeric_limits<CallNo>::max();
+
         CallSet(): limits(std::numeric_limits<CallNo>::min(), std::numeric_limits<CallNo>::max()), firstmerge(true) {}
 
         CallSet(CallFlags freq);
@@ -124,48 +165,27 @@ namespace trace {
         // Not empty set
         inline bool
         empty() const {
-            return fast_call_set.empty() && ranges.empty();
+            return ranges.empty();
         }
 
         void
         addRange(const CallRange & range) {
-            if (range.start <= range.stop &&
-                range.freq != FREQUENCY_NONE) {
-
-                if (empty()) {
-                    limits.start = range.start;
-                    limits.stop = range.stop;
-                } else {
-                    if (range.start < limits.start)
-                        limits.start = range.start;
-                    if (range.stop > limits.stop)
-                        limits.stop = range.stop;
-                }
-
-                /* Optimize by using fast_call_set whenever possible */
-                if (range.step == 1 && range.freq == FREQUENCY_ALL) {
-                    fast_call_set.add(range.start, range.stop);
-                } else {
-                    RangeList::iterator it = ranges.begin();
-                    while (it != ranges.end() && it->start < range.start) {
-                        ++it;
-                    }
-
-                    ranges.insert(it, range);
-                }
-            }
+            add(range);
+            compile();
         }
 
         inline bool
         contains(CallNo callNo, CallFlags callFlags = FREQUENCY_ALL) const {
-            if (empty()) {
+            const Segment *segment = findSegment(callNo);
+            if (!segment) {
                 return false;
             }
-            if (fast_call_set.contains(callNo))
+            if (segment->all) {
                 return true;
-            RangeList::const_iterator it;
-            for (it = ranges.begin(); it != ranges.end() && it->start <= callNo; ++it) {
-                if (it->contains(callNo, callFlags)) {
+            }
+            const CallRange *range = &segmentRanges[segment->first];
+            for (unsigned i = 0; i < segment->count; ++i, ++range) {
+                if (range->contains(callNo, callFlags)) {
                     return true;
                 }
             }
@@ -173,15 +193,21 @@ namespace trace {
         }
 
         inline bool
-        contains(const trace::Call &call) {
+        contains(const trace::Call &call) const {
             return contains(call.no, call.flags);
         }
 
-        CallNo getFirst() {
+        // First call not before callNo which may be in the set (whether
+        // calls match a frequency is only known once they are parsed), or
+        // NO_MEMBER.
+        CallNo
+        nextMember(CallNo callNo) const;
+
+        CallNo getFirst() const {
             return limits.start;
         }
 
-        CallNo getLast() {
+        CallNo getLast() const {
             return limits.stop;
         }
     };
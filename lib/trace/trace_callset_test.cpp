@@ -0,0 +1,140 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_callset.hpp"
+
+using namespace trace;
+
+
+static bool
+naiveContains(const std::vector<CallRange> &ranges, CallNo callNo, CallFlags flags)
+{
+    for (auto & range : ranges) {
+        if (range.contains(callNo, flags)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+TEST(callset, parse)
+{
+    CallSet set;
+    set.merge("3,10-20/5,100-110/draw,200-");
+
+    EXPECT_FALSE(set.contains(2));
+    EXPECT_TRUE(set.contains(3));
+    EXPECT_FALSE(set.contains(4));
+    EXPECT_TRUE(set.contains(10));
+    EXPECT_FALSE(set.contains(11));
+    EXPECT_TRUE(set.contains(15));
+    EXPECT_TRUE(set.contains(20));
+    EXPECT_TRUE(set.contains(105, CALL_FLAG_RENDER));
+    EXPECT_FALSE(set.contains(105, CALL_FLAG_END_FRAME));
+    EXPECT_FALSE(set.contains(111, CALL_FLAG_RENDER));
+    EXPECT_TRUE(set.contains(200));
+    EXPECT_TRUE(set.contains(std::numeric_limits<CallNo>::max()));
+
+    EXPECT_EQ(3u, set.getFirst());
+    EXPECT_EQ(std::numeric_limits<CallNo>::max(), set.getLast());
+}
+
+
+TEST(callset, nextMember)
+{
+    CallSet set;
+    set.merge("3,10-20/5,100-110/draw,1000-1001");
+
+    EXPECT_EQ(3u, set.nextMember(0));
+    EXPECT_EQ(3u, set.nextMember(3));
+    EXPECT_EQ(10u, set.nextMember(4));
+    EXPECT_EQ(15u, set.nextMember(11));
+    EXPECT_EQ(20u, set.nextMember(16));
+    EXPECT_EQ(100u, set.nextMember(21));
+    EXPECT_EQ(107u, set.nextMember(107));
+    EXPECT_EQ(1000u, set.nextMember(111));
+    EXPECT_EQ(1001u, set.nextMember(1001));
+    EXPECT_EQ(CallSet::NO_MEMBER, set.nextMember(1002));
+
+    CallSet empty;
+    EXPECT_EQ(CallSet::NO_MEMBER, empty.nextMember(0));
+}
+
+
+// Compare against a plain list of ranges, querying in and out of order
+TEST(callset, random)
+{
+    srand(1);
+    for (unsigned trial = 0; trial < 100; ++trial) {
+        CallSet set;
+        std::vector<CallRange> ranges;
+        unsigned count = 1 + rand() % 8;
+        for (unsigned i = 0; i < count; ++i) {
+            CallNo start = rand() % 1000;
+            CallNo stop = start + rand() % 200;
+            CallNo step = rand() % 2 ? 1 : 1 + rand() % 7;
+            CallFlags freq = rand() % 3 ? FREQUENCY_ALL : FREQUENCY_RENDER;
+            CallRange range(start, stop, step, freq);
+            set.addRange(range);
+            ranges.push_back(range);
+        }
+
+        for (CallNo callNo = 0; callNo < 1300; ++callNo) {
+            ASSERT_EQ(naiveContains(ranges, callNo, CALL_FLAG_RENDER),
+                      set.contains(callNo, CALL_FLAG_RENDER)) << callNo;
+            ASSERT_EQ(naiveContains(ranges, callNo, 0),
+                      set.contains(callNo, 0)) << callNo;
+        }
+
+        for (unsigned i = 0; i < 1000; ++i) {
+            CallNo callNo = rand() % 1300;
+            ASSERT_EQ(naiveContains(ranges, callNo, CALL_FLAG_RENDER),
+                      set.contains(callNo, CALL_FLAG_RENDER)) << callNo;
+
+            CallNo next = callNo;
+            while (next < 1300 && !naiveContains(ranges, next, FREQUENCY_ALL)) {
+                ++next;
+            }
+            ASSERT_EQ(next < 1300 ? next : CallSet::NO_MEMBER,
+                      set.nextMember(callNo)) << callNo;
+        }
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -69,6 +69,29 @@ FastCallSet::FastCallSet(): head(0, 0, MAX_LEVEL)
     max_level = 0;
 }
 
+void
+FastCallSet::clear(void)
+{
+    FastCallRangePtr node = head.next[0];
+    int i;
+
+    for (i = 0; i < max_level; i++) {
+        head.next[i] = FastCallRangePtr();
+    }
+
+    /* Unlink each node before dropping our reference to it, so that
+     * releasing it does not cascade into its successors. */
+    while (node()) {
+        FastCallRangePtr next = node->next[0];
+        for (i = 0; i < node->level; i++) {
+            node->next[i] = FastCallRangePtr();
+        }
+        node = next;
+    }
+
+    max_level = 0;
+}
+
 /*
  * Generate a random level number, distributed
  * so that each level is 1/4 as likely as the one before
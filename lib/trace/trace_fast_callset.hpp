@@ -129,6 +129,10 @@ public:
 
     bool empty(void) const;
 
+    // Release all ranges.  Unlike letting the set go out of scope, this
+    // does not recurse once per range, so it is safe on very long lists.
+    void clear(void);
+
     void add(CallNo first, CallNo last);
 
     void add(CallNo call_no);
@@ -29,6 +29,8 @@
 #include <fstream>
 #include <stdint.h>
 
+#include <functional>
+
 
 namespace trace {
 
@@ -48,6 +50,20 @@ public:
     static File *createBrotli(void);
     static File *createSnappy(void);
     static File *createForRead(const char *filename);
+
+    struct Chunk {
+        uint64_t offset;
+        size_t compressedSize;
+        size_t uncompressedSize;
+        unsigned codec;  // SNAPPY_CODEC_xxx
+    };
+    typedef std::function<void (const Chunk &)> ChunkCallback;
+
+    /**
+     * Enumerate the chunks of a snappy compressed trace, reading only their
+     * headers.  Returns false if the file isn't snappy compressed.
+     */
+    static bool scanSnappyChunks(const char *filename, const ChunkCallback &callback);
 public:
     File(void);
     virtual ~File();
@@ -61,6 +77,14 @@ public:
     bool skip(size_t length);
     int percentRead(void);
 
+    /**
+     * Uncompressed bytes read or skipped since opened.  Not meaningful after
+     * setCurrentOffset.
+     */
+    uint64_t position(void) const {
+        return m_position;
+    }
+
     virtual bool supportsOffsets(void) const;
     virtual File::Offset currentOffset(void) const;
     virtual void setCurrentOffset(const File::Offset &offset);
@@ -74,6 +98,7 @@ protected:
 
 protected:
     bool m_isOpened = false;
+    uint64_t m_position = 0;
 };
 
 inline bool File::isOpened(void) const
@@ -87,6 +112,7 @@ inline bool File::open(const char *filename)
         close();
     }
     m_isOpened = rawOpen(filename);
+    m_position = 0;
 
     return m_isOpened;
 }
@@ -96,7 +122,9 @@ inline size_t File::read(void *buffer, size_t length)
     if (!m_isOpened) {
         return 0;
     }
-    return rawRead(buffer, length);
+    size_t result = rawRead(buffer, length);
+    m_position += result;
+    return result;
 }
 
 inline int File::percentRead(void)
@@ -120,7 +148,11 @@ inline int File::getc(void)
     if (!m_isOpened) {
         return -1;
     }
-    return rawGetc();
+    int c = rawGetc();
+    if (c != -1) {
+        ++m_position;
+    }
+    return c;
 }
 
 inline bool File::skip(size_t length)
@@ -128,7 +160,11 @@ inline bool File::skip(size_t length)
     if (!m_isOpened) {
         return false;
     }
-    return rawSkip(length);
+    if (!rawSkip(length)) {
+        return false;
+    }
+    m_position += length;
+    return true;
 }
 
 
@@ -34,10 +34,22 @@
  *
  * The file is composed of a number of chunks, they are:
  * chunk {
- *     uint32 - specifying the length of the compressed data
- *     compressed data, in little endian
+ *     uint32 - specifying the length of the compressed data, in little
+ *              endian
+ *     compressed data
  * }
  * File can contain any number of such chunks.
+ *
+ * Files starting with SNAPPY_BYTE2_CODECS rather than SNAPPY_BYTE2 keep the
+ * length in the lower 28 bits, and the chunk codec in the upper 4 bits.  The
+ * codec is chosen per chunk when writing:
+ * - SNAPPY_CODEC_SNAPPY: snappy compressed data (the only codec in traces
+ *   written by older versions);
+ * - SNAPPY_CODEC_STORED: uncompressed data, for chunks that wouldn't
+ *   compress, such as compressed textures;
+ * - SNAPPY_CODEC_ZLIB: uint32 uncompressed length, in little endian,
+ *   followed by zlib compressed data, for text heavy chunks such as shader
+ *   sources.
  * The default size of an uncompressed chunk is specified in
  * SNAPPY_CHUNK_SIZE.
  *
@@ -53,6 +65,7 @@
 
 #include <snappy.h>
 #include <snappy-sinksource.h>
+#include <zlib.h>
 
 #include <iostream>
 #include <algorithm>
@@ -108,6 +121,8 @@ private:
     }
     void flushWriteCache(void);
     void flushReadCache(size_t skipLength = 0);
+    void readStoredChunk(size_t length);
+    void readZlibChunk(size_t compressedLength, size_t skipLength);
     void createCache(size_t size);
     size_t readCompressedLength();
 private:
@@ -118,9 +133,13 @@ private:
     char *m_cachePtr;
 
     char *m_compressedCache;
+    size_t m_compressedCacheSize;
 
     uint64_t m_currentChunkOffset;
     std::streampos m_endPos;
+
+    // Whether chunk lengths carry the codec
+    bool m_codecs;
 };
 
 SnappyFile::SnappyFile(void)
@@ -128,11 +147,11 @@ SnappyFile::SnappyFile(void)
       m_cacheMaxSize(SNAPPY_CHUNK_SIZE),
       m_cacheSize(m_cacheMaxSize),
       m_cache(new char [m_cacheMaxSize]),
-      m_cachePtr(m_cache)
+      m_cachePtr(m_cache),
+      m_codecs(false)
 {
-    size_t maxCompressedLength =
-        snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
-    m_compressedCache = new char[maxCompressedLength];
+    m_compressedCacheSize = snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
+    m_compressedCache = new char[m_compressedCacheSize];
 }
 
 SnappyFile::~SnappyFile()
@@ -159,7 +178,9 @@ bool SnappyFile::rawOpen(const char *filename)
         unsigned char byte1, byte2;
         m_stream >> byte1;
         m_stream >> byte2;
-        assert(byte1 == SNAPPY_BYTE1 && byte2 == SNAPPY_BYTE2);
+        assert(byte1 == SNAPPY_BYTE1 &&
+               (byte2 == SNAPPY_BYTE2 || byte2 == SNAPPY_BYTE2_CODECS));
+        m_codecs = byte2 == SNAPPY_BYTE2_CODECS;
 
         flushReadCache();
     }
@@ -218,12 +239,38 @@ void SnappyFile::flushReadCache(size_t skipLength)
     m_currentChunkOffset = m_stream.tellg();
     size_t compressedLength;
     compressedLength = readCompressedLength();
+    unsigned codec = SNAPPY_CODEC_SNAPPY;
+    if (m_codecs) {
+        codec = compressedLength >> SNAPPY_CHUNK_CODEC_SHIFT;
+        compressedLength &= SNAPPY_CHUNK_LENGTH_MASK;
+    }
     if (!compressedLength) {
         // Reached end of file
         createCache(0);
         return;
     }
 
+    switch (codec) {
+    case SNAPPY_CODEC_SNAPPY:
+        break;
+    case SNAPPY_CODEC_STORED:
+        readStoredChunk(compressedLength);
+        return;
+    case SNAPPY_CODEC_ZLIB:
+        readZlibChunk(compressedLength, skipLength);
+        return;
+    default:
+        std::cerr << "error: unsupported chunk codec " << codec << "\n";
+        createCache(0);
+        return;
+    }
+
+    if (compressedLength > m_compressedCacheSize) {
+        std::cerr << "error: chunk too large\n";
+        createCache(0);
+        return;
+    }
+
     m_stream.read((char*)m_compressedCache, compressedLength);
     if (m_stream.fail()) {
         std::cerr << "warning: unexpected end of file while reading trace\n";
@@ -257,6 +304,50 @@ void SnappyFile::flushReadCache(size_t skipLength)
     }
 }
 
+void SnappyFile::readStoredChunk(size_t length)
+{
+    createCache(length);
+    m_stream.read(m_cache, length);
+    if (m_stream.fail()) {
+        std::cerr << "warning: unexpected end of file while reading trace\n";
+        m_cacheSize = m_stream.gcount();
+    }
+}
+
+void SnappyFile::readZlibChunk(size_t compressedLength, size_t skipLength)
+{
+    if (compressedLength > m_compressedCacheSize || compressedLength < 4) {
+        std::cerr << "error: invalid zlib chunk\n";
+        createCache(0);
+        return;
+    }
+
+    m_stream.read(m_compressedCache, compressedLength);
+    if (m_stream.fail()) {
+        std::cerr << "warning: unexpected end of file while reading trace\n";
+        createCache(0);
+        return;
+    }
+
+    const unsigned char *buf = (const unsigned char *)m_compressedCache;
+    size_t uncompressedLength;
+    uncompressedLength  =  (size_t)buf[0];
+    uncompressedLength |= ((size_t)buf[1] <<  8);
+    uncompressedLength |= ((size_t)buf[2] << 16);
+    uncompressedLength |= ((size_t)buf[3] << 24);
+
+    createCache(uncompressedLength);
+    if (skipLength < uncompressedLength) {
+        uLongf destLength = uncompressedLength;
+        if (uncompress((Bytef *)m_cache, &destLength,
+                       (const Bytef *)m_compressedCache + 4,
+                       compressedLength - 4) != Z_OK) {
+            std::cerr << "error: failed to decompress chunk\n";
+            createCache(0);
+        }
+    }
+}
+
 void SnappyFile::createCache(size_t size)
 {
     if (size > m_cacheMaxSize) {
@@ -351,3 +442,77 @@ int SnappyFile::rawPercentRead(void)
 File* File::createSnappy(void) {
     return new SnappyFile;
 }
+
+
+bool File::scanSnappyChunks(const char *filename, const ChunkCallback &callback)
+{
+    std::ifstream stream(filename, std::fstream::binary | std::fstream::in);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    char magic[2];
+    stream.read(magic, sizeof magic);
+    if (stream.fail() ||
+        magic[0] != SNAPPY_BYTE1 ||
+        (magic[1] != SNAPPY_BYTE2 && magic[1] != SNAPPY_BYTE2_CODECS)) {
+        return false;
+    }
+    bool codecs = magic[1] == SNAPPY_BYTE2_CODECS;
+
+    while (true) {
+        File::Chunk chunk;
+        chunk.offset = stream.tellg();
+
+        unsigned char buf[4];
+        stream.read((char *)buf, sizeof buf);
+        if (stream.fail()) {
+            break;
+        }
+        chunk.compressedSize  =  (size_t)buf[0];
+        chunk.compressedSize |= ((size_t)buf[1] <<  8);
+        chunk.compressedSize |= ((size_t)buf[2] << 16);
+        chunk.compressedSize |= ((size_t)buf[3] << 24);
+        chunk.codec = SNAPPY_CODEC_SNAPPY;
+        if (codecs) {
+            chunk.codec = chunk.compressedSize >> SNAPPY_CHUNK_CODEC_SHIFT;
+            chunk.compressedSize &= SNAPPY_CHUNK_LENGTH_MASK;
+        }
+        if (!chunk.compressedSize) {
+            break;
+        }
+
+        size_t headerSize = 0;
+        if (chunk.codec == SNAPPY_CODEC_STORED) {
+            chunk.uncompressedSize = chunk.compressedSize;
+        } else if (chunk.codec == SNAPPY_CODEC_ZLIB) {
+            // The uncompressed length precedes the zlib stream
+            headerSize = sizeof buf;
+            stream.read((char *)buf, sizeof buf);
+            if (stream.fail() || chunk.compressedSize < headerSize) {
+                break;
+            }
+            chunk.uncompressedSize  =  (size_t)buf[0];
+            chunk.uncompressedSize |= ((size_t)buf[1] <<  8);
+            chunk.uncompressedSize |= ((size_t)buf[2] << 16);
+            chunk.uncompressedSize |= ((size_t)buf[3] << 24);
+        } else if (chunk.codec == SNAPPY_CODEC_SNAPPY) {
+            // The uncompressed length is a varint at the start of the chunk
+            char header[5];
+            headerSize = std::min(sizeof header, chunk.compressedSize);
+            stream.read(header, headerSize);
+            if (stream.fail() ||
+                !snappy::GetUncompressedLength(header, headerSize, &chunk.uncompressedSize)) {
+                break;
+            }
+        } else {
+            break;
+        }
+
+        callback(chunk);
+
+        stream.seekg(chunk.compressedSize - headerSize, std::ios::cur);
+    }
+
+    return true;
+}
@@ -0,0 +1,197 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_file.hpp"
+#include "trace_ostream.hpp"
+#include "trace_snappy.hpp"
+
+using namespace trace;
+
+
+#define CHUNK_SIZE (1024 * 1024)
+
+static const char *filename = "trace_file_snappy_test.trace";
+
+
+/*
+ * Chunk contents which the writer compresses with each codec.
+ */
+
+static void
+appendRandom(std::vector<char> &data)
+{
+    uint32_t state = 1;
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+        state = state * 1664525 + 1013904223;
+        data.push_back(char(state >> 24));
+    }
+}
+
+static void
+appendText(std::vector<char> &data)
+{
+    size_t end = data.size() + CHUNK_SIZE;
+    for (unsigned line = 0; data.size() < end; ++line) {
+        char buf[64];
+        snprintf(buf, sizeof buf, "uniform vec4 color%u;\n", line);
+        for (const char *p = buf; *p && data.size() < end; ++p) {
+            data.push_back(*p);
+        }
+    }
+}
+
+static void
+appendBinary(std::vector<char> &data)
+{
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+        data.push_back(char((i / 16) % 8));
+    }
+}
+
+
+class SnappyCodecs : public ::testing::Test
+{
+protected:
+    std::vector<char> data;
+
+    void
+    SetUp(void) override {
+        appendRandom(data);
+        appendText(data);
+        appendBinary(data);
+        // Partial last chunk
+        data.insert(data.end(), data.begin() + CHUNK_SIZE, data.begin() + CHUNK_SIZE + 1000);
+
+        std::unique_ptr<OutStream> stream(createSnappyStream(filename));
+        ASSERT_TRUE(stream != nullptr);
+        EXPECT_TRUE(stream->write(data.data(), data.size()));
+    }
+
+    void
+    TearDown(void) override {
+        remove(filename);
+    }
+};
+
+
+TEST_F(SnappyCodecs, chunks)
+{
+    std::vector<File::Chunk> chunks;
+    EXPECT_TRUE(File::scanSnappyChunks(filename, [&] (const File::Chunk &chunk) {
+        chunks.push_back(chunk);
+    }));
+
+    ASSERT_EQ(4u, chunks.size());
+    EXPECT_EQ(unsigned(SNAPPY_CODEC_STORED), chunks[0].codec);
+    EXPECT_EQ(unsigned(SNAPPY_CODEC_ZLIB), chunks[1].codec);
+    EXPECT_EQ(unsigned(SNAPPY_CODEC_SNAPPY), chunks[2].codec);
+    EXPECT_EQ(unsigned(SNAPPY_CODEC_ZLIB), chunks[3].codec);
+
+    EXPECT_EQ(size_t(CHUNK_SIZE), chunks[0].compressedSize);
+    for (unsigned i = 0; i < 3; ++i) {
+        EXPECT_EQ(size_t(CHUNK_SIZE), chunks[i].uncompressedSize);
+    }
+    EXPECT_EQ(1000u, chunks[3].uncompressedSize);
+}
+
+
+TEST_F(SnappyCodecs, read)
+{
+    std::unique_ptr<File> file(File::createForRead(filename));
+    ASSERT_TRUE(file != nullptr);
+
+    std::vector<char> actual(data.size() + 1);
+    EXPECT_EQ(data.size(), file->read(actual.data(), actual.size()));
+    actual.resize(data.size());
+    EXPECT_TRUE(actual == data);
+}
+
+
+TEST_F(SnappyCodecs, skip)
+{
+    std::unique_ptr<File> file(File::createForRead(filename));
+    ASSERT_TRUE(file != nullptr);
+
+    // Skip over the whole stored and zlib chunks, into the snappy one
+    size_t position = 2 * CHUNK_SIZE + 123;
+    EXPECT_TRUE(file->skip(position));
+
+    char buf[256];
+    ASSERT_EQ(sizeof buf, file->read(buf, sizeof buf));
+    EXPECT_EQ(0, memcmp(buf, &data[position], sizeof buf));
+}
+
+
+TEST_F(SnappyCodecs, offsets)
+{
+    std::unique_ptr<File> file(File::createForRead(filename));
+    ASSERT_TRUE(file != nullptr);
+    ASSERT_TRUE(file->supportsOffsets());
+
+    // A position within each chunk
+    static const size_t positions[] = {
+        100,
+        CHUNK_SIZE + 200,
+        2 * CHUNK_SIZE + 300,
+        3 * CHUNK_SIZE + 400,
+    };
+    const unsigned count = sizeof positions / sizeof positions[0];
+
+    File::Offset offsets[count];
+    size_t position = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        ASSERT_TRUE(file->skip(positions[i] - position));
+        position = positions[i];
+        offsets[i] = file->currentOffset();
+        EXPECT_EQ(positions[i] % CHUNK_SIZE, offsets[i].offsetInChunk);
+    }
+
+    // Revisit them backwards, reading across the end of each chunk
+    for (unsigned i = count; i-- > 0; ) {
+        file->setCurrentOffset(offsets[i]);
+
+        size_t length = std::min<size_t>(CHUNK_SIZE, data.size() - positions[i]);
+        std::vector<char> buf(length);
+        ASSERT_EQ(length, file->read(buf.data(), length));
+        EXPECT_EQ(0, memcmp(buf.data(), &data[positions[i]], length));
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -31,10 +31,21 @@
 
 #pragma once
 
+#include <stddef.h>
+
+#include <algorithm>
+#include <type_traits>
+
 namespace trace {
 
 
-#define TRACE_VERSION 5
+#define TRACE_VERSION 6
+
+
+/*
+ * First line of the text manifest describing a segmented trace.
+ */
+#define TRACE_SEGMENTS_MAGIC "apitrace-segments"
 
 
 enum Event {
@@ -48,6 +59,7 @@ enum CallDetail {
     CALL_RET,
     CALL_THREAD,
     CALL_BACKTRACE,
+    CALL_STACK,
 };
 
 enum Type {
@@ -67,8 +79,77 @@ enum Type {
     TYPE_OPAQUE,
     TYPE_REPR,
     TYPE_WSTRING,
+    TYPE_PACKED_ARRAY,
+};
+
+/*
+ * Element types of packed arrays.
+ */
+enum PackedType {
+    PACKED_SINT8 = 0,
+    PACKED_UINT8,
+    PACKED_SINT16,
+    PACKED_UINT16,
+    PACKED_SINT32,
+    PACKED_UINT32,
+    PACKED_SINT64,
+    PACKED_UINT64,
+    PACKED_FLOAT,
+    PACKED_DOUBLE,
 };
 
+/*
+ * Size in bytes of each element of packed arrays, or zero for unknown types.
+ */
+inline size_t
+getPackedTypeSize(int type) {
+    switch (type) {
+    case PACKED_SINT8:
+    case PACKED_UINT8:
+        return 1;
+    case PACKED_SINT16:
+    case PACKED_UINT16:
+        return 2;
+    case PACKED_SINT32:
+    case PACKED_UINT32:
+    case PACKED_FLOAT:
+        return 4;
+    case PACKED_SINT64:
+    case PACKED_UINT64:
+    case PACKED_DOUBLE:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Reverse the bytes of each element of a packed array.  Packed arrays are
+ * little endian in the trace, so this is needed on big endian hosts only.
+ */
+inline void
+swapPackedBytes(char *data, size_t size, size_t count) {
+    if (size > 1) {
+        for (size_t i = 0; i < count; ++i, data += size) {
+            std::reverse(data, data + size);
+        }
+    }
+}
+
+/*
+ * Packed element type matching the C type T.
+ */
+template< class T >
+inline PackedType
+getPackedType(void) {
+    static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8, "not a number");
+    if (std::is_floating_point<T>::value) {
+        return sizeof(T) == 4 ? PACKED_FLOAT : PACKED_DOUBLE;
+    }
+    unsigned log2Size = sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3;
+    return PackedType(PACKED_SINT8 + 2 * log2Size + (std::is_signed<T>::value ? 0 : 1));
+}
+
 enum BacktraceDetail {
     BACKTRACE_END = 0,
     BACKTRACE_MODULE,
@@ -81,6 +81,15 @@ Array::~Array() {
 }
 
 
+PackedArray::~PackedArray() {
+    for (auto & value : values) {
+        value->~Value();
+    }
+    // Don't let ~Array delete them
+    values.clear();
+}
+
+
 #define BLOB_MAX_BOUND_SIZE (1*1024*1024*1024)
 
 class BoundBlob {
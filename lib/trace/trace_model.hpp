@@ -34,9 +34,13 @@
 #include <stdlib.h>
 
 #include <map>
+#include <new>
+#include <type_traits>
 #include <vector>
 #include <ostream>
 
+#include "trace_format.hpp"
+
 
 namespace trace {
 
@@ -94,6 +98,7 @@ class Visitor;
 class Null;
 class Struct;
 class Array;
+class PackedArray;
 class Blob;
 
 
@@ -120,6 +125,8 @@ public:
     virtual const Array *toArray(void) const { return NULL; }
     virtual Array *toArray(void) { return NULL; }
 
+    virtual const PackedArray *toPackedArray(void) const { return NULL; }
+
     virtual const Struct *toStruct(void) const { return NULL; }
     virtual Struct *toStruct(void) { return NULL; }
 
@@ -327,6 +334,54 @@ public:
 };
 
 
+/*
+ * Array of numbers read from a packed array.  The elements are constructed
+ * in a single block rather than allocated one by one, and the raw elements
+ * are kept too, so they can be used as is.
+ */
+class PackedArray : public Array
+{
+public:
+    PackedArray(PackedType _type, size_t len) :
+        Array(len),
+        type(_type),
+        data(len * getPackedTypeSize(_type)),
+        elements(len)
+    {}
+    ~PackedArray();
+
+    const PackedArray *toPackedArray(void) const override { return this; }
+
+    template< class T, class V >
+    inline void
+    set(size_t index, V value) {
+        values[index] = new (&elements[index]) T(value);
+    }
+
+    /*
+     * The raw elements, if they were written from an array of T, or NULL
+     * otherwise.
+     */
+    template< class T >
+    inline const T *
+    get(void) const {
+        if (type != getPackedType<T>() || data.empty()) {
+            return NULL;
+        }
+        return reinterpret_cast<const T *>(data.data());
+    }
+
+    const PackedType type;
+
+    // Elements in host byte order
+    std::vector<char> data;
+
+private:
+    typedef std::aligned_union<0, SInt, UInt, Float, Double>::type Element;
+    std::vector<Element> elements;
+};
+
+
 class Blob : public Value
 {
 public:
@@ -0,0 +1,485 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "trace_ostream_file.hpp"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <vector>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "os.hpp"
+#include "os_process.hpp"
+#include "os_thread.hpp"
+
+
+namespace trace {
+
+
+class StdOutFile : public OutFile {
+public:
+    StdOutFile(const char *filename) {
+        std::ios_base::openmode fmode = std::fstream::binary
+                                      | std::fstream::out
+                                      | std::fstream::trunc;
+        m_stream.open(filename, fmode);
+    }
+
+    bool isOpen(void) {
+        return m_stream.is_open();
+    }
+
+    bool write(const void *buffer, size_t length) override {
+        m_stream.write((const char *)buffer, length);
+        return !m_stream.fail();
+    }
+
+    void flush(void) override {
+        m_stream.flush();
+    }
+
+private:
+    std::ofstream m_stream;
+};
+
+
+#ifdef __linux__
+
+
+/*
+ * Writes are gathered in staging buffers, which are written with pwrite once
+ * full, either inline or by a dedicated thread.  With O_DIRECT the buffers,
+ * offsets, and lengths must all be block aligned, so only whole blocks are
+ * written, and the last partial block is padded when flushing and written
+ * again once complete.
+ */
+class PosixOutFile : public OutFile {
+public:
+    PosixOutFile(void);
+    ~PosixOutFile();
+
+    bool open(const char *filename);
+
+    bool write(const void *buffer, size_t length) override;
+    void flush(void) override;
+
+private:
+    struct Buffer {
+        char *data;
+        size_t length;
+        unsigned long long offset;
+    };
+
+    enum {
+        ALIGNMENT = 4096,
+        BUFFER_SIZE = 2 * 1024 * 1024,
+        // Write once this much is gathered
+        BUFFER_THRESHOLD = 1024 * 1024,
+        // Block the application beyond this many buffers in flight, which
+        // are then kept around for reuse
+        MAX_PENDING = 8,
+        PREALLOCATE_SIZE = 64 * 1024 * 1024,
+    };
+
+    Buffer allocBuffer(void);
+    void freeBuffer(Buffer &buffer);
+    void submit(bool partial);
+    void enqueue(Buffer &buffer);
+    void writeBuffer(const Buffer &buffer);
+    void threadFunction(void);
+
+    int m_fd;
+    bool m_direct;
+    bool m_async;
+    os::ProcessId m_pid;
+
+    // Staging buffer, and the file size
+    Buffer m_buffer;
+    unsigned long long m_size;
+
+    // State shared with the writer thread.  It's kept apart so that a
+    // forked child can leak it, as the child has no writer thread, and
+    // destroying a condition variable with waiters would block.
+    struct Queue {
+        os::mutex mutex;
+        os::condition_variable pendingCond;
+        os::condition_variable doneCond;
+        std::deque<Buffer> pending;
+        std::vector<Buffer> free;
+        unsigned busy = 0;
+        bool quit = false;
+        os::thread thread;
+    };
+    Queue *m_queue;
+
+    // Only touched while writing
+    unsigned long long m_allocated;
+    bool m_preallocate;
+    std::atomic<bool> m_failed;
+};
+
+
+PosixOutFile::PosixOutFile(void) :
+    m_fd(-1),
+    m_direct(false),
+    m_async(false),
+    m_pid(os::getCurrentProcessId()),
+    m_size(0),
+    m_queue(new Queue),
+    m_allocated(0),
+    m_preallocate(true),
+    m_failed(false)
+{
+    m_buffer.data = nullptr;
+}
+
+
+static bool
+getBoolEnv(const char *name, bool defaultValue)
+{
+    const char *value = getenv(name);
+    if (!value || !*value) {
+        return defaultValue;
+    }
+    return strcmp(value, "0") != 0;
+}
+
+
+bool
+PosixOutFile::open(const char *filename)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    m_direct = getBoolEnv("TRACE_DIRECT_IO", false);
+    if (m_direct) {
+        m_fd = ::open(filename, flags | O_DIRECT, 0666);
+        if (m_fd < 0) {
+            // Not all file systems support it (e.g., tmpfs)
+            os::log("apitrace: warning: O_DIRECT not supported for %s\n", filename);
+            m_direct = false;
+        }
+    }
+    if (m_fd < 0) {
+        m_fd = ::open(filename, flags, 0666);
+        if (m_fd < 0) {
+            return false;
+        }
+    }
+
+    m_buffer = allocBuffer();
+    m_buffer.offset = 0;
+
+    m_async = getBoolEnv("TRACE_ASYNC_WRITE", true);
+    if (m_async) {
+        m_queue->thread = os::thread(&PosixOutFile::threadFunction, this);
+    }
+
+    return true;
+}
+
+
+PosixOutFile::~PosixOutFile()
+{
+    if (m_fd < 0) {
+        delete m_queue;
+        return;
+    }
+
+    if (os::getCurrentProcessId() != m_pid) {
+        // We are a forked child, where the writer thread doesn't exist, and
+        // the parent owns the file contents, so merely let go of the file.
+        ::close(m_fd);
+        return;
+    }
+
+    flush();
+
+    if (m_async) {
+        {
+            os::unique_lock<os::mutex> lock(m_queue->mutex);
+            m_queue->quit = true;
+        }
+        m_queue->pendingCond.notify_one();
+        m_queue->thread.join();
+    }
+
+    if (m_direct) {
+        // Drop the padding of the last block
+        if (ftruncate(m_fd, m_size) != 0) {
+            os::log("apitrace: warning: failed to truncate trace\n");
+        }
+    }
+    ::close(m_fd);
+
+    freeBuffer(m_buffer);
+    for (auto & buffer : m_queue->free) {
+        freeBuffer(buffer);
+    }
+    delete m_queue;
+}
+
+
+PosixOutFile::Buffer
+PosixOutFile::allocBuffer(void)
+{
+    Buffer buffer;
+    {
+        os::unique_lock<os::mutex> lock(m_queue->mutex);
+        if (!m_queue->free.empty()) {
+            buffer = m_queue->free.back();
+            m_queue->free.pop_back();
+            buffer.length = 0;
+            return buffer;
+        }
+    }
+
+    void *data = nullptr;
+    if (posix_memalign(&data, ALIGNMENT, BUFFER_SIZE) != 0) {
+        os::log("apitrace: error: out of memory\n");
+        os::abort();
+    }
+    buffer.data = (char *)data;
+    buffer.length = 0;
+    buffer.offset = 0;
+    return buffer;
+}
+
+
+void
+PosixOutFile::freeBuffer(Buffer &buffer)
+{
+    free(buffer.data);
+    buffer.data = nullptr;
+}
+
+
+bool
+PosixOutFile::write(const void *data, size_t length)
+{
+    if (os::getCurrentProcessId() != m_pid) {
+        // The file belongs to the parent process
+        return false;
+    }
+
+    const char *src = (const char *)data;
+    while (length) {
+        size_t size = std::min<size_t>(BUFFER_SIZE - m_buffer.length, length);
+        memcpy(m_buffer.data + m_buffer.length, src, size);
+        m_buffer.length += size;
+        m_size += size;
+        src += size;
+        length -= size;
+        if (m_buffer.length == BUFFER_SIZE) {
+            submit(false);
+        }
+    }
+
+    if (m_buffer.length >= BUFFER_THRESHOLD) {
+        submit(false);
+    }
+
+    return !m_failed;
+}
+
+
+void
+PosixOutFile::submit(bool partial)
+{
+    size_t length = m_buffer.length;
+    if (m_direct) {
+        length &= ~size_t(ALIGNMENT - 1);
+    }
+
+    if (length) {
+        Buffer next = allocBuffer();
+        next.offset = m_buffer.offset + length;
+        next.length = m_buffer.length - length;
+        memcpy(next.data, m_buffer.data + length, next.length);
+
+        m_buffer.length = length;
+        enqueue(m_buffer);
+        m_buffer = next;
+    }
+
+    if (partial && m_buffer.length) {
+        // Write a zero padded copy of the last block, which will be written
+        // again once complete.
+        assert(m_direct);
+        Buffer tail = allocBuffer();
+        tail.offset = m_buffer.offset;
+        tail.length = ALIGNMENT;
+        memcpy(tail.data, m_buffer.data, m_buffer.length);
+        memset(tail.data + m_buffer.length, 0, ALIGNMENT - m_buffer.length);
+        enqueue(tail);
+    }
+}
+
+
+void
+PosixOutFile::enqueue(Buffer &buffer)
+{
+    if (!m_async) {
+        writeBuffer(buffer);
+        os::unique_lock<os::mutex> lock(m_queue->mutex);
+        m_queue->free.push_back(buffer);
+        return;
+    }
+
+    {
+        os::unique_lock<os::mutex> lock(m_queue->mutex);
+        while (m_queue->pending.size() >= MAX_PENDING) {
+            m_queue->doneCond.wait(lock);
+        }
+        m_queue->pending.push_back(buffer);
+    }
+    m_queue->pendingCond.notify_one();
+}
+
+
+void
+PosixOutFile::flush(void)
+{
+    if (os::getCurrentProcessId() != m_pid) {
+        return;
+    }
+
+    submit(true);
+
+    if (m_async) {
+        os::unique_lock<os::mutex> lock(m_queue->mutex);
+        while (!m_queue->pending.empty() || m_queue->busy) {
+            m_queue->doneCond.wait(lock);
+        }
+    }
+}
+
+
+void
+PosixOutFile::writeBuffer(const Buffer &buffer)
+{
+    unsigned long long end = buffer.offset + buffer.length;
+
+    // Reserve the extents well ahead, to avoid fragmentation and the cost
+    // of allocating blocks on every write
+    if (m_preallocate && end > m_allocated) {
+        unsigned long long size = end - m_allocated + PREALLOCATE_SIZE;
+        if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, m_allocated, size) == 0) {
+            m_allocated += size;
+        } else {
+            m_preallocate = false;
+        }
+    }
+
+    const char *data = buffer.data;
+    size_t length = buffer.length;
+    off_t offset = buffer.offset;
+    while (length) {
+        ssize_t written = pwrite(m_fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!m_failed) {
+                os::log("apitrace: error: failed to write trace (%s)\n", strerror(errno));
+                m_failed = true;
+            }
+            return;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+}
+
+
+void
+PosixOutFile::threadFunction(void)
+{
+    Queue *queue = m_queue;
+    os::unique_lock<os::mutex> lock(queue->mutex);
+    while (true) {
+        while (queue->pending.empty() && !queue->quit) {
+            queue->pendingCond.wait(lock);
+        }
+        if (queue->pending.empty()) {
+            break;
+        }
+
+        Buffer buffer = queue->pending.front();
+        queue->pending.pop_front();
+        ++queue->busy;
+
+        lock.unlock();
+        writeBuffer(buffer);
+        lock.lock();
+
+        --queue->busy;
+        if (queue->free.size() < MAX_PENDING) {
+            queue->free.push_back(buffer);
+        } else {
+            freeBuffer(buffer);
+        }
+        queue->doneCond.notify_all();
+    }
+}
+
+
+#endif /* __linux__ */
+
+
+OutFile *
+createOutFile(const char *filename)
+{
+#ifdef __linux__
+    PosixOutFile *file = new PosixOutFile;
+    if (!file->open(filename)) {
+        delete file;
+        return nullptr;
+    }
+    return file;
+#else
+    StdOutFile *file = new StdOutFile(filename);
+    if (!file->isOpen()) {
+        delete file;
+        return nullptr;
+    }
+    return file;
+#endif
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,63 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Unbuffered output files, where the (compressed) bytes of an OutStream are
+ * written to.
+ */
+
+
+#pragma once
+
+#include <stddef.h>
+
+
+namespace trace {
+
+
+class OutFile {
+public:
+    virtual ~OutFile() {}
+
+    virtual bool write(const void *buffer, size_t length) = 0;
+
+    /* Wait until everything written so far was handed to the OS. */
+    virtual void flush(void) = 0;
+};
+
+
+/**
+ * Create a file for writing, truncating it.
+ *
+ * On Linux the file is written with pwrite, from a dedicated thread unless
+ * TRACE_ASYNC_WRITE=0, so that the traced application doesn't stall on disk
+ * I/O.  File extents are preallocated ahead of the writes, and
+ * TRACE_DIRECT_IO=1 bypasses the page cache with O_DIRECT.
+ */
+OutFile *
+createOutFile(const char *filename);
+
+
+} /* namespace trace */
@@ -27,14 +27,17 @@
 
 #include "trace_ostream.hpp"
 
-#include <fstream>
+#include <algorithm>
 
 #include <assert.h>
+#include <math.h>
 #include <string.h>
 
 #include <snappy.h>
+#include <zlib.h>
 
 #include "os.hpp"
+#include "trace_ostream_file.hpp"
 #include "trace_snappy.hpp"
 
 
@@ -44,6 +47,49 @@
 using namespace trace;
 
 
+/*
+ * Pick the codec for a chunk from the byte histogram of a sample of it.
+ *
+ * Chunks with nearly 8 bits of entropy per byte (compressed textures, etc.)
+ * won't shrink, so they are stored as is, whereas chunks which are mostly
+ * text (shader sources, etc.) are worth the extra effort of zlib.
+ */
+static unsigned
+chooseCodec(const char *data, size_t length)
+{
+    // Odd stride, so the sample doesn't alias with power of two strides
+    size_t stride = (length / 8192) | 1;
+
+    unsigned histogram[256] = {0};
+    size_t samples = 0;
+    size_t text = 0;
+    for (size_t i = 0; i < length; i += stride) {
+        unsigned char c = data[i];
+        ++histogram[c];
+        ++samples;
+        if ((c >= 0x20 && c < 0x7f) || c == '\n' || c == '\t' || c == '\r') {
+            ++text;
+        }
+    }
+
+    double entropy = 0.0;
+    for (unsigned count : histogram) {
+        if (count) {
+            double p = double(count) / double(samples);
+            entropy -= p * log2(p);
+        }
+    }
+
+    if (entropy > 7.5) {
+        return SNAPPY_CODEC_STORED;
+    }
+    if (text * 10 >= samples * 9) {
+        return SNAPPY_CODEC_ZLIB;
+    }
+    return SNAPPY_CODEC_SNAPPY;
+}
+
+
 class SnappyOutStream : public OutStream {
 public:
     SnappyOutStream(const char *filename);
@@ -53,7 +99,7 @@ public:
     bool write(const void *buffer, size_t length) override;
     void flush(void) override;
     bool isOpen(void) {
-        return m_stream.is_open();
+        return m_file != nullptr;
     }
 
 
@@ -74,21 +120,18 @@ private:
             return 0;
         }
     }
-    inline bool endOfData(void) const
-    {
-        return m_stream.eof() && freeCacheSize() == 0;
-    }
     void flushWriteCache(void);
     void createCache(size_t size);
-    void writeCompressedLength(size_t length);
+    void writeCompressedLength(size_t length, unsigned codec);
 private:
-    std::ofstream m_stream;
+    OutFile *m_file;
     size_t m_cacheMaxSize;
     size_t m_cacheSize;
     char *m_cache;
     char *m_cachePtr;
 
     char *m_compressedCache;
+    size_t m_compressedCacheSize;
 };
 
 SnappyOutStream::SnappyOutStream(const char *filename)
@@ -97,18 +140,16 @@ SnappyOutStream::SnappyOutStream(const char *filename)
       m_cache(new char [m_cacheMaxSize]),
       m_cachePtr(m_cache)
 {
-    size_t maxCompressedLength =
-        snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE);
-    m_compressedCache = new char[maxCompressedLength];
+    // Room for either a snappy or a zlib chunk
+    m_compressedCacheSize = std::max<size_t>(
+        snappy::MaxCompressedLength(SNAPPY_CHUNK_SIZE),
+        4 + compressBound(SNAPPY_CHUNK_SIZE));
+    m_compressedCache = new char[m_compressedCacheSize];
     
-    std::ios_base::openmode fmode = std::fstream::binary
-                                  | std::fstream::out
-                                  | std::fstream::trunc;
-    m_stream.open(filename, fmode);
-    if (m_stream.is_open()) {
-        m_stream << SNAPPY_BYTE1;
-        m_stream << SNAPPY_BYTE2;
-        m_stream.flush();
+    m_file = createOutFile(filename);
+    if (m_file) {
+        const char header[2] = {SNAPPY_BYTE1, SNAPPY_BYTE2_CODECS};
+        m_file->write(header, sizeof header);
     }
 }
 
@@ -151,8 +192,11 @@ bool SnappyOutStream::write(const void *buffer, size_t length)
 
 void SnappyOutStream::close(void)
 {
-    flushWriteCache();
-    m_stream.close();
+    if (m_file) {
+        flushWriteCache();
+        delete m_file;
+        m_file = nullptr;
+    }
     delete [] m_cache;
     m_cache = NULL;
     m_cachePtr = NULL;
@@ -161,7 +205,7 @@ void SnappyOutStream::close(void)
 void SnappyOutStream::flush(void)
 {
     flushWriteCache();
-    m_stream.flush();
+    m_file->flush();
 }
 
 void SnappyOutStream::flushWriteCache(void)
@@ -169,27 +213,57 @@ void SnappyOutStream::flushWriteCache(void)
     size_t inputLength = usedCacheSize();
 
     if (inputLength) {
-        size_t compressedLength;
+        unsigned codec = chooseCodec(m_cache, inputLength);
+        size_t compressedLength = 0;
+
+        if (codec == SNAPPY_CODEC_ZLIB) {
+            uLongf zlibLength = m_compressedCacheSize - 4;
+            if (compress2((Bytef *)m_compressedCache + 4, &zlibLength,
+                          (const Bytef *)m_cache, inputLength,
+                          Z_BEST_SPEED) == Z_OK) {
+                size_t length = inputLength;
+                unsigned char *buf = (unsigned char *)m_compressedCache;
+                buf[0] = length & 0xff; length >>= 8;
+                buf[1] = length & 0xff; length >>= 8;
+                buf[2] = length & 0xff; length >>= 8;
+                buf[3] = length & 0xff;
+                compressedLength = 4 + zlibLength;
+            } else {
+                codec = SNAPPY_CODEC_SNAPPY;
+            }
+        }
 
-        ::snappy::RawCompress(m_cache, inputLength,
-                              m_compressedCache, &compressedLength);
+        if (codec == SNAPPY_CODEC_SNAPPY) {
+            ::snappy::RawCompress(m_cache, inputLength,
+                                  m_compressedCache, &compressedLength);
+            if (compressedLength >= inputLength) {
+                codec = SNAPPY_CODEC_STORED;
+            }
+        }
 
-        writeCompressedLength(compressedLength);
-        m_stream.write(m_compressedCache, compressedLength);
+        if (codec == SNAPPY_CODEC_STORED) {
+            writeCompressedLength(inputLength, codec);
+            m_file->write(m_cache, inputLength);
+        } else {
+            writeCompressedLength(compressedLength, codec);
+            m_file->write(m_compressedCache, compressedLength);
+        }
         m_cachePtr = m_cache;
     }
     assert(m_cachePtr == m_cache);
 }
 
-void SnappyOutStream::writeCompressedLength(size_t length)
+void SnappyOutStream::writeCompressedLength(size_t length, unsigned codec)
 {
+    assert(length <= SNAPPY_CHUNK_LENGTH_MASK);
+    length |= (size_t)codec << SNAPPY_CHUNK_CODEC_SHIFT;
     unsigned char buf[4];
     buf[0] = length & 0xff; length >>= 8;
     buf[1] = length & 0xff; length >>= 8;
     buf[2] = length & 0xff; length >>= 8;
     buf[3] = length & 0xff; length >>= 8;
     assert(length == 0);
-    m_stream.write((const char *)buf, sizeof buf);
+    m_file->write(buf, sizeof buf);
 }
 
 
@@ -0,0 +1,247 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_file.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_file.hpp"
+
+using namespace trace;
+
+
+static const int8_t sint8s[] = {-128, -1, 0, 1, 127};
+static const uint16_t uint16s[] = {0, 1, 0xffff};
+static const int64_t sint64s[] = {INT64_MIN, -1, 0, INT64_MAX};
+static const uint64_t uint64s[] = {0, UINT64_MAX};
+static const float floats[] = {-1.5f, 0.0f, 0.25f};
+static const double doubles[] = {-1.5, 0.0, 1e100};
+
+
+template< class T >
+static void
+writePacked(Writer &writer, const T *values, size_t count)
+{
+    unsigned call = writer.beginEnter(&fooSig, 0);
+    writer.beginArg(0);
+    writer.writePackedArray(values, count);
+    writer.endArg();
+    endCall(writer, call);
+}
+
+
+template< class T, size_t N >
+static void
+writePacked(Writer &writer, const T (&values)[N])
+{
+    writePacked(writer, values, N);
+}
+
+
+class PackedArrayTest : public TraceFileTest
+{
+protected:
+    PackedArrayTest() :
+        TraceFileTest("trace_packed_test.trace")
+    {}
+
+    void
+    write(Writer &writer) override {
+        writePacked(writer, sint8s);
+        writePacked(writer, uint16s);
+        writePacked(writer, sint64s);
+        writePacked(writer, uint64s);
+        writePacked(writer, floats);
+        writePacked(writer, doubles);
+        writePacked(writer, floats, 0);
+    }
+};
+
+
+enum Kind {
+    KIND_OTHER,
+    KIND_SINT,
+    KIND_UINT,
+    KIND_FLOAT,
+    KIND_DOUBLE,
+};
+
+
+class KindVisitor : public Visitor
+{
+public:
+    Kind kind = KIND_OTHER;
+
+    void visit(SInt *) override { kind = KIND_SINT; }
+    void visit(UInt *) override { kind = KIND_UINT; }
+    void visit(Float *) override { kind = KIND_FLOAT; }
+    void visit(Double *) override { kind = KIND_DOUBLE; }
+};
+
+
+static Kind
+getKind(Value *value)
+{
+    KindVisitor visitor;
+    value->visit(visitor);
+    return visitor.kind;
+}
+
+
+static Array *
+parseArray(Parser &parser, Call * &call, size_t count)
+{
+    call = parser.parse_call();
+    if (!call) {
+        ADD_FAILURE() << "missing call";
+        return NULL;
+    }
+    Array *array = call->args[0].value->toArray();
+    if (!array) {
+        ADD_FAILURE() << "argument is not an array";
+        return NULL;
+    }
+    EXPECT_EQ(count, array->size());
+    return array;
+}
+
+
+/*
+ * Integers must parse into SInt when negative and UInt otherwise, like
+ * integers written one by one.
+ */
+template< class T, size_t N >
+static void
+expectIntegers(Parser &parser, const T (&values)[N])
+{
+    Call *call;
+    Array *array = parseArray(parser, call, N);
+    if (!array) {
+        delete call;
+        return;
+    }
+    for (size_t i = 0; i < N; ++i) {
+        Value *value = array->values[i];
+        if (values[i] < 0) {
+            EXPECT_EQ(KIND_SINT, getKind(value));
+            EXPECT_EQ((signed long long)values[i], value->toSInt());
+        } else {
+            EXPECT_EQ(KIND_UINT, getKind(value));
+            EXPECT_EQ((unsigned long long)values[i], value->toUInt());
+        }
+    }
+    delete call;
+}
+
+
+template< class T, size_t N >
+static void
+expectValues(Parser &parser, Kind kind, const T (&values)[N])
+{
+    Call *call;
+    Array *array = parseArray(parser, call, N);
+    if (!array) {
+        delete call;
+        return;
+    }
+    for (size_t i = 0; i < N; ++i) {
+        Value *value = array->values[i];
+        EXPECT_EQ(kind, getKind(value));
+        EXPECT_EQ(values[i], value->toDouble());
+    }
+    delete call;
+}
+
+
+TEST_F(PackedArrayTest, parse)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    expectIntegers(parser, sint8s);
+    expectIntegers(parser, uint16s);
+    expectIntegers(parser, sint64s);
+    expectIntegers(parser, uint64s);
+    expectValues(parser, KIND_FLOAT, floats);
+    expectValues(parser, KIND_DOUBLE, doubles);
+
+    Call *call;
+    parseArray(parser, call, 0);
+    delete call;
+
+    EXPECT_TRUE(parser.parse_call() == NULL);
+}
+
+
+TEST_F(PackedArrayTest, scan)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    unsigned count = 0;
+    Call *call;
+    while ((call = parser.scan_call())) {
+        ++count;
+        delete call;
+    }
+    EXPECT_EQ(7u, count);
+}
+
+
+/*
+ * Elements are little endian in the trace, whatever the host.
+ */
+TEST_F(PackedArrayTest, byteOrder)
+{
+    std::unique_ptr<File> file(File::createForRead(filename));
+    ASSERT_TRUE(file != nullptr);
+
+    std::vector<char> contents;
+    char buf[4096];
+    size_t length;
+    while ((length = file->read(buf, sizeof buf)) > 0) {
+        contents.insert(contents.end(), buf, buf + length);
+    }
+
+    static const char expected[] = {0x00, 0x00, 0x01, 0x00, char(0xff), char(0xff)};
+    EXPECT_TRUE(std::search(contents.begin(), contents.end(),
+                            expected, expected + sizeof expected) != contents.end());
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
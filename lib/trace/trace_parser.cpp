@@ -29,6 +29,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fstream>
+
+#include "os_string.hpp"
+
+#include "trace_callset.hpp"
 #include "trace_file.hpp"
 #include "trace_dump.hpp"
 #include "trace_parser.hpp"
@@ -42,8 +47,14 @@ namespace trace {
 
 Parser::Parser() {
     file = NULL;
+    segment = 0;
+    segment_base = 0;
     next_call_no = 0;
+    blobBytes = 0;
+    callFilter = NULL;
+    filterNext = 0;
     version = 0;
+    shared = false;
     api = API_UNKNOWN;
 
     glGetErrorSig = NULL;
@@ -57,6 +68,54 @@ Parser::~Parser() {
 
 bool Parser::open(const char *filename) {
     assert(!file);
+
+    if (openManifest(filename)) {
+        if (segments.empty()) {
+            std::cerr << "error: no segments in " << filename << "\n";
+            return false;
+        }
+        segment = 0;
+        segment_base = segments[0].firstCall;
+        next_call_no = segment_base;
+        if (!openFile(segments[0].filename.c_str())) {
+            segments.clear();
+            return false;
+        }
+    } else if (!openFile(filename)) {
+        return false;
+    }
+
+    api = API_UNKNOWN;
+    blobBytes = 0;
+
+    return true;
+}
+
+
+bool Parser::openShared(const char *filename, const Parser &other) {
+    assert(!file);
+
+    if (!other.segments.empty() || !openFile(filename)) {
+        return false;
+    }
+
+    functions = other.functions;
+    structs = other.structs;
+    enums = other.enums;
+    bitmasks = other.bitmasks;
+    frames = other.frames;
+    stacks = other.stacks;
+    shared = true;
+
+    glGetErrorSig = other.glGetErrorSig;
+    api = other.api;
+    blobBytes = 0;
+
+    return true;
+}
+
+
+bool Parser::openFile(const char *filename) {
     file = File::createForRead(filename);
     if (!file) {
         return false;
@@ -69,11 +128,55 @@ bool Parser::open(const char *filename) {
         file = NULL;
         return false;
     }
-    api = API_UNKNOWN;
 
     return true;
 }
 
+
+/**
+ * Read the list of segments, if the file is a segmented trace manifest.
+ */
+bool Parser::openManifest(const char *filename) {
+    std::ifstream stream(filename, std::ifstream::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    char magic[sizeof TRACE_SEGMENTS_MAGIC - 1];
+    stream.read(magic, sizeof magic);
+    if (stream.gcount() != sizeof magic ||
+        memcmp(magic, TRACE_SEGMENTS_MAGIC, sizeof magic) != 0) {
+        return false;
+    }
+
+    // Skip the rest of the first line
+    std::string line;
+    std::getline(stream, line);
+
+    // Segment file names are relative to the manifest
+    os::String directory(filename);
+    directory.trimFilename();
+
+    while (std::getline(stream, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.resize(line.size() - 1);
+        }
+        size_t space = line.find(' ');
+        if (line.empty() || space == std::string::npos) {
+            continue;
+        }
+        Segment seg;
+        seg.firstCall = strtoul(line.c_str(), NULL, 10);
+        os::String path(directory);
+        path.join(os::String(line.c_str() + space + 1));
+        seg.filename = path.str();
+        segments.push_back(seg);
+    }
+
+    return true;
+}
+
+
 template <typename Iter>
 inline void
 deleteAll(Iter begin, Iter end)
@@ -101,6 +204,81 @@ void Parser::close(void) {
 
     deleteAll(calls);
 
+    if (shared) {
+        functions.clear();
+        structs.clear();
+        enums.clear();
+        bitmasks.clear();
+        frames.clear();
+        stacks.clear();
+        shared = false;
+    } else {
+        deleteSignatures(functions, structs, enums, bitmasks);
+        deleteAll(stacks);
+    }
+    for (auto & seg : segments) {
+        deleteSignatures(seg.functions, seg.structs, seg.enums, seg.bitmasks);
+        deleteAll(seg.stacks);
+    }
+    segments.clear();
+    segment = 0;
+    segment_base = 0;
+
+    next_call_no = 0;
+}
+
+
+bool Parser::switchSegment(unsigned index) {
+    assert(index < segments.size());
+    if (index == segment) {
+        return true;
+    }
+
+    if (file) {
+        file->close();
+        delete file;
+        file = NULL;
+    }
+    deleteAll(calls);
+
+    Segment &current = segments[segment];
+    std::swap(functions, current.functions);
+    std::swap(structs, current.structs);
+    std::swap(enums, current.enums);
+    std::swap(bitmasks, current.bitmasks);
+    std::swap(frames, current.frames);
+    std::swap(stacks, current.stacks);
+
+    Segment &next = segments[index];
+    std::swap(functions, next.functions);
+    std::swap(structs, next.structs);
+    std::swap(enums, next.enums);
+    std::swap(bitmasks, next.bitmasks);
+    std::swap(frames, next.frames);
+    std::swap(stacks, next.stacks);
+
+    segment = index;
+    segment_base = next.firstCall;
+    next_call_no = segment_base;
+
+    if (!openFile(next.filename.c_str())) {
+        std::cerr << "error: failed to open segment " << next.filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+
+bool Parser::nextSegment(void) {
+    if (segment + 1 >= segments.size()) {
+        return false;
+    }
+    return switchSegment(segment + 1);
+}
+
+
+void Parser::deleteSignatures(FunctionMap &functions, StructMap &structs,
+                              EnumMap &enums, BitmaskMap &bitmasks) {
     // Delete all signature data.  Signatures are mere structures which don't
     // own their own memory, so we need to destroy all data we created here.
 
@@ -149,20 +327,24 @@ void Parser::close(void) {
         }
     }
     bitmasks.clear();
-
-    next_call_no = 0;
 }
 
 
 void Parser::getBookmark(ParseBookmark &bookmark) {
     bookmark.offset = file->currentOffset();
     bookmark.next_call_no = next_call_no;
+    bookmark.segment = segment;
 }
 
 
 void Parser::setBookmark(const ParseBookmark &bookmark) {
+    if (bookmark.segment != segment &&
+        !switchSegment(bookmark.segment)) {
+        return;
+    }
     file->setCurrentOffset(bookmark.offset);
     next_call_no = bookmark.next_call_no;
+    filterNext = 0;
     
     // Simply ignore all pending calls
     deleteAll(calls);
@@ -170,6 +352,10 @@ void Parser::setBookmark(const ParseBookmark &bookmark) {
 
 
 Call *Parser::parse_call(Mode mode) {
+    if (!file) {
+        // A segment failed to open
+        return NULL;
+    }
     do {
         Call *call;
         int c = read_byte();
@@ -201,6 +387,9 @@ Call *Parser::parse_call(Mode mode) {
                 adjust_call_flags(call);
                 return call;
             }
+            if (nextSegment()) {
+                break;
+            }
             return NULL;
         }
     } while(true);
@@ -438,6 +627,8 @@ void Parser::parse_enter(Mode mode) {
 
     call->no = next_call_no++;
 
+    mode = filterEnter(call->no, mode);
+
     if (parse_call_details(call, mode)) {
         calls.push_back(call);
     } else {
@@ -447,7 +638,7 @@ void Parser::parse_enter(Mode mode) {
 
 
 Call *Parser::parse_leave(Mode mode) {
-    unsigned call_no = read_uint();
+    unsigned call_no = segment_base + read_uint();
     Call *call = NULL;
     for (CallList::iterator it = calls.begin(); it != calls.end(); ++it) {
         if ((*it)->no == call_no) {
@@ -468,6 +659,8 @@ Call *Parser::parse_leave(Mode mode) {
         return NULL;
     }
 
+    mode = filterLeave(call->no, mode);
+
     if (parse_call_details(call, mode)) {
         return call;
     } else {
@@ -477,6 +670,29 @@ Call *Parser::parse_leave(Mode mode) {
 }
 
 
+/*
+ * Calls are entered in increasing order, so rather than looking every call up
+ * in the filter, skip straight to the next call which may be a member.
+ */
+Parser::Mode Parser::filterEnter(unsigned call_no, Mode mode) {
+    if (mode != FULL || !callFilter) {
+        return mode;
+    }
+    if (call_no >= filterNext) {
+        filterNext = callFilter->nextMember(call_no);
+    }
+    return call_no == filterNext ? FULL : SCAN;
+}
+
+
+Parser::Mode Parser::filterLeave(unsigned call_no, Mode mode) {
+    if (mode != FULL || !callFilter) {
+        return mode;
+    }
+    return callFilter->contains(call_no) ? FULL : SCAN;
+}
+
+
 bool Parser::parse_call_details(Call *call, Mode mode) {
     do {
         int c = read_byte();
@@ -504,6 +720,12 @@ bool Parser::parse_call_details(Call *call, Mode mode) {
 #endif
             parse_call_backtrace(call, mode);
             break;
+        case trace::CALL_STACK:
+#if TRACE_VERBOSE
+            std::cerr << "\tCALL_STACK\n";
+#endif
+            parse_call_stack(call, mode);
+            break;
         default:
             std::cerr << "error: ("<<call->name()<< ") unknown call detail "
                       << c << "\n";
@@ -524,6 +746,35 @@ bool Parser::parse_call_backtrace(Call *call, Mode mode) {
     return true;
 }
 
+/*
+ * Backtraces shared by several calls.  The calls point to the parser's copy,
+ * which lives until the trace is closed.
+ */
+bool Parser::parse_call_stack(Call *call, Mode mode) {
+    size_t id = read_uint();
+
+    StackState *stack = lookup(stacks, id);
+
+    if (!stack) {
+        stack = new StackState;
+        unsigned num_frames = read_uint();
+        stack->resize(num_frames);
+        for (unsigned i = 0; i < num_frames; ++i) {
+            (*stack)[i] = parse_backtrace_frame(mode);
+        }
+        stack->fileOffset = file->currentOffset();
+        stacks[id] = stack;
+    } else if (file->currentOffset() < stack->fileOffset) {
+        unsigned num_frames = read_uint();
+        for (unsigned i = 0; i < num_frames; ++i) {
+            parse_backtrace_frame(mode);
+        }
+    }
+
+    call->backtrace = stack;
+    return true;
+}
+
 StackFrame * Parser::parse_backtrace_frame(Mode mode) {
     size_t id = read_uint();
 
@@ -672,6 +923,9 @@ Value *Parser::parse_value(void) {
     case trace::TYPE_WSTRING:
         value = parse_wstring();
         break;
+    case trace::TYPE_PACKED_ARRAY:
+        value = parse_packed_array();
+        break;
     default:
         std::cerr << "error: unknown type " << c << "\n";
         exit(1);
@@ -736,6 +990,9 @@ void Parser::scan_value(void) {
     case trace::TYPE_WSTRING:
         scan_wstring();
         break;
+    case trace::TYPE_PACKED_ARRAY:
+        scan_packed_array();
+        break;
     default:
         std::cerr << "error: unknown type " << c << "\n";
         exit(1);
@@ -857,12 +1114,111 @@ void Parser::scan_array(void) {
 }
 
 
+/*
+ * Integers are read into SInt when negative and UInt otherwise, as when
+ * written element by element.
+ */
+template< class T >
+static inline void
+unpackIntegers(PackedArray *array, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        T value;
+        memcpy(&value, data + i * sizeof value, sizeof value);
+        if (value < 0) {
+            array->set<SInt>(i, (signed long long)value);
+        } else {
+            array->set<UInt>(i, (unsigned long long)value);
+        }
+    }
+}
+
+template< class T, class V >
+static inline void
+unpackValues(PackedArray *array, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i) {
+        T value;
+        memcpy(&value, data + i * sizeof value, sizeof value);
+        array->set<V>(i, value);
+    }
+}
+
+Value *Parser::parse_packed_array(void) {
+    int type = read_byte();
+    size_t len = read_uint();
+    size_t size = getPackedTypeSize(type);
+    if (!size) {
+        std::cerr << "error: unknown packed array type " << type << "\n";
+        exit(1);
+    }
+
+    PackedArray *array = new PackedArray(PackedType(type), len);
+    const char *data = array->data.data();
+    if (len) {
+        file->read(array->data.data(), array->data.size());
+#ifdef HAVE_BIGENDIAN
+        swapPackedBytes(array->data.data(), size, len);
+#endif
+    }
+
+    switch (type) {
+    case trace::PACKED_SINT8:
+        unpackIntegers<int8_t>(array, data, len);
+        break;
+    case trace::PACKED_UINT8:
+        unpackIntegers<uint8_t>(array, data, len);
+        break;
+    case trace::PACKED_SINT16:
+        unpackIntegers<int16_t>(array, data, len);
+        break;
+    case trace::PACKED_UINT16:
+        unpackIntegers<uint16_t>(array, data, len);
+        break;
+    case trace::PACKED_SINT32:
+        unpackIntegers<int32_t>(array, data, len);
+        break;
+    case trace::PACKED_UINT32:
+        unpackIntegers<uint32_t>(array, data, len);
+        break;
+    case trace::PACKED_SINT64:
+        unpackIntegers<int64_t>(array, data, len);
+        break;
+    case trace::PACKED_UINT64:
+        unpackIntegers<uint64_t>(array, data, len);
+        break;
+    case trace::PACKED_FLOAT:
+        unpackValues<float, Float>(array, data, len);
+        break;
+    case trace::PACKED_DOUBLE:
+        unpackValues<double, Double>(array, data, len);
+        break;
+    }
+    return array;
+}
+
+
+void Parser::scan_packed_array(void) {
+    int type = read_byte();
+    size_t len = read_uint();
+    size_t size = getPackedTypeSize(type);
+    if (!size) {
+        std::cerr << "error: unknown packed array type " << type << "\n";
+        exit(1);
+    }
+    if (len) {
+        file->skip(len * size);
+    }
+}
+
+
 Value *Parser::parse_blob(void) {
     size_t size = read_uint();
     Blob *blob = new Blob(size);
     if (size) {
         file->read(blob->buf, size);
     }
+    blobBytes += size;
     return blob;
 }
 
@@ -872,6 +1228,7 @@ void Parser::scan_blob(void) {
     if (size) {
         file->skip(size);
     }
+    blobBytes += size;
 }
 
 
@@ -28,6 +28,8 @@
 
 #include <iostream>
 #include <list>
+#include <string>
+#include <vector>
 
 #include "trace_file.hpp"
 #include "trace_format.hpp"
@@ -37,10 +39,14 @@
 namespace trace {
 
 
+class CallSet;
+
+
 struct ParseBookmark
 {
     File::Offset offset;
     unsigned next_call_no;
+    unsigned segment = 0;
 };
 
 
@@ -50,6 +56,8 @@ class AbstractParser
 public:
     virtual ~AbstractParser() {}
     virtual  Call *parse_call(void) = 0;
+    // Dispose of a call returned by parse_call.
+    virtual void releaseCall(Call *call) { delete call; }
     virtual void getBookmark(ParseBookmark &bookmark) = 0;
     virtual void setBookmark(const ParseBookmark &bookmark) = 0;
     virtual bool open(const char *filename) = 0;
@@ -91,24 +99,59 @@ protected:
     typedef SigState<EnumSig> EnumSigState;
     typedef SigState<BitmaskSig> BitmaskSigState;
     typedef SigState<StackFrame> StackFrameState;
+    typedef SigState<Backtrace> StackState;
 
     typedef std::vector<FunctionSigState *> FunctionMap;
     typedef std::vector<StructSigState *> StructMap;
     typedef std::vector<EnumSigState *> EnumMap;
     typedef std::vector<BitmaskSigState *> BitmaskMap;
     typedef std::vector<StackFrameState *> StackFrameMap;
+    typedef std::vector<StackState *> StackMap;
 
     FunctionMap functions;
     StructMap structs;
     EnumMap enums;
     BitmaskMap bitmasks;
     StackFrameMap frames;
+    StackMap stacks;
 
     FunctionSig *glGetErrorSig;
 
+    /*
+     * A segmented trace is a manifest listing several self-contained trace
+     * files, which are read in sequence.  Each segment re-emits the
+     * signatures it uses, so each has its own signature tables; those of the
+     * segments other than the current one are stashed here.
+     */
+    struct Segment {
+        std::string filename;
+        unsigned firstCall;
+        FunctionMap functions;
+        StructMap structs;
+        EnumMap enums;
+        BitmaskMap bitmasks;
+        StackFrameMap frames;
+        StackMap stacks;
+    };
+    std::vector<Segment> segments;
+    unsigned segment;
+
+    // Call number of the first call in the current segment
+    unsigned segment_base;
+
     unsigned next_call_no;
 
+    // Total size of the blobs parsed or scanned so far.
+    unsigned long long blobBytes;
+
+    // Calls whose details are parsed, see setCallFilter
+    const CallSet *callFilter;
+    unsigned filterNext;
+
     unsigned long long version;
+
+    // Whether the signatures belong to another parser, see openShared
+    bool shared;
 public:
     API api;
 
@@ -118,6 +161,17 @@ public:
 
     bool open(const char *filename) override;
 
+    /**
+     * Open the trace another parser has already read through, sharing its
+     * signatures rather than discovering them again, so that calls can be
+     * parsed from any of its bookmarks straight away.  Several parsers may
+     * then parse the trace concurrently, from different threads.
+     *
+     * The other parser must outlive this one.  Segmented traces are not
+     * supported.
+     */
+    bool openShared(const char *filename, const Parser &other);
+
     void close(void) override;
 
     Call *parse_call(void) override {
@@ -139,6 +193,12 @@ public:
 
     int percentRead()
     {
+        if (!file) {
+            return 100;
+        }
+        if (segments.size() > 1) {
+            return (segment * 100 + file->percentRead()) / segments.size();
+        }
         return file->percentRead();
     }
 
@@ -146,9 +206,31 @@ public:
         return parse_call(SCAN);
     }
 
+    /**
+     * Only parse the arguments of the calls which may belong to the given
+     * set.  The other calls are still returned, but without arguments nor
+     * return value, as with scan_call.
+     */
+    void setCallFilter(const CallSet *filter) {
+        callFilter = filter;
+        filterNext = 0;
+    }
+
 protected:
+    bool openFile(const char *filename);
+    bool openManifest(const char *filename);
+    bool switchSegment(unsigned index);
+    bool nextSegment(void);
+
+    static void
+    deleteSignatures(FunctionMap &functions, StructMap &structs,
+                     EnumMap &enums, BitmaskMap &bitmasks);
+
     Call *parse_call(Mode mode);
 
+    Mode filterEnter(unsigned call_no, Mode mode);
+    Mode filterLeave(unsigned call_no, Mode mode);
+
     FunctionSigFlags *parse_function_sig(void);
     StructSig *parse_struct_sig();
     EnumSig *parse_old_enum_sig();
@@ -169,6 +251,7 @@ protected:
     bool parse_call_details(Call *call, Mode mode);
 
     bool parse_call_backtrace(Call *call, Mode mode);
+    bool parse_call_stack(Call *call, Mode mode);
     StackFrame * parse_backtrace_frame(Mode mode);
 
     void adjust_call_flags(Call *call);
@@ -210,6 +293,9 @@ protected:
     Value *parse_array(void);
     void scan_array(void);
 
+    Value *parse_packed_array(void);
+    void scan_packed_array(void);
+
     Value *parse_blob(void);
     void scan_blob(void);
 
@@ -239,8 +325,21 @@ protected:
 };
 
 
+/**
+ * Durations of frames, in os::timeFrequency units.
+ */
+typedef std::vector<long long> FrameTimes;
+
+/**
+ * Wrap a parser so that, once the trace is replayed, the frames between
+ * firstFrame and lastFrame (inclusive, zero-based; the last frame when
+ * negative) are replayed loopCount more times (forever when negative) from
+ * memory.  Calls must be disposed with releaseCall.  The time of each looped
+ * frame is appended to frameTimes, if given.
+ */
 AbstractParser *
-lastFrameLoopParser(AbstractParser *parser, int loopCount);
+frameLoopParser(AbstractParser *parser, int loopCount, int firstFrame = -1, int lastFrame = -1,
+                FrameTimes *frameTimes = nullptr);
 
 
 } /* namespace trace */
@@ -24,26 +24,60 @@
  **************************************************************************/
 
 
+#include <assert.h>
+
+#include <iostream>
+#include <vector>
+
+#include "os_time.hpp"
 #include "trace_parser.hpp"
 
 
 namespace trace {
 
 
-// Decorator for parser which loops
-class LastFrameLoopParser : public AbstractParser  {
+/*
+ * Decorator for parser which loops over a range of frames.
+ *
+ * The trace is first replayed normally up to the end of the range.  The calls
+ * of the range are then parsed once more into memory and replayed from there,
+ * so that looping measures the replay of the frames and not the decompression
+ * and parsing of the trace.
+ */
+class FrameLoopParser : public AbstractParser  {
 public:
-    LastFrameLoopParser(AbstractParser *p, int c) {
+    FrameLoopParser(AbstractParser *p, int c, int first, int last, FrameTimes *times) {
         parser = p;
         loopCount = c;
+        firstFrame = first;
+        lastFrame = last;
+        frameNo = 0;
+        haveLoopStart = false;
+        looping = false;
+        cacheIndex = 0;
+        cachedFrames = 0;
+        lastWasEndFrame = false;
+        lastMark = 0;
+        frameTimes = times;
     }
 
-    ~LastFrameLoopParser() {
+    ~FrameLoopParser() {
+        for (auto call : calls) {
+            delete call;
+        }
         delete parser;
     }
 
     Call *parse_call(void) override;
 
+    // Calls replayed from memory are reused on every iteration, so they must
+    // not be deleted by the caller.
+    void releaseCall(Call *call) override {
+        if (!looping) {
+            delete call;
+        }
+    }
+
     // Delegate to Parser
     void getBookmark(ParseBookmark &bookmark) override { parser->getBookmark(bookmark); }
     void setBookmark(const ParseBookmark &bookmark) override { parser->setBookmark(bookmark); }
@@ -53,13 +87,39 @@ public:
 private:
     int loopCount;
     AbstractParser *parser;
+
+    // Range of frames to loop; a negative firstFrame means the last frame.
+    int firstFrame;
+    int lastFrame;
+
+    int frameNo;
+    bool haveLoopStart;
+    ParseBookmark loopStart;
     ParseBookmark frameStart;
-    ParseBookmark lastFrameStart;
+
+    bool looping;
+    std::vector<Call *> calls;
+    size_t cacheIndex;
+    unsigned cachedFrames;
+
+    // Frame timing while looping, if requested
+    bool lastWasEndFrame;
+    long long lastMark;
+    FrameTimes *frameTimes;
+
+    bool
+    startLoop(void);
+
+    Call *
+    loopCall(void);
+
+    void
+    markFrame(void);
 };
 
 
 bool
-LastFrameLoopParser::open(const char *filename)
+FrameLoopParser::open(const char *filename)
 {
     bool ret = parser->open(filename);
     if (ret) {
@@ -68,43 +128,134 @@ LastFrameLoopParser::open(const char *filename)
          * for a trace that has only one frame we need to get it at the
          * beginning. */
         parser->getBookmark(frameStart);
-        lastFrameStart = frameStart;
+        loopStart = frameStart;
+        haveLoopStart = firstFrame <= 0;
     }
     return ret;
 }
 
+
 Call *
-LastFrameLoopParser::parse_call(void)
+FrameLoopParser::parse_call(void)
 {
-    trace::Call *call;
+    if (looping) {
+        return loopCall();
+    }
 
-    call = parser->parse_call();
+    /* Stop the first pass once the end of the range has been replayed. */
+    if (lastFrame >= 0 && frameNo > lastFrame) {
+        return startLoop() ? loopCall() : nullptr;
+    }
 
-    /* Restart last frame when looping is requested. */
-    if (call) {
-        lastFrameStart = frameStart;
-        if (call->flags & trace::CALL_FLAG_END_FRAME) {
+    trace::Call *call = parser->parse_call();
+    if (!call) {
+        return startLoop() ? loopCall() : nullptr;
+    }
+
+    if (firstFrame < 0) {
+        /* Loop over the frame of the last call, as it may be an incomplete
+         * frame following the last frame boundary. */
+        loopStart = frameStart;
+        haveLoopStart = true;
+    }
+
+    if (call->flags & trace::CALL_FLAG_END_FRAME) {
+        ++frameNo;
+        if (firstFrame < 0) {
             parser->getBookmark(frameStart);
+        } else if (frameNo == firstFrame) {
+            parser->getBookmark(loopStart);
+            haveLoopStart = true;
         }
-    } else {
-        if (loopCount) {
-            frameStart = lastFrameStart;
-            parser->setBookmark(frameStart);
-            call = parser->parse_call();
-            if (loopCount > 0) {
-                --loopCount;
+    }
+
+    return call;
+}
+
+
+/**
+ * Parse the calls of the loop range into memory.
+ */
+bool
+FrameLoopParser::startLoop(void)
+{
+    if (!loopCount) {
+        return false;
+    }
+
+    if (!haveLoopStart) {
+        std::cerr << "warning: trace has only " << frameNo << " frames, not looping\n";
+        return false;
+    }
+
+    parser->setBookmark(loopStart);
+
+    Call *call;
+    while ((call = parser->parse_call())) {
+        calls.push_back(call);
+        if (call->flags & trace::CALL_FLAG_END_FRAME) {
+            ++cachedFrames;
+            if (lastFrame >= 0 && firstFrame + (int)cachedFrames > lastFrame) {
+                break;
             }
         }
     }
 
+    if (calls.empty()) {
+        return false;
+    }
+
+    looping = true;
+    cacheIndex = 0;
+    lastMark = os::getTime();
+    return true;
+}
+
+
+Call *
+FrameLoopParser::loopCall(void)
+{
+    if (lastWasEndFrame) {
+        markFrame();
+    }
+
+    if (cacheIndex == calls.size()) {
+        /* Time whole iterations when there's no frame boundary to go by. */
+        if (!cachedFrames) {
+            markFrame();
+        }
+        if (loopCount > 0) {
+            --loopCount;
+        }
+        if (!loopCount) {
+            return nullptr;
+        }
+        cacheIndex = 0;
+    }
+
+    Call *call = calls[cacheIndex++];
+    lastWasEndFrame = call->flags & trace::CALL_FLAG_END_FRAME;
     return call;
 }
 
 
+inline void
+FrameLoopParser::markFrame(void)
+{
+    long long now = os::getTime();
+    if (frameTimes) {
+        frameTimes->push_back(now - lastMark);
+    }
+    lastMark = now;
+}
+
+
 AbstractParser *
-lastFrameLoopParser(AbstractParser *parser, int loopCount)
+frameLoopParser(AbstractParser *parser, int loopCount, int firstFrame, int lastFrame,
+                FrameTimes *frameTimes)
 {
-    return new LastFrameLoopParser(parser, loopCount);
+    assert(firstFrame < 0 || lastFrame < 0 || firstFrame <= lastFrame);
+    return new FrameLoopParser(parser, loopCount, firstFrame, lastFrame, frameTimes);
 }
 
 
@@ -0,0 +1,134 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "trace_parser.hpp"
+#include "trace_test_file.hpp"
+
+using namespace trace;
+
+
+static const unsigned numCalls = 64;
+
+
+class SharedParserTest : public TraceFileTest
+{
+protected:
+    std::vector<ParseBookmark> bookmarks;
+
+    SharedParserTest() :
+        TraceFileTest("trace_parser_shared_test.trace")
+    {}
+
+    void
+    write(Writer &writer) override {
+        // Signatures are only defined by the first two calls
+        for (unsigned no = 0; no < numCalls; ++no) {
+            writeCall(writer, no);
+        }
+    }
+
+    void
+    scan(Parser &parser) {
+        for (unsigned no = 0; no < numCalls; ++no) {
+            ParseBookmark bookmark;
+            parser.getBookmark(bookmark);
+            bookmarks.push_back(bookmark);
+            delete parser.scan_call();
+        }
+    }
+};
+
+
+static void
+expectParse(Parser &parser, unsigned no)
+{
+    Call *call = parser.parse_call();
+    expectCall(call, no);
+    delete call;
+}
+
+
+TEST_F(SharedParserTest, bookmarks)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+    scan(parser);
+
+    // Start past the signature definitions, then go back to them
+    Parser shared;
+    ASSERT_TRUE(shared.openShared(filename, parser));
+    for (unsigned first : {numCalls - 1, numCalls / 2, 0u, 1u}) {
+        shared.setBookmark(bookmarks[first]);
+        for (unsigned no = first; no < numCalls; ++no) {
+            expectParse(shared, no);
+        }
+        EXPECT_TRUE(shared.parse_call() == NULL);
+    }
+    shared.close();
+
+    // The signatures still belong to the original parser
+    parser.setBookmark(bookmarks[0]);
+    expectParse(parser, 0);
+}
+
+
+TEST_F(SharedParserTest, threads)
+{
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+    scan(parser);
+
+    const unsigned numThreads = 4;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t] {
+            Parser shared;
+            ASSERT_TRUE(shared.openShared(filename, parser));
+            for (unsigned first = t; first < numCalls; first += numThreads) {
+                shared.setBookmark(bookmarks[first]);
+                expectParse(shared, first);
+            }
+        });
+    }
+    for (auto & thread : threads) {
+        thread.join();
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -30,6 +30,29 @@
 #include <string.h>
 #include <sstream>
 
+#define PROFILE_BUFFER_SIZE (64 * 1024)
+
+static size_t profileCallSize(uint32_t fields)
+{
+    size_t size = 3 * sizeof(uint32_t);
+    if (fields & trace::PROFILE_FIELD_GPU) {
+        size += 2 * sizeof(int64_t);
+    }
+    if (fields & trace::PROFILE_FIELD_CPU) {
+        size += 2 * sizeof(int64_t);
+    }
+    if (fields & trace::PROFILE_FIELD_MEMORY) {
+        size += 4 * sizeof(int64_t);
+    }
+    if (fields & trace::PROFILE_FIELD_PIXELS) {
+        size += sizeof(int64_t);
+    }
+    if (fields & trace::PROFILE_FIELD_HEAP) {
+        size += 2 * sizeof(int64_t);
+    }
+    return size;
+}
+
 namespace trace {
 Profiler::Profiler()
     : baseGpuTime(0),
@@ -40,22 +63,97 @@ Profiler::Profiler()
       cpuTimes(false),
       gpuTimes(true),
       pixelsDrawn(false),
-      memoryUsage(false)
+      memoryUsage(false),
+      heapUsage(false),
+      format(PROFILE_FORMAT_TEXT)
 {
 }
 
 Profiler::~Profiler()
 {
+    flush();
 }
 
-void Profiler::setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_)
+void Profiler::setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_,
+                     bool heapUsage_, ProfileFormat format_)
 {
     cpuTimes = cpuTimes_;
     gpuTimes = gpuTimes_;
     pixelsDrawn = pixelsDrawn_;
     memoryUsage = memoryUsage_;
+    heapUsage = heapUsage_;
+    format = format_;
+
+    if (format == PROFILE_FORMAT_BINARY) {
+        buffer.reserve(PROFILE_BUFFER_SIZE);
+        uint32_t byteOrder = PROFILE_BINARY_BYTE_ORDER;
+        uint32_t fields = 0;
+        if (gpuTimes) {
+            fields |= PROFILE_FIELD_GPU;
+        }
+        if (cpuTimes) {
+            fields |= PROFILE_FIELD_CPU;
+        }
+        if (memoryUsage) {
+            fields |= PROFILE_FIELD_MEMORY;
+        }
+        if (pixelsDrawn) {
+            fields |= PROFILE_FIELD_PIXELS;
+        }
+        if (heapUsage) {
+            fields |= PROFILE_FIELD_HEAP;
+        }
+        write(PROFILE_BINARY_MAGIC, PROFILE_BINARY_MAGIC_SIZE);
+        write(&byteOrder, sizeof byteOrder);
+        write(&fields, sizeof fields);
+    } else {
+        std::cout << "# call no gpu_start gpu_dura cpu_start cpu_dura vsize_start vsize_dura rss_start rss_dura pixels program name";
+        if (heapUsage) {
+            std::cout << " heap_start heap_dura";
+        }
+        std::cout << std::endl;
+    }
+}
+
+void Profiler::write(const void* data, size_t size)
+{
+    if (buffer.size() + size > PROFILE_BUFFER_SIZE) {
+        flush();
+    }
+    const char* bytes = static_cast<const char*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void Profiler::flush()
+{
+    if (format == PROFILE_FORMAT_BINARY) {
+        if (!buffer.empty()) {
+            fwrite(&buffer[0], 1, buffer.size(), stdout);
+            buffer.clear();
+        }
+        fflush(stdout);
+    } else {
+        std::cout.flush();
+    }
+}
+
+uint32_t Profiler::nameId(const char* name)
+{
+    std::map<std::string, uint32_t>::iterator it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+
+    uint32_t id = uint32_t(names.size());
+    names[name] = id;
+
+    uint32_t length = uint32_t(strlen(name));
+    write("n", 1);
+    write(&id, sizeof id);
+    write(&length, sizeof length);
+    write(name, length);
 
-    std::cout << "# call no gpu_start gpu_dura cpu_start cpu_dura vsize_start vsize_dura rss_start rss_dura pixels program name" << std::endl;
+    return id;
 }
 
 int64_t Profiler::getBaseCpuTime()
@@ -110,7 +208,8 @@ void Profiler::addCall(unsigned no,
                        int64_t gpuStart, int64_t gpuDuration,
                        int64_t cpuStart, int64_t cpuDuration,
                        int64_t vsizeStart, int64_t vsizeDuration,
-                       int64_t rssStart, int64_t rssDuration)
+                       int64_t rssStart, int64_t rssDuration,
+                       int64_t heapStart, int64_t heapDuration)
 {
     if (gpuTimes && gpuStart) {
         gpuStart -= baseGpuTime;
@@ -140,6 +239,38 @@ void Profiler::addCall(unsigned no,
         rssDuration = 0;
     }
 
+    if (!heapUsage) {
+        heapStart = 0;
+        heapDuration = 0;
+    }
+
+    if (format == PROFILE_FORMAT_BINARY) {
+        uint32_t header[3] = { no, nameId(name), program };
+        write("c", 1);
+        write(header, sizeof header);
+        if (gpuTimes) {
+            int64_t values[2] = { gpuStart, gpuDuration };
+            write(values, sizeof values);
+        }
+        if (cpuTimes) {
+            int64_t values[2] = { cpuStart, cpuDuration };
+            write(values, sizeof values);
+        }
+        if (memoryUsage) {
+            int64_t values[4] = { vsizeStart, vsizeDuration, rssStart, rssDuration };
+            write(values, sizeof values);
+        }
+        if (pixelsDrawn) {
+            write(&pixels, sizeof pixels);
+        }
+        if (heapUsage) {
+            int64_t values[2] = { heapStart, heapDuration };
+            write(values, sizeof values);
+        }
+        return;
+    }
+
+    /* Avoid std::endl here, as flushing on every call skews the timings. */
     std::cout << "call"
               << " " << no
               << " " << gpuStart
@@ -152,32 +283,142 @@ void Profiler::addCall(unsigned no,
               << " " << rssDuration
               << " " << pixels
               << " " << program
-              << " " << name
-              << std::endl;
+              << " " << name;
+    if (heapUsage) {
+        std::cout << " " << heapStart
+                  << " " << heapDuration;
+    }
+    std::cout << "\n";
 }
 
 void Profiler::addFrameEnd()
 {
-    std::cout << "frame_end" << std::endl;
+    if (format == PROFILE_FORMAT_BINARY) {
+        write("f", 1);
+        return;
+    }
+
+    std::cout << "frame_end\n";
+}
+
+void addProfileCall(Profile* profile, ProfileTotals& totals, const Profile::Call& call)
+{
+    if (totals.lastGpuTime < call.gpuStart + call.gpuDuration) {
+        totals.lastGpuTime = call.gpuStart + call.gpuDuration;
+    }
+
+    if (totals.lastCpuTime < call.cpuStart + call.cpuDuration) {
+        totals.lastCpuTime = call.cpuStart + call.cpuDuration;
+    }
+
+    if (totals.lastVsizeUsage < call.vsizeStart + call.vsizeDuration) {
+        totals.lastVsizeUsage = call.vsizeStart + call.vsizeDuration;
+    }
+
+    if (totals.lastRssUsage < call.rssStart + call.rssDuration) {
+        totals.lastRssUsage = call.rssStart + call.rssDuration;
+    }
+
+    profile->calls.push_back(call);
+
+    if (call.pixels >= 0) {
+        if (profile->programs.size() <= call.program) {
+            profile->programs.resize(call.program + 1);
+        }
+
+        Profile::Program& program = profile->programs[call.program];
+        program.cpuTotal += call.cpuDuration;
+        program.gpuTotal += call.gpuDuration;
+        program.pixelTotal += call.pixels;
+        program.vsizeTotal += call.vsizeDuration;
+        program.rssTotal += call.rssDuration;
+        program.calls.push_back((unsigned int)(profile->calls.size() - 1));
+    }
+}
+
+void addProfileFrameEnd(Profile* profile, ProfileTotals& totals)
+{
+    Profile::Frame frame;
+    frame.no = unsigned(profile->frames.size());
+
+    if (frame.no == 0) {
+        frame.gpuStart = 0;
+        frame.cpuStart = 0;
+        frame.vsizeStart = 0;
+        frame.rssStart = 0;
+        frame.calls.begin = 0;
+    } else {
+        frame.gpuStart = profile->frames.back().gpuStart + profile->frames.back().gpuDuration;
+        frame.cpuStart = profile->frames.back().cpuStart + profile->frames.back().cpuDuration;
+        frame.vsizeStart = profile->frames.back().vsizeStart + profile->frames.back().vsizeDuration;
+        frame.rssStart = profile->frames.back().rssStart + profile->frames.back().rssDuration;
+        frame.calls.begin = profile->frames.back().calls.end + 1;
+    }
+
+    frame.gpuDuration = totals.lastGpuTime - frame.gpuStart;
+    frame.cpuDuration = totals.lastCpuTime - frame.cpuStart;
+    frame.vsizeDuration = totals.lastVsizeUsage - frame.vsizeStart;
+    frame.rssDuration = totals.lastRssUsage - frame.rssStart;
+    frame.calls.end = (unsigned int)(profile->calls.size() - 1);
+
+    profile->frames.push_back(frame);
+}
+
+static void writeProfileCall(std::ostream& os, const Profile& profile, const Profile::Call& call)
+{
+    os << "call"
+       << " " << call.no
+       << " " << call.gpuStart
+       << " " << call.gpuDuration
+       << " " << call.cpuStart
+       << " " << call.cpuDuration
+       << " " << call.vsizeStart
+       << " " << call.vsizeDuration
+       << " " << call.rssStart
+       << " " << call.rssDuration
+       << " " << call.pixels
+       << " " << call.program
+       << " " << call.name;
+    if (profile.heapUsage) {
+        os << " " << call.heapStart
+           << " " << call.heapDuration;
+    }
+    os << "\n";
+}
+
+void writeProfileText(std::ostream& os, const Profile& profile)
+{
+    os << "# call no gpu_start gpu_dura cpu_start cpu_dura vsize_start vsize_dura rss_start rss_dura pixels program name";
+    if (profile.heapUsage) {
+        os << " heap_start heap_dura";
+    }
+    os << "\n";
+
+    size_t i = 0;
+    for (size_t f = 0; f < profile.frames.size(); ++f) {
+        const Profile::Frame& frame = profile.frames[f];
+        /* calls.end wraps around for empty leading frames. */
+        for (; i < profile.calls.size() && i <= frame.calls.end; ++i) {
+            writeProfileCall(os, profile, profile.calls[i]);
+        }
+        os << "frame_end\n";
+    }
+    for (; i < profile.calls.size(); ++i) {
+        writeProfileCall(os, profile, profile.calls[i]);
+    }
 }
 
 void Profiler::parseLine(const char* in, Profile* profile)
 {
     std::stringstream line(in, std::ios_base::in);
     std::string type;
-    static int64_t lastGpuTime;
-    static int64_t lastCpuTime;
-    static int64_t lastVsizeUsage;
-    static int64_t lastRssUsage;
+    static ProfileTotals totals;
 
     if (in[0] == '#' || strlen(in) < 4)
         return;
 
     if (profile->programs.size() == 0 && profile->calls.size() == 0 && profile->frames.size() == 0) {
-        lastGpuTime = 0;
-        lastCpuTime = 0;
-        lastVsizeUsage = 0;
-        lastRssUsage = 0;
+        totals = ProfileTotals();
     }
 
     line >> type;
@@ -198,62 +439,243 @@ void Profiler::parseLine(const char* in, Profile* profile)
              >> call.program
              >> call.name;
 
-        if (lastGpuTime < call.gpuStart + call.gpuDuration) {
-            lastGpuTime = call.gpuStart + call.gpuDuration;
+        /* Only present with heap profiling. */
+        call.heapStart = 0;
+        call.heapDuration = 0;
+        if (line >> call.heapStart
+                 >> call.heapDuration) {
+            profile->heapUsage = true;
         }
 
-        if (lastCpuTime < call.cpuStart + call.cpuDuration) {
-            lastCpuTime = call.cpuStart + call.cpuDuration;
-        }
+        addProfileCall(profile, totals, call);
+    } else if (type.compare("frame_end") == 0) {
+        addProfileFrameEnd(profile, totals);
+    }
+}
+
+ProfileParser::ProfileParser(Profile* profile_)
+    : profile(profile_),
+      state(STATE_UNKNOWN),
+      valid(true),
+      fields(0),
+      callSize(0)
+{
+}
+
+void ProfileParser::parse(const char* data, size_t size)
+{
+    if (!valid) {
+        return;
+    }
+
+    /* Only copy into the pending buffer what can't be consumed directly. */
+    if (!pending.empty()) {
+        pending.append(data, size);
+        pending.erase(0, consume(pending.data(), pending.size()));
+        return;
+    }
 
-        if (lastVsizeUsage < call.vsizeStart + call.vsizeDuration) {
-            lastVsizeUsage = call.vsizeStart + call.vsizeDuration;
+    size_t consumed = consume(data, size);
+    pending.assign(data + consumed, size - consumed);
+}
+
+size_t ProfileParser::consume(const char* data, size_t size)
+{
+    size_t offset = 0;
+    while (valid) {
+        State previous = state;
+        size_t consumed = state == STATE_TEXT || state == STATE_UNKNOWN
+                        ? parseText(data + offset, size - offset)
+                        : parseBinary(data + offset, size - offset);
+        offset += consumed;
+        if (!consumed && state == previous) {
+            break;
         }
+    }
+    return offset;
+}
 
-        if (lastRssUsage < call.rssStart + call.rssDuration) {
-            lastRssUsage = call.rssStart + call.rssDuration;
+size_t ProfileParser::parseText(const char* data, size_t size)
+{
+    if (state == STATE_UNKNOWN) {
+        if (size < PROFILE_BINARY_MAGIC_SIZE &&
+            memcmp(data, PROFILE_BINARY_MAGIC, size) == 0) {
+            return 0;
         }
+        if (size >= PROFILE_BINARY_MAGIC_SIZE &&
+            memcmp(data, PROFILE_BINARY_MAGIC, PROFILE_BINARY_MAGIC_SIZE) == 0) {
+            state = STATE_BINARY_HEADER;
+            return 0;
+        }
+        state = STATE_TEXT;
+    }
 
-        profile->calls.push_back(call);
+    size_t offset = 0;
+    while (offset < size) {
+        const char* start = data + offset;
+        const char* end = static_cast<const char*>(memchr(start, '\n', size - offset));
+        if (!end) {
+            break;
+        }
 
-        if (call.pixels >= 0) {
-            if (profile->programs.size() <= call.program) {
-                profile->programs.resize(call.program + 1);
+        std::string line(start, end);
+        std::stringstream stream(line, std::ios_base::in);
+        std::string type;
+        stream >> type;
+
+        if (type.compare("call") == 0) {
+            Profile::Call call;
+
+            stream >> call.no
+                   >> call.gpuStart
+                   >> call.gpuDuration
+                   >> call.cpuStart
+                   >> call.cpuDuration
+                   >> call.vsizeStart
+                   >> call.vsizeDuration
+                   >> call.rssStart
+                   >> call.rssDuration
+                   >> call.pixels
+                   >> call.program
+                   >> call.name;
+
+            call.heapStart = 0;
+            call.heapDuration = 0;
+            if (stream >> call.heapStart
+                       >> call.heapDuration) {
+                profile->heapUsage = true;
             }
 
-            Profile::Program& program = profile->programs[call.program];
-            program.cpuTotal += call.cpuDuration;
-            program.gpuTotal += call.gpuDuration;
-            program.pixelTotal += call.pixels;
-            program.vsizeTotal += call.vsizeDuration;
-            program.rssTotal += call.rssDuration;
-            program.calls.push_back((unsigned int)(profile->calls.size() - 1));
+            addProfileCall(profile, totals, call);
+        } else if (type.compare("frame_end") == 0) {
+            addProfileFrameEnd(profile, totals);
         }
-    } else if (type.compare("frame_end") == 0) {
-        Profile::Frame frame;
-        frame.no = unsigned(profile->frames.size());
-
-        if (frame.no == 0) {
-            frame.gpuStart = 0;
-            frame.cpuStart = 0;
-            frame.vsizeStart = 0;
-            frame.rssStart = 0;
-            frame.calls.begin = 0;
-        } else {
-            frame.gpuStart = profile->frames.back().gpuStart + profile->frames.back().gpuDuration;
-            frame.cpuStart = profile->frames.back().cpuStart + profile->frames.back().cpuDuration;
-            frame.vsizeStart = profile->frames.back().vsizeStart + profile->frames.back().vsizeDuration;
-            frame.rssStart = profile->frames.back().rssStart + profile->frames.back().rssDuration;
-            frame.calls.begin = profile->frames.back().calls.end + 1;
+
+        offset = end - data + 1;
+    }
+    return offset;
+}
+
+size_t ProfileParser::parseBinary(const char* data, size_t size)
+{
+    size_t offset = 0;
+
+    if (state == STATE_BINARY_HEADER) {
+        size_t headerSize = PROFILE_BINARY_MAGIC_SIZE + 2 * sizeof(uint32_t);
+        if (size < headerSize) {
+            return 0;
+        }
+        uint32_t byteOrder;
+        memcpy(&byteOrder, data + PROFILE_BINARY_MAGIC_SIZE, sizeof byteOrder);
+        if (byteOrder != PROFILE_BINARY_BYTE_ORDER) {
+            std::cerr << "error: profile was written with a different byte order\n";
+            valid = false;
+            return size;
         }
+        memcpy(&fields, data + PROFILE_BINARY_MAGIC_SIZE + sizeof byteOrder, sizeof fields);
+        callSize = profileCallSize(fields);
+        state = STATE_BINARY;
+        offset = headerSize;
+    }
+
+    while (offset < size) {
+        char type = data[offset];
+        size_t available = size - offset - 1;
+        const char* payload = data + offset + 1;
 
-        frame.gpuDuration = lastGpuTime - frame.gpuStart;
-        frame.cpuDuration = lastCpuTime - frame.cpuStart;
-        frame.vsizeDuration = lastVsizeUsage - frame.vsizeStart;
-        frame.rssDuration = lastRssUsage - frame.rssStart;
-        frame.calls.end = (unsigned int)(profile->calls.size() - 1);
+        if (type == 'c') {
+            if (available < callSize) {
+                break;
+            }
+
+            uint32_t header[3];
+            memcpy(header, payload, sizeof header);
+            payload += sizeof header;
+
+            if (header[1] >= names.size()) {
+                std::cerr << "error: invalid name in profile\n";
+                valid = false;
+                return size;
+            }
+
+            Profile::Call call;
+            call.no = header[0];
+            call.name = names[header[1]];
+            call.program = header[2];
+            call.gpuStart = 0;
+            call.gpuDuration = 0;
+            call.cpuStart = 0;
+            call.cpuDuration = 0;
+            call.vsizeStart = 0;
+            call.vsizeDuration = 0;
+            call.rssStart = 0;
+            call.rssDuration = 0;
+            call.heapStart = 0;
+            call.heapDuration = 0;
+            call.pixels = 0;
+
+            int64_t values[4];
+            if (fields & PROFILE_FIELD_GPU) {
+                memcpy(values, payload, 2 * sizeof values[0]);
+                payload += 2 * sizeof values[0];
+                call.gpuStart = values[0];
+                call.gpuDuration = values[1];
+            }
+            if (fields & PROFILE_FIELD_CPU) {
+                memcpy(values, payload, 2 * sizeof values[0]);
+                payload += 2 * sizeof values[0];
+                call.cpuStart = values[0];
+                call.cpuDuration = values[1];
+            }
+            if (fields & PROFILE_FIELD_MEMORY) {
+                memcpy(values, payload, 4 * sizeof values[0]);
+                payload += 4 * sizeof values[0];
+                call.vsizeStart = values[0];
+                call.vsizeDuration = values[1];
+                call.rssStart = values[2];
+                call.rssDuration = values[3];
+            }
+            if (fields & PROFILE_FIELD_PIXELS) {
+                memcpy(&call.pixels, payload, sizeof call.pixels);
+                payload += sizeof call.pixels;
+            }
+            if (fields & PROFILE_FIELD_HEAP) {
+                memcpy(values, payload, 2 * sizeof values[0]);
+                call.heapStart = values[0];
+                call.heapDuration = values[1];
+                profile->heapUsage = true;
+            }
 
-        profile->frames.push_back(frame);
+            addProfileCall(profile, totals, call);
+            offset += 1 + callSize;
+        } else if (type == 'f') {
+            addProfileFrameEnd(profile, totals);
+            offset += 1;
+        } else if (type == 'n') {
+            uint32_t id;
+            uint32_t length;
+            if (available < sizeof id + sizeof length) {
+                break;
+            }
+            memcpy(&id, payload, sizeof id);
+            memcpy(&length, payload + sizeof id, sizeof length);
+            if (available < sizeof id + sizeof length + length) {
+                break;
+            }
+            if (id != names.size()) {
+                std::cerr << "error: unexpected name in profile\n";
+                valid = false;
+                return size;
+            }
+            names.push_back(std::string(payload + sizeof id + sizeof length, length));
+            offset += 1 + sizeof id + sizeof length + length;
+        } else {
+            std::cerr << "error: unexpected record in profile\n";
+            valid = false;
+            return size;
+        }
     }
+
+    return offset;
 }
 }
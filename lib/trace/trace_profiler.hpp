@@ -26,9 +26,13 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <ostream>
 #include <string>
 #include <vector>
-#include <stdint.h>
 
 namespace trace
 {
@@ -50,6 +54,10 @@ struct Profile {
         int64_t rssStart;
         int64_t rssDuration;
 
+        /* Memory allocated by the retracer itself */
+        int64_t heapStart;
+        int64_t heapDuration;
+
         int64_t pixels;
 
         std::string name;
@@ -77,7 +85,7 @@ struct Profile {
     };
 
     struct Program {
-        Program() : gpuTotal(0), cpuTotal(0), pixelTotal(0) {}
+        Program() : gpuTotal(0), cpuTotal(0), pixelTotal(0), vsizeTotal(0), rssTotal(0) {}
 
         uint64_t gpuTotal;
         uint64_t cpuTotal;
@@ -89,18 +97,123 @@ struct Profile {
         std::vector<unsigned> calls;
     };
 
+    Profile() : heapUsage(false) {}
+
     std::vector<Call> calls;
     std::vector<Frame> frames;
     std::vector<Program> programs;
+
+    /* Whether calls have heap usage, which the text format only has then */
+    bool heapUsage;
+};
+
+/*
+ * Running totals used to derive frame timings from call timings.
+ */
+struct ProfileTotals {
+    ProfileTotals() : lastGpuTime(0), lastCpuTime(0), lastVsizeUsage(0), lastRssUsage(0) {}
+
+    int64_t lastGpuTime;
+    int64_t lastCpuTime;
+    int64_t lastVsizeUsage;
+    int64_t lastRssUsage;
+};
+
+enum ProfileFormat {
+    /* One line of text per call, as consumed by scripts/profileshader.py
+     * and friends. */
+    PROFILE_FORMAT_TEXT,
+
+    /* Compact binary stream, meant for qapitrace.
+     *
+     * It starts with an 8 byte magic ("apiprof" plus version byte), a 32 bit
+     * byte order marker, and a 32 bit mask of the ProfileFields present,
+     * followed by records, each introduced by a single byte:
+     *
+     *   'n'  name string table entry: uint32 id, uint32 length, characters
+     *   'c'  call: uint32 no, uint32 name id, uint32 program, followed by
+     *        int64 start and duration pairs for the GPU time, CPU time,
+     *        vsize and rss, an int64 pixel count, and an int64 start and
+     *        duration pair for the heap usage, for those fields that are
+     *        present
+     *   'f'  end of frame
+     *
+     * So call records have a fixed size within a stream.  Names are only
+     * emitted the first time they are referred to.  Numbers are in the byte
+     * order of the machine that wrote the profile.
+     */
+    PROFILE_FORMAT_BINARY,
+};
+
+enum ProfileFields {
+    PROFILE_FIELD_GPU    = (1 << 0),
+    PROFILE_FIELD_CPU    = (1 << 1),
+    PROFILE_FIELD_MEMORY = (1 << 2),
+    PROFILE_FIELD_PIXELS = (1 << 3),
+    PROFILE_FIELD_HEAP   = (1 << 4),
+};
+
+#define PROFILE_BINARY_MAGIC "apiprof\1"
+#define PROFILE_BINARY_MAGIC_SIZE 8
+#define PROFILE_BINARY_BYTE_ORDER 0x01020304
+
+void addProfileCall(Profile* profile, ProfileTotals& totals, const Profile::Call& call);
+void addProfileFrameEnd(Profile* profile, ProfileTotals& totals);
+
+/* Write a profile in the text format. */
+void writeProfileText(std::ostream& os, const Profile& profile);
+
+
+/*
+ * Incremental profile reader.
+ *
+ * Accepts both the binary and the text formats, in arbitrarily sized pieces,
+ * as they come out of the retracer's standard output.
+ */
+class ProfileParser
+{
+public:
+    ProfileParser(Profile* profile);
+
+    void parse(const char* data, size_t size);
+
+    /* Returns false if the stream was found to be malformed. */
+    bool isValid() const {
+        return valid;
+    }
+
+private:
+    enum State {
+        STATE_UNKNOWN,
+        STATE_TEXT,
+        STATE_BINARY_HEADER,
+        STATE_BINARY,
+    };
+
+    Profile* profile;
+    ProfileTotals totals;
+    State state;
+    bool valid;
+    uint32_t fields;
+    size_t callSize;
+    std::string pending;
+    std::vector<std::string> names;
+
+    size_t consume(const char* data, size_t size);
+    size_t parseText(const char* data, size_t size);
+    size_t parseBinary(const char* data, size_t size);
 };
 
+
 class Profiler
 {
 public:
     Profiler();
     ~Profiler();
 
-    void setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_);
+    void setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_,
+               bool heapUsage_ = false,
+               ProfileFormat format_ = PROFILE_FORMAT_TEXT);
 
     void addCall(unsigned no,
                  const char* name,
@@ -109,7 +222,8 @@ public:
                  int64_t gpuStart, int64_t gpuDuration,
                  int64_t cpuStart, int64_t cpuDuration,
                  int64_t vsizeStart, int64_t vsizeDuration,
-                 int64_t rssStart, int64_t rssDuration);
+                 int64_t rssStart, int64_t rssDuration,
+                 int64_t heapStart = 0, int64_t heapDuration = 0);
 
     void addFrameEnd();
 
@@ -125,6 +239,13 @@ public:
     int64_t getBaseVsizeUsage();
     int64_t getBaseRssUsage();
 
+    ProfileFormat getFormat() const {
+        return format;
+    }
+
+    /* Write out any buffered output. */
+    void flush();
+
     static void parseLine(const char* line, Profile* profile);
 
 private:
@@ -138,6 +259,17 @@ private:
     bool gpuTimes;
     bool pixelsDrawn;
     bool memoryUsage;
+    bool heapUsage;
+
+    ProfileFormat format;
+
+    /* Binary output is accumulated here and written out in large chunks. */
+    std::vector<char> buffer;
+    /* Keyed by contents, as signatures are freed between traces. */
+    std::map<std::string, uint32_t> names;
+
+    void write(const void* data, size_t size);
+    uint32_t nameId(const char* name);
 };
 }
 
@@ -0,0 +1,268 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdio.h>
+
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "os_process.hpp"
+#include "os_string.hpp"
+#include "trace_format.hpp"
+#include "trace_parser.hpp"
+#include "trace_test_file.hpp"
+#include "trace_writer_local.hpp"
+
+using namespace trace;
+
+
+static const FunctionSig swapSig = {1, "glXSwapBuffers", 1, testArgNames};
+
+static const char *filename = "trace_segment_test.trace";
+
+
+static os::String
+segmentName(unsigned index)
+{
+    return os::String::format("trace_segment_test.%04u.trace", index);
+}
+
+
+static unsigned
+enterCall(const FunctionSig *sig, unsigned no)
+{
+    unsigned call = localWriter.beginEnter(sig);
+    localWriter.beginArg(0);
+    localWriter.writeUInt(no);
+    localWriter.endArg();
+    localWriter.endEnter();
+    return call;
+}
+
+
+static void
+leaveCall(unsigned call)
+{
+    localWriter.beginLeave(call);
+    localWriter.beginReturn();
+    localWriter.writeUInt(call);
+    localWriter.endReturn();
+    localWriter.endLeave();
+}
+
+
+/**
+ * Trace through the LocalWriter singleton, starting a new segment every
+ * so many frames.
+ */
+class SegmentedTrace : public ::testing::Test
+{
+protected:
+    void
+    SetUp(void) override {
+        os::setEnvironment("TRACE_FILE", filename);
+        os::setEnvironment("TRACE_SEGMENT_FRAMES", "2");
+    }
+
+    void
+    TearDown(void) override {
+        localWriter.close();
+        os::unsetEnvironment("TRACE_FILE");
+        os::unsetEnvironment("TRACE_SEGMENT_FRAMES");
+
+        remove(filename);
+        for (unsigned i = 0; remove(segmentName(i)) == 0; ++i)
+            ;
+    }
+
+    /**
+     * Trace frames of a foo call followed by a swap, each taking its call
+     * number as argument.
+     */
+    void
+    writeFrames(unsigned first, unsigned last) {
+        for (unsigned no = first; no < last; ++no) {
+            leaveCall(enterCall(no % 2 ? &swapSig : &fooSig, no));
+        }
+        localWriter.close();
+    }
+
+    std::vector<unsigned>
+    readManifest(void) {
+        std::vector<unsigned> starts;
+        FILE *fp = fopen(filename, "rt");
+        if (!fp) {
+            ADD_FAILURE() << "no manifest";
+            return starts;
+        }
+        char magic[64];
+        unsigned version;
+        EXPECT_EQ(2, fscanf(fp, "%63s %u", magic, &version));
+        EXPECT_STREQ(TRACE_SEGMENTS_MAGIC, magic);
+        unsigned start;
+        char name[64];
+        while (fscanf(fp, "%u %63s", &start, name) == 2) {
+            EXPECT_STREQ(segmentName(starts.size()).str(), name);
+            starts.push_back(start);
+        }
+        fclose(fp);
+        return starts;
+    }
+};
+
+
+static void
+expectFrameCall(Call *call, unsigned no)
+{
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(no, call->no);
+    EXPECT_STREQ(no % 2 ? "glXSwapBuffers" : "foo", call->sig->name);
+    ASSERT_EQ(1u, call->args.size());
+    EXPECT_EQ(no, call->args[0].value->toUInt());
+    EXPECT_FALSE(call->flags & CALL_FLAG_INCOMPLETE);
+}
+
+
+TEST_F(SegmentedTrace, manifest)
+{
+    writeFrames(0, 12);
+
+    std::vector<unsigned> starts = readManifest();
+    std::vector<unsigned> expected = {0, 4, 8};
+    EXPECT_EQ(expected, starts);
+}
+
+
+TEST_F(SegmentedTrace, parse)
+{
+    writeFrames(0, 12);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    for (unsigned no = 0; no < 12; ++no) {
+        Call *call = parser.parse_call();
+        expectFrameCall(call, no);
+        delete call;
+    }
+    EXPECT_TRUE(parser.parse_call() == NULL);
+}
+
+
+TEST_F(SegmentedTrace, bookmarks)
+{
+    writeFrames(0, 12);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    ParseBookmark bookmarks[12];
+    for (unsigned no = 0; no < 12; ++no) {
+        parser.getBookmark(bookmarks[no]);
+        delete parser.parse_call();
+    }
+
+    // Jump backwards into an earlier segment and read across a boundary
+    parser.setBookmark(bookmarks[3]);
+    for (unsigned no = 3; no < 8; ++no) {
+        Call *call = parser.parse_call();
+        expectFrameCall(call, no);
+        delete call;
+    }
+
+    // Jump forwards into a later segment
+    parser.setBookmark(bookmarks[11]);
+    Call *call = parser.parse_call();
+    expectFrameCall(call, 11);
+    delete call;
+    EXPECT_TRUE(parser.parse_call() == NULL);
+}
+
+
+/*
+ * A call in flight on another thread doesn't hold back the segment, and
+ * shows as incomplete in the segment it was entered in.
+ */
+TEST_F(SegmentedTrace, straddle)
+{
+    std::promise<void> entered;
+    std::promise<void> resume;
+    std::thread thread([&] () {
+        unsigned call = enterCall(&fooSig, 0);
+        entered.set_value();
+        resume.get_future().wait();
+        leaveCall(call);
+    });
+    entered.get_future().wait();
+
+    for (unsigned no = 1; no < 6; ++no) {
+        leaveCall(enterCall(no % 2 ? &swapSig : &fooSig, no));
+    }
+    resume.set_value();
+    thread.join();
+    writeFrames(6, 8);
+
+    std::vector<unsigned> starts = readManifest();
+    std::vector<unsigned> expected = {0, 4};
+    EXPECT_EQ(expected, starts);
+
+    Parser parser;
+    ASSERT_TRUE(parser.open(filename));
+
+    for (unsigned no = 1; no < 4; ++no) {
+        Call *call = parser.parse_call();
+        expectFrameCall(call, no);
+        delete call;
+    }
+
+    Call *call = parser.parse_call();
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(0u, call->no);
+    EXPECT_TRUE(call->flags & CALL_FLAG_INCOMPLETE);
+    EXPECT_TRUE(call->ret == NULL);
+    delete call;
+
+    // Its leave in the next segment is skipped
+    for (unsigned no = 4; no < 8; ++no) {
+        call = parser.parse_call();
+        expectFrameCall(call, no);
+        ASSERT_TRUE(call->ret != NULL);
+        EXPECT_EQ(no - 4, call->ret->toUInt());
+        delete call;
+    }
+    EXPECT_TRUE(parser.parse_call() == NULL);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
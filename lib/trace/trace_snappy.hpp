@@ -31,4 +31,21 @@
 #define SNAPPY_BYTE1 'a'
 #define SNAPPY_BYTE2 't'
 
+/*
+ * Files which may contain chunks compressed with other codecs than snappy
+ * have a different second byte, so that older versions refuse them.
+ */
+#define SNAPPY_BYTE2_CODECS 'c'
+
+/*
+ * In such files the upper bits of each chunk's length select how the chunk
+ * was compressed, see trace_file_snappy.cpp.
+ */
+#define SNAPPY_CHUNK_LENGTH_MASK 0x0fffffff
+#define SNAPPY_CHUNK_CODEC_SHIFT 28
+
+#define SNAPPY_CODEC_SNAPPY 0
+#define SNAPPY_CODEC_STORED 1
+#define SNAPPY_CODEC_ZLIB   2
+
 
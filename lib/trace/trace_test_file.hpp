@@ -0,0 +1,112 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Helpers shared by the tests which write a small trace and parse it back.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#include "gtest/gtest.h"
+
+#include "trace_writer.hpp"
+
+
+static const char *testArgNames[] = {"x"};
+
+static const trace::FunctionSig fooSig = {0, "foo", 1, testArgNames};
+static const trace::FunctionSig barSig = {1, "bar", 1, testArgNames};
+
+
+/*
+ * Begin a call taking its number as argument.  Anything else the call enters
+ * with can be written before endCall.
+ */
+static inline unsigned
+beginCall(trace::Writer &writer, const trace::FunctionSig *sig, unsigned no)
+{
+    unsigned call = writer.beginEnter(sig, 0);
+    writer.beginArg(0);
+    writer.writeUInt(no);
+    writer.endArg();
+    return call;
+}
+
+static inline void
+endCall(trace::Writer &writer, unsigned call)
+{
+    writer.endEnter();
+    writer.beginLeave(call);
+    writer.endLeave();
+}
+
+/* Write call NO, alternating between foo and bar. */
+static inline void
+writeCall(trace::Writer &writer, unsigned no)
+{
+    endCall(writer, beginCall(writer, no % 2 ? &barSig : &fooSig, no));
+}
+
+static inline void
+expectCall(trace::Call *call, unsigned no)
+{
+    ASSERT_TRUE(call != NULL);
+    EXPECT_EQ(no, call->no);
+    EXPECT_STREQ(no % 2 ? "bar" : "foo", call->name());
+    ASSERT_EQ(1u, call->args.size());
+    EXPECT_EQ(no, call->args[0].value->toUInt());
+}
+
+
+/*
+ * Writes the trace in SetUp, and removes it in TearDown.
+ */
+class TraceFileTest : public ::testing::Test
+{
+protected:
+    const char *filename;
+
+    TraceFileTest(const char *_filename) :
+        filename(_filename)
+    {}
+
+    virtual void
+    write(trace::Writer &writer) = 0;
+
+    void
+    SetUp(void) override {
+        trace::Writer writer;
+        ASSERT_TRUE(writer.open(filename));
+        write(writer);
+        writer.close();
+    }
+
+    void
+    TearDown(void) override {
+        remove(filename);
+    }
+};
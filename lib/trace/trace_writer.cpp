@@ -41,7 +41,8 @@ namespace trace {
 
 
 Writer::Writer() :
-    call_no(0)
+    call_no(0),
+    bytes_written(0)
 {
     m_file = nullptr;
 }
@@ -59,19 +60,26 @@ Writer::close(void) {
 
 bool
 Writer::open(const char *filename) {
+    return open(createSnappyStream(filename));
+}
+
+bool
+Writer::open(OutStream *stream) {
     close();
 
-    m_file = createSnappyStream(filename);
+    m_file = stream;
     if (!m_file) {
         return false;
     }
 
     call_no = 0;
+    bytes_written = 0;
     functions.clear();
     structs.clear();
     enums.clear();
     bitmasks.clear();
     frames.clear();
+    stacks.clear();
 
     _writeUInt(TRACE_VERSION);
 
@@ -81,6 +89,7 @@ Writer::open(const char *filename) {
 void inline
 Writer::_write(const void *sBuffer, size_t dwBytesToWrite) {
     m_file->write(sBuffer, dwBytesToWrite);
+    bytes_written += dwBytesToWrite;
 }
 
 void inline
@@ -142,6 +151,20 @@ void Writer::beginBacktrace(unsigned num_frames) {
     }
 }
 
+bool Writer::beginStack(Id id) {
+    _writeByte(trace::CALL_STACK);
+    _writeUInt(id);
+    if (lookup(stacks, id)) {
+        return false;
+    }
+    stacks[id] = true;
+    return true;
+}
+
+void Writer::beginStackFrames(unsigned num_frames) {
+    _writeUInt(num_frames);
+}
+
 void Writer::writeStackFrame(const RawStackFrame *frame) {
     _writeUInt(frame->id);
     if (!lookup(frames, frame->id)) {
@@ -323,6 +346,22 @@ void Writer::writeBlob(const void *data, size_t size) {
     }
 }
 
+void Writer::writePackedArray(PackedType type, const void *values, size_t count) {
+    _writeByte(trace::TYPE_PACKED_ARRAY);
+    _writeByte(type);
+    _writeUInt(count);
+    if (count) {
+        size_t size = getPackedTypeSize(type);
+#ifdef HAVE_BIGENDIAN
+        std::vector<char> buf((const char *)values, (const char *)values + count * size);
+        swapPackedBytes(buf.data(), size, count);
+        _write(buf.data(), buf.size());
+#else
+        _write(values, count * size);
+#endif
+    }
+}
+
 void Writer::writeEnum(const EnumSig *sig, signed long long value) {
     _writeByte(trace::TYPE_ENUM);
     _writeUInt(sig->id);
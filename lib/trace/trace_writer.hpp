@@ -35,6 +35,7 @@
 #include <vector>
 
 #include "trace_model.hpp"
+#include "trace_format.hpp"
 
 namespace trace {
     class OutStream;
@@ -44,17 +45,23 @@ namespace trace {
         OutStream *m_file;
         unsigned call_no;
 
+        // Uncompressed bytes written since opened
+        unsigned long long bytes_written;
+
         std::vector<bool> functions;
         std::vector<bool> structs;
         std::vector<bool> enums;
         std::vector<bool> bitmasks;
         std::vector<bool> frames;
+        std::vector<bool> stacks;
 
     public:
         Writer();
         ~Writer();
 
         bool open(const char *filename);
+        /* Write to an already created stream, taking ownership of it. */
+        bool open(OutStream *stream);
         void close(void);
 
         unsigned beginEnter(const FunctionSig *sig, unsigned thread_id);
@@ -73,6 +80,15 @@ namespace trace {
         void writeStackFrame(const RawStackFrame *frame);
         inline void endBacktrace(void) {}
 
+        /**
+         * Refer to a backtrace shared by several calls, which is only written
+         * in full the first time.  Returns true if so, in which case the
+         * caller must follow with beginStackFrames and writeStackFrame.
+         */
+        bool beginStack(Id id);
+        void beginStackFrames(unsigned num_frames);
+        inline void endStack(void) {}
+
         void beginArray(size_t length);
         inline void endArray(void) {}
 
@@ -95,6 +111,18 @@ namespace trace {
         void writeWString(const wchar_t *str);
         void writeWString(const wchar_t *str, size_t size);
         void writeBlob(const void *data, size_t size);
+
+        /**
+         * Write an array of numbers in one go, rather than element by element.
+         */
+        void writePackedArray(PackedType type, const void *values, size_t count);
+
+        template< class T >
+        inline void
+        writePackedArray(const T *values, size_t count) {
+            writePackedArray(getPackedType<T>(), values, count);
+        }
+
         void writeEnum(const EnumSig *sig, signed long long value);
         void writeBitmask(const BitmaskSig *sig, unsigned long long value);
         void writeNull(void);
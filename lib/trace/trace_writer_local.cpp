@@ -25,18 +25,23 @@
 
 
 #include <assert.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "os.hpp"
+#include "os_time.hpp"
 #include "os_thread.hpp"
 #include "os_string.hpp"
 #include "os_version.hpp"
 #include "trace_ostream.hpp"
 #include "trace_writer_local.hpp"
 #include "trace_format.hpp"
+#include "trace_parser.hpp"
 #include "os_backtrace.hpp"
 
 
@@ -55,6 +60,37 @@ const FunctionSig free_sig = {2, "free", 1, free_args};
 static const char *realloc_args[2] = {"ptr", "size"};
 const FunctionSig realloc_sig = {3, "realloc", 2, realloc_args};
 
+static const char *stats_args[7] = {"functions", "calls", "bytes", "trace_ns", "call_ns", "lock_ns", "backtrace_ns"};
+const FunctionSig stats_sig = {4, "apitrace_stats", 7, stats_args};
+
+
+/**
+ * Parse a size with an optional K, M, or G suffix.
+ */
+static unsigned long long
+parseSize(const char *s)
+{
+    char *end;
+    unsigned long long size = strtoull(s, &end, 0);
+    switch (*end) {
+    case 'G':
+    case 'g':
+        size <<= 10;
+        /* fall-through */
+    case 'M':
+    case 'm':
+        size <<= 10;
+        /* fall-through */
+    case 'K':
+    case 'k':
+        size <<= 10;
+        break;
+    default:
+        break;
+    }
+    return size;
+}
+
 
 static void exceptionCallback(void)
 {
@@ -62,15 +98,198 @@ static void exceptionCallback(void)
 }
 
 
+/*
+ * Capture overhead statistics.
+ *
+ * Times are in os::getTime() units.  "trace" is the time spent serializing
+ * (and compressing) a call, "call" the time between the two halves of the
+ * call -- mostly the real entry point --, and "lock" the time spent waiting
+ * for other threads to finish writing.
+ */
+struct FunctionStats {
+    const FunctionSig *sig;
+    unsigned long long calls;
+    unsigned long long bytes;
+    long long traceTime;
+    long long callTime;
+    long long lockTime;
+    long long backtraceTime;
+};
+
+struct PendingCall {
+    unsigned call_no;
+    Id id;
+    long long time;
+};
+
+/*
+ * Counters are kept per thread, and only summed when reporting.  They are
+ * only ever touched with the LocalWriter mutex held.
+ */
+struct ThreadStats {
+    /* Indexed by signature ID */
+    std::vector<FunctionStats> functions;
+
+    /* Calls whose real entry point is being executed */
+    std::vector<PendingCall> pending;
+
+    /* Call being written */
+    Id id;
+    long long start;
+    unsigned long long bytes;
+};
+
+static const Id NO_CALL = ~0U;
+
+/* Maximum number of shared backtraces */
+#define MAX_STACKS 4096
+
+static std::vector<ThreadStats *> threadStats;
+
+static OS_THREAD_LOCAL ThreadStats *thread_stats;
+
+static volatile sig_atomic_t statsRequested = 0;
+
+#ifndef _WIN32
+/* The application's own SIGUSR2 handling, if any */
+static struct sigaction statsPreviousAction;
+
+static void
+statsSignalHandler(int sig, siginfo_t *info, void *context)
+{
+    statsRequested = 1;
+
+    const struct sigaction &previous = statsPreviousAction;
+    if (previous.sa_flags & SA_SIGINFO) {
+        previous.sa_sigaction(sig, info, context);
+    } else if (previous.sa_handler != SIG_DFL &&
+               previous.sa_handler != SIG_IGN) {
+        previous.sa_handler(sig);
+    }
+}
+#endif
+
+static inline ThreadStats *
+getThreadStats(void)
+{
+    ThreadStats *ts = thread_stats;
+    if (!ts) {
+        ts = new ThreadStats;
+        ts->id = NO_CALL;
+        threadStats.push_back(ts);
+        thread_stats = ts;
+    }
+    return ts;
+}
+
+static inline FunctionStats &
+getFunctionStats(ThreadStats *ts, const FunctionSig *sig)
+{
+    if (sig->id >= ts->functions.size()) {
+        FunctionStats zero = FunctionStats();
+        ts->functions.resize(sig->id + 1, zero);
+    }
+    FunctionStats &fs = ts->functions[sig->id];
+    fs.sig = sig;
+    return fs;
+}
+
+static void
+sumStats(std::vector<FunctionStats> &totals)
+{
+    FunctionStats zero = FunctionStats();
+    for (auto ts : threadStats) {
+        if (ts->functions.size() > totals.size()) {
+            totals.resize(ts->functions.size(), zero);
+        }
+        for (size_t id = 0; id < ts->functions.size(); ++id) {
+            const FunctionStats &fs = ts->functions[id];
+            FunctionStats &total = totals[id];
+            if (fs.calls) {
+                total.sig = fs.sig;
+                total.calls += fs.calls;
+                total.bytes += fs.bytes;
+                total.traceTime += fs.traceTime;
+                total.callTime += fs.callTime;
+                total.lockTime += fs.lockTime;
+                total.backtraceTime += fs.backtraceTime;
+            }
+        }
+    }
+
+    totals.erase(std::remove_if(totals.begin(), totals.end(),
+                                [](const FunctionStats &fs) { return fs.calls == 0; }),
+                 totals.end());
+
+    // Most expensive first
+    std::sort(totals.begin(), totals.end(),
+              [](const FunctionStats &a, const FunctionStats &b) {
+                  return a.traceTime + a.lockTime + a.backtraceTime >
+                         b.traceTime + b.lockTime + b.backtraceTime;
+              });
+}
+
+static inline double
+toMilliseconds(long long time)
+{
+    return time * 1.0e3 / os::timeFrequency;
+}
+
+static inline unsigned long long
+toNanoseconds(long long time)
+{
+    return time * 1.0e9 / os::timeFrequency;
+}
+
+
 LocalWriter::LocalWriter() :
-    acquired(0)
+    acquired(0),
+    fileSerial(0),
+    segmentSize(0),
+    segmentFrames(0),
+    segmentFrameCount(0),
+    maxStacks(MAX_STACKS),
+    stats(false),
+    statsInTrace(false)
 {
     os::String process = os::getProcessName();
     os::log("apitrace: loaded into %s\n", process.str());
 
+#ifndef _WIN32
+    // Before the exception handlers take it over
+    struct sigaction previous;
+    if (sigaction(SIGUSR2, NULL, &previous) == 0 &&
+        !((previous.sa_flags & SA_SIGINFO) &&
+          previous.sa_sigaction == statsSignalHandler)) {
+        statsPreviousAction = previous;
+    }
+#endif
+
     // Install the signal handlers as early as possible, to prevent
     // interfering with the application's signal handling.
     os::setExceptionCallback(exceptionCallback);
+
+    const char *statsOption = getenv("APITRACE_STATS");
+    if (statsOption && strcmp(statsOption, "0") != 0) {
+        stats = true;
+        statsInTrace = strcmp(statsOption, "trace") == 0;
+#ifndef _WIN32
+        // Print the statistics so far on SIGUSR2.  The handler merely sets a
+        // flag, and the table is printed on the next traced call.  Signals
+        // the application already handled are still passed on to it, but
+        // no longer terminate it by default.
+        if ((statsPreviousAction.sa_flags & SA_SIGINFO) ||
+            (statsPreviousAction.sa_handler != SIG_DFL &&
+             statsPreviousAction.sa_handler != SIG_IGN)) {
+            os::log("apitrace: warning: SIGUSR2 is handled by the application too\n");
+        }
+        struct sigaction action;
+        action.sa_sigaction = statsSignalHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigaction(SIGUSR2, &action, NULL);
+#endif
+    }
 }
 
 LocalWriter::~LocalWriter()
@@ -78,6 +297,15 @@ LocalWriter::~LocalWriter()
     os::resetExceptionCallback();
     checkProcessId();
 
+    if (stats) {
+        mutex.lock();
+        dumpStats();
+        if (statsInTrace && m_file) {
+            writeStats();
+        }
+        mutex.unlock();
+    }
+
     os::String process = os::getProcessName();
     os::log("apitrace: unloaded from %s\n", process.str());
 }
@@ -139,9 +367,23 @@ LocalWriter::open(void) {
 
     os::log("apitrace: tracing to %s\n", lpFileName);
 
-    if (!Writer::open(lpFileName)) {
+    const char *size = getenv("TRACE_SEGMENT_SIZE");
+    segmentSize = size ? parseSize(size) : 0;
+    const char *frames = getenv("TRACE_SEGMENT_FRAMES");
+    segmentFrames = frames ? strtoul(frames, NULL, 0) : 0;
+
+    if (segmentSize || segmentFrames) {
+        // The trace file becomes a manifest listing the segments
+        manifestName = lpFileName;
+        segmentPrefix = lpFileName;
+        segmentPrefix.trimExtension();
+        segmentStarts.clear();
+        openSegment();
+    } else if (!Writer::open(lpFileName)) {
         os::log("apitrace: error: failed to open %s\n", lpFileName);
         os::abort();
+    } else {
+        ++fileSerial;
     }
 
     pid = os::getCurrentProcessId();
@@ -152,6 +394,153 @@ LocalWriter::open(void) {
 #endif
 }
 
+os::String
+LocalWriter::segmentName(unsigned index) {
+    return os::String::format("%s.%04u.trace", segmentPrefix.str(), index);
+}
+
+void
+LocalWriter::openSegment(void) {
+    unsigned firstCall = 0;
+    if (!segmentStarts.empty()) {
+        firstCall = segmentStarts.back() + call_no;
+    }
+
+    os::String fileName = segmentName(segmentStarts.size());
+    os::log("apitrace: starting segment %s\n", fileName.str());
+    if (!Writer::open(fileName)) {
+        os::log("apitrace: error: failed to open %s\n", fileName.str());
+        os::abort();
+    }
+
+    ++fileSerial;
+    segmentStarts.push_back(firstCall);
+    segmentFrameCount = 0;
+
+    writeManifest();
+}
+
+/*
+ * Rewrite the manifest every time a segment is started, so that the finished
+ * segments can be processed while the capture continues.
+ */
+void
+LocalWriter::writeManifest(void) {
+    os::String tmpName = os::String::format("%s.tmp", manifestName.str());
+    FILE *fp = fopen(tmpName, "wt");
+    if (!fp) {
+        os::log("apitrace: warning: failed to write %s\n", tmpName.str());
+        return;
+    }
+
+    fprintf(fp, "%s 1\n", TRACE_SEGMENTS_MAGIC);
+    for (unsigned i = 0; i < segmentStarts.size(); ++i) {
+        os::String fileName = segmentName(i);
+        fileName.trimDirectory();
+        fprintf(fp, "%u %s\n", segmentStarts[i], fileName.str());
+    }
+    fclose(fp);
+
+#ifdef _WIN32
+    remove(manifestName);
+#endif
+    if (rename(tmpName, manifestName) != 0) {
+        os::log("apitrace: warning: failed to write %s\n", manifestName.str());
+    }
+}
+
+bool
+LocalWriter::isFrameEnd(const FunctionSig *sig) {
+    if (sig->id >= frameEnds.size()) {
+        frameEnds.resize(sig->id + 1, -1);
+    }
+    signed char &frameEnd = frameEnds[sig->id];
+    if (frameEnd < 0) {
+        frameEnd = (Parser::lookupCallFlags(sig->name) & CALL_FLAG_END_FRAME) ? 1 : 0;
+    }
+    return frameEnd;
+}
+
+bool
+LocalWriter::isBacktraceNeeded(const FunctionSig *sig) {
+    if (sig->id >= backtraces.size()) {
+        backtraces.resize(sig->id + 1, -1);
+    }
+    signed char &backtrace = backtraces[sig->id];
+    if (backtrace < 0) {
+        backtrace = os::backtrace_is_needed(sig->name) ? 1 : 0;
+    }
+    return backtrace;
+}
+
+#define BACKTRACE_DEPTH 10
+
+void
+LocalWriter::writeBacktrace(void) {
+    uintptr_t addresses[BACKTRACE_DEPTH];
+    unsigned num_addresses = os::get_backtrace_addresses(addresses, BACKTRACE_DEPTH);
+    if (!num_addresses) {
+        // Unsupported, so symbolize right away
+        std::vector<RawStackFrame> backtrace = os::get_backtrace();
+        beginBacktrace(backtrace.size());
+        for (auto & frame : backtrace) {
+            writeStackFrame(&frame);
+        }
+        endBacktrace();
+        return;
+    }
+
+    writeBacktrace(addresses, num_addresses);
+}
+
+void
+LocalWriter::writeFullBacktrace(const uintptr_t *addresses, unsigned num_addresses) {
+    std::vector<RawStackFrame> backtrace = os::symbolize_backtrace(addresses, num_addresses);
+    beginBacktrace(backtrace.size());
+    for (auto & frame : backtrace) {
+        writeStackFrame(&frame);
+    }
+    endBacktrace();
+}
+
+void
+LocalWriter::writeBacktrace(const uintptr_t *addresses, unsigned num_addresses) {
+    size_t hash = num_addresses;
+    for (unsigned i = 0; i < num_addresses; ++i) {
+        hash = hash * 31 + addresses[i];
+    }
+
+    Id id;
+    auto it = stackIds.find(hash);
+    if (it == stackIds.end()) {
+        if (stackAddresses.size() >= maxStacks) {
+            writeFullBacktrace(addresses, num_addresses);
+            return;
+        }
+        id = stackAddresses.size();
+        stackAddresses.emplace_back(addresses, addresses + num_addresses);
+        stackIds[hash] = id;
+    } else {
+        id = it->second;
+        const std::vector<uintptr_t> &stack = stackAddresses[id];
+        if (stack.size() != num_addresses ||
+            !std::equal(stack.begin(), stack.end(), addresses)) {
+            // Hash collision, so don't share it
+            writeFullBacktrace(addresses, num_addresses);
+            return;
+        }
+    }
+
+    if (beginStack(id)) {
+        std::vector<RawStackFrame> backtrace = os::symbolize_backtrace(addresses, num_addresses);
+        beginStackFrames(backtrace.size());
+        for (auto & frame : backtrace) {
+            writeStackFrame(&frame);
+        }
+    }
+    endStack();
+}
+
 static uintptr_t next_thread_num = 1;
 
 static OS_THREAD_LOCAL uintptr_t thread_num;
@@ -171,12 +560,20 @@ void LocalWriter::checkProcessId(void) {
 }
 
 unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
+    long long lockStart = stats ? os::getTime() : 0;
+
     mutex.lock();
     ++acquired;
 
-    checkProcessId();
-    if (!m_file) {
-        open();
+    ThreadStats *ts = NULL;
+    long long start = 0;
+    if (stats) {
+        start = os::getTime();
+        ts = getThreadStats();
+        if (statsRequested) {
+            statsRequested = 0;
+            dumpStats();
+        }
     }
 
     uintptr_t this_thread_num = thread_num;
@@ -187,36 +584,237 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
 
     assert(this_thread_num);
     unsigned thread_id = this_thread_num - 1;
+
+    checkProcessId();
+    if (!m_file) {
+        open();
+    } else if (((segmentSize && bytes_written >= segmentSize) ||
+                (segmentFrames && segmentFrameCount >= segmentFrames)) &&
+               inflightCalls.find(thread_id) == inflightCalls.end()) {
+        // Other threads may be in the middle of a call, but waiting for all
+        // of them to return could take forever.
+        openSegment();
+    }
+
+    if (segmentFrames && isFrameEnd(sig)) {
+        ++segmentFrameCount;
+    }
+
+    FunctionStats *fs = NULL;
+    if (ts) {
+        fs = &getFunctionStats(ts, sig);
+        ++fs->calls;
+        fs->lockTime += start - lockStart;
+        ts->id = sig->id;
+        ts->start = start;
+        ts->bytes = bytes_written;
+    }
+
     unsigned call_no = Writer::beginEnter(sig, thread_id);
-    if (!fake && os::backtrace_is_needed(sig->name)) {
-        std::vector<RawStackFrame> backtrace = os::get_backtrace();
-        beginBacktrace(backtrace.size());
-        for (auto & frame : backtrace) {
-            writeStackFrame(&frame);
+    if (!fake && isBacktraceNeeded(sig)) {
+        long long backtraceStart = fs ? os::getTime() : 0;
+        writeBacktrace();
+        if (fs) {
+            long long backtraceTime = os::getTime() - backtraceStart;
+            fs->backtraceTime += backtraceTime;
+            // Don't count it as serialization time too
+            ts->start += backtraceTime;
         }
-        endBacktrace();
+    }
+    if (segmentSize || segmentFrames) {
+        InflightCall entered = {call_no, fileSerial};
+        inflightCalls[thread_id].push_back(entered);
+    }
+    if (ts) {
+        PendingCall pending = {call_no, sig->id, 0};
+        ts->pending.push_back(pending);
     }
     return call_no;
 }
 
 void LocalWriter::endEnter(void) {
     Writer::endEnter();
+    if (stats) {
+        ThreadStats *ts = thread_stats;
+        if (ts && ts->id != NO_CALL) {
+            long long now = os::getTime();
+            FunctionStats &fs = ts->functions[ts->id];
+            fs.traceTime += now - ts->start;
+            fs.bytes += bytes_written - ts->bytes;
+            ts->id = NO_CALL;
+            if (!ts->pending.empty()) {
+                ts->pending.back().time = now;
+            }
+        }
+    }
     --acquired;
     mutex.unlock();
 }
 
 void LocalWriter::beginLeave(unsigned call) {
+    long long lockStart = stats ? os::getTime() : 0;
+
     mutex.lock();
     ++acquired;
+
+    if (stats) {
+        ThreadStats *ts = thread_stats;
+        if (ts) {
+            // Calls which never left are dropped along the way
+            size_t i = ts->pending.size();
+            while (i > 0 && ts->pending[i - 1].call_no != call) {
+                --i;
+            }
+            if (i > 0) {
+                const PendingCall &pending = ts->pending[i - 1];
+                long long now = os::getTime();
+                FunctionStats &fs = ts->functions[pending.id];
+                fs.callTime += lockStart - pending.time;
+                fs.lockTime += now - lockStart;
+                ts->id = pending.id;
+                ts->start = now;
+                ts->bytes = bytes_written;
+                ts->pending.resize(i - 1);
+            }
+        }
+    }
+
+    if (segmentSize || segmentFrames) {
+        std::unordered_map<unsigned, std::vector<InflightCall> >::iterator it =
+            inflightCalls.find(thread_num - 1);
+        if (it != inflightCalls.end()) {
+            // Calls which never left are dropped along the way
+            std::vector<InflightCall> &inflight = it->second;
+            size_t i = inflight.size();
+            while (i > 0 && inflight[i - 1].call_no != call) {
+                --i;
+            }
+            if (i > 0) {
+                if (inflight[i - 1].fileSerial != fileSerial) {
+                    // The call was entered in a previous segment, where it
+                    // will show as incomplete, and its number means nothing
+                    // in this one.  Use the number of the next call instead,
+                    // which the parser doesn't know yet and so skips.
+                    call = call_no;
+                }
+                inflight.resize(i - 1);
+                if (inflight.empty()) {
+                    inflightCalls.erase(it);
+                }
+            }
+        }
+    }
+
     Writer::beginLeave(call);
 }
 
 void LocalWriter::endLeave(void) {
     Writer::endLeave();
+    if (stats) {
+        ThreadStats *ts = thread_stats;
+        if (ts && ts->id != NO_CALL) {
+            FunctionStats &fs = ts->functions[ts->id];
+            fs.traceTime += os::getTime() - ts->start;
+            fs.bytes += bytes_written - ts->bytes;
+            ts->id = NO_CALL;
+        }
+    }
     --acquired;
     mutex.unlock();
 }
 
+/*
+ * Print a table with the statistics so far.  Must be called with the mutex
+ * held.
+ */
+void LocalWriter::dumpStats(void) {
+    std::vector<FunctionStats> totals;
+    sumStats(totals);
+
+    FunctionStats all = FunctionStats();
+    for (auto & fs : totals) {
+        all.calls += fs.calls;
+        all.bytes += fs.bytes;
+        all.traceTime += fs.traceTime;
+        all.callTime += fs.callTime;
+        all.lockTime += fs.lockTime;
+        all.backtraceTime += fs.backtraceTime;
+    }
+
+    os::log("apitrace: stats: %12s %14s %12s %12s %12s %12s  %s\n",
+            "calls", "bytes", "trace (ms)", "call (ms)", "lock (ms)", "bt (ms)", "function");
+    for (auto & fs : totals) {
+        os::log("apitrace: stats: %12llu %14llu %12.3f %12.3f %12.3f %12.3f  %s\n",
+                fs.calls, fs.bytes,
+                toMilliseconds(fs.traceTime), toMilliseconds(fs.callTime),
+                toMilliseconds(fs.lockTime), toMilliseconds(fs.backtraceTime),
+                fs.sig->name);
+    }
+    os::log("apitrace: stats: %12llu %14llu %12.3f %12.3f %12.3f %12.3f  %s\n",
+            all.calls, all.bytes,
+            toMilliseconds(all.traceTime), toMilliseconds(all.callTime),
+            toMilliseconds(all.lockTime), toMilliseconds(all.backtraceTime),
+            "(total)");
+}
+
+/*
+ * Append the statistics to the trace as a fake apitrace_stats call, with one
+ * array per column.  Must be called with the mutex held.
+ */
+void LocalWriter::writeStats(void) {
+    std::vector<FunctionStats> totals;
+    sumStats(totals);
+
+    uintptr_t this_thread_num = thread_num;
+    unsigned thread_id = this_thread_num ? this_thread_num - 1 : 0;
+    unsigned _call = Writer::beginEnter(&stats_sig, thread_id);
+
+    beginArg(0);
+    beginArray(totals.size());
+    for (auto & fs : totals) {
+        beginElement();
+        writeString(fs.sig->name);
+        endElement();
+    }
+    endArray();
+    endArg();
+
+    for (unsigned arg = 1; arg < stats_sig.num_args; ++arg) {
+        beginArg(arg);
+        beginArray(totals.size());
+        for (auto & fs : totals) {
+            beginElement();
+            switch (arg) {
+            case 1:
+                writeUInt(fs.calls);
+                break;
+            case 2:
+                writeUInt(fs.bytes);
+                break;
+            case 3:
+                writeUInt(toNanoseconds(fs.traceTime));
+                break;
+            case 4:
+                writeUInt(toNanoseconds(fs.callTime));
+                break;
+            case 5:
+                writeUInt(toNanoseconds(fs.lockTime));
+                break;
+            case 6:
+                writeUInt(toNanoseconds(fs.backtraceTime));
+                break;
+            }
+            endElement();
+        }
+        endArray();
+        endArg();
+    }
+
+    Writer::endEnter();
+    Writer::beginLeave(_call);
+    Writer::endLeave();
+}
+
 void LocalWriter::flush(void) {
     /*
      * Do nothing if the mutex is already acquired (e.g., if a segfault happen
@@ -32,8 +32,12 @@
 
 #include <stdint.h>
 
+#include <unordered_map>
+#include <vector>
+
 #include "os_thread.hpp"
 #include "os_process.hpp"
+#include "os_string.hpp"
 #include "trace_writer.hpp"
 
 
@@ -43,6 +47,7 @@ namespace trace {
     extern const FunctionSig malloc_sig;
     extern const FunctionSig free_sig;
     extern const FunctionSig realloc_sig;
+    extern const FunctionSig stats_sig;
 
     /**
      * A specialized Writer class, mean to trace the current process.
@@ -52,6 +57,10 @@ namespace trace {
      * - uses mutexes to allow tracing from multiple threades
      * - flushes the output to ensure the last call is traced in event of
      *   abnormal termination
+     * - optionally splits the trace into segments, as specified by the
+     *   TRACE_SEGMENT_SIZE and TRACE_SEGMENT_FRAMES environment variables
+     * - optionally measures its own overhead, as specified by the
+     *   APITRACE_STATS environment variable
      */
     class LocalWriter : public Writer {
     protected:
@@ -77,6 +86,86 @@ namespace trace {
 
         void checkProcessId();
 
+        /**
+         * Incremented whenever a new file or segment is started.  Each thread
+         * records it for the calls it has in flight, and a new segment is
+         * only started when the calling thread has none, so that at least
+         * its own calls don't straddle two segments.
+         */
+        unsigned fileSerial;
+
+        struct InflightCall {
+            unsigned call_no;
+            unsigned fileSerial;
+        };
+
+        /**
+         * Calls each thread has entered but not left yet, indexed by thread
+         * ID.  Only tracked when segmenting, and a thread's entry is removed
+         * once it has no calls in flight, so exited threads don't linger.
+         */
+        std::unordered_map<unsigned, std::vector<InflightCall> > inflightCalls;
+
+        /**
+         * Segmentation limits, zero when disabled.
+         */
+        unsigned long long segmentSize;
+        unsigned segmentFrames;
+
+        os::String manifestName;
+        os::String segmentPrefix;
+
+        /**
+         * Call number of the first call of each segment so far.
+         */
+        std::vector<unsigned> segmentStarts;
+        unsigned segmentFrameCount;
+
+        /**
+         * Whether each function ends a frame, indexed by signature ID (-1
+         * when not looked up yet).
+         */
+        std::vector<signed char> frameEnds;
+
+        /**
+         * Whether each function needs a backtrace, as specified by the
+         * APITRACE_BACKTRACE environment variable, indexed by signature ID
+         * (-1 when not looked up yet).
+         */
+        std::vector<signed char> backtraces;
+
+        /**
+         * Return addresses of the backtraces seen so far, indexed by stack
+         * ID, and the IDs by hash of the addresses.  Recurring backtraces are
+         * only symbolized and written once.
+         *
+         * At most maxStacks backtraces are shared, so that these stay bounded
+         * in long captures with many distinct call sites.  Backtraces seen
+         * past that are written in full with each call.
+         */
+        std::vector< std::vector<uintptr_t> > stackAddresses;
+        std::unordered_map<size_t, Id> stackIds;
+        size_t maxStacks;
+
+        /**
+         * Whether to collect capture overhead statistics, and whether to
+         * also append them to the trace on exit.
+         */
+        bool stats;
+        bool statsInTrace;
+
+        void dumpStats(void);
+        void writeStats(void);
+
+        os::String segmentName(unsigned index);
+        void openSegment(void);
+        void writeManifest(void);
+        bool isFrameEnd(const FunctionSig *sig);
+        bool isBacktraceNeeded(const FunctionSig *sig);
+        void writeBacktrace(void);
+        void writeBacktrace(const uintptr_t *addresses, unsigned num_addresses);
+        void writeFullBacktrace(const uintptr_t *addresses, unsigned num_addresses);
+
     public:
         /**
          * Should never called directly -- use localWriter singleton below
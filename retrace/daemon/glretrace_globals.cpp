@@ -112,6 +112,18 @@ static DefaultDumper defaultDumper;
 
 Dumper *dumper = &defaultDumper;
 
+class DefaultFastForwarder: public FastForwarder {
+ public:
+  bool
+  canSkip(trace::Call &call) {  // NOLINT -- can't change ApiTrace badness
+    return false;
+  }
+};
+
+static DefaultFastForwarder defaultFastForwarder;
+
+FastForwarder *fastForwarder = &defaultFastForwarder;
+
 
 }  // namespace retrace
 
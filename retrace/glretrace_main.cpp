@@ -30,6 +30,7 @@
 
 #include <map>
 #include <sstream>
+#include <vector>
 
 #include "retrace.hpp"
 #include "glproc.hpp"
@@ -38,6 +39,7 @@
 #include "os_time.hpp"
 #include "os_memory.hpp"
 #include "highlight.hpp"
+#include "memory_sampler.hpp"
 #include "metric_writer.hpp"
 
 /* Synchronous debug output may reduce performance however,
@@ -74,6 +76,10 @@ struct CallQuery
     int64_t vsizeEnd;
     int64_t rssStart;
     int64_t rssEnd;
+    int64_t memoryStart;
+    int64_t memoryEnd;
+    int64_t heapStart;
+    int64_t heapEnd;
 };
 
 static bool supportsElapsed = true;
@@ -213,10 +219,24 @@ getCurrentRss(int64_t& rss) {
     rss = os::getRss();
 }
 
+/* When sampling in the background, only the time is taken here, and the
+ * usage is looked up when the query is completed. */
+static inline void
+getCurrentMemory(int64_t& time, int64_t& vsize, int64_t& rss) {
+    if (retrace::memorySampler.isRunning()) {
+        time = os::getTime();
+    } else {
+        long long v, r;
+        os::getMemoryUsage(v, r);
+        vsize = v;
+        rss = r;
+    }
+}
+
 static void
 completeCallQuery(CallQuery& query) {
     /* Get call start and duration */
-    int64_t gpuStart = 0, gpuDuration = 0, cpuDuration = 0, pixels = 0, vsizeDuration = 0, rssDuration = 0;
+    int64_t gpuStart = 0, gpuDuration = 0, cpuDuration = 0, pixels = 0, vsizeDuration = 0, rssDuration = 0, heapDuration = 0;
 
     if (query.isDraw) {
         if (retrace::profilingGpuTimes) {
@@ -252,14 +272,27 @@ completeCallQuery(CallQuery& query) {
     }
 
     if (retrace::profilingMemoryUsage) {
+        if (retrace::memorySampler.isRunning()) {
+            long long vsize, rss;
+            retrace::memorySampler.lookup(query.memoryStart, vsize, rss);
+            query.vsizeStart = vsize;
+            query.rssStart = rss;
+            retrace::memorySampler.lookup(query.memoryEnd, vsize, rss);
+            query.vsizeEnd = vsize;
+            query.rssEnd = rss;
+        }
         vsizeDuration = query.vsizeEnd - query.vsizeStart;
         rssDuration = query.rssEnd - query.rssStart;
     }
 
+    if (retrace::heapTracking) {
+        heapDuration = query.heapEnd - query.heapStart;
+    }
+
     glDeleteQueries(NUM_QUERIES, query.ids);
 
     /* Add call to profile */
-    retrace::profiler.addCall(query.call, query.sig->name, query.program, pixels, gpuStart, gpuDuration, query.cpuStart, cpuDuration, query.vsizeStart, vsizeDuration, query.rssStart, rssDuration);
+    retrace::profiler.addCall(query.call, query.sig->name, query.program, pixels, gpuStart, gpuDuration, query.cpuStart, cpuDuration, query.vsizeStart, vsizeDuration, query.rssStart, rssDuration, query.heapStart, heapDuration);
 }
 
 void
@@ -268,6 +301,10 @@ flushQueries() {
         completeCallQuery(callQuerie);
     }
 
+    if (retrace::memorySampler.isRunning() && !callQueries.empty()) {
+        retrace::memorySampler.discard(callQueries.back().memoryEnd);
+    }
+
     callQueries.clear();
 }
 
@@ -307,6 +344,8 @@ beginProfile(trace::Call &call, bool isDraw) {
     query.call = call.no;
     query.sig = call.sig;
     query.program = currentContext ? currentContext->currentUserProgram : 0;
+    query.memoryStart = query.memoryEnd = 0;
+    query.heapStart = query.heapEnd = 0;
 
     glGenQueries(NUM_QUERIES, query.ids);
 
@@ -335,8 +374,12 @@ beginProfile(trace::Call &call, bool isDraw) {
 
     if (retrace::profilingMemoryUsage) {
         CallQuery& query = callQueries.back();
-        query.vsizeStart = os::getVsize();
-        query.rssStart = os::getRss();
+        getCurrentMemory(query.memoryStart, query.vsizeStart, query.rssStart);
+    }
+
+    if (retrace::heapTracking) {
+        CallQuery& query = callQueries.back();
+        query.heapStart = retrace::getHeapUsage();
     }
 }
 
@@ -371,8 +414,12 @@ endProfile(trace::Call &call, bool isDraw) {
 
     if (retrace::profilingMemoryUsage) {
         CallQuery& query = callQueries.back();
-        query.vsizeEnd = os::getVsize();
-        query.rssEnd = os::getRss();
+        getCurrentMemory(query.memoryEnd, query.vsizeEnd, query.rssEnd);
+    }
+
+    if (retrace::heapTracking) {
+        CallQuery& query = callQueries.back();
+        query.heapEnd = retrace::getHeapUsage();
     }
 }
 
@@ -834,6 +881,323 @@ public:
 static GLDumper glDumper;
 
 
+/**
+ * Whether draws with the given program may write to images, shader storage
+ * buffers or atomic counters.
+ */
+static bool
+programHasSideEffects(GLuint program,
+                      const glfeatures::Profile &profile,
+                      const glfeatures::Features &features)
+{
+    if (!program) {
+        return false;
+    }
+
+    GLint atomicCounterBuffers = 0;
+    glGetProgramiv(program, GL_ACTIVE_ATOMIC_COUNTER_BUFFERS, &atomicCounterBuffers);
+    if (atomicCounterBuffers) {
+        return true;
+    }
+
+    if (profile.versionGreaterOrEqual(glfeatures::API_GL, 4, 3) ||
+        profile.versionGreaterOrEqual(glfeatures::API_GLES, 3, 1) ||
+        features.ARB_program_interface_query) {
+        GLint storageBlocks = 0;
+        glGetProgramInterfaceiv(program, GL_SHADER_STORAGE_BLOCK, GL_ACTIVE_RESOURCES, &storageBlocks);
+        if (storageBlocks) {
+            return true;
+        }
+    }
+
+    GLint activeUniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeUniforms);
+    if (activeUniforms > 0) {
+        std::vector<GLuint> indices(activeUniforms);
+        std::vector<GLint> types(activeUniforms);
+        for (GLint i = 0; i < activeUniforms; ++i) {
+            indices[i] = i;
+        }
+        glGetActiveUniformsiv(program, activeUniforms, &indices[0], GL_UNIFORM_TYPE, &types[0]);
+        for (GLint type : types) {
+            if (type >= GL_IMAGE_1D &&
+                type <= GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * Only rendering into the window's framebuffer is skipped: rendering into
+ * FBOs may end up in textures sampled later, and anything else with side
+ * effects (transform feedback, queries, image/buffer stores) is conservatively
+ * kept.  As the window's framebuffer is then stale, skipping stops for good
+ * once it is read back (glReadPixels, glCopyTex*Image, blits, etc.)
+ *
+ * Every call before the target frame goes through here, so that the state
+ * deciding whether draws can be skipped is only queried again after calls
+ * which may change it, and the side effects of programs once per link.
+ */
+class GLFastForwarder : public retrace::FastForwarder {
+public:
+    bool
+    canSkip(trace::Call &call) override {
+        if (!skipping) {
+            return false;
+        }
+
+        glretrace::Context *currentContext = glretrace::getCurrentContext();
+
+        switch (getCallKind(call)) {
+        case CALL_READ:
+            if (skipped && currentContext && readsWindow(call, currentContext)) {
+                retrace::warning(call) << "window framebuffer read after skipping rendering, so no longer fast-forwarding\n";
+                skipping = false;
+                return false;
+            }
+            // Blits into the window's framebuffer may still be skipped
+            break;
+        case CALL_PROGRAM:
+            programs.clear();
+            /* fall-through */
+        case CALL_STATE:
+            stateValid = false;
+            return false;
+        default:
+            break;
+        }
+
+        if (!(call.flags & trace::CALL_FLAG_RENDER) ||
+            !currentContext ||
+            currentContext->insideList) {
+            return false;
+        }
+
+        if (currentContext != stateContext) {
+            programs.clear();
+            stateContext = currentContext;
+            stateValid = false;
+        }
+        if (!stateValid) {
+            stateSkippable = querySkippable(currentContext);
+            stateValid = true;
+        }
+
+        skipped = skipped || stateSkippable;
+        return stateSkippable;
+    }
+
+private:
+    enum CallKind {
+        CALL_OTHER = 0,
+        CALL_STATE,     // may change whether draws can be skipped
+        CALL_PROGRAM,   // may also change the side effects of programs
+        CALL_READ,      // may read from the window's framebuffer
+    };
+
+    // Whether we're still skipping, and whether we skipped anything yet
+    bool skipping = true;
+    bool skipped = false;
+
+    // Whether draws can be skipped in the current state
+    glretrace::Context *stateContext = nullptr;
+    bool stateValid = false;
+    bool stateSkippable = false;
+
+    // Side effects of each program, by name
+    std::map<GLuint, bool> programs;
+
+    // Indexed by signature ID, -1 when not classified yet
+    std::vector<signed char> callKinds;
+
+    static bool
+    hasPrefix(const char *name, const char *prefix) {
+        return strncmp(name, prefix, strlen(prefix)) == 0;
+    }
+
+    static CallKind
+    classify(const char *name) {
+        static const char *readPrefixes[] = {
+            "glReadPixels",
+            "glReadnPixels",
+            "glCopyTex",
+            "glCopyMultiTex",
+            "glCopyPixels",
+            "glCopyColor",
+            "glCopyConvolution",
+            "glAccum",
+            "glBlit",
+        };
+        static const char *programPrefixes[] = {
+            "glLinkProgram",
+            "glProgramBinary",
+            "glDeleteProgram",
+            "glDeleteObject",
+        };
+        // glEnd must match glBegin, and display lists can contain anything
+        static const char *statePrefixes[] = {
+            "glBindFramebuffer",
+            "glDeleteFramebuffers",
+            "glUseProgram",
+            "glBindProgramPipeline",
+            "glBeginTransformFeedback",
+            "glEndTransformFeedback",
+            "glPauseTransformFeedback",
+            "glResumeTransformFeedback",
+            "glBindTransformFeedback",
+            "glDeleteTransformFeedbacks",
+            "glBeginQuery",
+            "glEndQuery",
+            "glEnd",
+            "glCallList",
+        };
+
+        for (const char *prefix : readPrefixes) {
+            if (hasPrefix(name, prefix)) {
+                return CALL_READ;
+            }
+        }
+        for (const char *prefix : programPrefixes) {
+            if (hasPrefix(name, prefix)) {
+                return CALL_PROGRAM;
+            }
+        }
+        // Contexts may be destroyed and others created at the same address
+        if (strstr(name, "MakeCurrent") ||
+            strstr(name, "MakeContextCurrent") ||
+            strstr(name, "SetCurrentContext")) {
+            return CALL_PROGRAM;
+        }
+        for (const char *prefix : statePrefixes) {
+            if (hasPrefix(name, prefix)) {
+                return CALL_STATE;
+            }
+        }
+        return CALL_OTHER;
+    }
+
+    CallKind
+    getCallKind(trace::Call &call) {
+        unsigned id = call.sig->id;
+        if (id >= callKinds.size()) {
+            callKinds.resize(id + 1, -1);
+        }
+        signed char &kind = callKinds[id];
+        if (kind < 0) {
+            kind = classify(call.name());
+        }
+        return CallKind(kind);
+    }
+
+    static bool
+    readsWindow(trace::Call &call, glretrace::Context *currentContext) {
+        if (strcmp(call.name(), "glBlitNamedFramebuffer") == 0) {
+            return call.arg(0).toUInt() == 0;
+        }
+
+        const glfeatures::Features &features = currentContext->features();
+        if (!features.framebuffer_object) {
+            return true;
+        }
+
+        GLint readFramebuffer = 0;
+        glGetIntegerv(features.read_framebuffer_object ? GL_READ_FRAMEBUFFER_BINDING : GL_FRAMEBUFFER_BINDING,
+                      &readFramebuffer);
+        return readFramebuffer == 0;
+    }
+
+    bool
+    querySkippable(glretrace::Context *currentContext) {
+        const glfeatures::Profile profile = currentContext->actualProfile();
+        const glfeatures::Features &features = currentContext->features();
+
+        bool skip = true;
+
+        if (features.framebuffer_object) {
+            GLint drawFramebuffer = 0;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+            skip = skip && drawFramebuffer == 0;
+        }
+
+        if (skip && (profile.versionGreaterOrEqual(glfeatures::API_GL, 4, 0) ||
+                     profile.versionGreaterOrEqual(glfeatures::API_GLES, 3, 0))) {
+            GLboolean transformFeedbackActive = GL_FALSE;
+            glGetBooleanv(GL_TRANSFORM_FEEDBACK_ACTIVE, &transformFeedbackActive);
+            skip = !transformFeedbackActive;
+        } else if (skip && profile.versionGreaterOrEqual(glfeatures::API_GL, 3, 0)) {
+            GLint transformFeedbackBuffer = 0;
+            glGetIntegerv(GL_TRANSFORM_FEEDBACK_BUFFER_BINDING, &transformFeedbackBuffer);
+            skip = transformFeedbackBuffer == 0;
+        }
+
+        if (skip) {
+            skip = !queryActive(profile);
+        }
+
+        if (skip && (profile.versionGreaterOrEqual(glfeatures::API_GL, 4, 2) ||
+                     profile.versionGreaterOrEqual(glfeatures::API_GLES, 3, 1) ||
+                     features.ARB_shader_image_load_store ||
+                     features.ARB_shader_storage_buffer_object)) {
+            GLint pipeline = 0;
+            glGetIntegerv(GL_PROGRAM_PIPELINE_BINDING, &pipeline);
+            GLint program = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+            if (pipeline) {
+                skip = false;
+            } else {
+                auto it = programs.find(program);
+                if (it == programs.end()) {
+                    bool sideEffects = programHasSideEffects(program, profile, features);
+                    it = programs.insert(std::make_pair(GLuint(program), sideEffects)).first;
+                }
+                skip = !it->second;
+            }
+        }
+
+        // Don't let errors from unsupported queries be blamed on other calls
+        while (glGetError() != GL_NO_ERROR)
+            ;
+
+        return skip;
+    }
+
+    static bool
+    queryActive(const glfeatures::Profile &profile) {
+        static const GLenum targets[] = {
+            GL_SAMPLES_PASSED,
+            GL_ANY_SAMPLES_PASSED,
+            GL_ANY_SAMPLES_PASSED_CONSERVATIVE,
+            GL_PRIMITIVES_GENERATED,
+            GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN,
+        };
+
+        if (profile.desktop() ? !profile.versionGreaterOrEqual(1, 5)
+                              : !profile.versionGreaterOrEqual(3, 0)) {
+            return false;
+        }
+
+        // Targets unsupported by the context merely raise errors
+        for (GLenum target : targets) {
+            if (!profile.desktop() && target == GL_SAMPLES_PASSED) {
+                continue;
+            }
+            GLint query = 0;
+            glGetQueryiv(target, GL_CURRENT_QUERY, &query);
+            if (query) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+static GLFastForwarder glFastForwarder;
+
+
 void
 retrace::setFeatureLevel(const char *featureLevel)
 {
@@ -845,6 +1209,7 @@ void
 retrace::setUp(void) {
     glws::init();
     dumper = &glDumper;
+    fastForwarder = &glFastForwarder;
 }
 
 
@@ -0,0 +1,168 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+#if defined(__GLIBC__) || defined(__ANDROID__)
+#include <malloc.h>
+#define HAVE_MALLINFO 1
+#endif
+
+#include "os_memory.hpp"
+#include "os_time.hpp"
+#include "memory_sampler.hpp"
+
+
+namespace retrace {
+
+
+MemorySampler memorySampler;
+
+
+MemorySampler::MemorySampler() :
+    interval(0),
+    running(false),
+    stopping(false)
+{
+}
+
+
+MemorySampler::~MemorySampler()
+{
+    stop();
+}
+
+
+void
+MemorySampler::start(unsigned long intervalUsecs)
+{
+    if (running) {
+        return;
+    }
+
+    interval = intervalUsecs;
+    stopping = false;
+    running = true;
+
+    /* Ensure there's always a sample to look up. */
+    sample();
+
+    thread = os::thread(&MemorySampler::run, this);
+}
+
+
+void
+MemorySampler::stop(void)
+{
+    if (!running) {
+        return;
+    }
+
+    stopping = true;
+    thread.join();
+    thread = os::thread();
+    running = false;
+}
+
+
+void
+MemorySampler::sample(void)
+{
+    Sample s;
+    os::getMemoryUsage(s.vsize, s.rss);
+    s.time = os::getTime();
+
+    os::unique_lock<os::mutex> lock(mutex);
+    samples.push_back(s);
+}
+
+
+void
+MemorySampler::run(void)
+{
+    while (!stopping) {
+        os::sleep(interval);
+        sample();
+    }
+}
+
+
+void
+MemorySampler::lookup(long long time, long long &vsize, long long &rss)
+{
+    os::unique_lock<os::mutex> lock(mutex);
+
+    if (samples.empty()) {
+        lock.unlock();
+        os::getMemoryUsage(vsize, rss);
+        return;
+    }
+
+    std::deque<Sample>::const_iterator it =
+        std::upper_bound(samples.begin(), samples.end(), time,
+                         [](long long t, const Sample &s) { return t < s.time; });
+    if (it != samples.begin()) {
+        --it;
+    }
+    vsize = it->vsize;
+    rss = it->rss;
+}
+
+
+void
+MemorySampler::discard(long long time)
+{
+    os::unique_lock<os::mutex> lock(mutex);
+
+    /* Keep the last sample at or before the given time. */
+    while (samples.size() > 1 && samples[1].time <= time) {
+        samples.pop_front();
+    }
+}
+
+
+bool heapTracking = false;
+
+
+long long
+getHeapUsage(void)
+{
+#if defined(__GLIBC__) && __GLIBC__ == 2 && __GLIBC_MINOR__ >= 33
+    struct mallinfo2 info = mallinfo2();
+    return (long long)(info.uordblks + info.hblkhd);
+#elif defined(HAVE_MALLINFO)
+    // These are ints with older glibc, which wrap around past 2 GiB
+    struct mallinfo info = mallinfo();
+    return (long long)info.uordblks + (long long)info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+
+} /* namespace retrace */
@@ -0,0 +1,118 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Memory usage sampling for `--pmem`.
+ */
+
+#pragma once
+
+
+#include <atomic>
+#include <deque>
+
+#include "os_thread.hpp"
+
+
+namespace retrace {
+
+
+/**
+ * Samples the memory usage of the process on a background thread, so that
+ * the replay thread only needs to take timestamps.
+ */
+class MemorySampler
+{
+public:
+    MemorySampler();
+    ~MemorySampler();
+
+    void
+    start(unsigned long intervalUsecs);
+
+    void
+    stop(void);
+
+    bool
+    isRunning(void) const {
+        return running;
+    }
+
+    /**
+     * Memory usage at the given os::getTime() timestamp, i.e., as of the
+     * latest sample taken no later than it.
+     */
+    void
+    lookup(long long time, long long &vsize, long long &rss);
+
+    /**
+     * Forget the samples which are no longer needed to look up timestamps
+     * at or after the given one.
+     */
+    void
+    discard(long long time);
+
+private:
+    struct Sample {
+        long long time;
+        long long vsize;
+        long long rss;
+    };
+
+    os::mutex mutex;
+    std::deque<Sample> samples;
+    os::thread thread;
+    unsigned long interval;
+    bool running;
+    std::atomic<bool> stopping;
+
+    void
+    sample(void);
+
+    void
+    run(void);
+};
+
+
+extern MemorySampler memorySampler;
+
+
+/**
+ * Whether to record the heap usage, i.e., the bytes the process currently has
+ * allocated with malloc, either by the retracer or the driver.  Unlike the
+ * totals above, this doesn't include mapped files, stacks, or freed memory
+ * malloc holds on to.
+ */
+extern bool heapTracking;
+
+/**
+ * Bytes currently allocated with malloc, as reported by mallinfo.  Always
+ * zero on platforms where this is not supported.
+ */
+long long
+getHeapUsage(void);
+
+
+} /* namespace retrace */
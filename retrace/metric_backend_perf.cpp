@@ -0,0 +1,415 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+
+#include <iostream>
+
+#include "metric_backend_perf.hpp"
+
+
+#ifndef PERF_FLAG_FD_CLOEXEC
+#define PERF_FLAG_FD_CLOEXEC 0
+#endif
+
+// stored for queries whose counters could not be read
+#define INVALID_VALUE (-1)
+
+
+static inline pid_t
+getThreadId(void)
+{
+    return syscall(__NR_gettid);
+}
+
+
+Metric_perf::Metric_perf(unsigned gId, unsigned id, const std::string &name,
+                         const std::string &desc, uint32_t eventType, uint64_t eventConfig)
+    : m_gId(gId), m_id(id), m_name(name), m_desc(desc),
+      m_eventType(eventType), m_eventConfig(eventConfig),
+      available(false)
+{
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        enabled[i] = false;
+    }
+}
+
+unsigned Metric_perf::id() {
+    return m_id;
+}
+
+unsigned Metric_perf::groupId() {
+    return m_gId;
+}
+
+std::string Metric_perf::name() {
+    return m_name;
+}
+
+std::string Metric_perf::description() {
+    return m_desc;
+}
+
+MetricNumType Metric_perf::numType() {
+    return CNT_NUM_INT64;
+}
+
+MetricType Metric_perf::type() {
+    if (m_eventType == PERF_TYPE_SOFTWARE &&
+        m_eventConfig == PERF_COUNT_SW_TASK_CLOCK) {
+        return CNT_TYPE_DURATION;
+    }
+    return CNT_TYPE_GENERIC;
+}
+
+MetricBackend_perf::MetricBackend_perf(MmapAllocator<char> &alloc)
+    : alloc(alloc), supported(false), excludeKernel(false)
+{
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        queryInProgress[i] = false;
+        metricsEnabled[i] = false;
+        startValid[i] = false;
+    }
+
+    // Add metrics below (hardware first, as they must lead the event group)
+    metrics.emplace_back(0, 0, "Cycles", "CPU cycles",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    metrics.emplace_back(0, 1, "Instructions", "Retired instructions",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    metrics.emplace_back(0, 2, "Cache Misses", "Last level cache misses",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    metrics.emplace_back(0, 3, "Branch Misses", "Mispredicted branch instructions",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    metrics.emplace_back(1, 0, "Task Clock", "CPU time of the retracing threads (ns)",
+                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+    metrics.emplace_back(1, 1, "Context Switches", "Context switches of the retracing threads",
+                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    metrics.emplace_back(1, 2, "Page Faults", "Page faults of the retracing threads",
+                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+
+    // probe which events can be opened (PMU may be missing, e.g. in VMs)
+    for (auto &m : metrics) {
+        int fd = openEvent(m, -1, excludeKernel);
+        if (fd < 0 && !excludeKernel && (errno == EACCES || errno == EPERM)) {
+            // kernel.perf_event_paranoid >= 2
+            excludeKernel = true;
+            fd = openEvent(m, -1, excludeKernel);
+        }
+        if (fd >= 0) {
+            m.available = true;
+            supported = true;
+            close(fd);
+        }
+    }
+
+    // populate lookups
+    for (auto &m : metrics) {
+        idLookup[std::make_pair(m.groupId(), m.id())] = &m;
+        nameLookup[m.name()] = &m;
+    }
+}
+
+MetricBackend_perf::~MetricBackend_perf() {
+    closeGroups();
+}
+
+int MetricBackend_perf::openEvent(const Metric_perf &metric, int groupFd,
+                                  bool excludeKernel)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = metric.eventType();
+    attr.config = metric.eventConfig();
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.disabled = groupFd == -1 ? 1 : 0; // group is enabled via its leader
+    attr.exclude_kernel = excludeKernel ? 1 : 0;
+    attr.exclude_hv = 1;
+
+    // this thread, any CPU
+    return syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
+}
+
+void MetricBackend_perf::openGroup(pid_t tid) {
+    groups.emplace_back();
+    Group &group = groups.back();
+    group.tid = tid;
+
+    for (unsigned i = 0; i < metrics.size(); i++) {
+        Metric_perf &m = metrics[i];
+        bool enabled = false;
+        for (int j = 0; j < QUERY_BOUNDARY_LIST_END; j++) {
+            enabled = enabled || m.enabled[j];
+        }
+        if (!enabled) {
+            continue;
+        }
+        int fd = openEvent(m, group.fds.empty() ? -1 : group.fds[0], excludeKernel);
+        if (fd < 0) {
+            std::cerr << "Warning: Could not open perf event \"" << m.name()
+                      << "\" (" << strerror(errno) << ")." << std::endl;
+            continue;
+        }
+        group.members.push_back(i);
+        group.fds.push_back(fd);
+    }
+
+    group.buffer.assign(1 + group.fds.size(), 0);
+
+    if (!group.fds.empty()) {
+        ioctl(group.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void MetricBackend_perf::closeGroups(void) {
+    for (auto &group : groups) {
+        // close members before the leader
+        for (auto it = group.fds.rbegin(); it != group.fds.rend(); ++it) {
+            close(*it);
+        }
+    }
+    groups.clear();
+}
+
+/*
+ * Sum the counters of all threads into readBuffer, opening the calling
+ * thread's group first if needed.  Queries are never issued concurrently, as
+ * retracing threads take turns.
+ */
+bool MetricBackend_perf::readGroups(void) {
+    pid_t tid = getThreadId();
+    bool found = false;
+    for (auto &group : groups) {
+        found = found || group.tid == tid;
+    }
+    if (!found) {
+        // counted from now on, so zero until now
+        openGroup(tid);
+    }
+
+    readBuffer.assign(metrics.size(), 0);
+    bool valid = true;
+    for (auto &group : groups) {
+        if (group.fds.empty()) {
+            valid = false;
+            continue;
+        }
+        size_t size = group.buffer.size() * sizeof group.buffer[0];
+        if (read(group.fds[0], group.buffer.data(), size) != static_cast<ssize_t>(size)) {
+            valid = false;
+            continue;
+        }
+        for (unsigned i = 0; i < group.members.size(); i++) {
+            readBuffer[group.members[i]] += group.buffer[1 + i];
+        }
+    }
+    return valid;
+}
+
+
+bool MetricBackend_perf::isSupported() {
+    return supported;
+    // though individual metrics might be not supported
+}
+
+void MetricBackend_perf::enumGroups(enumGroupsCallback callback, void* userData) {
+    callback(0, 0, userData); // hardware group
+    callback(1, 0, userData); // software group
+}
+
+std::string MetricBackend_perf::getGroupName(unsigned group) {
+    switch(group) {
+        case 0:
+            return "Hardware";
+        case 1:
+            return "Software";
+        default:
+            return "";
+    }
+}
+
+void MetricBackend_perf::enumMetrics(unsigned group, enumMetricsCallback callback, void* userData) {
+    for (auto &m : metrics) {
+        if (m.groupId() == group && m.available) {
+            callback(&m, 0, userData);
+        }
+    }
+}
+
+std::unique_ptr<Metric>
+MetricBackend_perf::getMetricById(unsigned groupId, unsigned metricId) {
+    auto entryToCopy = idLookup.find(std::make_pair(groupId, metricId));
+    if (entryToCopy != idLookup.end()) {
+        return std::unique_ptr<Metric>(new Metric_perf(*entryToCopy->second));
+    } else {
+        return nullptr;
+    }
+}
+
+std::unique_ptr<Metric>
+MetricBackend_perf::getMetricByName(std::string metricName) {
+    auto entryToCopy = nameLookup.find(metricName);
+    if (entryToCopy != nameLookup.end()) {
+        return std::unique_ptr<Metric>(new Metric_perf(*entryToCopy->second));
+    } else {
+        return nullptr;
+    }
+}
+
+
+int MetricBackend_perf::enableMetric(Metric* metric, QueryBoundary pollingRule) {
+    // metric is not necessarily the same object as in metrics[]
+    auto entry = idLookup.find(std::make_pair(metric->groupId(), metric->id()));
+    if ((entry != idLookup.end()) && entry->second->available) {
+        entry->second->enabled[pollingRule] = true;
+        return 0;
+    }
+    return 1;
+}
+
+unsigned MetricBackend_perf::generatePasses() {
+    // draw calls profiling not needed if all calls are profiled
+    for (int i = 0; i < METRIC_LIST_END; i++) {
+        if (metrics[i].enabled[QUERY_BOUNDARY_CALL]) {
+            metrics[i].enabled[QUERY_BOUNDARY_DRAWCALL] = false;
+        }
+    }
+    // setup storage for profiled metrics
+    for (int j = 0; j < QUERY_BOUNDARY_LIST_END; j++) {
+        metricsEnabled[j] = false;
+        for (int i = 0; i < METRIC_LIST_END; i++) {
+            if (metrics[i].enabled[j]) {
+                data[i][j] = std::unique_ptr<Storage>(new Storage(MmapAllocator<int64_t>(alloc)));
+                metricsEnabled[j] = true;
+            }
+        }
+    }
+    // all counters are read together, so a single pass is enough
+    return 1;
+}
+
+void MetricBackend_perf::beginPass() {
+    closeGroups();
+    openGroup(getThreadId());
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        queryInProgress[i] = false;
+    }
+}
+
+void MetricBackend_perf::endPass() {
+    closeGroups();
+}
+
+void MetricBackend_perf::pausePass() {
+    if (queryInProgress[QUERY_BOUNDARY_FRAME]) endQuery(QUERY_BOUNDARY_FRAME);
+}
+
+void MetricBackend_perf::continuePass() {
+    // counters are per thread, not per context
+}
+
+void MetricBackend_perf::beginQuery(QueryBoundary boundary) {
+    // DRAWCALL is a CALL
+    bool call = boundary == QUERY_BOUNDARY_DRAWCALL &&
+                metricsEnabled[QUERY_BOUNDARY_CALL];
+    if (!metricsEnabled[boundary] && !call) {
+        return;
+    }
+
+    bool valid = readGroups();
+
+    if (metricsEnabled[boundary]) {
+        start[boundary] = readBuffer;
+        startValid[boundary] = valid;
+        queryInProgress[boundary] = true;
+    }
+    if (call) {
+        start[QUERY_BOUNDARY_CALL] = readBuffer;
+        startValid[QUERY_BOUNDARY_CALL] = valid;
+        queryInProgress[QUERY_BOUNDARY_CALL] = true;
+    }
+}
+
+void MetricBackend_perf::endQuery(QueryBoundary boundary) {
+    // DRAWCALL is a CALL
+    bool call = boundary == QUERY_BOUNDARY_DRAWCALL &&
+                queryInProgress[QUERY_BOUNDARY_CALL];
+    if (!queryInProgress[boundary] && !call) {
+        return;
+    }
+
+    bool valid = readGroups();
+
+    if (queryInProgress[boundary]) {
+        addData(boundary, valid);
+    }
+    if (call) {
+        addData(QUERY_BOUNDARY_CALL, valid);
+    }
+}
+
+void MetricBackend_perf::addData(QueryBoundary boundary, bool valid) {
+    valid = valid && startValid[boundary];
+    for (int i = 0; i < METRIC_LIST_END; i++) {
+        Metric_perf &metric = metrics[i];
+        if (metric.enabled[boundary]) {
+            int64_t value = INVALID_VALUE;
+            if (valid) {
+                value = readBuffer[i] - start[boundary][i];
+            }
+            data[i][boundary]->push_back(value);
+        }
+    }
+    queryInProgress[boundary] = false;
+}
+
+void MetricBackend_perf::enumDataQueryId(unsigned id, enumDataCallback callback,
+                                         QueryBoundary boundary, void* userData) {
+    for (int i = 0; i < METRIC_LIST_END; i++) {
+        Metric_perf &metric = metrics[i];
+        if (metric.enabled[boundary]) {
+            int64_t &value = (*data[i][boundary])[id];
+            callback(&metric, id, value == INVALID_VALUE ? nullptr : &value, 0, userData);
+        }
+    }
+}
+
+unsigned MetricBackend_perf::getNumPasses() {
+    return 1;
+}
+
+MetricBackend_perf&
+MetricBackend_perf::getInstance(MmapAllocator<char> &alloc) {
+    static MetricBackend_perf backend(alloc);
+    return backend;
+}
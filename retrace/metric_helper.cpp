@@ -35,6 +35,9 @@
 #include "metric_backend_amd_perfmon.hpp"
 #include "metric_backend_intel_perfquery.hpp"
 #include "metric_backend_opengl.hpp"
+#ifdef __linux__
+#include "metric_backend_perf.hpp"
+#endif
 #include "mmap_allocator.hpp"
 
 namespace glretrace {
@@ -59,6 +62,9 @@ MetricBackend* getBackend(std::string backendName) {
     if (backendName == "GL_AMD_performance_monitor") return &MetricBackend_AMD_perfmon::getInstance(currentContext, alloc);
     else if (backendName == "GL_INTEL_performance_query") return &MetricBackend_INTEL_perfquery::getInstance(currentContext, alloc);
     else if (backendName == "opengl") return &MetricBackend_opengl::getInstance(currentContext, alloc);
+#ifdef __linux__
+    else if (backendName == "perf") return &MetricBackend_perf::getInstance(alloc);
+#endif
     else return nullptr;
 }
 
@@ -92,7 +98,11 @@ void listMetricsCLI() {
     // backends is to be populated with backend names
     std::string backends[] = {"GL_AMD_performance_monitor",
                               "GL_INTEL_performance_query",
-                              "opengl"};
+                              "opengl",
+#ifdef __linux__
+                              "perf",
+#endif
+                             };
     std::cout << "Available metrics: \n";
     for (auto s : backends) {
         auto b = getBackend(s);
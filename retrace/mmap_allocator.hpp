@@ -39,13 +39,17 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 #define ALLOC_CHUNK_SIZE 64 * 1024 * 1024L
 
 /*
  * Allocator that backs up memory with mmaped file
  * File is grown by ALLOC_CHUNK_SIZE, this new region is mmaped then
- * Nothing is deallocated
+ * Nothing is deallocated until the last allocator sharing the file is
+ * destroyed, which unmaps it all.  The file is created in $TMPDIR and
+ * unlinked right away, so it is removed even if we crash.
 */
 
 class MmapedFileBuffer
@@ -61,13 +65,22 @@ private:
 
     void operator=(MmapedFileBuffer const&) = delete;
 
+    static void fail(const char *what) {
+        std::cerr << "error: " << what << " failed for file backed memory ("
+                  << strerror(errno) << ")\n";
+        abort();
+    }
+
     void newMmap() {
         int ret = ftruncate(fd, chunkSize * (mmaps.size() + 1));
         if (ret < 0) {
-            abort();
+            fail("ftruncate");
         }
         vptr = mmap(NULL, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
                     chunkSize * mmaps.size());
+        if (vptr == MAP_FAILED) {
+            fail("mmap");
+        }
         mmaps.push_front(vptr);
         curChunkSize = 0;
     }
@@ -77,17 +90,22 @@ public:
         : curChunkSize(0),
           chunkSize(ALLOC_CHUNK_SIZE & ~(sysconf(_SC_PAGE_SIZE) - 1))
     {
-        char templ[] = ".pbtmpXXXXXX";
-        fd = mkstemp(templ);
-        unlink(templ);
+        const char *tmpdir = getenv("TMPDIR");
+        std::string templ = tmpdir && *tmpdir ? tmpdir : "/tmp";
+        templ += "/apitrace-XXXXXX";
+        fd = mkstemp(&templ[0]);
+        if (fd < 0) {
+            fail("mkstemp");
+        }
+        unlink(templ.c_str());
         newMmap();
     }
 
     ~MmapedFileBuffer() {
-        close(fd);
         for (auto &m : mmaps) {
             munmap(m, chunkSize);
         }
+        close(fd);
     }
 
     void* allocate(size_t size) {
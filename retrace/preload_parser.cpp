@@ -0,0 +1,260 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+
+#include "os_time.hpp"
+#include "preload_parser.hpp"
+
+
+namespace retrace {
+
+
+/*
+ * Rough heap footprint of a value's node, on top of any blob data.
+ */
+static const unsigned long long valueOverhead = 32;
+
+
+PreloadParser::PreloadParser(trace::AbstractParser *_parser,
+                             unsigned long long _budget,
+                             unsigned _lastCallNo) :
+    parser(_parser),
+    budget(_budget),
+    lastCallNo(_lastCallNo),
+    nextCall(0),
+    releasedCalls(0),
+    spillStart(~size_t(0)),
+    loadedBytes(0),
+    spilledBytes(0),
+    loadTime(0)
+{
+}
+
+
+PreloadParser::~PreloadParser()
+{
+    close();
+    delete parser;
+}
+
+
+bool
+PreloadParser::open(const char *filename)
+{
+    if (!parser->open(filename)) {
+        return false;
+    }
+
+    long long startTime = os::getTime();
+
+    trace::Call *call;
+    while ((call = parser->parse_call())) {
+        bool spill = budget && loadedBytes >= budget;
+        if (spill && spillStart > calls.size()) {
+            spillStart = calls.size();
+        }
+
+        loadedBytes += sizeof *call;
+        for (auto & arg : call->args) {
+            loadedBytes += account(arg.value, spill);
+        }
+        loadedBytes += account(call->ret, spill);
+
+        calls.push_back(call);
+
+        if (call->no >= lastCallNo) {
+            break;
+        }
+    }
+
+    long long endTime = os::getTime();
+    loadTime = (endTime - startTime) * (1.0 / os::timeFrequency);
+
+    return true;
+}
+
+
+void
+PreloadParser::close(void)
+{
+    while (releasedCalls < calls.size()) {
+        releaseCall(calls[releasedCalls]);
+    }
+    calls.clear();
+    nextCall = 0;
+    releasedCalls = 0;
+    spillStart = ~size_t(0);
+    spillAllocator.reset();
+    parser->close();
+}
+
+
+trace::Call *
+PreloadParser::parse_call(void)
+{
+    if (nextCall >= calls.size()) {
+        return nullptr;
+    }
+    return calls[nextCall++];
+}
+
+
+/*
+ * Calls are released in the same order they are handed out, which allows to
+ * tell whether a call had its blobs spilled.
+ */
+void
+PreloadParser::releaseCall(trace::Call *call)
+{
+    assert(releasedCalls < calls.size());
+    assert(calls[releasedCalls] == call);
+
+    if (releasedCalls >= spillStart) {
+        for (auto & arg : call->args) {
+            unspill(arg.value);
+        }
+        unspill(call->ret);
+    }
+    calls[releasedCalls++] = nullptr;
+
+    delete call;
+}
+
+
+void
+PreloadParser::getBookmark(trace::ParseBookmark &bookmark)
+{
+    std::cerr << "error: preloaded traces can't be rewound\n";
+    exit(1);
+}
+
+
+void
+PreloadParser::setBookmark(const trace::ParseBookmark &bookmark)
+{
+    std::cerr << "error: preloaded traces can't be rewound\n";
+    exit(1);
+}
+
+
+/**
+ * Estimate the memory taken by a value, moving its blobs into file backed
+ * memory if requested.
+ */
+unsigned long long
+PreloadParser::account(trace::Value *value, bool spill)
+{
+    if (!value) {
+        return 0;
+    }
+
+    unsigned long long bytes = valueOverhead;
+
+    trace::Blob *blob = value->toBlob();
+    if (blob) {
+        if (spill && !spillAllocator) {
+            spillAllocator.reset(new MmapAllocator<char>);
+        }
+        if (spill && blob->size && blob->size <= spillAllocator->max_size()) {
+            char *buf = spillAllocator->allocate(blob->size);
+            memcpy(buf, blob->buf, blob->size);
+            delete [] blob->buf;
+            blob->buf = buf;
+            spilledBytes += blob->size;
+        } else {
+            bytes += blob->size;
+        }
+        return bytes;
+    }
+
+    trace::Array *array = value->toArray();
+    if (array) {
+        for (auto element : array->values) {
+            bytes += account(element, spill);
+        }
+        return bytes;
+    }
+
+    trace::Struct *_struct = value->toStruct();
+    if (_struct) {
+        for (auto member : _struct->members) {
+            bytes += account(member, spill);
+        }
+        return bytes;
+    }
+
+    return bytes;
+}
+
+
+/**
+ * Detach spilled blobs from their values before deletion.
+ *
+ * Blobs keep their contents alive after being bound (see Blob::~Blob), but
+ * spilled contents are never freed by MmapAllocator until close anyway.
+ */
+void
+PreloadParser::unspill(trace::Value *value)
+{
+    if (!value) {
+        return;
+    }
+
+    trace::Blob *blob = value->toBlob();
+    if (blob) {
+        if (blob->size && blob->size <= spillAllocator->max_size()) {
+            if (!blob->bound) {
+                spillAllocator->deallocate(blob->buf, blob->size);
+            }
+            blob->buf = nullptr;
+            blob->bound = false;
+        }
+        return;
+    }
+
+    trace::Array *array = value->toArray();
+    if (array) {
+        for (auto element : array->values) {
+            unspill(element);
+        }
+        return;
+    }
+
+    trace::Struct *_struct = value->toStruct();
+    if (_struct) {
+        for (auto member : _struct->members) {
+            unspill(member);
+        }
+    }
+}
+
+
+} /* namespace retrace */
@@ -0,0 +1,127 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Preloading of the trace for `--preload`.
+ */
+
+#pragma once
+
+
+#include <deque>
+#include <memory>
+
+#include "trace_parser.hpp"
+#include "mmap_allocator.hpp"
+
+
+namespace retrace {
+
+
+/**
+ * Parser decorator which parses all calls up front when the trace is opened,
+ * so that replay timings don't include file I/O, decompression nor parsing.
+ *
+ * Once the decoded calls exceed the memory budget, the blobs of subsequent
+ * calls are moved into file backed memory (see MmapAllocator), leaving the
+ * paging to the OS.
+ */
+class PreloadParser : public trace::AbstractParser
+{
+public:
+    /**
+     * Take ownership of parser.  Calls past lastCallNo are not loaded; a zero
+     * budget means no limit.
+     */
+    PreloadParser(trace::AbstractParser *parser,
+                  unsigned long long budget,
+                  unsigned lastCallNo = ~0U);
+
+    ~PreloadParser();
+
+    bool open(const char *filename) override;
+
+    void close(void) override;
+
+    trace::Call *parse_call(void) override;
+
+    void releaseCall(trace::Call *call) override;
+
+    // Preloaded calls can't be rewound, so these fail with an error
+    void getBookmark(trace::ParseBookmark &bookmark) override;
+    void setBookmark(const trace::ParseBookmark &bookmark) override;
+
+    unsigned long long getVersion(void) const override {
+        return parser->getVersion();
+    }
+
+    size_t
+    getLoadedCalls(void) const {
+        return calls.size();
+    }
+
+    unsigned long long
+    getLoadedBytes(void) const {
+        return loadedBytes;
+    }
+
+    unsigned long long
+    getSpilledBytes(void) const {
+        return spilledBytes;
+    }
+
+    /** Seconds spent loading the trace. */
+    float
+    getLoadTime(void) const {
+        return loadTime;
+    }
+
+private:
+    trace::AbstractParser *parser;
+    unsigned long long budget;
+    unsigned lastCallNo;
+
+    std::deque<trace::Call *> calls;
+    size_t nextCall;
+    size_t releasedCalls;
+
+    // Index of the first call whose blobs were spilled, and the memory they
+    // were spilled to, created on the first spill and unmapped on close
+    size_t spillStart;
+    std::unique_ptr< MmapAllocator<char> > spillAllocator;
+
+    unsigned long long loadedBytes;
+    unsigned long long spilledBytes;
+    float loadTime;
+
+    unsigned long long
+    account(trace::Value *value, bool spill);
+
+    void
+    unspill(trace::Value *value);
+};
+
+
+} /* namespace retrace */
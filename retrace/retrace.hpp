@@ -103,6 +103,23 @@ public:
 };
 
 
+/**
+ * Elements of an input array written packed from an array of T, which can be
+ * passed as is to the API, or NULL if they must be decoded one by one.
+ *
+ * The API must not write to them, as calls may be retraced more than once.
+ */
+template< class T >
+inline T *
+asPackedArray(const trace::Value &value) {
+    const trace::PackedArray *array = value.toPackedArray();
+    if (!array) {
+        return NULL;
+    }
+    return const_cast<T *>(array->get<T>());
+}
+
+
 /**
  * Output verbosity when retracing files.
  */
@@ -245,6 +262,27 @@ public:
 extern Dumper *dumper;
 
 
+/**
+ * Decides which rendering calls can be skipped with --fast-forward-to.
+ */
+class FastForwarder
+{
+public:
+    /**
+     * Whether the call can be skipped without affecting any state but the
+     * contents of the window's framebuffer.
+     *
+     * Called for every call before the target frame, not only rendering
+     * ones, so that implementations can follow state changes and reads.
+     */
+    virtual bool
+    canSkip(trace::Call &call) = 0;
+};
+
+
+extern FastForwarder *fastForwarder;
+
+
 void
 setFeatureLevel(const char *featureLevel);
 
@@ -480,9 +480,36 @@ class Retracer:
         print '    return;'
 
     def extractArg(self, function, arg, arg_type, lvalue, rvalue):
+        elemType = self.packedElementType(arg)
+        if elemType is not None:
+            # Use the parser's elements directly when their type matches,
+            # falling back to decoding them one by one
+            print '    %s = retrace::asPackedArray<%s>(%s);' % (lvalue, elemType, rvalue)
+            print '    if (!%s) {' % lvalue
+            ValueAllocator().visit(arg_type, lvalue, rvalue)
+            ValueDeserializer().visit(arg_type, lvalue, rvalue)
+            print '    }'
+            return
         ValueAllocator().visit(arg_type, lvalue, rvalue)
         if arg.input:
             ValueDeserializer().visit(arg_type, lvalue, rvalue)
+
+    def packedElementType(self, arg):
+        '''Return the mutable element type of input-only const arrays of
+        numbers, whose values may have been written packed.'''
+        if not arg.input or arg.output:
+            return None
+        type = arg.type
+        while isinstance(type, stdapi.Alias):
+            type = type.type
+        if not isinstance(type, stdapi.Array) or not isinstance(type.type, stdapi.Const):
+            return None
+        literal = type.type
+        while isinstance(literal, (stdapi.Const, stdapi.Alias)):
+            literal = literal.type
+        if not isinstance(literal, stdapi.Literal) or literal.kind not in ('SInt', 'UInt', 'Float', 'Double'):
+            return None
+        return type.type.mutable()
     
     def extractOpaqueArg(self, function, arg, arg_type, lvalue, rvalue):
         try:
@@ -26,10 +26,15 @@
  **************************************************************************/
 
 
+#include <stdlib.h>
 #include <string.h>
 #include <limits.h> // for CHAR_MAX
+#include <algorithm>
 #include <memory> // for unique_ptr
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 #include <getopt.h>
 #ifndef _WIN32
 #include <unistd.h> // for isatty()
@@ -39,12 +44,15 @@
 #include "os_crtdbg.hpp"
 #include "os_time.hpp"
 #include "os_thread.hpp"
+#include "thread_pool.hpp"
 #include "image.hpp"
 #include "threaded_snapshot.hpp"
 #include "trace_callset.hpp"
 #include "trace_dump.hpp"
 #include "trace_option.hpp"
 #include "retrace.hpp"
+#include "memory_sampler.hpp"
+#include "preload_parser.hpp"
 #include "state_writer.hpp"
 #include "ws.hpp"
 
@@ -61,7 +69,11 @@ static enum {
 static trace::CallSet snapshotFrequency;
 static unsigned snapshotInterval = 0;
 
-static unsigned dumpStateCallNo = ~0;
+static trace::CallSet dumpStateCalls;
+static const char *dumpStatePrefix = NULL;
+static bool dumpStateOnce = true;
+static bool dumpStateIncremental = false;
+static bool dumpStatePending = false;
 
 retrace::Retracer retracer;
 
@@ -154,6 +166,22 @@ static DefaultDumper defaultDumper;
 Dumper *dumper = &defaultDumper;
 
 
+class DefaultFastForwarder: public FastForwarder
+{
+public:
+    bool
+    canSkip(trace::Call &call) override {
+        return false;
+    }
+};
+
+static DefaultFastForwarder defaultFastForwarder;
+
+FastForwarder *fastForwarder = &defaultFastForwarder;
+
+static unsigned fastForwardFrame = 0;
+
+
 typedef StateWriter *(*StateWriterFactory)(std::ostream &);
 static StateWriterFactory stateWriterFactory = createJSONStateWriter;
 
@@ -161,6 +189,237 @@ static StateWriterFactory stateWriterFactory = createJSONStateWriter;
 static Snapshotter *snapshotter;
 
 
+/**
+ * Serialize state dumps on worker threads, so that encoding the images
+ * doesn't hold up the replay.
+ *
+ * Documents are either written to separate files, or to stdout, in order,
+ * each preceded by a "CALL_NO SIZE\n" line.
+ *
+ * In incremental mode, sections which didn't change since the document they
+ * were last written in are replaced by references to it.
+ *
+ * As each recording holds copies of all images, only a couple of them per
+ * worker may be queued, and the replay waits for them to drain past that.
+ */
+class StateDumpQueue
+{
+private:
+    os::mutex mutex;
+    os::condition_variable turn;
+    os::condition_variable drained;
+    unsigned queued;
+    unsigned maxQueued;
+    std::map<unsigned, std::pair<unsigned, std::string>> pending;
+    unsigned nextSeq;
+    unsigned nextWrite;
+    unsigned nextDelta;
+
+    bool incremental;
+
+    // Last written version of each section.  The contents confirm hash
+    // matches, at the cost of keeping a copy of the last state.
+    struct SectionState {
+        unsigned long long hash;
+        std::string contents;
+        unsigned callNo;
+    };
+    std::map<std::string, SectionState> lastSections;
+
+    // Must be last, so that workers are joined before anything else is
+    // destroyed.
+    ThreadPool pool;
+
+    void
+    write(unsigned seq, unsigned callNo, StateRecorder *recording);
+
+    void
+    writeDelta(StateWriter &writer, unsigned seq, unsigned callNo,
+               const StateRecorder &recording);
+
+public:
+    StateDumpQueue(size_t nb_threads, bool _incremental) :
+        queued(0),
+        maxQueued(2 * std::max<size_t>(nb_threads, 1)),
+        nextSeq(0),
+        nextWrite(0),
+        nextDelta(0),
+        incremental(_incremental),
+        pool(std::max<size_t>(nb_threads, 1))
+    {}
+
+    void
+    enqueue(unsigned callNo, StateRecorder *recording) {
+        {
+            os::unique_lock<os::mutex> lock(mutex);
+            drained.wait(lock, [&]{ return queued < maxQueued; });
+            ++queued;
+        }
+        pool.enqueue(&StateDumpQueue::write, this, nextSeq++, callNo, recording);
+    }
+};
+
+
+void
+StateDumpQueue::write(unsigned seq, unsigned callNo, StateRecorder *recording)
+{
+    if (dumpStatePrefix) {
+        const char *ext = stateWriterFactory == createUBJSONStateWriter ? "ubjson" : "json";
+        os::String filename = os::String::format("%s%010u.%s", dumpStatePrefix, callNo, ext);
+        std::ofstream os(filename, std::ofstream::binary);
+        if (os) {
+            StateWriter *writer = stateWriterFactory(os);
+            writeDelta(*writer, seq, callNo, *recording);
+            delete writer;
+        } else {
+            std::cerr << "error: failed to create " << filename << "\n";
+        }
+    } else {
+        std::stringstream ss;
+        StateWriter *writer = stateWriterFactory(ss);
+        writeDelta(*writer, seq, callNo, *recording);
+        delete writer;
+
+        os::unique_lock<os::mutex> lock(mutex);
+        pending[seq] = std::make_pair(callNo, ss.str());
+        auto it = pending.begin();
+        while (it != pending.end() && it->first == nextWrite) {
+            const std::string &doc = it->second.second;
+            std::cout << it->second.first << " " << doc.size() << "\n";
+            std::cout.write(doc.data(), doc.size());
+            it = pending.erase(it);
+            ++nextWrite;
+        }
+        std::cout.flush();
+    }
+
+    delete recording;
+
+    {
+        os::unique_lock<os::mutex> lock(mutex);
+        --queued;
+    }
+    drained.notify_one();
+}
+
+
+void
+StateDumpQueue::writeDelta(StateWriter &writer, unsigned seq, unsigned callNo,
+                           const StateRecorder &recording)
+{
+    if (!incremental) {
+        recording.replay(writer);
+        return;
+    }
+
+    // Split the document into sections, going one level deeper for the
+    // members holding images and buffers, and hash them.
+    struct Section {
+        std::string name;
+        size_t begin;
+        size_t end;
+        unsigned long long hash;
+        unsigned refCallNo;
+    };
+    std::vector<Section> sections;
+    std::vector<StateRecorder::Member> members;
+    recording.getMembers(members);
+    for (auto & member : members) {
+        const std::string &name = *member.name;
+        std::vector<StateRecorder::Member> nested;
+        if ((name == "textures" ||
+             name == "framebuffer" ||
+             name == "buffers") &&
+            recording.isObject(member.begin, member.end)) {
+            recording.getMembers(nested, member.begin + 1, member.end - 1);
+        }
+        if (!nested.empty()) {
+            for (auto & child : nested) {
+                Section section;
+                section.name = name + "/" + *child.name;
+                section.begin = child.begin;
+                section.end = child.end;
+                sections.push_back(section);
+            }
+        } else {
+            Section section;
+            section.name = name;
+            section.begin = member.begin;
+            section.end = member.end;
+            sections.push_back(section);
+        }
+    }
+    for (auto & section : sections) {
+        section.hash = recording.hash(section.begin, section.end);
+    }
+
+    // Compare against the previous documents, in order
+    {
+        os::unique_lock<os::mutex> lock(mutex);
+        turn.wait(lock, [&]{ return nextDelta == seq; });
+        for (auto & section : sections) {
+            auto it = lastSections.find(section.name);
+            if (it != lastSections.end() &&
+                it->second.hash == section.hash &&
+                recording.hasContents(section.begin, section.end, it->second.contents)) {
+                section.refCallNo = it->second.callNo;
+            } else {
+                SectionState &state = lastSections[section.name];
+                state.hash = section.hash;
+                state.contents.clear();
+                recording.getContents(section.begin, section.end, state.contents);
+                state.callNo = callNo;
+                section.refCallNo = ~0U;
+            }
+        }
+        ++nextDelta;
+    }
+    turn.notify_all();
+
+    std::string parent;
+    for (auto & section : sections) {
+        size_t slash = section.name.find('/');
+        std::string sectionParent = slash == std::string::npos ? "" : section.name.substr(0, slash);
+        if (sectionParent != parent) {
+            if (!parent.empty()) {
+                writer.endObject();
+                writer.endMember();
+            }
+            if (!sectionParent.empty()) {
+                writer.beginMember(sectionParent);
+                writer.beginObject();
+            }
+            parent = sectionParent;
+        }
+
+        writer.beginMember(slash == std::string::npos ? section.name : section.name.substr(slash + 1));
+        if (section.refCallNo == ~0U) {
+            recording.replay(writer, section.begin, section.end);
+        } else {
+            writer.beginObject();
+            writer.writeStringMember("__class__", "reference");
+            writer.writeIntMember("__call__", section.refCallNo);
+            writer.endObject();
+        }
+        writer.endMember();
+    }
+    if (!parent.empty()) {
+        writer.endObject();
+        writer.endMember();
+    }
+}
+
+
+static StateDumpQueue *stateDumpQueue;
+
+
+static void
+finishStateDumps(void) {
+    delete stateDumpQueue;
+    stateDumpQueue = NULL;
+}
+
+
 /**
  * Take snapshots.
  */
@@ -269,23 +528,48 @@ retraceCall(trace::Call *call) {
         }
     }
 
-    retracer.retrace(*call);
+    // Skip rendering before the frame we're fast-forwarding to
+    if (frameNo >= fastForwardFrame ||
+        !fastForwarder->canSkip(*call)) {
+        retracer.retrace(*call);
+    }
 
     if (doSnapshot) {
         if (!swapRenderTarget) {
             takeSnapshot(call->no);
         }
         if (call->no >= snapshotFrequency.getLast()) {
+            finishStateDumps();
             exit(0);
         }
     }
 
-    if (call->no >= dumpStateCallNo &&
-        dumper->canDump()) {
-        StateWriter *writer = stateWriterFactory(std::cout);
-        dumper->dumpState(*writer);
-        delete writer;
-        exit(0);
+    if (dumpingState) {
+        // Dump as soon as possible, should the current call not allow it
+        if (dumpStateOnce) {
+            dumpStatePending = dumpStatePending || call->no >= dumpStateCalls.getFirst();
+        } else {
+            dumpStatePending = dumpStatePending || dumpStateCalls.contains(*call);
+        }
+
+        if (dumpStatePending && dumper->canDump()) {
+            dumpStatePending = false;
+            if (dumpStateOnce) {
+                StateWriter *writer = stateWriterFactory(std::cout);
+                dumper->dumpState(*writer);
+                delete writer;
+                exit(0);
+            }
+
+            StateRecorder *recording = new StateRecorder;
+            dumper->dumpState(*recording);
+            stateDumpQueue->enqueue(call->no, recording);
+
+            if (call->no >= dumpStateCalls.getLast()) {
+                finishStateDumps();
+                exit(0);
+            }
+        }
     }
 }
 
@@ -423,7 +707,7 @@ public:
             assert(call->thread_id == leg);
 
             retraceCall(call);
-            delete call;
+            parser->releaseCall(call);
             call = parser->parse_call();
 
         } while (call && call->thread_id == leg);
@@ -584,6 +868,36 @@ RelayRace::stopRunners(void) {
 }
 
 
+/**
+ * Summarize the times of the frames looped with --loop.
+ */
+static void
+reportLoopTimes(trace::FrameTimes &frameTimes)
+{
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    std::sort(frameTimes.begin(), frameTimes.end());
+
+    size_t count = frameTimes.size();
+    size_t p99 = (count * 99 + 99) / 100;
+    p99 = std::min(count, std::max(p99, (size_t)1)) - 1;
+
+    if ((retrace::verbosity >= -1 || retrace::profiling) &&
+        retrace::profiler.getFormat() != trace::PROFILE_FORMAT_BINARY) {
+        double msecs = 1000.0 / os::timeFrequency;
+        std::cout <<
+            "Looped " << count << " frames:"
+            " min " << frameTimes[0] * msecs << " ms,"
+            " median " << frameTimes[count / 2] * msecs << " ms,"
+            " p99 " << frameTimes[p99] * msecs << " ms\n";
+    }
+
+    frameTimes.clear();
+}
+
+
 static void
 mainLoop() {
     addCallbacks(retracer);
@@ -597,7 +911,7 @@ mainLoop() {
         trace::Call *call;
         while ((call = parser->parse_call())) {
             retraceCall(call);
-            delete call;
+            parser->releaseCall(call);
         }
     } else {
         RelayRace race;
@@ -608,7 +922,12 @@ mainLoop() {
     long long endTime = os::getTime();
     float timeInterval = (endTime - startTime) * (1.0 / os::timeFrequency);
 
-    if ((retrace::verbosity >= -1) || (retrace::profiling)) {
+    if (retrace::profiling) {
+        retrace::profiler.flush();
+    }
+
+    if ((retrace::verbosity >= -1 || retrace::profiling) &&
+        retrace::profiler.getFormat() != trace::PROFILE_FORMAT_BINARY) {
         std::cout << 
             "Rendered " << frameNo << " frames"
             " in " <<  timeInterval << " secs,"
@@ -639,6 +958,9 @@ usage(const char *argv0) {
         "      --pgpu              gpu profiling (gpu times per draw call)\n"
         "      --ppd               pixels drawn profiling (pixels drawn per draw call)\n"
         "      --pmem              memory usage profiling (vsize rss per call)\n"
+        "      --pmem-interval=USECS  sample memory usage on a separate thread every USECS microseconds\n"
+        "      --pmem-heap         profile memory allocated with malloc\n"
+        "      --profile-format=FMT  profile output format (`text` or `binary`; default is text)\n"
         "      --pcalls            call profiling metrics selection\n"
         "      --pframes           frame profiling metrics selection\n"
         "      --pdrawcalls        draw call profiling metrics selection\n"
@@ -659,10 +981,15 @@ usage(const char *argv0) {
         "      --snapshot-interval=N    specify a frame interval when generating snaphots (default is 0)\n"
         "  -t, --snapshot-threaded encode screenshots on multiple threads\n"
         "  -v, --verbose           increase output verbosity\n"
-        "  -D, --dump-state=CALL   dump state at specific call no\n"
+        "  -D, --dump-state=CALLSET  dump state at the specified calls\n"
         "      --dump-format=FORMAT dump state format (`json` or `ubjson`)\n"
+        "      --dump-state-prefix=PREFIX  write each state dump to PREFIX<CALL_NO>.json instead of stdout\n"
+        "      --dump-state-incremental  only dump the state which changed since the previous dumps\n"
         "  -w, --wait              waitOnFinish on final frame\n"
         "      --loop[=N]          loop N times (N<0 continuously) replaying final frame.\n"
+        "      --loop-frames=A[-B] loop frames A to B instead of the final frame (continuously unless --loop=N)\n"
+        "      --fast-forward-to=FRAME  skip rendering which has no lasting effects before FRAME\n"
+        "      --preload[=BUDGET]  load the trace into memory before replaying, spilling to disk past BUDGET bytes (K, M, G suffixes allowed)\n"
         "      --singlethread      use a single thread to replay command stream\n";
 }
 
@@ -689,7 +1016,15 @@ enum {
     SINGLETHREAD_OPT,
     SNAPSHOT_INTERVAL_OPT,
     DUMP_FORMAT_OPT,
-    MARKERS_OPT
+    MARKERS_OPT,
+    PROFILE_FORMAT_OPT,
+    PMEM_INTERVAL_OPT,
+    PMEM_HEAP_OPT,
+    LOOP_FRAMES_OPT,
+    PRELOAD_OPT,
+    DUMP_STATE_PREFIX_OPT,
+    DUMP_STATE_INCREMENTAL_OPT,
+    FAST_FORWARD_OPT
 };
 
 const static char *
@@ -707,6 +1042,8 @@ longOptions[] = {
     {"driver", required_argument, 0, DRIVER_OPT},
     {"dump-state", required_argument, 0, 'D'},
     {"dump-format", required_argument, 0, DUMP_FORMAT_OPT},
+    {"dump-state-prefix", required_argument, 0, DUMP_STATE_PREFIX_OPT},
+    {"dump-state-incremental", no_argument, 0, DUMP_STATE_INCREMENTAL_OPT},
     {"fullscreen", no_argument, 0, FULLSCREEN_OPT},
     {"headless", no_argument, 0, HEADLESS_OPT},
     {"help", no_argument, 0, 'h'},
@@ -715,6 +1052,9 @@ longOptions[] = {
     {"pgpu", no_argument, 0, PGPU_OPT},
     {"ppd", no_argument, 0, PPD_OPT},
     {"pmem", no_argument, 0, PMEM_OPT},
+    {"pmem-interval", required_argument, 0, PMEM_INTERVAL_OPT},
+    {"pmem-heap", no_argument, 0, PMEM_HEAP_OPT},
+    {"profile-format", required_argument, 0, PROFILE_FORMAT_OPT},
     {"pcalls", required_argument, 0, PCALLS_OPT},
     {"pframes", required_argument, 0, PFRAMES_OPT},
     {"pdrawcalls", required_argument, 0, PDRAWCALLS_OPT},
@@ -729,6 +1069,9 @@ longOptions[] = {
     {"verbose", no_argument, 0, 'v'},
     {"wait", no_argument, 0, 'w'},
     {"loop", optional_argument, 0, LOOP_OPT},
+    {"loop-frames", required_argument, 0, LOOP_FRAMES_OPT},
+    {"preload", optional_argument, 0, PRELOAD_OPT},
+    {"fast-forward-to", required_argument, 0, FAST_FORWARD_OPT},
     {"singlethread", no_argument, 0, SINGLETHREAD_OPT},
     {0, 0, 0, 0}
 };
@@ -745,8 +1088,14 @@ int main(int argc, char **argv)
 {
     using namespace retrace;
     int loopCount = 0;
+    int loopFirstFrame = -1;
+    int loopLastFrame = -1;
+    bool preload = false;
+    unsigned long long preloadBudget = 0;
     int i;
     bool snapshotThreaded = false;
+    trace::ProfileFormat profileFormat = trace::PROFILE_FORMAT_TEXT;
+    int memoryInterval = 0;
 
     os::setDebugOutput(os::OUTPUT_STDERR);
 
@@ -772,10 +1121,16 @@ int main(int argc, char **argv)
             useCallNos = trace::boolOption(optarg);
             break;
         case 'D':
-            dumpStateCallNo = atoi(optarg);
+            dumpStateCalls.merge(optarg);
             dumpingState = true;
             retrace::verbosity = -2;
             break;
+        case DUMP_STATE_PREFIX_OPT:
+            dumpStatePrefix = optarg;
+            break;
+        case DUMP_STATE_INCREMENTAL_OPT:
+            dumpStateIncremental = true;
+            break;
         case DUMP_FORMAT_OPT:
             if (strcasecmp(optarg, "json") == 0) {
                 stateWriterFactory = &createJSONStateWriter;
@@ -880,6 +1235,49 @@ int main(int argc, char **argv)
         case LOOP_OPT:
             loopCount = trace::intOption(optarg, -1);
             break;
+        case LOOP_FRAMES_OPT:
+            {
+                char *end;
+                loopFirstFrame = strtol(optarg, &end, 0);
+                loopLastFrame = loopFirstFrame;
+                if (*end == '-') {
+                    loopLastFrame = strtol(end + 1, &end, 0);
+                }
+                if (*end != '\0' || loopFirstFrame < 0 || loopLastFrame < loopFirstFrame) {
+                    std::cerr << "error: invalid frame range " << optarg << "\n";
+                    return 1;
+                }
+                if (!loopCount) {
+                    loopCount = -1;
+                }
+            }
+            break;
+        case FAST_FORWARD_OPT:
+            fastForwardFrame = trace::intOption(optarg);
+            break;
+        case PRELOAD_OPT:
+            preload = true;
+            if (optarg) {
+                char *end;
+                preloadBudget = strtoull(optarg, &end, 0);
+                switch (*end) {
+                case 'G': case 'g':
+                    preloadBudget <<= 10;
+                    /* fall-through */
+                case 'M': case 'm':
+                    preloadBudget <<= 10;
+                    /* fall-through */
+                case 'K': case 'k':
+                    preloadBudget <<= 10;
+                    ++end;
+                    break;
+                }
+                if (*end != '\0') {
+                    std::cerr << "error: invalid memory budget " << optarg << "\n";
+                    return 1;
+                }
+            }
+            break;
         case PGPU_OPT:
             retrace::debug = 0;
             retrace::profiling = true;
@@ -908,6 +1306,32 @@ int main(int argc, char **argv)
 
             retrace::profilingMemoryUsage = true;
             break;
+        case PMEM_INTERVAL_OPT:
+            retrace::debug = 0;
+            retrace::profiling = true;
+            retrace::verbosity = -1;
+
+            retrace::profilingMemoryUsage = true;
+            memoryInterval = trace::intOption(optarg, 0);
+            break;
+        case PMEM_HEAP_OPT:
+            retrace::debug = 0;
+            retrace::profiling = true;
+            retrace::verbosity = -1;
+
+            retrace::heapTracking = true;
+            break;
+        case PROFILE_FORMAT_OPT:
+            if (strcasecmp(optarg, "text") == 0) {
+                profileFormat = trace::PROFILE_FORMAT_TEXT;
+            } else if (strcasecmp(optarg, "binary") == 0) {
+                os::setBinaryMode(stdout);
+                profileFormat = trace::PROFILE_FORMAT_BINARY;
+            } else {
+                std::cerr << "error: unsupported profile format `" << optarg << "`\n";
+                return EXIT_FAILURE;
+            }
+            break;
         case PCALLS_OPT:
             retrace::debug = 0;
             retrace::profiling = true;
@@ -972,9 +1396,27 @@ int main(int argc, char **argv)
         snapshotter = new Snapshotter();
     }
 
+    if (dumpingState) {
+        dumpStateOnce = !dumpStatePrefix &&
+                        !dumpStateIncremental &&
+                        dumpStateCalls.getFirst() == dumpStateCalls.getLast();
+        if (!dumpStateOnce) {
+            stateDumpQueue = new StateDumpQueue(os::thread::hardware_concurrency(),
+                                                dumpStateIncremental);
+        }
+    }
+
     retrace::setUp();
     if (retrace::profiling && !retrace::profilingWithBackends) {
-        retrace::profiler.setup(retrace::profilingCpuTimes, retrace::profilingGpuTimes, retrace::profilingPixelsDrawn, retrace::profilingMemoryUsage);
+        retrace::profiler.setup(retrace::profilingCpuTimes, retrace::profilingGpuTimes, retrace::profilingPixelsDrawn, retrace::profilingMemoryUsage, retrace::heapTracking, profileFormat);
+        if (retrace::profilingMemoryUsage && memoryInterval > 0) {
+            retrace::memorySampler.start(memoryInterval);
+        }
+    }
+
+    if (preload && loopCount) {
+        std::cerr << "error: --preload can't be used together with --loop\n";
+        return 1;
     }
 
     os::setExceptionCallback(exceptionCallback);
@@ -983,16 +1425,36 @@ int main(int argc, char **argv)
          retrace::curPass++)
     {
         for (i = optind; i < argc; ++i) {
+            trace::FrameTimes loopFrameTimes;
             parser = new trace::Parser;
             if (loopCount) {
-                parser = lastFrameLoopParser(parser, loopCount);
+                parser = frameLoopParser(parser, loopCount, loopFirstFrame, loopLastFrame,
+                                         &loopFrameTimes);
+            }
+
+            PreloadParser *preloadParser = nullptr;
+            if (preload) {
+                preloadParser = new PreloadParser(parser, preloadBudget,
+                                                  dumpingState ? dumpStateCalls.getLast() : ~0U);
+                parser = preloadParser;
             }
 
             if (!parser->open(argv[i])) {
                 return 1;
             }
 
+            if (preloadParser &&
+                (retrace::verbosity >= -1 || retrace::profiling) &&
+                retrace::profiler.getFormat() != trace::PROFILE_FORMAT_BINARY) {
+                std::cout <<
+                    "Loaded " << preloadParser->getLoadedCalls() << " calls"
+                    " (" << (preloadParser->getLoadedBytes() >> 20) << " MB"
+                    ", " << (preloadParser->getSpilledBytes() >> 20) << " MB spilled)"
+                    " in " << preloadParser->getLoadTime() << " secs\n";
+            }
+
             retrace::mainLoop();
+            reportLoopTimes(loopFrameTimes);
 
             parser->close();
 
@@ -1003,6 +1465,10 @@ int main(int argc, char **argv)
 
     os::resetExceptionCallback();
 
+    retrace::memorySampler.stop();
+
+    finishStateDumps();
+
     delete snapshotter;
 
     // XXX: X often hangs on XCloseDisplay
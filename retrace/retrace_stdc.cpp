@@ -85,5 +85,6 @@ static void retrace_memcpy(trace::Call &call) {
 const retrace::Entry retrace::stdc_callbacks[] = {
     {"malloc", &retrace_malloc},
     {"memcpy", &retrace_memcpy},
+    {"apitrace_stats", &retrace::ignore},
     {NULL, NULL}
 };
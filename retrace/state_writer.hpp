@@ -34,6 +34,7 @@
 #include <ostream>
 #include <type_traits>
 #include <string>
+#include <vector>
 
 
 namespace image {
@@ -162,7 +163,7 @@ public:
         {}
     };
 
-    void
+    virtual void
     writeImage(image::Image *image, const ImageDesc & desc);
 
     inline void
@@ -174,6 +175,131 @@ public:
 };
 
 
+/*
+ * StateWriter which merely records what is written, so that it can be
+ * replayed into another writer later, possibly from another thread.
+ *
+ * Images are copied, and only encoded when replayed.
+ */
+class StateRecorder : public StateWriter
+{
+public:
+    ~StateRecorder();
+
+    void beginObject(void) override;
+    void endObject(void) override;
+    void beginMember(const char * name) override;
+    void endMember(void) override;
+    void beginArray(void) override;
+    void endArray(void) override;
+    void writeString(const char *) override;
+    void writeBlob(const void *bytes, size_t size) override;
+    void writeNull(void) override;
+    void writeBool(bool) override;
+    void writeSInt(signed long long) override;
+    void writeUInt(unsigned long long) override;
+    void writeFloat(float) override;
+    void writeFloat(double) override;
+
+    using StateWriter::writeImage;
+    void writeImage(image::Image *image, const ImageDesc & desc) override;
+
+    /**
+     * Replay the recorded ops in the range [begin, end) into writer.
+     */
+    void
+    replay(StateWriter &writer, size_t begin = 0, size_t end = ~size_t(0)) const;
+
+    struct Member {
+        const std::string *name;
+        // Range of ops of the member's value
+        size_t begin;
+        size_t end;
+    };
+
+    /**
+     * List the members of the object whose contents are the ops in the range
+     * [begin, end); by default the top level members.
+     */
+    void
+    getMembers(std::vector<Member> &members, size_t begin = 0, size_t end = ~size_t(0)) const;
+
+    /**
+     * Whether the ops in the range [begin, end) are a single object.
+     */
+    bool
+    isObject(size_t begin, size_t end) const;
+
+    /**
+     * Content hash of the ops in the range [begin, end), including any
+     * images' pixels.
+     */
+    unsigned long long
+    hash(size_t begin, size_t end) const;
+
+    /**
+     * Append the contents of the ops in the range [begin, end) to contents,
+     * in a form only meant to be compared with hasContents().
+     */
+    void
+    getContents(size_t begin, size_t end, std::string &contents) const;
+
+    /**
+     * Whether the ops in the range [begin, end) have the given contents, as
+     * returned by getContents().
+     */
+    bool
+    hasContents(size_t begin, size_t end, const std::string &contents) const;
+
+private:
+    enum Kind {
+        BEGIN_OBJECT,
+        END_OBJECT,
+        BEGIN_MEMBER,
+        END_MEMBER,
+        BEGIN_ARRAY,
+        END_ARRAY,
+        STRING,
+        BLOB,
+        NULL_,
+        BOOL,
+        SINT,
+        UINT,
+        FLOAT,
+        DOUBLE,
+        IMAGE,
+    };
+
+    struct Op {
+        Kind kind;
+        union {
+            bool b;
+            signed long long i;
+            unsigned long long u;
+            double d;
+            size_t index;
+        };
+    };
+
+    std::vector<Op> ops;
+    std::vector<std::string> strings;
+    std::vector<image::Image *> images;
+    std::vector<ImageDesc> imageDescs;
+
+    template< class Sink >
+    void
+    serialize(size_t begin, size_t end, Sink &sink) const;
+
+    inline Op &
+    push(Kind kind) {
+        ops.emplace_back();
+        Op &op = ops.back();
+        op.kind = kind;
+        return op;
+    }
+};
+
+
 StateWriter *
 createJSONStateWriter(std::ostream &os);
 
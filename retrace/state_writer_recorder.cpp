@@ -0,0 +1,433 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "state_writer.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "image.hpp"
+
+
+StateRecorder::~StateRecorder()
+{
+    for (auto image : images) {
+        delete image;
+    }
+}
+
+
+void
+StateRecorder::beginObject(void)
+{
+    push(BEGIN_OBJECT);
+}
+
+
+void
+StateRecorder::endObject(void)
+{
+    push(END_OBJECT);
+}
+
+
+void
+StateRecorder::beginMember(const char * name)
+{
+    push(BEGIN_MEMBER).index = strings.size();
+    strings.emplace_back(name);
+}
+
+
+void
+StateRecorder::endMember(void)
+{
+    push(END_MEMBER);
+}
+
+
+void
+StateRecorder::beginArray(void)
+{
+    push(BEGIN_ARRAY);
+}
+
+
+void
+StateRecorder::endArray(void)
+{
+    push(END_ARRAY);
+}
+
+
+void
+StateRecorder::writeString(const char *s)
+{
+    push(STRING).index = strings.size();
+    strings.emplace_back(s);
+}
+
+
+void
+StateRecorder::writeBlob(const void *bytes, size_t size)
+{
+    push(BLOB).index = strings.size();
+    strings.emplace_back(static_cast<const char *>(bytes), size);
+}
+
+
+void
+StateRecorder::writeNull(void)
+{
+    push(NULL_);
+}
+
+
+void
+StateRecorder::writeBool(bool b)
+{
+    push(BOOL).b = b;
+}
+
+
+void
+StateRecorder::writeSInt(signed long long i)
+{
+    push(SINT).i = i;
+}
+
+
+void
+StateRecorder::writeUInt(unsigned long long u)
+{
+    push(UINT).u = u;
+}
+
+
+void
+StateRecorder::writeFloat(float f)
+{
+    push(FLOAT).d = f;
+}
+
+
+void
+StateRecorder::writeFloat(double d)
+{
+    push(DOUBLE).d = d;
+}
+
+
+void
+StateRecorder::writeImage(image::Image *image, const ImageDesc & desc)
+{
+    assert(image);
+    if (!image) {
+        writeNull();
+        return;
+    }
+
+    // The caller retains ownership of the image, so take a copy.  This is
+    // much cheaper than encoding it.
+    image::Image *copy = new image::Image(image->width, image->height,
+                                          image->channels, image->flipped,
+                                          image->channelType);
+    memcpy(copy->pixels, image->pixels,
+           size_t(image->height) * image->width * image->bytesPerPixel);
+    copy->label = image->label;
+
+    push(IMAGE).index = images.size();
+    images.push_back(copy);
+    imageDescs.push_back(desc);
+}
+
+
+void
+StateRecorder::replay(StateWriter &writer, size_t begin, size_t end) const
+{
+    end = std::min(end, ops.size());
+    for (size_t i = begin; i < end; ++i) {
+        const Op & op = ops[i];
+        switch (op.kind) {
+        case BEGIN_OBJECT:
+            writer.beginObject();
+            break;
+        case END_OBJECT:
+            writer.endObject();
+            break;
+        case BEGIN_MEMBER:
+            writer.beginMember(strings[op.index]);
+            break;
+        case END_MEMBER:
+            writer.endMember();
+            break;
+        case BEGIN_ARRAY:
+            writer.beginArray();
+            break;
+        case END_ARRAY:
+            writer.endArray();
+            break;
+        case STRING:
+            writer.writeString(strings[op.index]);
+            break;
+        case BLOB:
+            writer.writeBlob(strings[op.index].data(), strings[op.index].size());
+            break;
+        case NULL_:
+            writer.writeNull();
+            break;
+        case BOOL:
+            writer.writeBool(op.b);
+            break;
+        case SINT:
+            writer.writeSInt(op.i);
+            break;
+        case UINT:
+            writer.writeUInt(op.u);
+            break;
+        case FLOAT:
+            writer.writeFloat(static_cast<float>(op.d));
+            break;
+        case DOUBLE:
+            writer.writeFloat(op.d);
+            break;
+        case IMAGE:
+            writer.writeImage(images[op.index], imageDescs[op.index]);
+            break;
+        default:
+            assert(0);
+        }
+    }
+}
+
+
+void
+StateRecorder::getMembers(std::vector<Member> &members, size_t begin, size_t end) const
+{
+    end = std::min(end, ops.size());
+
+    Member member;
+    unsigned depth = 0;
+    for (size_t i = begin; i < end; ++i) {
+        switch (ops[i].kind) {
+        case BEGIN_MEMBER:
+            if (depth == 0) {
+                member.name = &strings[ops[i].index];
+                member.begin = i + 1;
+            }
+            ++depth;
+            break;
+        case END_MEMBER:
+            --depth;
+            if (depth == 0) {
+                member.end = i;
+                members.push_back(member);
+            }
+            break;
+        case BEGIN_OBJECT:
+        case BEGIN_ARRAY:
+            ++depth;
+            break;
+        case END_OBJECT:
+        case END_ARRAY:
+            --depth;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+bool
+StateRecorder::isObject(size_t begin, size_t end) const
+{
+    return end - begin >= 2 &&
+           end <= ops.size() &&
+           ops[begin].kind == BEGIN_OBJECT &&
+           ops[end - 1].kind == END_OBJECT;
+}
+
+
+/*
+ * 64-bit FNV-1a, but taking whole words at a time, as images can be large.
+ */
+static const unsigned long long fnvOffsetBasis = 0xcbf29ce484222325ULL;
+static const unsigned long long fnvPrime = 0x100000001b3ULL;
+
+static inline unsigned long long
+hashWord(unsigned long long h, unsigned long long word)
+{
+    return (h ^ word) * fnvPrime;
+}
+
+static unsigned long long
+hashBytes(unsigned long long h, const void *data, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    h = hashWord(h, size);
+    while (size >= sizeof(unsigned long long)) {
+        unsigned long long word;
+        memcpy(&word, p, sizeof word);
+        h = hashWord(h, word);
+        p += sizeof word;
+        size -= sizeof word;
+    }
+    while (size--) {
+        h = hashWord(h, *p++);
+    }
+    return h;
+}
+
+
+/*
+ * Feed the contents of the ops in the range [begin, end) to the sink, as
+ * words and byte strings.
+ */
+template< class Sink >
+void
+StateRecorder::serialize(size_t begin, size_t end, Sink &sink) const
+{
+    end = std::min(end, ops.size());
+
+    for (size_t i = begin; i < end; ++i) {
+        const Op & op = ops[i];
+        sink.word(op.kind);
+        switch (op.kind) {
+        case BEGIN_MEMBER:
+        case STRING:
+        case BLOB:
+            sink.bytes(strings[op.index].data(), strings[op.index].size());
+            break;
+        case BOOL:
+            sink.word(op.b);
+            break;
+        case SINT:
+        case UINT:
+            sink.word(op.u);
+            break;
+        case FLOAT:
+        case DOUBLE:
+            {
+                unsigned long long bits;
+                memcpy(&bits, &op.d, sizeof bits);
+                sink.word(bits);
+            }
+            break;
+        case IMAGE:
+            {
+                const image::Image *image = images[op.index];
+                const ImageDesc &desc = imageDescs[op.index];
+                sink.word(image->width);
+                sink.word(image->height);
+                sink.word(image->channels);
+                sink.word(image->channelType);
+                sink.word(image->flipped);
+                sink.word(desc.depth);
+                sink.bytes(desc.format.data(), desc.format.size());
+                sink.bytes(image->label.data(), image->label.size());
+                sink.bytes(image->pixels,
+                           size_t(image->height) * image->width * image->bytesPerPixel);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+struct HashSink {
+    unsigned long long h = fnvOffsetBasis;
+
+    void word(unsigned long long w) { h = hashWord(h, w); }
+    void bytes(const void *data, size_t size) { h = hashBytes(h, data, size); }
+};
+
+unsigned long long
+StateRecorder::hash(size_t begin, size_t end) const
+{
+    HashSink sink;
+    serialize(begin, end, sink);
+    return sink.h;
+}
+
+
+struct AppendSink {
+    std::string &contents;
+
+    void
+    word(unsigned long long w) {
+        contents.append(reinterpret_cast<const char *>(&w), sizeof w);
+    }
+
+    void
+    bytes(const void *data, size_t size) {
+        word(size);
+        contents.append(static_cast<const char *>(data), size);
+    }
+};
+
+void
+StateRecorder::getContents(size_t begin, size_t end, std::string &contents) const
+{
+    AppendSink sink = {contents};
+    serialize(begin, end, sink);
+}
+
+
+struct CompareSink {
+    const std::string &contents;
+    size_t offset;
+    bool equal;
+
+    void
+    word(unsigned long long w) {
+        bytes(&w, sizeof w, false);
+    }
+
+    void
+    bytes(const void *data, size_t size, bool sized = true) {
+        if (sized) {
+            word(size);
+        }
+        if (equal) {
+            equal = contents.size() - offset >= size &&
+                    memcmp(contents.data() + offset, data, size) == 0;
+            offset += size;
+        }
+    }
+};
+
+bool
+StateRecorder::hasContents(size_t begin, size_t end, const std::string &contents) const
+{
+    CompareSink sink = {contents, 0, true};
+    serialize(begin, end, sink);
+    return sink.equal && sink.offset == contents.size();
+}
@@ -0,0 +1,136 @@
+#!/usr/bin/env python
+##########################################################################
+#
+# Copyright 2016 VMware, Inc.
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+'''Reconstruct full JSON state dumps from `glretrace --dump-state-incremental`
+output.'''
+
+
+import json
+import optparse
+import os.path
+import re
+import sys
+
+
+# Members whose own members are dumped incrementally
+nestedSections = ('textures', 'framebuffer', 'buffers')
+
+
+def isReference(value):
+    return isinstance(value, dict) and value.get('__class__') == 'reference'
+
+
+class Reconstructor:
+
+    def __init__(self):
+        # Latest full value of every section, and the call it was dumped at
+        self.sections = {}
+
+    def resolve(self, name, value, callNo):
+        if isReference(value):
+            refCallNo = value['__call__']
+            try:
+                sectionCallNo, value = self.sections[name]
+            except KeyError:
+                raise ValueError('%u: reference to missing %s at call %u' % (callNo, name, refCallNo))
+            if sectionCallNo != refCallNo:
+                raise ValueError('%u: reference to %s at call %u, but last dumped at %u' % (callNo, name, refCallNo, sectionCallNo))
+        else:
+            self.sections[name] = (callNo, value)
+        return value
+
+    def reconstruct(self, state, callNo):
+        for name, value in list(state.items()):
+            if name in nestedSections and value and isinstance(value, dict) and not isReference(value):
+                for childName, childValue in list(value.items()):
+                    value[childName] = self.resolve(name + '/' + childName, childValue, callNo)
+            else:
+                state[name] = self.resolve(name, value, callNo)
+        return state
+
+
+def readStream(stream):
+    '''Read the framed documents written to stdout.'''
+
+    while True:
+        header = stream.readline()
+        if not header:
+            break
+        callNo, size = header.split()
+        data = stream.read(int(size))
+        yield int(callNo), json.loads(data.decode('utf-8'), strict=False)
+
+
+def getCallNo(filename):
+    mo = re.search(r'(\d+)\.json$', os.path.basename(filename))
+    if not mo:
+        raise ValueError('%s: could not determine the call number' % filename)
+    return int(mo.group(1))
+
+
+def readFiles(filenames):
+    '''Read the documents written with --dump-state-prefix.'''
+
+    # Documents must be processed in call order
+    for filename in sorted(filenames, key=getCallNo):
+        yield getCallNo(filename), json.load(open(filename, 'rt'), strict=False)
+
+
+def main():
+    optparser = optparse.OptionParser(
+        usage="\n\t%prog [options] <json> ...\n\t%prog [options] - < stream")
+    optparser.add_option(
+        '-o', '--output-prefix', metavar='PREFIX',
+        type='string', dest='prefix', default=None,
+        help='write each document to PREFIX<CALL_NO>.json instead of to stdout')
+
+    (options, args) = optparser.parse_args(sys.argv[1:])
+
+    if not args:
+        optparser.error('no state dumps specified')
+
+    if args == ['-']:
+        stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+        documents = readStream(stdin)
+    else:
+        documents = readFiles(args)
+
+    reconstructor = Reconstructor()
+    for callNo, state in documents:
+        state = reconstructor.reconstruct(state, callNo)
+        data = json.dumps(state, sort_keys=True, indent=2)
+        if options.prefix is None:
+            sys.stdout.write('%u %u\n' % (callNo, len(data) + 1))
+            sys.stdout.write(data + '\n')
+        else:
+            filename = '%s%010u.json' % (options.prefix, callNo)
+            open(filename, 'wt').write(data + '\n')
+            sys.stderr.write('Wrote %s\n' % filename)
+
+
+if __name__ == '__main__':
+    main()
@@ -208,6 +208,13 @@ class ValueSerializer(stdapi.Visitor, stdapi.ExpanderMixin):
         array_length = self.expand(array.length)
         print '    if (%s) {' % instance
         print '        size_t %s = %s > 0 ? %s : 0;' % (length, array_length, array_length)
+        elemType = self.packedElementType(array.type)
+        if elemType is not None:
+            print '        trace::localWriter.writePackedArray(reinterpret_cast<const %s *>(%s), %s);' % (elemType.expr, instance, length)
+            print '    } else {'
+            print '        trace::localWriter.writeNull();'
+            print '    }'
+            return
         print '        trace::localWriter.beginArray(%s);' % length
         print '        for (size_t %s = 0; %s < %s; ++%s) {' % (index, index, length, index)
         print '            trace::localWriter.beginElement();'
@@ -219,6 +226,18 @@ class ValueSerializer(stdapi.Visitor, stdapi.ExpanderMixin):
         print '        trace::localWriter.writeNull();'
         print '    }'
 
+    def packedElementType(self, type):
+        '''Return the non-const element type if arrays of it can be written
+        packed, i.e., when it is an integer or floating point number.'''
+        while isinstance(type, stdapi.Const):
+            type = type.type
+        elemType = type
+        while isinstance(type, (stdapi.Const, stdapi.Alias)):
+            type = type.type
+        if isinstance(type, stdapi.Literal) and type.kind in ('SInt', 'UInt', 'Float', 'Double'):
+            return elemType
+        return None
+
     def visitAttribArray(self, array, instance):
         # For each element, decide if it is a key or a value (which depends on the previous key).
         # If it is a value, store it as the right type - usually int, some bitfield, or some enum.
@@ -465,8 +484,9 @@ def getInterfaceHierarchy(allIfaces, baseIface):
 class Tracer:
     '''Base class to orchestrate the code generation of API tracing.'''
 
-    # 0-3 are reserved to memcpy, malloc, free, and realloc
-    __id = 4
+    # 0-3 are reserved to memcpy, malloc, free, and realloc, and 4 to
+    # apitrace_stats
+    __id = 5
 
     def __init__(self):
         self.api = None